@@ -290,6 +290,17 @@ contains(FIRST_CLASS_MESSAGING, 1) {
 }
 
 
+#######################################################################
+##  ECDSA Verification
+#######################################################################
+# Signatures are verified on the curve directly unless
+# use: qmake "USE_EVP_ECDSA=1"
+contains(USE_EVP_ECDSA, 1) {
+    message("Building with EVP_PKEY ECDSA verification")
+    DEFINES += USE_EVP_ECDSA=1
+}
+
+
 #######################################################################
 ##  LevelDB
 #######################################################################
@@ -548,13 +559,16 @@ HEADERS += \
     src/threadsafety.h \
     src/txdb-leveldb.h \
     src/exploredb-leveldb.h \
+    src/batch-leveldb.h \
     src/explore/explore.hpp \
+    src/explore/ExploreAddress.hpp \
     src/explore/ExploreConstants.hpp \
     src/explore/ExploreDestination.hpp \
     src/explore/ExploreInput.hpp \
     src/explore/ExploreOutput.hpp \
     src/explore/ExploreInOutLookup.hpp \
     src/explore/ExploreInOutList.hpp \
+    src/explore/ExploreRichList.hpp \
     src/explore/ExploreTx.hpp \
     src/explore/InOutInfo.hpp \
     src/explore/AddrTxInfo.hpp \
@@ -568,6 +582,7 @@ HEADERS += \
     src/bip32/typedefs.h \
     src/ui_interface.h \
     src/uint256.h \
+    src/arith_uint256.h \
     src/util.h \
     src/version.h \
     src/wallet.h \
@@ -682,11 +697,13 @@ SOURCES += \
     src/exploredb-leveldb.cpp \
     src/rpcexplore.cpp \
     src/explore/explore.cpp \
+    src/explore/ExploreAddress.cpp \
     src/explore/ExploreDestination.cpp \
     src/explore/ExploreInput.cpp \
     src/explore/ExploreOutput.cpp \
     src/explore/ExploreInOutLookup.cpp \
     src/explore/ExploreInOutList.cpp \
+    src/explore/ExploreRichList.cpp \
     src/explore/ExploreTx.cpp \
     src/explore/InOutInfo.cpp \
     src/explore/AddrTxInfo.cpp \
@@ -0,0 +1,209 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2014 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ARITH_UINT256_H
+#define BITCOIN_ARITH_UINT256_H
+
+#include "uint256.h"
+
+#include <stdexcept>
+#include <stdint.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// arith_uint256
+//
+
+/** 256-bit unsigned integer with the multiply, divide and compact
+ * ("nBits") conversions that targets and chain trust need. Unlike CBigNum
+ * it lives on the stack and never touches OpenSSL. Arithmetic wraps
+ * modulo 2^256, so callers must keep their values in range.
+ */
+class arith_uint256 : public base_uint256
+{
+public:
+    typedef base_uint256 basetype;
+
+    arith_uint256()
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
+    arith_uint256(const basetype& b)
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = b.pn[i];
+    }
+
+    arith_uint256& operator=(const basetype& b)
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = b.pn[i];
+        return *this;
+    }
+
+    arith_uint256(uint64_t b)
+    {
+        pn[0] = (unsigned int)b;
+        pn[1] = (unsigned int)(b >> 32);
+        for (int i = 2; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
+    arith_uint256& operator=(uint64_t b)
+    {
+        pn[0] = (unsigned int)b;
+        pn[1] = (unsigned int)(b >> 32);
+        for (int i = 2; i < WIDTH; i++)
+            pn[i] = 0;
+        return *this;
+    }
+
+    arith_uint256& operator*=(uint32_t b32)
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            uint64_t n = carry + (uint64_t)b32 * pn[i];
+            pn[i] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+        return *this;
+    }
+
+    arith_uint256& operator*=(const arith_uint256& b)
+    {
+        arith_uint256 a;
+        for (int j = 0; j < WIDTH; j++)
+        {
+            uint64_t carry = 0;
+            for (int i = 0; i + j < WIDTH; i++)
+            {
+                uint64_t n = carry + a.pn[i + j] + (uint64_t)pn[j] * b.pn[i];
+                a.pn[i + j] = n & 0xffffffff;
+                carry = n >> 32;
+            }
+        }
+        *this = a;
+        return *this;
+    }
+
+    arith_uint256& operator/=(const arith_uint256& b)
+    {
+        arith_uint256 div = b;
+        arith_uint256 num = *this;
+        *this = 0;
+
+        const int num_bits = num.bits();
+        const int div_bits = div.bits();
+        if (div_bits == 0)
+            throw std::runtime_error("Division by zero");
+        if (div_bits > num_bits)
+            return *this;
+
+        int shift = num_bits - div_bits;
+        div <<= shift;
+        while (shift >= 0)
+        {
+            if (num >= div)
+            {
+                num -= div;
+                pn[shift / 32] |= (1u << (shift & 31));
+            }
+            div >>= 1;
+            shift--;
+        }
+        return *this;
+    }
+
+    /** Position of the highest bit set plus one, or zero for zero */
+    int bits() const
+    {
+        for (int pos = WIDTH - 1; pos >= 0; pos--)
+        {
+            if (pn[pos])
+            {
+                for (int nbits = 31; nbits > 0; nbits--)
+                    if (pn[pos] & (1u << nbits))
+                        return 32 * pos + nbits + 1;
+                return 32 * pos + 1;
+            }
+        }
+        return 0;
+    }
+
+    /** Decode the compact "nBits" form. The sign bit and values that do not
+     * fit in 256 bits are reported through the flags instead of being
+     * represented, which is where this differs from CBigNum::SetCompact.
+     */
+    arith_uint256& SetCompact(uint32_t nCompact, bool* pfNegative = NULL, bool* pfOverflow = NULL)
+    {
+        int nSize = nCompact >> 24;
+        uint32_t nWord = nCompact & 0x007fffff;
+        if (nSize <= 3)
+        {
+            nWord >>= 8 * (3 - nSize);
+            *this = nWord;
+        }
+        else
+        {
+            *this = nWord;
+            *this <<= 8 * (nSize - 3);
+        }
+        if (pfNegative)
+            *pfNegative = nWord != 0 && (nCompact & 0x00800000) != 0;
+        if (pfOverflow)
+            *pfOverflow = nWord != 0 && ((nSize > 34) ||
+                                         (nWord > 0xff && nSize > 33) ||
+                                         (nWord > 0xffff && nSize > 32));
+        return *this;
+    }
+
+    uint32_t GetCompact(bool fNegative = false) const
+    {
+        int nSize = (bits() + 7) / 8;
+        uint32_t nCompact = 0;
+        if (nSize <= 3)
+            nCompact = Get64() << 8 * (3 - nSize);
+        else
+        {
+            arith_uint256 bn = *this;
+            bn >>= 8 * (nSize - 3);
+            nCompact = bn.Get64();
+        }
+        // The 0x00800000 bit denotes the sign, so if it is already set,
+        // divide the mantissa by 256 and increase the exponent.
+        if (nCompact & 0x00800000)
+        {
+            nCompact >>= 8;
+            nSize++;
+        }
+        nCompact |= nSize << 24;
+        nCompact |= (fNegative && (nCompact & 0x007fffff) ? 0x00800000 : 0);
+        return nCompact;
+    }
+};
+
+inline const arith_uint256 operator<<(const arith_uint256& a, unsigned int shift)       { return arith_uint256(a) <<= shift; }
+inline const arith_uint256 operator>>(const arith_uint256& a, unsigned int shift)       { return arith_uint256(a) >>= shift; }
+inline const arith_uint256 operator+(const arith_uint256& a, const arith_uint256& b)    { return arith_uint256(a) += b; }
+inline const arith_uint256 operator-(const arith_uint256& a, const arith_uint256& b)    { return arith_uint256(a) -= b; }
+inline const arith_uint256 operator*(const arith_uint256& a, const arith_uint256& b)    { return arith_uint256(a) *= b; }
+inline const arith_uint256 operator*(const arith_uint256& a, uint32_t b)                { return arith_uint256(a) *= b; }
+inline const arith_uint256 operator/(const arith_uint256& a, const arith_uint256& b)    { return arith_uint256(a) /= b; }
+inline const arith_uint256 operator~(const arith_uint256& a)                            { return ~(const base_uint256&)a; }
+
+inline uint256 ArithToUint256(const arith_uint256& a)
+{
+    return uint256(a);
+}
+
+inline arith_uint256 UintToArith256(const uint256& a)
+{
+    return arith_uint256(a);
+}
+
+#endif
@@ -0,0 +1,125 @@
+// Copyright (c) 2009-2012 The Bitcoin Developers.
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BATCH_LEVELDB_H
+#define BITCOIN_BATCH_LEVELDB_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+// The writes and deletes of an open database transaction (CTxDB,
+// CExploreDB and SecMsgDB all keep one as activeBatch).
+//
+// Reads inside a transaction must see its pending changes. A
+// leveldb::WriteBatch can only be searched by walking all of it, which
+// made a transaction with k reads after k writes O(k^2). The pending
+// changes are kept in a hash map instead, holding the last put or delete
+// for each key, and the WriteBatch is only built from it on commit. As
+// only the last change to a key survives, the result is the same as
+// replaying every change in order.
+//
+// The WriteBatch is built in key order, so a large commit (such as the
+// explore index checkpoints of a bulk reindex) goes into the memtable as
+// one ascending run instead of hash order.
+class CLevelDBBatch
+{
+private:
+    struct CPending
+    {
+        bool fDeleted;
+        std::string strValue;
+    };
+
+    std::unordered_map<std::string, CPending> mapPending;
+
+public:
+    void Put(const std::string& strKey, const std::string& strValue)
+    {
+        CPending& pending = mapPending[strKey];
+        pending.fDeleted = false;
+        pending.strValue = strValue;
+    }
+
+    void Delete(const std::string& strKey)
+    {
+        CPending& pending = mapPending[strKey];
+        pending.fDeleted = true;
+        pending.strValue.clear();
+    }
+
+    // Returns true if the batch has a change for the key: then either
+    // sets (value, false) for a put or just deleted = true for a delete.
+    bool Get(const std::string& strKey, std::string* pstrValue, bool* pfDeleted) const
+    {
+        std::unordered_map<std::string, CPending>::const_iterator mi = mapPending.find(strKey);
+        if (mi == mapPending.end())
+        {
+            return false;
+        }
+        *pfDeleted = mi->second.fDeleted;
+        if (!mi->second.fDeleted)
+        {
+            *pstrValue = mi->second.strValue;
+        }
+        return true;
+    }
+
+    // Takes over the changes of batchOther (which is left empty); its
+    // changes win over those of this batch for keys in both.
+    void Absorb(CLevelDBBatch& batchOther)
+    {
+        std::unordered_map<std::string, CPending>::iterator mi;
+        for (mi = batchOther.mapPending.begin(); mi != batchOther.mapPending.end(); ++mi)
+        {
+            CPending& pending = mapPending[mi->first];
+            pending.fDeleted = mi->second.fDeleted;
+            pending.strValue.swap(mi->second.strValue);
+        }
+        batchOther.Clear();
+    }
+
+    size_t size() const
+    {
+        return mapPending.size();
+    }
+
+    void Clear()
+    {
+        mapPending.clear();
+    }
+
+    leveldb::Status Write(leveldb::DB* pdb, const leveldb::WriteOptions& options) const
+    {
+        typedef std::unordered_map<std::string, CPending>::const_iterator pending_it;
+        std::vector<pending_it> vSorted;
+        vSorted.reserve(mapPending.size());
+        for (pending_it mi = mapPending.begin(); mi != mapPending.end(); ++mi)
+        {
+            vSorted.push_back(mi);
+        }
+        std::sort(vSorted.begin(), vSorted.end(),
+                  [](const pending_it& a, const pending_it& b) { return a->first < b->first; });
+
+        leveldb::WriteBatch batch;
+        for (std::vector<pending_it>::const_iterator it = vSorted.begin(); it != vSorted.end(); ++it)
+        {
+            if ((*it)->second.fDeleted)
+            {
+                batch.Delete((*it)->first);
+            }
+            else
+            {
+                batch.Put((*it)->first, (*it)->second.strValue);
+            }
+        }
+        return pdb->Write(options, &batch);
+    }
+};
+
+#endif // BITCOIN_BATCH_LEVELDB_H
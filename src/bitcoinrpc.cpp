@@ -352,6 +352,8 @@ static const CRPCCommand vRPCCommands[] =
     { "getconnectioncount",        &getconnectioncount,        true,   false },
     { "getpeerinfo",               &getpeerinfo,               true,   false },
     { "getdifficulty",             &getdifficulty,             true,   false },
+    { "getsigcacheinfo",           &getsigcacheinfo,           true,   false },
+    { "testverify",                &testverify,                true,   false },
     { "getinfo",                   &getinfo,                   true,   false },
     { "getsubsidy",                &getsubsidy,                true,   false },
     { "getmininginfo",             &getmininginfo,             true,   false },
@@ -430,6 +432,7 @@ static const CRPCCommand vRPCCommands[] =
     { "createrawtransaction",      &createrawtransaction,      false,  false },
     { "decoderawtransaction",      &decoderawtransaction,      false,  false },
     { "decodescript",              &decodescript,              false,  false },
+    { "testscripttemplate",        &testscripttemplate,        false,  false },
     { "signrawtransaction",        &signrawtransaction,        false,  false },
     { "sendrawtransaction",        &sendrawtransaction,        false,  false },
     { "getcheckpoint",             &getcheckpoint,             true,   false },
@@ -1454,6 +1457,8 @@ Array RPCConvertValues(const string &strMethod, const vector<string> &strParams)
     if (strMethod == "createrawtransaction"         && n > 1) ConvertTo<Object>(params[1]);
     if (strMethod == "signrawtransaction"           && n > 1) ConvertTo<Array>(params[1], true);
     if (strMethod == "signrawtransaction"           && n > 2) ConvertTo<Array>(params[2], true);
+    if (strMethod == "testscripttemplate"           && n > 0) ConvertTo<boost::int64_t>(params[0]);
+    if (strMethod == "testverify"                   && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "keypoolrefill"                && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "sendtostealthaddress"         && n > 1) ConvertTo<double>(params[1]);
     if (strMethod == "encodebase58"                 && n > 1) ConvertTo<bool>(params[1]);
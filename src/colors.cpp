@@ -76,12 +76,12 @@ unsigned char pchMessageStartTestnet[4] = { 0xcb, 0xad, 0xef, 0xfd };
 ///
 //////////////////////////////////////////////////////////////////////
 // proof limits
-CBigNum bnProofOfWorkLimit(~uint256(0) >> 26);
-CBigNum bnProofOfWorkLimitKawpow(~uint256(0) >> 12);
-CBigNum bnProofOfStakeLimit(~uint256(0) >> 14);
-CBigNum bnProofOfWorkLimitTestNet(~uint256(0) >> 24);
-CBigNum bnProofOfWorkLimitKawpowTestNet(~uint256(0) >> 8);
-CBigNum bnProofOfStakeLimitTestNet(~uint256(0) >> 8);
+arith_uint256 bnProofOfWorkLimit(~uint256(0) >> 26);
+arith_uint256 bnProofOfWorkLimitKawpow(~uint256(0) >> 12);
+arith_uint256 bnProofOfStakeLimit(~uint256(0) >> 14);
+arith_uint256 bnProofOfWorkLimitTestNet(~uint256(0) >> 24);
+arith_uint256 bnProofOfWorkLimitKawpowTestNet(~uint256(0) >> 8);
+arith_uint256 bnProofOfStakeLimitTestNet(~uint256(0) >> 8);
 
 // target spacings
 // bgw can have independent block spacings for PoS and PoW
@@ -1212,27 +1212,22 @@ struct CardSorter cardSorter;
 ///
 //////////////////////////////////////////////////////////////////////
 
-CBigNum GetTargetLimit(bool fProofOfStake, unsigned int nTime)
+const arith_uint256& GetArithTargetLimit(bool fProofOfStake, unsigned int nTime)
 {
-    CBigNum bnTargetLimit;
     if (fProofOfStake)
     {
-        bnTargetLimit = fTestNet ? bnProofOfStakeLimitTestNet : bnProofOfStakeLimit;
+        return fTestNet ? bnProofOfStakeLimitTestNet : bnProofOfStakeLimit;
     }
-    else
+    if (GetFork(nTime) < BRK_FORK007)
     {
-        if (GetFork(nTime) < BRK_FORK007)
-        {
-            bnTargetLimit = fTestNet ? bnProofOfWorkLimitTestNet
-                                     : bnProofOfWorkLimit;
-        }
-        else
-        {
-            bnTargetLimit = fTestNet ? bnProofOfWorkLimitKawpowTestNet
-                                     : bnProofOfWorkLimitKawpow;
-        }
+        return fTestNet ? bnProofOfWorkLimitTestNet : bnProofOfWorkLimit;
     }
-    return bnTargetLimit;
+    return fTestNet ? bnProofOfWorkLimitKawpowTestNet : bnProofOfWorkLimitKawpow;
+}
+
+CBigNum GetTargetLimit(bool fProofOfStake, unsigned int nTime)
+{
+    return CBigNum(ArithToUint256(GetArithTargetLimit(fProofOfStake, nTime)));
 }
 
 int64_t GetTargetSpacing(bool fProofOfStake, int64_t nTime)
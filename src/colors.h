@@ -12,8 +12,11 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include "arith_uint256.h"
 #include "bignum.h"
 
+#include <boost/shared_ptr.hpp>
+
 // breakout genesis block time
 #define BRK_GENESIS_TIME 1465544351
 
@@ -309,6 +312,7 @@ bool AppendColorBytes(int n, valtype &vch);
 
 
 // minting
+const arith_uint256& GetArithTargetLimit(bool fProofOfStake, unsigned int nTime);
 CBigNum GetTargetLimit(bool fProofOfStake, unsigned int nTime);
 int64_t GetTargetSpacing(bool fProofOfStake, int64_t nTime);
 int GetCoinbaseMaturity();
@@ -618,4 +622,201 @@ public:
 };
 
 
+// Compact array of N_COLORS amounts, used for the per-block supply
+// tallies in CBlockIndex. Consecutive blocks differ in only a few colors,
+// so the values are an immutable base array, shared between copies, plus
+// a short sorted list of colors that differ from it. A NULL base is all
+// zeros. Serializes exactly like std::vector<int64_t> of size N_COLORS.
+class ColorsArray
+{
+public:
+    // more than this many differences and a fresh base is made
+    static const unsigned int MAX_OVERRIDES = 8;
+
+private:
+    typedef std::vector<int64_t> BaseArray;
+    typedef std::pair<int, int64_t> Override;
+    typedef std::vector<Override> Overrides;
+
+    boost::shared_ptr<const BaseArray> pbase;
+    Overrides vOverride;
+
+    int64_t GetBase(int nColor) const
+    {
+        return pbase ? (*pbase)[nColor] : 0;
+    }
+
+    Overrides::iterator FindOverride(int nColor)
+    {
+        Overrides::iterator it = vOverride.begin();
+        while (it != vOverride.end() && it->first < nColor)
+        {
+            ++it;
+        }
+        return it;
+    }
+
+    // Express v as differences from base, if it takes few enough
+    bool TryBase(const boost::shared_ptr<const BaseArray>& pbaseIn,
+                 const std::vector<int64_t>& v)
+    {
+        Overrides vNew;
+        for (int nColor = 0; nColor < N_COLORS; ++nColor)
+        {
+            int64_t nBase = pbaseIn ? (*pbaseIn)[nColor] : 0;
+            if (v[nColor] != nBase)
+            {
+                if (vNew.size() == MAX_OVERRIDES)
+                {
+                    return false;
+                }
+                vNew.push_back(std::make_pair(nColor, v[nColor]));
+            }
+        }
+        pbase = pbaseIn;
+        vOverride.swap(vNew);
+        return true;
+    }
+
+public:
+    ColorsArray() {}
+
+    int64_t Get(int nColor) const
+    {
+        assert(nColor >= 0 && nColor < N_COLORS);
+        for (Overrides::const_iterator it = vOverride.begin(); it != vOverride.end(); ++it)
+        {
+            if (it->first == nColor)
+            {
+                return it->second;
+            }
+            if (it->first > nColor)
+            {
+                break;
+            }
+        }
+        return GetBase(nColor);
+    }
+
+    int64_t operator[](int nColor) const
+    {
+        return Get(nColor);
+    }
+
+    void Set(int nColor, int64_t nValue)
+    {
+        assert(nColor >= 0 && nColor < N_COLORS);
+        Overrides::iterator it = FindOverride(nColor);
+        bool fFound = (it != vOverride.end() && it->first == nColor);
+        if (nValue == GetBase(nColor))
+        {
+            if (fFound)
+            {
+                vOverride.erase(it);
+            }
+            return;
+        }
+        if (fFound)
+        {
+            it->second = nValue;
+            return;
+        }
+        if (vOverride.size() < MAX_OVERRIDES)
+        {
+            vOverride.insert(it, std::make_pair(nColor, nValue));
+            return;
+        }
+        std::vector<int64_t> v;
+        GetAll(v);
+        v[nColor] = nValue;
+        pbase.reset(new BaseArray(v));
+        vOverride.clear();
+    }
+
+    void Add(int nColor, int64_t nValue)
+    {
+        Set(nColor, Get(nColor) + nValue);
+    }
+
+    void GetAll(std::vector<int64_t>& v) const
+    {
+        if (pbase)
+        {
+            v = *pbase;
+        }
+        else
+        {
+            v.assign(N_COLORS, 0);
+        }
+        for (Overrides::const_iterator it = vOverride.begin(); it != vOverride.end(); ++it)
+        {
+            v[it->first] = it->second;
+        }
+    }
+
+    // Replace all values; shares the base of pref (e.g. the previous
+    // block's array) when v is close enough to it.
+    void SetAll(const std::vector<int64_t>& v, const ColorsArray* pref = NULL)
+    {
+        assert(v.size() == N_COLORS);
+        if (pref && pref->pbase && TryBase(pref->pbase, v))
+        {
+            return;
+        }
+        if (TryBase(boost::shared_ptr<const BaseArray>(), v))
+        {
+            return;
+        }
+        pbase.reset(new BaseArray(v));
+        vOverride.clear();
+    }
+
+    // Re-express the current values relative to pref's base
+    void Rebase(const ColorsArray& ref)
+    {
+        if (pbase == ref.pbase)
+        {
+            return;
+        }
+        std::vector<int64_t> v;
+        GetAll(v);
+        SetAll(v, &ref);
+    }
+
+    // Heap bytes owned by this array alone (shared bases not counted)
+    size_t DynamicUsage() const
+    {
+        size_t nUsage = vOverride.capacity() * sizeof(Override);
+        if (pbase && pbase.unique())
+        {
+            nUsage += sizeof(BaseArray) + N_COLORS * sizeof(int64_t);
+        }
+        return nUsage;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(N_COLORS) + N_COLORS * sizeof(int64_t);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        std::vector<int64_t> v;
+        GetAll(v);
+        ::Serialize(s, v, nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        std::vector<int64_t> v;
+        ::Unserialize(s, v, nType, nVersion);
+        // tolerate records written with a different number of colors
+        v.resize(N_COLORS, 0);
+        SetAll(v);
+    }
+};
+
+
 #endif  // BREAKOUT_COLORS_H
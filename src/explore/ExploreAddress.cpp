@@ -0,0 +1,60 @@
+// Copyright (c) 2026 The Breakout Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ExploreAddress.hpp"
+
+#include "base58.h"
+
+using namespace std;
+
+
+bool ExploreAddress::Set(const CTxDestination& dest)
+{
+    SetNull();
+    const uint160* pid;
+    if (const CKeyID* pkeyID = boost::get<CKeyID>(&dest))
+    {
+        vch[0] = fTestNet ? PUBKEY_ADDRESS_TEST : PUBKEY_ADDRESS;
+        pid = pkeyID;
+    }
+    else if (const CScriptID* pscriptID = boost::get<CScriptID>(&dest))
+    {
+        vch[0] = fTestNet ? SCRIPT_ADDRESS_TEST : SCRIPT_ADDRESS;
+        pid = pscriptID;
+    }
+    else
+    {
+        return false;
+    }
+    memcpy(&vch[1], pid->cbegin(), 20);
+    return true;
+}
+
+bool ExploreAddress::SetString(const string& strAddress, int& nColorRet)
+{
+    CBitcoinAddress address(strAddress);
+    if (!address.IsValid())
+    {
+        SetNull();
+        return false;
+    }
+    nColorRet = address.nColor;
+    return Set(address.Get());
+}
+
+string ExploreAddress::ToString(int nColor) const
+{
+    uint160 id;
+    memcpy(id.begin(), &vch[1], 20);
+    switch (vch[0])
+    {
+    case PUBKEY_ADDRESS:
+    case PUBKEY_ADDRESS_TEST:
+        return CBitcoinAddress(CKeyID(id, nColor), nColor).ToString();
+    case SCRIPT_ADDRESS:
+    case SCRIPT_ADDRESS_TEST:
+        return CBitcoinAddress(CScriptID(id), nColor).ToString();
+    }
+    return string();
+}
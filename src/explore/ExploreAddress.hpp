@@ -0,0 +1,74 @@
+// Copyright (c) 2026 The Breakout Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _EXPLOREADDRESS_H_
+#define _EXPLOREADDRESS_H_ 1
+
+#include <cstring>
+#include <string>
+
+#include "serialize.h"
+#include "script.h"
+
+
+// An address as the explore index stores it: the address version byte and
+// the hash160, i.e. a base58 address before encoding. The color is kept
+// beside it (in the key or record), so base58 is only needed to show an
+// address or to parse one given to an RPC.
+class ExploreAddress
+{
+public:
+    static const unsigned int SIZE = 21;
+
+    unsigned char vch[SIZE];
+
+    ExploreAddress()
+    {
+        SetNull();
+    }
+
+    explicit ExploreAddress(const CTxDestination& dest)
+    {
+        Set(dest);
+    }
+
+    void SetNull()
+    {
+        memset(vch, 0, SIZE);
+    }
+
+    bool IsNull() const
+    {
+        return vch[0] == 0;
+    }
+
+    // Returns false (leaving the address null) for anything but a key or
+    // script id.
+    bool Set(const CTxDestination& dest);
+
+    // Parses a base58 address; sets its color too.
+    bool SetString(const std::string& strAddress, int& nColorRet);
+
+    std::string ToString(int nColor) const;
+
+    friend bool operator==(const ExploreAddress& a, const ExploreAddress& b)
+    {
+        return memcmp(a.vch, b.vch, SIZE) == 0;
+    }
+    friend bool operator!=(const ExploreAddress& a, const ExploreAddress& b)
+    {
+        return !(a == b);
+    }
+    friend bool operator<(const ExploreAddress& a, const ExploreAddress& b)
+    {
+        return memcmp(a.vch, b.vch, SIZE) < 0;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(FLATDATA(vch));
+    )
+};
+
+#endif  /* _EXPLOREADDRESS_H_ */
@@ -6,13 +6,8 @@
 #define _EXPLORECONSTANTS_H_ 1
 
 #include <string>
-#include <map>
 
-typedef std::pair<std::string, std::string> exploreKey_t;
-
-// sorted in descending order
-typedef std::map<int64_t, unsigned int,
-                 std::greater<int64_t> > MapBalanceCounts;
+typedef unsigned char exploreKey_t;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -27,69 +22,45 @@ const int MASK_ADDR_TX = ~FLAG_ADDR_TX;
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// leveldb record strings for the explore API
+// leveldb record types for the explore API
 //
-
-const std::string EXPLORE_KEY = "EXPK";
+// Every explore key starts with one of these bytes (see CExploreKey). They
+// are stored on disk, so never renumber them. The schema keys ("version",
+// "exploreBestBlock") are serialized strings and start with their length
+// (7 and 16), which the types stay clear of.
 
 // Explore Sentinel lexigraphical first key for iterating
-const std::string EXPLORE_SENTINEL_LABEL = "";
-const exploreKey_t EXPLORE_SENTINEL(EXPLORE_KEY, EXPLORE_SENTINEL_LABEL);
+const exploreKey_t EXPLORE_SENTINEL = 0x40;
 
 // Addr Qty
-const std::string ADDR_QTY_INPUT_LABEL = "AQI";
-const exploreKey_t ADDR_QTY_INPUT(EXPLORE_KEY, ADDR_QTY_INPUT_LABEL);
-
-const std::string ADDR_QTY_OUTPUT_LABEL = "AQO";
-const exploreKey_t ADDR_QTY_OUTPUT(EXPLORE_KEY, ADDR_QTY_OUTPUT_LABEL);
-
-const std::string ADDR_QTY_INOUT_LABEL = "AQIO";
-const exploreKey_t ADDR_QTY_INOUT(EXPLORE_KEY, ADDR_QTY_INOUT_LABEL);
-
-const std::string ADDR_QTY_UNSPENT_LABEL = "AQU";
-const exploreKey_t ADDR_QTY_UNSPENT(EXPLORE_KEY, ADDR_QTY_UNSPENT_LABEL);
-
-const std::string ADDR_QTY_VIO_LABEL = "AQV";
-const exploreKey_t ADDR_QTY_VIO(EXPLORE_KEY, ADDR_QTY_VIO_LABEL);
+const exploreKey_t ADDR_QTY_INPUT = 0x41;
+const exploreKey_t ADDR_QTY_OUTPUT = 0x42;
+const exploreKey_t ADDR_QTY_INOUT = 0x43;
+const exploreKey_t ADDR_QTY_UNSPENT = 0x44;
+const exploreKey_t ADDR_QTY_VIO = 0x45;
 
 // Addr Tx
-const std::string ADDR_TX_INPUT_LABEL = "ATI";
-const exploreKey_t ADDR_TX_INPUT(EXPLORE_KEY, ADDR_TX_INPUT_LABEL);
-
-const std::string ADDR_TX_OUTPUT_LABEL = "ATO";
-const exploreKey_t ADDR_TX_OUTPUT(EXPLORE_KEY, ADDR_TX_OUTPUT_LABEL);
-
-const std::string ADDR_TX_INOUT_LABEL = "ATIO";
-const exploreKey_t ADDR_TX_INOUT(EXPLORE_KEY, ADDR_TX_INOUT_LABEL);
+const exploreKey_t ADDR_TX_INPUT = 0x46;
+const exploreKey_t ADDR_TX_OUTPUT = 0x47;
+const exploreKey_t ADDR_TX_INOUT = 0x48;
 
 // Addr Lookup
-const std::string ADDR_LOOKUP_OUTPUT_LABEL = "ALO";
-const exploreKey_t ADDR_LOOKUP_OUTPUT(EXPLORE_KEY, ADDR_LOOKUP_OUTPUT_LABEL);
+const exploreKey_t ADDR_LOOKUP_OUTPUT = 0x49;
 
 // Addr List
-const std::string ADDR_LIST_VIO_LABEL = "ALV";
-const exploreKey_t ADDR_LIST_VIO(EXPLORE_KEY, ADDR_LIST_VIO_LABEL);
-
-const std::string ADDR_LIST_TXDESC_LABEL = "ALT";
-const exploreKey_t ADDR_LIST_TXDESC(EXPLORE_KEY, ADDR_LIST_TXDESC_LABEL);
+const exploreKey_t ADDR_LIST_VIO = 0x4a;
+const exploreKey_t ADDR_LIST_TXDESC = 0x4b;
 
 // Addr Value
-const std::string ADDR_BALANCE_LABEL = "AB";
-const exploreKey_t ADDR_BALANCE(EXPLORE_KEY, ADDR_BALANCE_LABEL);
-
-const std::string ADDR_VALUEIN_LABEL = "AVI";
-const exploreKey_t ADDR_VALUEIN(EXPLORE_KEY, ADDR_VALUEIN_LABEL);
-
-const std::string ADDR_VALUEOUT_LABEL = "AVO";
-const exploreKey_t ADDR_VALUEOUT(EXPLORE_KEY, ADDR_VALUEOUT_LABEL);
+const exploreKey_t ADDR_BALANCE = 0x4c;
+const exploreKey_t ADDR_VALUEIN = 0x4d;
+const exploreKey_t ADDR_VALUEOUT = 0x4e;
 
 // Addr Set
-const std::string ADDR_SET_BAL_LABEL = "ASB";
-const exploreKey_t ADDR_SET_BAL(EXPLORE_KEY, ADDR_SET_BAL_LABEL);
+const exploreKey_t ADDR_SET_BAL = 0x4f;
 
 // Tx Info
-const std::string EXPLORE_TX_LABEL = "ETX";
-const exploreKey_t EXPLORE_TX(EXPLORE_KEY, EXPLORE_TX_LABEL);
+const exploreKey_t EXPLORE_TX = 0x50;
 
 
 #endif  // _EXPLORECONSTANTS_H_
@@ -25,7 +25,7 @@ ExploreDestination::ExploreDestination()
     SetNull();
 }
 
-ExploreDestination::ExploreDestination(const vector<string>& addressesIn,
+ExploreDestination::ExploreDestination(const vector<ExploreAddress>& addressesIn,
                                        const int requiredIn,
                                        const int colorIn,
                                        const int64_t& amountIn,
@@ -43,12 +43,19 @@ bool ExploreDestination::HasAddress(const string& sAddr) const
 {
     // linear search should be fast enough because of expected
     //    small size of addresses
-    return find(addresses.begin(), addresses.end(), sAddr) != addresses.end();
+    BOOST_FOREACH(const ExploreAddress& a, addresses)
+    {
+        if (a.ToString(color) == sAddr)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 bool ExploreDestination::IsSameAs(const string& sAddr) const
 {
-    return (addresses.size() == 1) && (addresses[0] == sAddr);
+    return (addresses.size() == 1) && (addresses[0].ToString(color) == sAddr);
 }
     
 void ExploreDestination::AsJSON(Object& objRet) const
@@ -57,9 +64,9 @@ void ExploreDestination::AsJSON(Object& objRet) const
     if (!addresses.empty())
     {
         Array aryAddr;
-        BOOST_FOREACH(const string& a, addresses)
+        BOOST_FOREACH(const ExploreAddress& a, addresses)
         {
-            aryAddr.push_back(a);
+            aryAddr.push_back(a.ToString(color));
         }
         objRet.push_back(Pair("addresses", aryAddr));
         objRet.push_back(Pair("reqSigs", (int64_t)required));
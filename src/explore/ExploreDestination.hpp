@@ -6,6 +6,7 @@
 #define _EXPLOREDESTINATION_H_ 1
 
 #include "serialize.h"
+#include "ExploreAddress.hpp"
 
 #include "json/json_spirit_utils.h"
 
@@ -13,7 +14,7 @@
 class ExploreDestination
 {
 public:
-    std::vector<std::string> addresses;
+    std::vector<ExploreAddress> addresses;
     int required;
     int color;
     int64_t amount;
@@ -23,7 +24,7 @@ public:
 
     ExploreDestination();
 
-    ExploreDestination(const std::vector<std::string>& addressesIn,
+    ExploreDestination(const std::vector<ExploreAddress>& addressesIn,
                        const int requiredIn,
                        const int colorIn,
                        const int64_t& amountIn,
@@ -0,0 +1,279 @@
+// Copyright (c) 2026 The Breakout Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ExploreRichList.hpp"
+
+#include "util.h"
+
+using namespace std;
+
+
+// Splits p into the entries before entry and those from entry on.
+void ExploreRichList::Split(Node* p, const Entry& entry,
+                            Node*& pLeftRet, Node*& pRightRet)
+{
+    if (p == NULL)
+    {
+        pLeftRet = NULL;
+        pRightRet = NULL;
+    }
+    else if (p->entry < entry)
+    {
+        Split(p->right, entry, p->right, pRightRet);
+        Update(p);
+        pLeftRet = p;
+    }
+    else
+    {
+        Split(p->left, entry, pLeftRet, p->left);
+        Update(p);
+        pRightRet = p;
+    }
+}
+
+// Joins two trees where every entry of pLeft comes before those of pRight.
+ExploreRichList::Node* ExploreRichList::Merge(Node* pLeft, Node* pRight)
+{
+    if (pLeft == NULL)
+    {
+        return pRight;
+    }
+    if (pRight == NULL)
+    {
+        return pLeft;
+    }
+    if (pLeft->priority > pRight->priority)
+    {
+        pLeft->right = Merge(pLeft->right, pRight);
+        Update(pLeft);
+        return pLeft;
+    }
+    pRight->left = Merge(pLeft, pRight->left);
+    Update(pRight);
+    return pRight;
+}
+
+bool ExploreRichList::EraseFrom(Node*& p, const Entry& entry)
+{
+    if (p == NULL)
+    {
+        return false;
+    }
+    bool fErased;
+    if (entry < p->entry)
+    {
+        fErased = EraseFrom(p->left, entry);
+    }
+    else if (p->entry < entry)
+    {
+        fErased = EraseFrom(p->right, entry);
+    }
+    else
+    {
+        Node* pOld = p;
+        p = Merge(p->left, p->right);
+        delete pOld;
+        return true;
+    }
+    if (fErased)
+    {
+        Update(p);
+    }
+    return fErased;
+}
+
+unsigned int ExploreRichList::Resize(Node* p)
+{
+    if (p == NULL)
+    {
+        return 0;
+    }
+    p->size = 1 + Resize(p->left) + Resize(p->right);
+    return p->size;
+}
+
+void ExploreRichList::Destroy(Node* p)
+{
+    if (p != NULL)
+    {
+        Destroy(p->left);
+        Destroy(p->right);
+        delete p;
+    }
+}
+
+// In-order walk that skips whole subtrees lying before the start.
+void ExploreRichList::Collect(const Node* p, unsigned int& nSkip, unsigned int& nMax,
+                              vector<Entry>& vRet)
+{
+    if ((p == NULL) || (nMax == 0))
+    {
+        return;
+    }
+    unsigned int nLeft = Size(p->left);
+    if (nSkip >= nLeft)
+    {
+        nSkip -= nLeft;
+    }
+    else
+    {
+        Collect(p->left, nSkip, nMax, vRet);
+    }
+    if (nMax == 0)
+    {
+        return;
+    }
+    if (nSkip > 0)
+    {
+        nSkip -= 1;
+    }
+    else
+    {
+        vRet.push_back(p->entry);
+        nMax -= 1;
+    }
+    Collect(p->right, nSkip, nMax, vRet);
+}
+
+ExploreRichList::~ExploreRichList()
+{
+    Destroy(root);
+}
+
+void ExploreRichList::clear()
+{
+    Destroy(root);
+    root = NULL;
+}
+
+bool ExploreRichList::Contains(int64_t nBalance, const ExploreAddress& addr) const
+{
+    const Entry entry(nBalance, addr);
+    const Node* p = root;
+    while (p != NULL)
+    {
+        if (entry < p->entry)
+        {
+            p = p->left;
+        }
+        else if (p->entry < entry)
+        {
+            p = p->right;
+        }
+        else
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ExploreRichList::Insert(int64_t nBalance, const ExploreAddress& addr)
+{
+    if (Contains(nBalance, addr))
+    {
+        return false;
+    }
+    Node* pNew = new Node;
+    pNew->entry = Entry(nBalance, addr);
+    pNew->priority = insecure_rand();
+    pNew->size = 1;
+    pNew->left = NULL;
+    pNew->right = NULL;
+    Node* pLeft;
+    Node* pRight;
+    Split(root, pNew->entry, pLeft, pRight);
+    root = Merge(Merge(pLeft, pNew), pRight);
+    return true;
+}
+
+bool ExploreRichList::Erase(int64_t nBalance, const ExploreAddress& addr)
+{
+    return EraseFrom(root, Entry(nBalance, addr));
+}
+
+// Builds the treap of sorted entries in one pass: each new node goes on the
+// right spine, below the last node there with a higher priority, and takes
+// the nodes it passes as its left subtree.
+bool ExploreRichList::Assign(const vector<Entry>& vEntries)
+{
+    clear();
+    vector<Node*> vSpine;
+    for (unsigned int i = 0; i < vEntries.size(); ++i)
+    {
+        if ((i > 0) && !(vEntries[i - 1] < vEntries[i]))
+        {
+            root = vSpine.empty() ? NULL : vSpine.front();
+            clear();
+            return false;
+        }
+        Node* pNew = new Node;
+        pNew->entry = vEntries[i];
+        pNew->priority = insecure_rand();
+        pNew->size = 1;
+        pNew->left = NULL;
+        pNew->right = NULL;
+        while (!vSpine.empty() && (vSpine.back()->priority < pNew->priority))
+        {
+            pNew->left = vSpine.back();
+            vSpine.pop_back();
+        }
+        if (!vSpine.empty())
+        {
+            vSpine.back()->right = pNew;
+        }
+        vSpine.push_back(pNew);
+    }
+    if (!vSpine.empty())
+    {
+        root = vSpine.front();
+        Resize(root);
+    }
+    return true;
+}
+
+unsigned int ExploreRichList::CountAbove(int64_t nBalance) const
+{
+    unsigned int nCount = 0;
+    const Node* p = root;
+    while (p != NULL)
+    {
+        if (p->entry.balance > nBalance)
+        {
+            nCount += Size(p->left) + 1;
+            p = p->right;
+        }
+        else
+        {
+            p = p->left;
+        }
+    }
+    return nCount;
+}
+
+unsigned int ExploreRichList::CountAtLeast(int64_t nBalance) const
+{
+    unsigned int nCount = 0;
+    const Node* p = root;
+    while (p != NULL)
+    {
+        if (p->entry.balance >= nBalance)
+        {
+            nCount += Size(p->left) + 1;
+            p = p->right;
+        }
+        else
+        {
+            p = p->left;
+        }
+    }
+    return nCount;
+}
+
+void ExploreRichList::GetRange(unsigned int nStart, unsigned int nMax,
+                               vector<Entry>& vRet) const
+{
+    vRet.clear();
+    Collect(root, nStart, nMax, vRet);
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2026 The Breakout Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _EXPLORERICHLIST_H_
+#define _EXPLORERICHLIST_H_ 1
+
+#include <map>
+#include <vector>
+
+#include "ExploreAddress.hpp"
+
+
+// The rich list of one color: every address with a non-dust balance, richest
+// first and tied balances in address order.
+//
+// It is a treap (a binary search tree balanced by random node priorities)
+// whose nodes also count their subtree, so the number of addresses above a
+// balance and the address at a given position are both found in O(log n),
+// and a page of m addresses in O(log n + m), however deep in the list.
+class ExploreRichList
+{
+public:
+    struct Entry
+    {
+        int64_t balance;
+        ExploreAddress address;
+
+        Entry() : balance(0) {}
+        Entry(int64_t balanceIn, const ExploreAddress& addressIn)
+            : balance(balanceIn), address(addressIn) {}
+
+        // the rich list order
+        friend bool operator<(const Entry& a, const Entry& b)
+        {
+            if (a.balance != b.balance)
+            {
+                return a.balance > b.balance;
+            }
+            return a.address < b.address;
+        }
+    };
+
+private:
+    struct Node
+    {
+        Entry entry;
+        unsigned int priority;
+        unsigned int size;
+        Node* left;
+        Node* right;
+    };
+
+    Node* root;
+
+    static unsigned int Size(const Node* p)
+    {
+        return p ? p->size : 0;
+    }
+    static void Update(Node* p)
+    {
+        p->size = 1 + Size(p->left) + Size(p->right);
+    }
+    static void Split(Node* p, const Entry& entry, Node*& pLeftRet, Node*& pRightRet);
+    static Node* Merge(Node* pLeft, Node* pRight);
+    static bool EraseFrom(Node*& p, const Entry& entry);
+    static unsigned int Resize(Node* p);
+    static void Destroy(Node* p);
+    static void Collect(const Node* p, unsigned int& nSkip, unsigned int& nMax,
+                        std::vector<Entry>& vRet);
+
+    ExploreRichList(const ExploreRichList&);
+    ExploreRichList& operator=(const ExploreRichList&);
+
+public:
+    ExploreRichList() : root(NULL) {}
+    ~ExploreRichList();
+
+    unsigned int size() const
+    {
+        return Size(root);
+    }
+    bool empty() const
+    {
+        return root == NULL;
+    }
+    void clear();
+
+    bool Contains(int64_t nBalance, const ExploreAddress& addr) const;
+    // Both return false if the list already has / does not have the entry.
+    bool Insert(int64_t nBalance, const ExploreAddress& addr);
+    bool Erase(int64_t nBalance, const ExploreAddress& addr);
+
+    // Replaces the contents with vEntries, which must be in rich list order
+    // and without duplicates (returns false, leaving the list empty, if not).
+    // Takes O(n), for loading a snapshot.
+    bool Assign(const std::vector<Entry>& vEntries);
+
+    // Number of addresses with a balance above nBalance, so the rank of an
+    // address with nBalance is CountAbove(nBalance) + 1 (ties share a rank).
+    unsigned int CountAbove(int64_t nBalance) const;
+    // Number of addresses with a balance of at least nBalance.
+    unsigned int CountAtLeast(int64_t nBalance) const;
+
+    // Up to nMax entries from position nStart (0 is the richest).
+    void GetRange(unsigned int nStart, unsigned int nMax,
+                  std::vector<Entry>& vRet) const;
+};
+
+// color -> rich list
+typedef std::map<int, ExploreRichList> MapColorRichLists;
+
+
+#endif  /* _EXPLORERICHLIST_H_ */
@@ -8,6 +8,11 @@
 #include "main.h"
 #include "explore.hpp"
 
+#include <atomic>
+#include <memory>
+
+#include <boost/thread.hpp>
+
 using namespace std;
 
 
@@ -28,12 +33,10 @@ static inline int64_t ExploreMaxDust(int nColor)
     return CENT[nColor];
 }
 
-// Per color, an STL map ordered decreasing (big balances first). These are
-// ordered in-memory keys to sets of addresses, used to look up addresses with
-// these balances in the database. Values are the number of addresses for each
-// balance. This allows iterating over balances to find, say, the top 100
-// addresses of a given color.
-MapColorBalances mapAddressBalances;
+// Per color, the in-memory rich list of the non-dust addresses, ordered by
+// balance. It mirrors the by-balance sets in the database, and answers the
+// rank and page queries of the rich list RPCs without reading those sets.
+MapColorRichLists mapAddressBalances;
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -79,7 +82,7 @@ void ExploreGetDestinations(const vector<CTxOut>& vout, VecDest& vret)
 {
     BOOST_FOREACH(const CTxOut& txout, vout)
     {
-        vector<string> vAddrs;
+        vector<ExploreAddress> vAddrs;
         int nReq;
         const char* type;
 
@@ -90,7 +93,7 @@ void ExploreGetDestinations(const vector<CTxOut>& vout, VecDest& vret)
         {
             BOOST_FOREACH(const CTxDestination& txdest, vTxDest)
             {
-                vAddrs.push_back(CBitcoinAddress(txdest, txout.nColor).ToString());
+                vAddrs.push_back(ExploreAddress(txdest));
             }
             type = GetTxnOutputType(t);
         }
@@ -108,52 +111,177 @@ void ExploreGetDestinations(const vector<CTxOut>& vout, VecDest& vret)
 }
 
 
-void UpdateMapAddressBalances(const MapColorBalances& mapAddressBalancesAdd,
-                              const MapColorBalancesRemove& setAddressBalancesRemove,
-                              MapColorBalances& mapAddressBalancesRet)
+void UpdateMapAddressBalances(const MapBalanceMoves& mapMoves,
+                              MapColorRichLists& mapAddressBalancesRet)
 {
    /**********************************************************************
     * update the in-memory mapAddressBalances (per color)
     **********************************************************************/
-    // remove
-    for (MapColorBalancesRemove::const_iterator it = setAddressBalancesRemove.begin();
-         it != setAddressBalancesRemove.end(); ++it)
+    MapBalanceMoves::const_iterator it;
+    for (it = mapMoves.begin(); it != mapMoves.end(); ++it)
     {
-        MapBalanceCounts& retForColor = mapAddressBalancesRet[it->first];
-        BOOST_FOREACH(int64_t b, it->second)
+        const ExploreAddress& addr = it->first.first;
+        const int nColor = it->first.second;
+        const int64_t nBalanceOld = it->second.first;
+        const int64_t nBalanceNew = it->second.second;
+        if (nBalanceOld == nBalanceNew)
         {
-            retForColor.erase(b);
+            continue;
         }
-    }
-    // add
-    for (MapColorBalances::const_iterator it = mapAddressBalancesAdd.begin();
-         it != mapAddressBalancesAdd.end(); ++it)
-    {
-        MapBalanceCounts& retForColor = mapAddressBalancesRet[it->first];
-        BOOST_FOREACH(const MapBalanceCounts::value_type& p, it->second)
+        ExploreRichList& richlist = mapAddressBalancesRet[nColor];
+        // dust balances are not in the rich list
+        if ((nBalanceOld > ExploreMaxDust(nColor)) &&
+            !richlist.Erase(nBalanceOld, addr))
         {
-            retForColor[p.first] = p.second;
+            error("UpdateMapAddressBalances() : TSNH %s not in the rich list",
+                  addr.ToString(nColor).c_str());
+        }
+        if ((nBalanceNew > ExploreMaxDust(nColor)) &&
+            !richlist.Insert(nBalanceNew, addr))
+        {
+            error("UpdateMapAddressBalances() : TSNH %s already in the rich list",
+                  addr.ToString(nColor).c_str());
         }
     }
 }
 
-// Resolve a single standard destination script to its (color-aware) address
-// string. Returns false for scripts with no single extractable destination.
-static bool ExploreScriptToAddress(const CScript& script, int nColor, string& strAddrRet)
+// Resolve a single standard destination script to its compact address.
+// Returns false for scripts with no single extractable destination.
+static bool ExploreScriptToAddress(const CScript& script, ExploreAddress& addrRet)
 {
     CTxDestination dest;
     if (!ExtractDestination(script, dest))
     {
         return false;
     }
-    strAddrRet = CBitcoinAddress(dest, nColor).ToString();
+    return addrRet.Set(dest);
+}
+
+// Whether coinstake tx pays its first output (after the marker) back to
+// the (address, color) of its first input.
+static bool ExploreIsSelfStake(const CTransaction& tx, const MapPrevTx& mapInputs)
+{
+    if (tx.vout.size() < 2)
+    {
+        return false;
+    }
+    const CTxOut& txoutIn = ExploreGetOutputFor(tx.vin[0], mapInputs);
+    ExploreAddress addrIn, addrOut;
+    return ExploreScriptToAddress(txoutIn.scriptPubKey, addrIn) &&
+           ExploreScriptToAddress(tx.vout[1].scriptPubKey, addrOut) &&
+           (addrIn == addrOut) && (txoutIn.nColor == tx.vout[1].nColor);
+}
+
+// Moves addr from the balance set of nBalanceOld to that of nBalanceNew
+// (dust balances have no set).
+static bool ExploreMoveBalanceSet(CExploreDB& exploredb,
+                                  const ExploreAddress& addr,
+                                  const int nColor,
+                                  const int64_t nBalanceOld,
+                                  const int64_t nBalanceNew)
+{
+    set<ExploreAddress> setAddr;
+    // no tracking of dust balances here
+    if (nBalanceOld > ExploreMaxDust(nColor))
+    {
+        if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
+        {
+            // This should never happen: no old balance
+            return error("ExploreMoveBalanceSet() : TSNH no balance set for %s",
+                         addr.ToString(nColor).c_str());
+        }
+        // remove from its old set
+        setAddr.erase(addr);
+        if (setAddr.empty())
+        {
+            if (!exploredb.RemoveAddrSet(ADDR_SET_BAL, nColor, nBalanceOld))
+            {
+                return error("ExploreMoveBalanceSet() : can't remove addr set");
+            }
+        }
+        else
+        {
+            if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
+            {
+                return error("ExploreMoveBalanceSet() : can't write addr set");
+            }
+        }
+    }
+    // add to new set if non-dust
+    //    (dust balances are not tracked this way)
+    if (nBalanceNew > ExploreMaxDust(nColor))
+    {
+        if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
+        {
+            return error("ExploreMoveBalanceSet() : can't read addr set %s",
+                         FormatMoney(nBalanceNew, nColor).c_str());
+        }
+        if (setAddr.insert(addr).second == false)
+        {
+            // This should never happen: address unexpectedly in set
+            return error("ExploreMoveBalanceSet() : TSNH address unexpectedly in set: %s",
+                         addr.ToString(nColor).c_str());
+        }
+        if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
+        {
+            return error("ExploreMoveBalanceSet() : can't write addr set");
+        }
+    }
     return true;
 }
 
+// Only the balance before the first change and after the last one matter
+// to the balance sets, so a run of changes is recorded as one move.
+static void ExploreRecordBalanceMove(const ExploreAddress& addr,
+                                     const int nColor,
+                                     const int64_t nBalanceOld,
+                                     const int64_t nBalanceNew,
+                                     MapBalanceMoves& mapMovesRet)
+{
+    pair<MapBalanceMoves::iterator, bool> ret =
+        mapMovesRet.insert(make_pair(make_pair(addr, nColor),
+                                     make_pair(nBalanceOld, nBalanceNew)));
+    if (!ret.second)
+    {
+        ret.first->second.second = nBalanceNew;
+    }
+}
+
+// Updates the balance sets and the in-memory rich list for the moves. A
+// move that fails is logged and the rest are still made; the rich list only
+// takes the moves the balance sets did, so it never disagrees with them.
+static bool ExploreApplyBalanceMoves(CExploreDB& exploredb,
+                                     const MapBalanceMoves& mapMoves)
+{
+    bool fOK = true;
+    MapBalanceMoves mapMade;
+    MapBalanceMoves::const_iterator it;
+    for (it = mapMoves.begin(); it != mapMoves.end(); ++it)
+    {
+        if (it->second.first == it->second.second)
+        {
+            continue;
+        }
+        if (ExploreMoveBalanceSet(exploredb, it->first.first, it->first.second,
+                                  it->second.first, it->second.second))
+        {
+            mapMade.insert(*it);
+        }
+        else
+        {
+            fOK = false;
+        }
+    }
+    UpdateMapAddressBalances(mapMade, mapAddressBalances);
+    return fOK;
+}
+
 // fEconomicEvents: when false (a self-staking coinstake wash) the debit/credit
 // bookkeeping (input record, in-out entry, VIO list, value-out total) is
 // skipped; only the UTXO/balance bookkeeping (mark prevout spent, balance,
 // rich-list set) is applied.
+// The rich-list set update is not made but recorded in mapMovesRet, for
+// ExploreApplyBalanceMoves.
 bool ExploreConnectInput(CExploreDB& exploredb,
                          const int nHeight,
                          const int nVtx,
@@ -162,25 +290,23 @@ bool ExploreConnectInput(CExploreDB& exploredb,
                          const MapPrevTx& mapInputs,
                          const uint256& txid,
                          vector<CTxOut>& vPrevOutRet,
-                         MapColorBalances& mapAddressBalancesAddRet,
-                         MapColorBalancesRemove& setAddressBalancesRemoveRet,
-                         const bool fEconomicEvents)
+                         const bool fEconomicEvents,
+                         MapBalanceMoves& mapMovesRet)
 {
     const CTxIn& txIn = tx.vin[n];
     const CTxOut txOut = ExploreGetOutputFor(txIn, mapInputs);
     const int64_t nValue = txOut.nValue;
     const int nColor = txOut.nColor;
     const CScript &script = txOut.scriptPubKey;
-    txnouttype typetxo;
-    vector<valtype> vSolutions;
-    if (!Solver(script, typetxo, vSolutions))
+    CScriptTemplate tmpl;
+    if (!MatchScriptTemplate(script, tmpl))
     {
         // this should never happen: input has insoluble script
         return error("ExploreConnectInput() : TSNH input %u has insoluble script: %s\n", n,
                      txid.ToString().c_str());
     }
     vPrevOutRet.push_back(txOut);
-    switch (typetxo)
+    switch (tmpl.type)
     {
     // standard destinations
     case TX_PUBKEY:
@@ -188,13 +314,13 @@ bool ExploreConnectInput(CExploreDB& exploredb,
     case TX_SCRIPTHASH:
     {
         CTxDestination dest;
-        if (!ExtractDestination(script, dest))
+        if (!ExtractDestination(tmpl, dest))
         {
             // This should never happen: scriptPubKey is bad?
             return error("ExploreConnectInput() : TSNH scriptPubKey is bad");
         }
 
-        string strAddr = CBitcoinAddress(dest, nColor).ToString();
+        ExploreAddress addr(dest);
 
        /***************************************************************
         * 1. mark the previous output as spent (set the spent flag)
@@ -202,11 +328,11 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         // lookup the OutputID for the previous output
         int nOutputID = -1;
         if (!exploredb.ReadAddrLookup(ADDR_LOOKUP_OUTPUT,
-                                 strAddr, nColor, txIn.prevout.hash, txIn.prevout.n,
+                                 addr, nColor, txIn.prevout.hash, txIn.prevout.n,
                                  nOutputID))
         {
             return _Err("ExploreConnectInput(): can't read prev output ID",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -214,15 +340,15 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         {
             // This should never happen : invalid output ID
             return _Err("ExploreConnectInput(): TSNH invalid output ID",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // for sanity: check that the explore db and chain are synced
         ExploreOutput storedOut;
-        if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, nOutputID, storedOut))
+        if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, addr, nColor, nOutputID, storedOut))
         {
             return _Err("ExploreConnectInput(): can't read prev output",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -230,31 +356,31 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         {
             // This should never happen, stored tx doesn't match
             return _Err("ExploreConnectInput() : TSNH stored prev tx doesn't match",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedOut.vout != (int)txIn.prevout.n)
         {
             // This should never happen, stored n doesn't match output n
             return _Err("ExploreConnectInput(): TSNH stored prev vout doesn't match",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedOut.IsSpent())
         {
             // This should never happen, stored output is spent
             return _Err("ExploreConnectInput(): TSNH stored prev output is spent",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
         // write the previous output back, marked as spent
         storedOut.Spend(txid, n);
         if (!exploredb.WriteAddrTx(ADDR_TX_OUTPUT,
-                              strAddr, nColor, nOutputID, storedOut))
+                              addr, nColor, nOutputID, storedOut))
         {
             return _Err("ExploreConnectInput(): can't write prev output",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -262,25 +388,25 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         * 2. update the balance
         ***************************************************************/
         int64_t nBalanceOld;
-        if (!exploredb.ReadAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceOld))
+        if (!exploredb.ReadAddrValue(ADDR_BALANCE, addr, nColor, nBalanceOld))
         {
             return _Err("ExploreConnectInput() : can't read addr balance",
-                        strAddr, -1, txid, n,
+                        addr.ToString(nColor), -1, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (nValue > nBalanceOld)
         {
             // This should never happen: output value exceeds balance
             return _Err("ExploreConnectInput() : TSNH prev output value exceeds balance",
-                        strAddr, -1, txid, n,
+                        addr.ToString(nColor), -1, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         int64_t nBalanceNew = nBalanceOld - nValue;
         // no desire to remove evidence of this address here, even if no balance
-        if (!exploredb.WriteAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceNew))
+        if (!exploredb.WriteAddrValue(ADDR_BALANCE, addr, nColor, nBalanceNew))
         {
             return _Err("ExploreConnectInput() : can't write addr balance",
-                        strAddr, -1, txid, n,
+                        addr.ToString(nColor), -1, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -291,32 +417,32 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         * 3. add the input
         ***************************************************************/
         int nQtyInputs;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, strAddr, nColor, nQtyInputs))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, addr, nColor, nQtyInputs))
         {
             return _Err("ExploreConnectInput() : can't read qty inputs",
-                        strAddr, nQtyInputs, txid, n,
+                        addr.ToString(nColor), nQtyInputs, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (nQtyInputs < 0)
         {
             // This should never happen: negative number of inputs
             return _Err("ExploreConnectInput() : TSNH negative inputs",
-                        strAddr, nQtyInputs, txid, n,
+                        addr.ToString(nColor), nQtyInputs, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         nQtyInputs += 1;
-        if (exploredb.AddrTxIsViable(ADDR_TX_INPUT, strAddr, nColor, nQtyInputs))
+        if (exploredb.AddrTxIsViable(ADDR_TX_INPUT, addr, nColor, nQtyInputs))
         {
             // This should never happen, input tx already exists
             return _Err("ExploreConnectInput() : TSNH input tx exists",
-                        strAddr, nQtyInputs, txid, n,
+                        addr.ToString(nColor), nQtyInputs, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // write the new index record
-        if (!exploredb.WriteAddrQty(ADDR_QTY_INPUT, strAddr, nColor, nQtyInputs))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_INPUT, addr, nColor, nQtyInputs))
         {
             return _Err("ExploreConnectInput() : can't write qty of inputs",
-                        strAddr, nQtyInputs, txid, n,
+                        addr.ToString(nColor), nQtyInputs, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // write the input record
@@ -324,10 +450,10 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         newIn.Set(txid, n,
                   txIn.prevout.hash, txIn.prevout.n,
                   nColor, nValue, nBalanceNew);
-        if (!exploredb.WriteAddrTx(ADDR_TX_INPUT, strAddr, nColor, nQtyInputs, newIn))
+        if (!exploredb.WriteAddrTx(ADDR_TX_INPUT, addr, nColor, nQtyInputs, newIn))
         {
             return _Err("ExploreConnectInput() : can't write input",
-                        strAddr, nQtyInputs, txid, n,
+                        addr.ToString(nColor), nQtyInputs, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -335,40 +461,40 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         * 4. add the in-out
         ***************************************************************/
         int nQtyInOuts;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreConnectInput() : can't read qty in-outs",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (nQtyInOuts < 0)
         {
             // This should never happen: negative number of in-outs
             return _Err("ExploreConnectInput() : TSNH negative in-outs",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         nQtyInOuts += 1;
-        if (exploredb.AddrTxIsViable(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts))
+        if (exploredb.AddrTxIsViable(ADDR_TX_INOUT, addr, nColor, nQtyInOuts))
         {
             // This should never happen, input in-out tx already exists
             return _Err("ExploreConnectInput() : TSNH input in-out tx exists",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // write the new index record
-        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreConnectInput() : can't write qty of in-outs",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // write the in-out record
         ExploreInOutLookup newInOut(nQtyInputs, true);
-        if (!exploredb.WriteAddrTx(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts, newInOut))
+        if (!exploredb.WriteAddrTx(ADDR_TX_INOUT, addr, nColor, nQtyInOuts, newInOut))
         {
             return _Err("ExploreConnectInput() : can't write input in-out",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (fDebugExplore && !fReindexExplore)
@@ -376,7 +502,7 @@ bool ExploreConnectInput(CExploreDB& exploredb,
             printf("EXPLORE connecting INPUT in-out (%d)\n"
                    "   %s - %d\n   %d:%s\n",
                    nQtyInOuts,
-                   strAddr.c_str(), nQtyInputs,
+                   addr.ToString(nColor).c_str(), nQtyInputs,
                    n, txid.GetHex().c_str());
         }
 
@@ -385,10 +511,10 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         ***************************************************************/
         // read the index (qty vios)
         int nQtyVIOStored;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIOStored))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIOStored))
         {
             return _Err("ExploreConnectInput() : can't read qty vios",
-                        strAddr, nQtyVIOStored, txid, n,
+                        addr.ToString(nColor), nQtyVIOStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         int nQtyVIO = nQtyVIOStored;
@@ -402,10 +528,10 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         else if (nQtyVIOStored > 0)
         {
             // not the first tx for address, read the vio
-            if (!exploredb.ReadAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIOStored, iolist))
+            if (!exploredb.ReadAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIOStored, iolist))
             {
                 return _Err("ExploreConnectInput() : can't read in-out list",
-                            strAddr, nQtyVIOStored, txid, n,
+                            addr.ToString(nColor), nQtyVIOStored, txid, n,
                             txIn.prevout.hash, txIn.prevout.n);
             }
         }
@@ -413,14 +539,14 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         {
             // This should never happen: negative number of in-outs
             return _Err("ExploreConnectInput() : TSNH negative txs",
-                        strAddr, nQtyVIOStored, txid, n,
+                        addr.ToString(nColor), nQtyVIOStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if ((nQtyVIOStored == 0) && !iolist.vinouts.empty())
         {
             // This should never happen: vio is already populated
             return _Err("ExploreConnectInput() : TSNH populated vio",
-                        strAddr, nQtyVIOStored, txid, n,
+                        addr.ToString(nColor), nQtyVIOStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // nNewData harbors flag to distinguish input or output
@@ -430,7 +556,7 @@ bool ExploreConnectInput(CExploreDB& exploredb,
                 return _Err(strprintf("ExploreConnectInput() : "
                                       "TSNH inout data negative (%d)",
                                       nNewData).c_str(),
-                             strAddr, newInOut.GetID(), txid, n,
+                             addr.ToString(nColor), newInOut.GetID(), txid, n,
                              txIn.prevout.hash, txIn.prevout.n);
         }
         // The following loop
@@ -449,7 +575,7 @@ bool ExploreConnectInput(CExploreDB& exploredb,
             {
                 // this should never happen: input is already in list
                 return _Err("ExploreConnectInput() : TSNH input already listed",
-                            strAddr, newInOut.GetID(), txid, n,
+                            addr.ToString(nColor), newInOut.GetID(), txid, n,
                             txIn.prevout.hash, txIn.prevout.n);
             }
             // It is slightly more expensive to read all the in-outs
@@ -459,11 +585,11 @@ bool ExploreConnectInput(CExploreDB& exploredb,
             if (otherInOut.IsInput())
             {
                 ExploreInput otherIn;
-                if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, strAddr, nColor, otherInOut.GetID(),
+                if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, addr, nColor, otherInOut.GetID(),
                                      otherIn))
                 {
                     return _Err("ExploreConnectInput() : can't read listed input",
-                                strAddr, otherInOut.GetID(), txid, n,
+                                addr.ToString(nColor), otherInOut.GetID(), txid, n,
                                 txIn.prevout.hash, txIn.prevout.n);
                 }
                 txidOther = otherIn.txid;
@@ -471,11 +597,11 @@ bool ExploreConnectInput(CExploreDB& exploredb,
             else
             {
                 ExploreOutput otherOut;
-                if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, otherInOut.GetID(),
+                if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, addr, nColor, otherInOut.GetID(),
                                      otherOut))
                 {
                     return _Err("ExploreConnectInput() : can't read listed output",
-                                strAddr, otherInOut.GetID(), txid, n,
+                                addr.ToString(nColor), otherInOut.GetID(), txid, n,
                                 txIn.prevout.hash, txIn.prevout.n);
                 }
                 txidOther = otherOut.txid;
@@ -497,17 +623,17 @@ bool ExploreConnectInput(CExploreDB& exploredb,
             else if (txidOther != txidStored)
             {
                 return _Err("ExploreConnectInput() : in-out from different tx",
-                            strAddr, otherInOut.GetID(), txidStored, n,
+                            addr.ToString(nColor), otherInOut.GetID(), txidStored, n,
                             txIn.prevout.hash, txIn.prevout.n);
             }
         }
         // new tx: write the new index record
         if (nQtyVIO == (nQtyVIOStored + 1))
         {
-            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIO))
+            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIO))
             {
                 return _Err("ExploreConnectInput() : can't write qty of txs",
-                            strAddr, nQtyVIO, txid, n,
+                            addr.ToString(nColor), nQtyVIO, txid, n,
                             txIn.prevout.hash, txIn.prevout.n);
             }
             // new tx means new record means new vio
@@ -518,15 +644,15 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         {
             // This should never happen: nQtyVIO incremented more than once
             return _Err("ExploreConnectInput() : TSNH qty vios overincrement",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // update or make a new record depending on qty vios
         iolist.vinouts.push_back(nNewData);
-        if (!exploredb.WriteAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO, iolist))
+        if (!exploredb.WriteAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO, iolist))
         {
             return _Err("ExploreConnectInput() : can't write vio",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -534,16 +660,16 @@ bool ExploreConnectInput(CExploreDB& exploredb,
         * 6. update the value out (new input increases value out)
         ***************************************************************/
         int64_t nValueOut;
-        if (!exploredb.ReadAddrValue(ADDR_VALUEOUT, strAddr, nColor, nValueOut))
+        if (!exploredb.ReadAddrValue(ADDR_VALUEOUT, addr, nColor, nValueOut))
         {
             return _Err("ExploreConnectInput() : can't read addr value out",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         nValueOut += nValue;
-        if (!exploredb.WriteAddrValue(ADDR_VALUEOUT, strAddr, nColor, nValueOut))
+        if (!exploredb.WriteAddrValue(ADDR_VALUEOUT, addr, nColor, nValueOut))
         {
             return _Err("ExploreConnectInput() : can't write addr value out",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
       }  // ---- end economic (debit) events ----
 
@@ -551,59 +677,8 @@ bool ExploreConnectInput(CExploreDB& exploredb,
        /***************************************************************
         * 7. update the balance sets (for rich list, etc)
         ***************************************************************/
-        set<string> setAddr;
-        // no tracking of dust balances here
-        if (nBalanceOld > ExploreMaxDust(nColor))
-        {
-            if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-            {
-                // This should never happen: no old balance
-                return error("ExploreConnectInput() : TSNH no balance set for %s",
-                             strAddr.c_str());
-            }
-            // remove from its old set
-            setAddr.erase(strAddr);
-            if (setAddr.empty())
-            {
-                if (!exploredb.RemoveAddrSet(ADDR_SET_BAL, nColor, nBalanceOld))
-                {
-                    return error("ExploreConnectInput() : can't remove addr set");
-                }
-                mapAddressBalancesAddRet[nColor].erase(nBalanceOld);
-                setAddressBalancesRemoveRet[nColor].insert(nBalanceOld);
-            }
-            else
-            {
-                if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-                {
-                    return error("ExploreConnectInput() : can't write addr set");
-                }
-                mapAddressBalancesAddRet[nColor][nBalanceOld] = setAddr.size();
-                setAddressBalancesRemoveRet[nColor].erase(nBalanceOld);
-            }
-            // add to new set if non-dust
-            //    (dust balances are not tracked this way)
-            if (nBalanceNew > ExploreMaxDust(nColor))
-            {
-                if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-                {
-                    return error("ExploreConnectInput() : can't read addr set %s",
-                                 FormatMoney(nBalanceNew, nColor).c_str());
-                }
-                if (setAddr.insert(strAddr).second == false)
-                {
-                    // This should never happen: address unexpectedly in set
-                    return error("ExploreConnectInput() : TSNH address unexpectedly in set: %s",
-                                 strAddr.c_str());
-                }
-                if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-                {
-                    return error("ExploreConnectInput() : can't write addr set");
-                }
-                mapAddressBalancesAddRet[nColor][nBalanceNew] = setAddr.size();
-                setAddressBalancesRemoveRet[nColor].erase(nBalanceNew);
-            }
-        }
+        ExploreRecordBalanceMove(addr, nColor, nBalanceOld, nBalanceNew,
+                                 mapMovesRet);
     }
         break;
     // nonstandard
@@ -622,15 +697,15 @@ bool ExploreConnectInput(CExploreDB& exploredb,
 // bookkeeping (in-out entry, VIO list, value-in total) is skipped; the
 // UTXO/balance bookkeeping (balance, output record, output lookup, rich-list
 // set) is always applied so future spends of the output resolve.
+// The rich-list set update is recorded as for ExploreConnectInput.
 bool ExploreConnectOutput(CExploreDB& exploredb,
                           const int nHeight,
                           const int nVtx,
                           const CTransaction& tx,
                           const unsigned int n,
                           const uint256& txid,
-                          MapColorBalances& mapAddressBalancesAddRet,
-                          MapColorBalancesRemove& setAddressBalancesRemoveRet,
-                          const bool fEconomicEvents)
+                          const bool fEconomicEvents,
+                          MapBalanceMoves& mapMovesRet)
 {
     if (tx.IsCoinStake() && (n == 0))
     {
@@ -641,16 +716,15 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
     const int64_t nValue = txOut.nValue;
     const int nColor = txOut.nColor;
     const CScript &script = txOut.scriptPubKey;
-    txnouttype typetxo;
-    vector<valtype> vSolutions;
-    if (!Solver(script, typetxo, vSolutions))
+    CScriptTemplate tmpl;
+    if (!MatchScriptTemplate(script, tmpl))
     {
         // output has insoluble script -- skip
         // printf("ExploreConnectOutput() : output %u has insoluble script: %s\n", n,
         //        tx.GetHash().ToString().c_str());
         return true;
     }
-    switch (typetxo)
+    switch (tmpl.type)
     {
     // standard destinations
     case TX_PUBKEY:
@@ -658,28 +732,28 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
     case TX_SCRIPTHASH:
     {
         CTxDestination dest;
-        if (!ExtractDestination(script, dest))
+        if (!ExtractDestination(tmpl, dest))
         {
             // This should never happen: scriptPubKey is bad?
             return error("ExploreConnectOutput() : TSNH scriptPubKey is bad");
         }
 
-        string strAddr = CBitcoinAddress(dest, nColor).ToString();
+        ExploreAddress addr(dest);
 
        /***************************************************************
         * 1. update the balance
         ***************************************************************/
         int64_t nBalanceOld;
-        if (!exploredb.ReadAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceOld))
+        if (!exploredb.ReadAddrValue(ADDR_BALANCE, addr, nColor, nBalanceOld))
         {
             return _Err("ExploreConnectOutput() : can't read addr balance",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         int64_t nBalanceNew = nBalanceOld + nValue;
-        if (!exploredb.WriteAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceNew))
+        if (!exploredb.WriteAddrValue(ADDR_BALANCE, addr, nColor, nBalanceNew))
         {
             return _Err("ExploreConnectOutput() : can't write addr balance",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
 
 
@@ -687,55 +761,55 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
         * 2. add the output
         ***************************************************************/
         int nQtyOutputs;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, strAddr, nColor, nQtyOutputs))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutputs))
         {
             return _Err("ExploreConnectOutput() : can't read qty outputs",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
         if (nQtyOutputs < 0)
         {
             // This should never happen: negative number of outputs
             return _Err("ExploreConnectOutput() : TSNH negative outputs",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
         nQtyOutputs += 1;
-        if (exploredb.AddrTxIsViable(ADDR_TX_OUTPUT, strAddr, nColor, nQtyOutputs))
+        if (exploredb.AddrTxIsViable(ADDR_TX_OUTPUT, addr, nColor, nQtyOutputs))
         {
             // This should never happen, output tx already exists
             return _Err("ExploreConnectOutput() : TSNH output tx exists",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
         // write the new index record
-        if (!exploredb.WriteAddrQty(ADDR_QTY_OUTPUT, strAddr, nColor, nQtyOutputs))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutputs))
         {
             return _Err("ExploreConnectOutput() : can't write qty of outputs",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
         // write the output record
         ExploreOutput newOut;
         newOut.Set(txid, n, nColor, txOut.nValue, nBalanceNew);
-        if (!exploredb.WriteAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, nQtyOutputs, newOut))
+        if (!exploredb.WriteAddrTx(ADDR_TX_OUTPUT, addr, nColor, nQtyOutputs, newOut))
         {
             return _Err("ExploreConnectOutput() : can't write output",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
 
        /***************************************************************
         * 3. add the output lookup
         ***************************************************************/
         // ensure the output lookup does not exist
-        if (exploredb.AddrLookupIsViable(ADDR_LOOKUP_OUTPUT, strAddr, nColor, txid, n))
+        if (exploredb.AddrLookupIsViable(ADDR_LOOKUP_OUTPUT, addr, nColor, txid, n))
         {
             // This should never happen, output lookup already exists
             return _Err("ExploreConnectOutput() : TSNH lookup exists",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
         // fetch the OutputID
-        if (!exploredb.WriteAddrLookup(ADDR_LOOKUP_OUTPUT, strAddr, nColor, txid, n,
+        if (!exploredb.WriteAddrLookup(ADDR_LOOKUP_OUTPUT, addr, nColor, txid, n,
                                                      nQtyOutputs))
         {
             return _Err("ExploreConnectOutput() : can't write lookup",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
 
       // ---- economic (credit) events: skipped for a coinstake self-stake wash ----
@@ -745,43 +819,43 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
         * 4. add the in-out
         ***************************************************************/
         int nQtyInOuts;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreConnectOutput() : can't read qty in-outs",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         if (nQtyInOuts < 0)
         {
             // This should never happen: negative number of in-outs
             return _Err("ExploreConnectOutput() : TSNH negative in-outs",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         nQtyInOuts += 1;
-        if (exploredb.AddrTxIsViable(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts))
+        if (exploredb.AddrTxIsViable(ADDR_TX_INOUT, addr, nColor, nQtyInOuts))
         {
             // This should never happen, output in-out tx already exists
             return _Err("ExploreConnectOutput() : TSNH output in-out tx exists",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         // write the new index record
-        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreConnectOutput() : can't write qty of in-outs",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         // write the in-out record
         ExploreInOutLookup newInOut(nQtyOutputs, false);
-        if (!exploredb.WriteAddrTx(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts, newInOut))
+        if (!exploredb.WriteAddrTx(ADDR_TX_INOUT, addr, nColor, nQtyInOuts, newInOut))
         {
             return _Err("ExploreConnectOutput() : can't write output in-out",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         if (fDebugExplore && !fReindexExplore)
         {
             printf("EXPLORE connecting OUTPUT in-out (%d)\n"
                    "   %s - %d\n   %d:%s\n",
                    nQtyInOuts,
-                   strAddr.c_str(), nQtyOutputs,
+                   addr.ToString(nColor).c_str(), nQtyOutputs,
                    n, txid.GetHex().c_str());
         }
 
@@ -790,10 +864,10 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
         ***************************************************************/
         // read the index (qty vios)
         int nQtyVIOStored;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIOStored))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIOStored))
         {
             return _Err("ExploreConnectOutput() : can't read qty vios",
-                        strAddr, nQtyVIOStored, txid, n);
+                        addr.ToString(nColor), nQtyVIOStored, txid, n);
         }
         int nQtyVIO = nQtyVIOStored;
         // read the vio if necessary (not the first tx for address)
@@ -806,30 +880,30 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
         else if (nQtyVIOStored > 0)
         {
             // not the first tx for address, read the vio
-            if (!exploredb.ReadAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIOStored, iolist))
+            if (!exploredb.ReadAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIOStored, iolist))
             {
                 return _Err("ExploreConnectOutput() : can't read in-out list",
-                            strAddr, nQtyVIOStored, txid, n);
+                            addr.ToString(nColor), nQtyVIOStored, txid, n);
             }
         }
         else
         {
             // This should never happen: negative number of in-outs
             return _Err("ExploreConnectOutput() : TSNH negative txs",
-                        strAddr, nQtyVIOStored, txid, n);
+                        addr.ToString(nColor), nQtyVIOStored, txid, n);
         }
         if ((nQtyVIOStored == 0) & !iolist.vinouts.empty())
         {
             // This should never happen: negative number of in-outs
             return _Err("ExploreConnectOutput() : TSNH populated vio",
-                        strAddr, nQtyVIOStored, txid, n);
+                        addr.ToString(nColor), nQtyVIOStored, txid, n);
         }
         // nNewData harbors flag to distinguish input or output
         int nNewData = newInOut.Get();
         if (nNewData < 0)
         {
                 return _Err("ExploreConnectOutput() : TSNH inout data negative",
-                            strAddr, newInOut.GetID(), txid, n);
+                            addr.ToString(nColor), newInOut.GetID(), txid, n);
         }
         // The following loop
         //    1. determines whether the list for this address-tx pair exists
@@ -847,7 +921,7 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
             {
                 // this should never happen: output is already in list
                 return _Err("ExploreConnectOutput() : TSNH output already listed",
-                            strAddr, newInOut.GetID(), txid, n);
+                            addr.ToString(nColor), newInOut.GetID(), txid, n);
             }
             // It is slightly more expensive to read all the in-outs
             // but we need to do a sanity check. Also, this should be fast.
@@ -856,22 +930,22 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
             if (otherInOut.IsInput())
             {
                 ExploreInput otherIn;
-                if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, strAddr, nColor, otherInOut.GetID(),
+                if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, addr, nColor, otherInOut.GetID(),
                                      otherIn))
                 {
                     return _Err("ExploreConnectOutput() : can't read listed input",
-                                strAddr, otherInOut.GetID(), txid, n);
+                                addr.ToString(nColor), otherInOut.GetID(), txid, n);
                 }
                 txidOther = otherIn.txid;
             }
             else
             {
                 ExploreOutput otherOut;
-                if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, otherInOut.GetID(),
+                if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, addr, nColor, otherInOut.GetID(),
                                      otherOut))
                 {
                     return _Err("ExploreConnectOutput() : can't read listed output",
-                                strAddr, otherInOut.GetID(), txid, n);
+                                addr.ToString(nColor), otherInOut.GetID(), txid, n);
                 }
                 txidOther = otherOut.txid;
             }
@@ -891,16 +965,16 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
             else if (txidOther != txidStored)
             {
                 return _Err("ExploreConnectOutput() : in-out from different tx",
-                            strAddr, otherInOut.GetID(), txidStored, n);
+                            addr.ToString(nColor), otherInOut.GetID(), txidStored, n);
             }
         }
         // write the new index record if necessary
         if (nQtyVIO == (nQtyVIOStored + 1))
         {
-            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIO))
+            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIO))
             {
                 return _Err("ExploreConnectOutput() : can't write qty of txs",
-                            strAddr, nQtyVIO, txid, n);
+                            addr.ToString(nColor), nQtyVIO, txid, n);
             }
             // new record means new vio
             iolist.Clear(nHeight, nVtx);
@@ -910,89 +984,38 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
         {
             // This should never happen: nQtyVIO incremented more than once
             return _Err("ExploreConnectOutput() : TSNH qty vios overincrement",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
         // update or make a new record depending on qty vios
         iolist.vinouts.push_back(nNewData);
-        if (!exploredb.WriteAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO, iolist))
+        if (!exploredb.WriteAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO, iolist))
         {
             return _Err("ExploreConnectOutput() : can't write vio",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
 
        /***************************************************************
         * 6. update the value in (new output increases value in)
         ***************************************************************/
         int64_t nValueIn;
-        if (!exploredb.ReadAddrValue(ADDR_VALUEIN, strAddr, nColor, nValueIn))
+        if (!exploredb.ReadAddrValue(ADDR_VALUEIN, addr, nColor, nValueIn))
         {
             return _Err("ExploreConnectOutput() : can't read addr value in",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         nValueIn += nValue;
-        if (!exploredb.WriteAddrValue(ADDR_VALUEIN, strAddr, nColor, nValueIn))
+        if (!exploredb.WriteAddrValue(ADDR_VALUEIN, addr, nColor, nValueIn))
         {
             return _Err("ExploreConnectOutput() : can't write addr value in",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
       }  // ---- end economic (credit) events ----
 
        /***************************************************************
         * 7. update the balance address sets (for rich list, etc)
         ***************************************************************/
-        set<string> setAddr;
-        // no tracking of dust balances here
-        if (nBalanceOld > ExploreMaxDust(nColor))
-        {
-            if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-            {
-                // This should never happen: no old balance
-                return error("ExploreConnectOutput() : TSNH no balance set for %s",
-                             strAddr.c_str());
-            }
-            // remove from its old set
-            setAddr.erase(strAddr);
-            if (setAddr.empty())
-            {
-                if (!exploredb.RemoveAddrSet(ADDR_SET_BAL, nColor, nBalanceOld))
-                {
-                    return error("ExploreConnectOutput() : can't remove addr set");
-                }
-                mapAddressBalancesAddRet[nColor].erase(nBalanceOld);
-                setAddressBalancesRemoveRet[nColor].insert(nBalanceOld);
-            }
-            else
-            {
-                if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-                {
-                    return error("ExploreConnectOutput() : can't write addr set");
-                }
-                mapAddressBalancesAddRet[nColor][nBalanceOld] = setAddr.size();
-                setAddressBalancesRemoveRet[nColor].erase(nBalanceOld);
-            }
-        }
-        // add to new set if non-dust
-        //    (dust balances are not tracked this way)
-        if (nBalanceNew > ExploreMaxDust(nColor))
-        {
-            if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-            {
-                return error("ExploreConnectOutput() : can't read addr set %s",
-                             FormatMoney(nBalanceNew, nColor).c_str());
-            }
-            if (setAddr.insert(strAddr).second == false)
-            {
-                // This should never happen: address unexpectedly in set
-                return error("ExploreConnectOutput() : TSNH address unexpectedly in set: %s",
-                             strAddr.c_str());
-            }
-            if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-            {
-                return error("ExploreConnectOutput() : can't write addr set");
-            }
-            mapAddressBalancesAddRet[nColor][nBalanceNew] = setAddr.size();
-            setAddressBalancesRemoveRet[nColor].erase(nBalanceNew);
-        }
+        ExploreRecordBalanceMove(addr, nColor, nBalanceOld, nBalanceNew,
+                                 mapMovesRet);
     }
         break;
     // nonstandard
@@ -1008,71 +1031,103 @@ bool ExploreConnectOutput(CExploreDB& exploredb,
 }
 
 
-bool ExploreConnectTx(CTxDB& txdb,
-                      CExploreDB& exploredb,
-                      const CTransaction& tx,
-                      const uint256& hashBlock,
-                      const unsigned int nBlockTime,
-                      const int nHeight,
-                      const int nVtx)
+// Reads the prevouts of tx and classifies it for ExploreConnectTx.
+static bool ExploreFetchTx(CTxDB& txdb,
+                           const CTransaction& tx,
+                           MapPrevTx& mapInputsRet,
+                           int& txflagsRet,
+                           bool& fEconomicEventsRet)
 {
-    MapColorBalances mapAddressBalancesAdd;
-    MapColorBalancesRemove setAddressBalancesRemove;
-
     map<uint256, CTxIndex> mapUnused;
     bool fInvalid;
-    MapPrevTx mapInputs;
-    if (!const_cast<CTransaction&>(tx).FetchInputs(txdb, mapUnused, true, false, mapInputs, fInvalid))
+    if (!const_cast<CTransaction&>(tx).FetchInputs(txdb, mapUnused, true, false, mapInputsRet, fInvalid))
     {
         // This should never happen: couldn't fetch inputs
         return error("ExploreConnectTx() : TSNH couldn't fetch inputs");
     }
 
-    uint256 txid = tx.GetHash();
-
-    int txflags = EXPLORE_TXFLAGS_NONE;
+    txflagsRet = EXPLORE_TXFLAGS_NONE;
 
     // Whether to record the debit/credit economic events for this tx. It is
     // turned off only for a self-staking coinstake (see below), which is an
     // economic wash: only the UTXO/balance bookkeeping is kept.
-    bool fEconomicEvents = true;
+    fEconomicEventsRet = true;
 
-    vector<CTxOut> vPrevOut;
     if (tx.IsCoinBase())
     {
         // Coinbase has no real inputs. In Breakout the PoS reward is paid in
         // the coinbase, so the coinbase outputs are the mint and are counted
-        // as receipts (the normal output handling below does this).
-        txflags = EXPLORE_TXFLAGS_COINBASE;
+        // as receipts (the normal output handling does this).
+        txflagsRet = EXPLORE_TXFLAGS_COINBASE;
     }
-    else
+    else if (tx.IsCoinStake())
+    {
+        txflagsRet = EXPLORE_TXFLAGS_COINSTAKE;
+        // Breakout coinstake is zero-sum: it returns exactly the staked
+        // principal (the reward is a separate coinbase output). Its inputs
+        // come from a single address A; the non-marker outputs pay a single
+        // address B. A self-stake (A == B) is an economic wash and must be
+        // recorded as neither debit nor credit. A -staketo (A != B) is a
+        // genuine transfer of principal and is recorded normally.
+        fEconomicEventsRet = !ExploreIsSelfStake(tx, mapInputsRet);
+    }
+    return true;
+}
+
+// Writes the ExploreTx record. vPrevOut holds the prevouts connected by
+// ExploreConnectInput (those with a soluble script).
+static void ExploreWriteTx(CExploreDB& exploredb,
+                           const CTransaction& tx,
+                           const uint256& txid,
+                           const vector<CTxOut>& vPrevOut,
+                           const uint256& hashBlock,
+                           const unsigned int nBlockTime,
+                           const int nHeight,
+                           const int nVtx,
+                           const int txflags)
+{
+    VecDest vFrom;
+    ExploreGetDestinations(vPrevOut, vFrom);
+    VecDest vTo;
+    ExploreGetDestinations(tx.vout, vTo);
+
+    ExploreTx txInfo(hashBlock, nBlockTime, nHeight, nVtx,
+                     vFrom, vTo, txflags);
+
+    exploredb.WriteExploreTx(txid, txInfo);
+}
+
+bool ExploreConnectTx(CTxDB& txdb,
+                      CExploreDB& exploredb,
+                      const CTransaction& tx,
+                      const uint256& hashBlock,
+                      const unsigned int nBlockTime,
+                      const int nHeight,
+                      const int nVtx)
+{
+    MapBalanceMoves mapMoves;
+
+    MapPrevTx mapInputs;
+    int txflags;
+    bool fEconomicEvents;
+    if (!ExploreFetchTx(txdb, tx, mapInputs, txflags, fEconomicEvents))
+    {
+        return false;
+    }
+
+    uint256 txid = tx.GetHash();
+
+    vector<CTxOut> vPrevOut;
+    if (!tx.IsCoinBase())
     {
-        if (tx.IsCoinStake())
-        {
-            txflags = EXPLORE_TXFLAGS_COINSTAKE;
-            // Breakout coinstake is zero-sum: it returns exactly the staked
-            // principal (the reward is a separate coinbase output). Its inputs
-            // come from a single address A; the non-marker outputs pay a single
-            // address B. A self-stake (A == B) is an economic wash and must be
-            // recorded as neither debit nor credit. A -staketo (A != B) is a
-            // genuine transfer of principal and is recorded normally.
-            string strIn, strOut;
-            if ((tx.vout.size() > 1) &&
-                ExploreScriptToAddress(ExploreGetOutputFor(tx.vin[0], mapInputs).scriptPubKey, ExploreGetOutputFor(tx.vin[0], mapInputs).nColor, strIn) &&
-                ExploreScriptToAddress(tx.vout[1].scriptPubKey, tx.vout[1].nColor, strOut))
-            {
-                fEconomicEvents = (strIn != strOut);
-            }
-        }
         for (unsigned int n = 0; n < tx.vin.size(); ++n)
         {
             ExploreConnectInput(exploredb,
                                 nHeight, nVtx,
                                 tx, n, mapInputs, txid,
                                 vPrevOut,
-                                mapAddressBalancesAdd,
-                                setAddressBalancesRemove,
-                                fEconomicEvents);
+                                fEconomicEvents,
+                                mapMoves);
         }
     }
 
@@ -1081,44 +1136,26 @@ bool ExploreConnectTx(CTxDB& txdb,
         ExploreConnectOutput(exploredb,
                              nHeight, nVtx,
                              tx, n, txid,
-                             mapAddressBalancesAdd,
-                             setAddressBalancesRemove,
-                             fEconomicEvents);
+                             fEconomicEvents,
+                             mapMoves);
     }
 
-    VecDest vFrom;
-    ExploreGetDestinations(vPrevOut, vFrom);
-    VecDest vTo;
-    ExploreGetDestinations(tx.vout, vTo);
-
-    ExploreTx txInfo(hashBlock, nBlockTime, nHeight, nVtx,
-                     vFrom, vTo, txflags);
-
-    exploredb.WriteExploreTx(txid, txInfo);
+    ExploreWriteTx(exploredb, tx, txid, vPrevOut,
+                   hashBlock, nBlockTime, nHeight, nVtx, txflags);
 
-    UpdateMapAddressBalances(mapAddressBalancesAdd,
-                             setAddressBalancesRemove,
-                             mapAddressBalances);
+    // like the inputs and outputs, not checked
+    ExploreApplyBalanceMoves(exploredb, mapMoves);
 
     return true;
 }
 
-bool ExploreConnectBlock(CTxDB& txdb, CExploreDB& exploredb, const CBlock *const block)
+// Indexes the block into whatever transaction exploredb has open.
+static bool ExploreConnectBlockTxs(CTxDB& txdb, CExploreDB& exploredb,
+                                   const CBlock *const block,
+                                   const CBlockIndex *const pindex)
 {
     const uint256 h = block->GetHash();
 
-    std::map<uint256, CBlockIndex*>::const_iterator mi = mapBlockIndex.find(h);
-    if ((mi == mapBlockIndex.end()) || !mi->second)
-    {
-        return error("ExploreConnectBlock() : TSNH block not in index");
-    }
-    const CBlockIndex* pindex = mi->second;
-
-    if (!exploredb.TxnBegin())
-    {
-        return error("ExploreConnectBlock() : TxnBegin failed");
-    }
-
     if (pindex->pprev == NULL)
     {
         // genesis block
@@ -1135,7 +1172,6 @@ bool ExploreConnectBlock(CTxDB& txdb, CExploreDB& exploredb, const CBlock *const
         if (!ExploreConnectTx(txdb, exploredb, tx, h,
                               pindex->nTime, pindex->nHeight, nVtx))
         {
-            exploredb.TxnAbort();
             return false;
         }
         nVtx += 1;
@@ -1144,6 +1180,31 @@ bool ExploreConnectBlock(CTxDB& txdb, CExploreDB& exploredb, const CBlock *const
     // record the explore best block (used at startup for auto-heal)
     exploredb.WriteExploreBest(h, pindex->nHeight);
 
+    return true;
+}
+
+bool ExploreConnectBlock(CTxDB& txdb, CExploreDB& exploredb, const CBlock *const block)
+{
+    const uint256 h = block->GetHash();
+
+    std::map<uint256, CBlockIndex*>::const_iterator mi = mapBlockIndex.find(h);
+    if ((mi == mapBlockIndex.end()) || !mi->second)
+    {
+        return error("ExploreConnectBlock() : TSNH block not in index");
+    }
+    const CBlockIndex* pindex = mi->second;
+
+    if (!exploredb.TxnBegin())
+    {
+        return error("ExploreConnectBlock() : TxnBegin failed");
+    }
+
+    if (!ExploreConnectBlockTxs(txdb, exploredb, block, pindex))
+    {
+        exploredb.TxnAbort();
+        return false;
+    }
+
     if (!exploredb.TxnCommit())
     {
         return error("ExploreConnectBlock() : TxnCommit failed");
@@ -1151,6 +1212,441 @@ bool ExploreConnectBlock(CTxDB& txdb, CExploreDB& exploredb, const CBlock *const
     return true;
 }
 
+// Parallel bulk indexing. Every record ExploreConnectInput and
+// ExploreConnectOutput touch, apart from the rich-list balance sets, belongs
+// to one (address, color), so the addresses are split into shards and each
+// shard is indexed by its own worker, in chain order, into its own pending
+// batch. A chunk of blocks goes through two stages:
+//   1. readers load the blocks and their prevouts and find the shard of
+//      every input and output (the txdb is only read during the rebuild);
+//   2. one worker per shard connects its inputs and outputs and writes the
+//      ExploreTx records of the txids it owns.
+// The balance set moves of all shards are then applied and everything is
+// committed together with the explore best block.
+struct CExploreTxWork
+{
+    const CTransaction* ptx;
+    uint256 txid;
+    MapPrevTx mapInputs;
+    vector<CTxOut> vPrevOut;
+    int txflags;
+    bool fEconomicEvents;
+    vector<unsigned int> vInShard;
+    vector<unsigned int> vOutShard;
+};
+
+struct CExploreBlockWork
+{
+    const CBlockIndex* pindex;
+    CBlock block;
+    vector<CExploreTxWork> vTx;
+};
+
+// One input, output or ExploreTx record for a shard worker.
+struct CExploreEvent
+{
+    enum { INPUT, OUTPUT, TX };
+
+    const CExploreBlockWork* pblock;
+    const CExploreTxWork* ptx;
+    int nVtx;
+    int nType;
+    unsigned int n;
+
+    CExploreEvent(const CExploreBlockWork* pblockIn, const CExploreTxWork* ptxIn,
+                  int nVtxIn, int nTypeIn, unsigned int nIn) :
+        pblock(pblockIn), ptx(ptxIn), nVtx(nVtxIn), nType(nTypeIn), n(nIn) {}
+};
+
+struct CExploreChunkJob
+{
+    vector<CExploreBlockWork>& vBlock;
+    const unsigned int nShards;
+    const unsigned int nMaxPending;
+    vector<vector<CExploreEvent> > vShardEvents;
+    // next event of each shard, kept across checkpoints within the chunk
+    vector<unsigned int> vShardPos;
+    vector<CExploreDB*> vShardDB;
+    vector<MapBalanceMoves> vShardMoves;
+    std::atomic<int> nNext;
+    std::atomic<bool> fFailed;
+
+    // The shards stop before block nStopBlock. vShardBlock is the last
+    // block each shard started on since the last checkpoint.
+    boost::mutex mutex;
+    int nStopBlock;
+    vector<int> vShardBlock;
+
+    CExploreChunkJob(vector<CExploreBlockWork>& vBlockIn,
+                     const vector<CExploreDB*>& vShardDBIn,
+                     unsigned int nMaxPendingIn) :
+        vBlock(vBlockIn), nShards(vShardDBIn.size()), nMaxPending(nMaxPendingIn),
+        vShardEvents(vShardDBIn.size()), vShardPos(vShardDBIn.size(), 0),
+        vShardDB(vShardDBIn), vShardMoves(vShardDBIn.size()),
+        nNext(0), fFailed(false),
+        nStopBlock(vBlockIn.size()), vShardBlock(vShardDBIn.size(), -1) {}
+
+    // false if the shard must not go on to block nBlock
+    bool StartBlock(unsigned int nShard, int nBlock)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        if (nBlock >= nStopBlock)
+        {
+            return false;
+        }
+        vShardBlock[nShard] = nBlock;
+        return true;
+    }
+
+    // Ends the round after the furthest block any shard has started, the
+    // first boundary all of them can still stop at.
+    void RequestStop()
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        int nStop = 0;
+        for (unsigned int i = 0; i < nShards; i++)
+        {
+            nStop = max(nStop, vShardBlock[i] + 1);
+        }
+        nStopBlock = min(nStopBlock, nStop);
+    }
+};
+
+// The shard of the (address, color) an output pays, found the same way
+// ExploreConnectInput and ExploreConnectOutput resolve the address but
+// without encoding it. Outputs without one go to shard 0.
+static unsigned int ExploreShardOf(const CTxOut& txout, unsigned int nShards)
+{
+    CScriptTemplate tmpl;
+    CTxDestination dest;
+    if (!MatchScriptTemplate(txout.scriptPubKey, tmpl) ||
+        !ExtractDestination(tmpl, dest))
+    {
+        return 0;
+    }
+    uint64_t nID;
+    if (const CKeyID* pkeyID = boost::get<CKeyID>(&dest))
+    {
+        nID = pkeyID->Get64();
+    }
+    else if (const CScriptID* pscriptID = boost::get<CScriptID>(&dest))
+    {
+        nID = pscriptID->Get64();
+    }
+    else
+    {
+        return 0;
+    }
+    return (unsigned int)((nID ^ (uint64_t)txout.nColor) % nShards);
+}
+
+static void ThreadExploreReadBlocks(CExploreChunkJob* pjob)
+{
+    CTxDB txdb("r");
+    while (!pjob->fFailed)
+    {
+        int i = pjob->nNext++;
+        if (i >= (int)pjob->vBlock.size())
+        {
+            break;
+        }
+        CExploreBlockWork& work = pjob->vBlock[i];
+        if (!work.block.ReadFromDisk(work.pindex, true))
+        {
+            error("ExploreConnectBlocks() : failed to read block %d",
+                  work.pindex->nHeight);
+            pjob->fFailed = true;
+            break;
+        }
+        work.vTx.resize(work.block.vtx.size());
+        for (unsigned int j = 0; j < work.block.vtx.size(); j++)
+        {
+            const CTransaction& tx = work.block.vtx[j];
+            CExploreTxWork& txwork = work.vTx[j];
+            txwork.ptx = &tx;
+            txwork.txid = tx.GetHash();
+            if (!ExploreFetchTx(txdb, tx, txwork.mapInputs,
+                                txwork.txflags, txwork.fEconomicEvents))
+            {
+                pjob->fFailed = true;
+                break;
+            }
+            if (!tx.IsCoinBase())
+            {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                {
+                    const CTxOut& txPrevOut = ExploreGetOutputFor(txin, txwork.mapInputs);
+                    // the prevouts ExploreConnectInput would collect
+                    CScriptTemplate tmpl;
+                    if (MatchScriptTemplate(txPrevOut.scriptPubKey, tmpl))
+                    {
+                        txwork.vPrevOut.push_back(txPrevOut);
+                    }
+                    txwork.vInShard.push_back(ExploreShardOf(txPrevOut, pjob->nShards));
+                }
+            }
+            BOOST_FOREACH(const CTxOut& txout, tx.vout)
+            {
+                txwork.vOutShard.push_back(ExploreShardOf(txout, pjob->nShards));
+            }
+        }
+    }
+}
+
+// Runs the shard's events up to the block the round stops at. Once the
+// shard's batch holds nMaxPending keys it asks for the round to end at the
+// next block boundary.
+static void ThreadExploreShard(CExploreChunkJob* pjob, unsigned int nShard)
+{
+    CExploreDB& exploredb = *pjob->vShardDB[nShard];
+    MapBalanceMoves& mapMoves = pjob->vShardMoves[nShard];
+    const vector<CExploreEvent>& vEvents = pjob->vShardEvents[nShard];
+    unsigned int& nPos = pjob->vShardPos[nShard];
+    vector<CTxOut> vPrevOut;
+
+    int nBlockCurrent = -1;
+    for (; nPos < vEvents.size(); ++nPos)
+    {
+        const CExploreEvent& event = vEvents[nPos];
+        int nBlock = event.pblock - &pjob->vBlock[0];
+        if (nBlock != nBlockCurrent)
+        {
+            if ((nBlockCurrent >= 0) && (exploredb.TxnSize() >= pjob->nMaxPending))
+            {
+                pjob->RequestStop();
+            }
+            if (!pjob->StartBlock(nShard, nBlock))
+            {
+                break;
+            }
+            nBlockCurrent = nBlock;
+        }
+        const CExploreTxWork& txwork = *event.ptx;
+        const CBlockIndex* pindex = event.pblock->pindex;
+        // results are not checked, as in ExploreConnectTx
+        switch (event.nType)
+        {
+        case CExploreEvent::INPUT:
+            vPrevOut.clear();
+            ExploreConnectInput(exploredb,
+                                pindex->nHeight, event.nVtx,
+                                *txwork.ptx, event.n, txwork.mapInputs, txwork.txid,
+                                vPrevOut,
+                                txwork.fEconomicEvents,
+                                mapMoves);
+            break;
+        case CExploreEvent::OUTPUT:
+            ExploreConnectOutput(exploredb,
+                                 pindex->nHeight, event.nVtx,
+                                 *txwork.ptx, event.n, txwork.txid,
+                                 txwork.fEconomicEvents,
+                                 mapMoves);
+            break;
+        case CExploreEvent::TX:
+            ExploreWriteTx(exploredb, *txwork.ptx, txwork.txid, txwork.vPrevOut,
+                           pindex->GetBlockHash(), pindex->nTime,
+                           pindex->nHeight, event.nVtx, txwork.txflags);
+            break;
+        }
+    }
+}
+
+static bool ExploreConnectBlocksParallel(CExploreDB& exploredb,
+                                         const CBlockIndex* pindexFirst,
+                                         int nBlocksPerCommit, unsigned int nMaxPending,
+                                         int nThreads, int& nCountRet)
+{
+    nCountRet = 0;
+    if (exploredb.TxnActive())
+    {
+        return error("ExploreConnectBlocks() : TSNH transaction already open");
+    }
+
+    // one handle, so one pending batch, per shard
+    vector<unique_ptr<CExploreDB> > vShardDBOwned;
+    vector<CExploreDB*> vShardDB;
+    for (int i = 0; i < nThreads; i++)
+    {
+        vShardDBOwned.push_back(unique_ptr<CExploreDB>(new CExploreDB("r+")));
+        vShardDB.push_back(vShardDBOwned.back().get());
+    }
+
+    const CBlockIndex* pindex = pindexFirst;
+    while (pindex && !fRequestShutdown)
+    {
+        vector<CExploreBlockWork> vBlock;
+        vBlock.reserve(nBlocksPerCommit);
+        while (pindex && ((int)vBlock.size() < nBlocksPerCommit))
+        {
+            vBlock.push_back(CExploreBlockWork());
+            vBlock.back().pindex = pindex;
+            pindex = pindex->pnext;
+        }
+        CExploreChunkJob job(vBlock, vShardDB, nMaxPending);
+
+        // 1. read
+        {
+            boost::thread_group threadGroup;
+            for (int i = 0; i < nThreads; i++)
+            {
+                threadGroup.create_thread(boost::bind(&ThreadExploreReadBlocks, &job));
+            }
+            threadGroup.join_all();
+        }
+        if (job.fFailed)
+        {
+            return error("ExploreConnectBlocks() : failed to read blocks from height %d",
+                         vBlock.front().pindex->nHeight);
+        }
+
+        // hand out the work in chain order: per tx the inputs, then the
+        // outputs, then the ExploreTx record
+        BOOST_FOREACH(const CExploreBlockWork& work, vBlock)
+        {
+            for (unsigned int j = 0; j < work.vTx.size(); j++)
+            {
+                const CExploreTxWork& txwork = work.vTx[j];
+                for (unsigned int n = 0; n < txwork.vInShard.size(); n++)
+                {
+                    job.vShardEvents[txwork.vInShard[n]].push_back(
+                        CExploreEvent(&work, &txwork, j, CExploreEvent::INPUT, n));
+                }
+                for (unsigned int n = 0; n < txwork.vOutShard.size(); n++)
+                {
+                    job.vShardEvents[txwork.vOutShard[n]].push_back(
+                        CExploreEvent(&work, &txwork, j, CExploreEvent::OUTPUT, n));
+                }
+                job.vShardEvents[txwork.txid.Get64() % job.nShards].push_back(
+                    CExploreEvent(&work, &txwork, j, CExploreEvent::TX, 0));
+            }
+        }
+
+        // 2. index, checkpointing at the end of the chunk or earlier at the
+        // block boundary where a shard's batch grew past nMaxPending
+        int nDone = 0;
+        while (nDone < (int)vBlock.size())
+        {
+            BOOST_FOREACH(CExploreDB* pdb, vShardDB)
+            {
+                pdb->TxnBegin();
+            }
+            job.nStopBlock = vBlock.size();
+            job.vShardBlock.assign(job.nShards, -1);
+            {
+                boost::thread_group threadGroup;
+                for (int i = 0; i < nThreads; i++)
+                {
+                    threadGroup.create_thread(boost::bind(&ThreadExploreShard, &job, i));
+                }
+                threadGroup.join_all();
+            }
+
+            // checkpoint
+            if (!exploredb.TxnBegin())
+            {
+                return error("ExploreConnectBlocks() : TxnBegin failed");
+            }
+            if ((nDone == 0) && (vBlock.front().pindex->pprev == NULL))
+            {
+                exploredb.WriteExploreSentinel();
+            }
+            BOOST_FOREACH(CExploreDB* pdb, vShardDB)
+            {
+                exploredb.TxnMerge(*pdb);
+            }
+            // the shards' addresses are disjoint, so their moves are too
+            BOOST_FOREACH(MapBalanceMoves& mapMoves, job.vShardMoves)
+            {
+                if (!ExploreApplyBalanceMoves(exploredb, mapMoves))
+                {
+                    exploredb.TxnAbort();
+                    return error("ExploreConnectBlocks() : failed to update balance sets");
+                }
+                mapMoves.clear();
+            }
+            const CBlockIndex* pindexLast = vBlock[job.nStopBlock - 1].pindex;
+            exploredb.WriteExploreBest(pindexLast->GetBlockHash(), pindexLast->nHeight);
+            if (!exploredb.TxnCommit())
+            {
+                return error("ExploreConnectBlocks() : TxnCommit failed");
+            }
+            nCountRet += job.nStopBlock - nDone;
+            nDone = job.nStopBlock;
+            printf("Breakout Explore indexed to height %d\n", pindexLast->nHeight);
+        }
+    }
+    return true;
+}
+
+// Bulk indexing for the reindex and startup catch-up. One transaction is
+// held open across many blocks, so the hot per-address records (quantities,
+// values, lists, balance sets) are read from and merged in the pending batch
+// instead of being fetched from disk and committed again for every block.
+// Each commit also carries the explore best block, so it is a checkpoint an
+// interrupted run resumes from. A commit happens every nBlocksPerCommit
+// blocks, or sooner once the batch holds nMaxPending keys.
+bool ExploreConnectBlocks(CTxDB& txdb, CExploreDB& exploredb,
+                          const CBlockIndex* pindexFirst,
+                          int nBlocksPerCommit, unsigned int nMaxPending,
+                          int nThreads, int& nCountRet)
+{
+    if (nThreads > 1)
+    {
+        return ExploreConnectBlocksParallel(exploredb, pindexFirst,
+                                            nBlocksPerCommit, nMaxPending,
+                                            nThreads, nCountRet);
+    }
+
+    nCountRet = 0;
+    if (exploredb.TxnActive())
+    {
+        return error("ExploreConnectBlocks() : TSNH transaction already open");
+    }
+
+    int nInBatch = 0;
+    const CBlockIndex* pindex = pindexFirst;
+    while (pindex && !fRequestShutdown)
+    {
+        CBlock block;
+        if (!block.ReadFromDisk(pindex, true))
+        {
+            exploredb.TxnAbort();
+            return error("ExploreConnectBlocks() : failed to read block %d",
+                         pindex->nHeight);
+        }
+        if ((nInBatch == 0) && !exploredb.TxnBegin())
+        {
+            return error("ExploreConnectBlocks() : TxnBegin failed");
+        }
+        if (!ExploreConnectBlockTxs(txdb, exploredb, &block, pindex))
+        {
+            exploredb.TxnAbort();
+            return error("ExploreConnectBlocks() : failed at block %d",
+                         pindex->nHeight);
+        }
+        nInBatch += 1;
+        nCountRet += 1;
+        if ((nInBatch >= nBlocksPerCommit) ||
+            (exploredb.TxnSize() >= nMaxPending))
+        {
+            if (!exploredb.TxnCommit())
+            {
+                return error("ExploreConnectBlocks() : TxnCommit failed");
+            }
+            nInBatch = 0;
+            printf("Breakout Explore indexed to height %d\n", pindex->nHeight);
+        }
+        pindex = pindex->pnext;
+    }
+
+    // also reached on shutdown: keep what was indexed as the checkpoint
+    if ((nInBatch > 0) && !exploredb.TxnCommit())
+    {
+        return error("ExploreConnectBlocks() : final TxnCommit failed");
+    }
+    return true;
+}
+
 // fEconomicEvents mirrors ExploreConnectOutput: when false (coinstake self-
 // stake wash) the credit events removed here are those that were never
 // written; only the UTXO/balance removal is applied.
@@ -1158,24 +1654,22 @@ bool ExploreDisconnectOutput(CExploreDB& exploredb,
                              const CTransaction& tx,
                              const unsigned int n,
                              const uint256& txid,
-                             MapColorBalances& mapAddressBalancesAddRet,
-                             MapColorBalancesRemove& setAddressBalancesRemoveRet,
-                             const bool fEconomicEvents)
+                             const bool fEconomicEvents,
+                             MapBalanceMoves& mapMovesRet)
 {
     const CTxOut& txOut = tx.vout[n];
     const int64_t nValue = txOut.nValue;
     const int nColor = txOut.nColor;
     const CScript &script = txOut.scriptPubKey;
-    txnouttype typetxo;
-    vector<valtype> vSolutions;
-    if (!Solver(script, typetxo, vSolutions))
+    CScriptTemplate tmpl;
+    if (!MatchScriptTemplate(script, tmpl))
     {
         // output has insoluble script -- skip
         // printf("DisonnectBlock() : output %u has insoluble script\n   %s\n",
         //        n, txid.ToString().c_str());
         return true;
     }
-    switch (typetxo)
+    switch (tmpl.type)
     {
     // standard destinations
     case TX_PUBKEY:
@@ -1183,91 +1677,91 @@ bool ExploreDisconnectOutput(CExploreDB& exploredb,
     case TX_SCRIPTHASH:
     {
         CTxDestination dest;
-        if (!ExtractDestination(script, dest))
+        if (!ExtractDestination(tmpl, dest))
         {
             // This should never happen: scriptPubKey is bad?
             return error("ExploreDisconnectOutput() : TSNH scriptPubKey is bad");
         }
 
-        string strAddr = CBitcoinAddress(dest, nColor).ToString();
+        ExploreAddress addr(dest);
 
        /***************************************************************
         * 1. remove the output lookup
         ***************************************************************/
         // fetch the OutputID
         int nOutputID = -1;
-        if (!exploredb.ReadAddrLookup(ADDR_LOOKUP_OUTPUT, strAddr, nColor, txid, n,
+        if (!exploredb.ReadAddrLookup(ADDR_LOOKUP_OUTPUT, addr, nColor, txid, n,
                                                      nOutputID))
         {
             return _Err("ExploreDisconnectOutput() : can't read output ID",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         if (nOutputID < 1)
         {
             // This should never happen : invalid output ID
             return _Err("ExploreDisconnectOutput() : TSNH invalid output ID",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         // finalize removal of the lookup
-        if (!exploredb.RemoveAddrLookup(ADDR_LOOKUP_OUTPUT, strAddr, nColor, txid, n))
+        if (!exploredb.RemoveAddrLookup(ADDR_LOOKUP_OUTPUT, addr, nColor, txid, n))
         {
             return _Err("ExploreDisconnectOutput() : can't remove lookup",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
 
        /***************************************************************
         * 2. remove the output
         ***************************************************************/
         int nQtyOutStored;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, strAddr, nColor, nQtyOutStored))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutStored))
         {
             return _Err("ExploreDisconnectOutput() : can't read qty outputs",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         if (nQtyOutStored != nOutputID)
         {
             // This should never happen : output ID mismatch
             return _Err("ExploreDisconnectOutput() : TSNH output ID mismatch",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         // for sanity: check that the explore db and chain are synced
         ExploreOutput storedOut;
-        if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, nOutputID, storedOut))
+        if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, addr, nColor, nOutputID, storedOut))
         {
             return _Err("ExploreDisconnectOutput() : can't read output",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         if (storedOut.txid != txid)
         {
             // This should never happen, stored tx doesn't match
             return _Err("ExploreDisconnectOutput() : TSNH stored tx doesn't match",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         if (storedOut.vout != (int)n)
         {
             // This should never happen, stored n doesn't match output n
             return _Err("ExploreDisconnectOutput() : TSNH stored vout doesn't match",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         if (storedOut.IsSpent())
         {
             // This should never happne, stored output is spent
             return _Err("ExploreDisconnectOutput() : TSNH stored output is spent",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         // finalize removal
-        if (!exploredb.RemoveAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, nOutputID))
+        if (!exploredb.RemoveAddrTx(ADDR_TX_OUTPUT, addr, nColor, nOutputID))
         {
             return _Err("ExploreDisconnectOutput() : can't remove output",
-                        strAddr, nOutputID, txid, n);
+                        addr.ToString(nColor), nOutputID, txid, n);
         }
         int nQtyOutputs = nQtyOutStored - 1;
         // there is no desire to remove evidence of this address here,
         // so we don't test for 0 outputs, etc
-        if (!exploredb.WriteAddrQty(ADDR_QTY_OUTPUT, strAddr, nColor, nQtyOutputs))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutputs))
         {
             return _Err("ExploreDisconnectOutput() : can't write qty outputs",
-                        strAddr, nQtyOutputs, txid, n);
+                        addr.ToString(nColor), nQtyOutputs, txid, n);
         }
 
       // ---- economic (credit) events: skipped for a coinstake self-stake wash ----
@@ -1278,56 +1772,56 @@ bool ExploreDisconnectOutput(CExploreDB& exploredb,
         ***************************************************************/
         // read the qty in-outs
         int nQtyInOuts;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreDisconnectOutput() : can't read qty in-outs",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         if (nQtyInOuts < 1)
         {
             // This should never happen: negative number of in-outs
             return _Err("ExploreDisconnectOutput() : TSNH no in-outs",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         // read the in-out lookup
         ExploreInOutLookup storedInOut;
-        if (!exploredb.ReadAddrTx(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts, storedInOut))
+        if (!exploredb.ReadAddrTx(ADDR_TX_INOUT, addr, nColor, nQtyInOuts, storedInOut))
         {
             return _Err("ExploreDisconnectOutput() : can't read in-out",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         if (storedInOut.GetID() != nQtyOutStored)
         {
             // This should never happen, stored tx doesn't match
             return _Err("ExploreDisconnectOutput() : TSNH stored in-out doesn't match",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         if (storedInOut.IsInput())
         {
             // This should never happen, stored is an input
             return _Err("ExploreDisconnectOutput() : TSNH stored is an input",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         // finalize removal
-        if (!exploredb.RemoveAddrTx(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.RemoveAddrTx(ADDR_TX_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreDisconnectOutput() : can't remove in-out",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         nQtyInOuts -= 1;
         // there is no desire to remove evidence of this address here,
         // so we don't test for 0 outputs, etc
-        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreDisconnectOutput() : can't write qty in-outs",
-                        strAddr, nQtyInOuts, txid, n);
+                        addr.ToString(nColor), nQtyInOuts, txid, n);
         }
         if (fDebugExplore && !fReindexExplore)
         {
             printf("EXPLORE disconnecting OUTPUT in-out (%d)\n"
                    "   %s - %d\n   %d:%s\n",
                    nQtyInOuts,
-                   strAddr.c_str(), nQtyOutStored,
+                   addr.ToString(nColor).c_str(), nQtyOutStored,
                    n, txid.GetHex().c_str());
         }
 
@@ -1336,72 +1830,72 @@ bool ExploreDisconnectOutput(CExploreDB& exploredb,
         ***************************************************************/
         // read the index (qty txs)
         int nQtyVIO;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIO))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIO))
         {
             return _Err("ExploreDisconnectOutput() : can't read qty vios",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
         // sanity checks: (1) must be a tx to update, (2) no negative txs
         if (nQtyVIO == 0)
         {
             // This should never happen: no txs
             return _Err("ExploreDisconnectOutput() : TSNH no txs",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
         else if (nQtyVIO < 0)
         {
             // This should never happen: negative number of txs
             return _Err("ExploreDisconnectOutput() : TSNH negative txs",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
         // read the vio
         ExploreInOutList iolist;
-        if (!exploredb.ReadAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO, iolist))
+        if (!exploredb.ReadAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO, iolist))
         {
             return _Err("ExploreDisconnectOutput() : can't read vio",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
         // sanity check: vio should not be empty
         if (iolist.vinouts.empty())
         {
             // This should never happen: vio is empty
             return _Err("ExploreDisconnectOutput() : TSNH vio is empty",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
         // sanity check: last of iolist should be same as the current vio index
         if (storedInOut.Get() != iolist.vinouts.back())
         {
             // This should never happen: vio is inconsistent
             return _Err("ExploreDisconnectOutput() : TSNH vio inconsistent",
-                        strAddr, nQtyVIO, txid, n);
+                        addr.ToString(nColor), nQtyVIO, txid, n);
         }
         // pop the most recent vio
         iolist.vinouts.pop_back();
         // last vio of the list, erase the current vio and decrement the index
         if (iolist.vinouts.empty())
         {
-            if (!exploredb.RemoveAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO))
+            if (!exploredb.RemoveAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO))
             {
                 // This should never happen: can not remove vio record
                 return _Err("ExploreDisconnectOutput() : TSNH can't remove vio",
-                            strAddr, nQtyVIO, txid, n);
+                            addr.ToString(nColor), nQtyVIO, txid, n);
             }
             nQtyVIO -= 1;
-            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIO))
+            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIO))
             {
                 // This should never happen: can't write qty vios
                 return _Err("ExploreDisconnectOutput() : TSNH can't write qty vios",
-                            strAddr, nQtyVIO, txid, n);
+                            addr.ToString(nColor), nQtyVIO, txid, n);
             }
         }
         // vio still has in-outs, keep it around
         else
         {
-            if (!exploredb.WriteAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO, iolist))
+            if (!exploredb.WriteAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO, iolist))
             {
                 // This should never happen: can't write the vio
                 return _Err("ExploreDisconnectOutput() : TSNH can't write vio",
-                            strAddr, nQtyVIO, txid, n);
+                            addr.ToString(nColor), nQtyVIO, txid, n);
             }
         }
       }  // ---- end economic (credit) events ----
@@ -1410,23 +1904,23 @@ bool ExploreDisconnectOutput(CExploreDB& exploredb,
         * 5. update the balance
         ***************************************************************/
         int64_t nBalanceOld;
-        if (!exploredb.ReadAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceOld))
+        if (!exploredb.ReadAddrValue(ADDR_BALANCE, addr, nColor, nBalanceOld))
         {
             return _Err("ExploreDisconnectOutput() : can't read addr balance",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         if (nValue > nBalanceOld)
         {
             // This should never happen: output value exceeds balance
             return _Err("ExploreDisconnectOutput() : TSNH output value exceeds balance",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         int64_t nBalanceNew = nBalanceOld - nValue;
         // no desire to remove evidence of this address here, even if no balance
-        if (!exploredb.WriteAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceNew))
+        if (!exploredb.WriteAddrValue(ADDR_BALANCE, addr, nColor, nBalanceNew))
         {
             return _Err("ExploreDisconnectOutput() : can't write addr balance",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
 
       // ---- economic (credit) event: skipped for a coinstake self-stake wash ----
@@ -1436,82 +1930,31 @@ bool ExploreDisconnectOutput(CExploreDB& exploredb,
         * 6. update the value in (removed output decreases value in)
         ***************************************************************/
         int64_t nValueIn;
-        if (!exploredb.ReadAddrValue(ADDR_VALUEIN, strAddr, nColor, nValueIn))
+        if (!exploredb.ReadAddrValue(ADDR_VALUEIN, addr, nColor, nValueIn))
         {
             return _Err("ExploreDisconnectOutput() : can't read addr value in",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         if (nValue > nValueIn)
         {
             // This should never happen: output value exceeds address value in
             return _Err("ExploreDisconnectOutput() : TSNH output value exceeds value in",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         nValueIn -= nValue;
         // no desire to remove evidence of this address here, even if no value in
-        if (!exploredb.WriteAddrValue(ADDR_VALUEIN, strAddr, nColor, nValueIn))
+        if (!exploredb.WriteAddrValue(ADDR_VALUEIN, addr, nColor, nValueIn))
         {
             return _Err("ExploreDisconnectOutput() : can't write addr value in",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
       }  // ---- end economic (credit) event ----
 
        /***************************************************************
         * 7. update the balance sets (for rich list, etc)
         ***************************************************************/
-        set<string> setAddr;
-        // no tracking of dust balances here
-        if (nBalanceOld > ExploreMaxDust(nColor))
-        {
-            if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-            {
-                // This should never happen: no old balance
-                return error("ExploreDisconnectOutput() : TSNH no balance set for %s",
-                             strAddr.c_str());
-            }
-            // remove from its old set
-            setAddr.erase(strAddr);
-            if (setAddr.empty())
-            {
-                if (!exploredb.RemoveAddrSet(ADDR_SET_BAL, nColor, nBalanceOld))
-                {
-                    return error("ExploreDisconnectOutput() : can't remove addr set");
-                }
-                mapAddressBalancesAddRet[nColor].erase(nBalanceOld);
-                setAddressBalancesRemoveRet[nColor].insert(nBalanceOld);
-            }
-            else
-            {
-                if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-                {
-                    return error("ExploreDisconnectOutput() : can't write addr set");
-                }
-                mapAddressBalancesAddRet[nColor][nBalanceOld] = setAddr.size();
-                setAddressBalancesRemoveRet[nColor].erase(nBalanceOld);
-            }
-            // add to new set if non-dust
-            //    (dust balances are not tracked this way)
-            if (nBalanceNew > ExploreMaxDust(nColor))
-            {
-                if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-                {
-                    return error("ExploreDisconnectOutput() : can't read addr set %s",
-                                 FormatMoney(nBalanceNew, nColor).c_str());
-                }
-                if (setAddr.insert(strAddr).second == false)
-                {
-                    // This should never happen: address unexpectedly in set
-                    return error("ExploreDisconnectOutput() : TSNH address unexpectedly in set: %s",
-                                 strAddr.c_str());
-                }
-                if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-                {
-                    return error("ExploreDisconnectOutput() : can't write addr set");
-                }
-                mapAddressBalancesAddRet[nColor][nBalanceNew] = setAddr.size();
-                setAddressBalancesRemoveRet[nColor].erase(nBalanceNew);
-            }
-        }
+        ExploreRecordBalanceMove(addr, nColor, nBalanceOld, nBalanceNew,
+                                 mapMovesRet);
     }
         break;
     // nonstandard
@@ -1534,24 +1977,22 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
                             const unsigned int n,
                             const MapPrevTx& mapInputs,
                             const uint256& txid,
-                            MapColorBalances& mapAddressBalancesAddRet,
-                            MapColorBalancesRemove& setAddressBalancesRemoveRet,
-                            const bool fEconomicEvents)
+                            const bool fEconomicEvents,
+                            MapBalanceMoves& mapMovesRet)
 {
     const CTxIn& txIn = tx.vin[n];
     const CTxOut txOut = ExploreGetOutputFor(txIn, mapInputs);
     const int64_t nValue = txOut.nValue;
     const int nColor = txOut.nColor;
     const CScript &script = txOut.scriptPubKey;
-    txnouttype typetxo;
-    vector<valtype> vSolutions;
-    if (!Solver(script, typetxo, vSolutions))
+    CScriptTemplate tmpl;
+    if (!MatchScriptTemplate(script, tmpl))
     {
         // this should never happen: input has insoluble script
         return error("ExploreDisconnectInput() : TSNH input %u has insoluble script: %s\n", n,
                      txid.ToString().c_str());
     }
-    switch (typetxo)
+    switch (tmpl.type)
     {
     // standard destinations
     case TX_PUBKEY:
@@ -1559,13 +2000,13 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
     case TX_SCRIPTHASH:
     {
         CTxDestination dest;
-        if (!ExtractDestination(script, dest))
+        if (!ExtractDestination(tmpl, dest))
         {
             // This should never happen: scriptPubKey is bad?
             return error("ExploreDisconnectInput() : TSNH scriptPubKey is bad");
         }
 
-        string strAddr = CBitcoinAddress(dest, nColor).ToString();
+        ExploreAddress addr(dest);
 
       // ---- economic (debit) events: skipped for a coinstake self-stake wash ----
       if (fEconomicEvents)
@@ -1574,54 +2015,54 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         * 1. remove the input
         ***************************************************************/
         int nQtyInStored;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, strAddr, nColor, nQtyInStored))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, addr, nColor, nQtyInStored))
         {
             return _Err("ExploreDisconnectInput() : can't read qty inputs",
-                        strAddr, nQtyInStored, txid, n,
+                        addr.ToString(nColor), nQtyInStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (nQtyInStored < 1)
         {
             // This should never happen: no input found
             return _Err("ExploreDisconnectInput() : TSNH no input found",
-                        strAddr, nQtyInStored, txid, n,
+                        addr.ToString(nColor), nQtyInStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // for sanity: check that db and chain are synced
         ExploreInput storedIn;
-        if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, strAddr, nColor, nQtyInStored, storedIn))
+        if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, addr, nColor, nQtyInStored, storedIn))
         {
             return _Err("ExploreDisconnectInput() : can't read input",
-                        strAddr, nQtyInStored, txid, n,
+                        addr.ToString(nColor), nQtyInStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedIn.txid != txid)
         {
             // This should never happen, stored tx doesn't match input tx
             return _Err("ExploreDisconnectInput() : TSNH stored input tx doesn't match",
-                        strAddr, nQtyInStored, txid, n,
+                        addr.ToString(nColor), nQtyInStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedIn.vin != (int)n)
         {
             // This should never happen, stored doesn't match input n
             return _Err("ExploreDisconnectInput() : TSNH stored input n doesn't match",
-                        strAddr, nQtyInStored, txid, n,
+                        addr.ToString(nColor), nQtyInStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // finalize removal
-        if (!exploredb.RemoveAddrTx(ADDR_TX_INPUT, strAddr, nColor, nQtyInStored))
+        if (!exploredb.RemoveAddrTx(ADDR_TX_INPUT, addr, nColor, nQtyInStored))
         {
             return _Err("ExploreDisconnectInput() : can't remove input",
-                        strAddr, nQtyInStored, txid, n,
+                        addr.ToString(nColor), nQtyInStored, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         int nQtyInputs = nQtyInStored - 1;
         // no need to remove evidence of this address here even if balance is 0
-        if (!exploredb.WriteAddrQty(ADDR_QTY_INPUT, strAddr, nColor, nQtyInputs))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_INPUT, addr, nColor, nQtyInputs))
         {
             return _Err("ExploreDisconnectInput() : can't write qty of inputs",
-                        strAddr, nQtyInputs, txid, n,
+                        addr.ToString(nColor), nQtyInputs, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -1630,55 +2071,55 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         * 2. remove the in-out
         ***************************************************************/
         int nQtyInOuts;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreDisconnectInput() : can't read qty in-outs",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (nQtyInOuts < 1)
         {
             // This should never happen : no in-outs
             return _Err("ExploreDisconnectInput() : TSNH no in-outs found",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // for sanity: check that the explore db and chain are synced
         ExploreInOutLookup storedInOut;
-        if (!exploredb.ReadAddrTx(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts, storedInOut))
+        if (!exploredb.ReadAddrTx(ADDR_TX_INOUT, addr, nColor, nQtyInOuts, storedInOut))
         {
             return _Err("ExploreDisconnectInput() : can't read in-out",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedInOut.GetID() != nQtyInStored)
         {
             // This should never happen, stored tx doesn't match
             return _Err("ExploreDisconnectInput() : TSNH stored in-out doesn't match",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedInOut.IsOutput())
         {
             // This should never happen, stored is an output
             return _Err("ExploreDisconnectInput() : TSNH stored is an output",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // finalize removal
-        if (!exploredb.RemoveAddrTx(ADDR_TX_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.RemoveAddrTx(ADDR_TX_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreDisconnectInput() : can't remove in-out",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         nQtyInOuts -= 1;
         // there is no desire to remove evidence of this address here,
         // so we don't test for 0 outputs, etc
-        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, strAddr, nColor, nQtyInOuts))
+        if (!exploredb.WriteAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
         {
             return _Err("ExploreDisconnectInput() : can't write qty in-outs",
-                        strAddr, nQtyInOuts, txid, n,
+                        addr.ToString(nColor), nQtyInOuts, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (fDebugExplore && !fReindexExplore)
@@ -1686,7 +2127,7 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
             printf("EXPLORE disconnecting INPUT in-out (%d)\n"
                    "   %s - %d\n   %d:%s\n",
                    nQtyInOuts,
-                   strAddr.c_str(), nQtyInStored,
+                   addr.ToString(nColor).c_str(), nQtyInStored,
                    n, txid.GetHex().c_str());
         }
 
@@ -1695,10 +2136,10 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         ***************************************************************/
         // read the index (qty txs)
         int nQtyVIO;
-        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIO))
+        if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIO))
         {
             return _Err("ExploreDisconnectInput() : can't read qty vios",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // sanity checks: (1) must be a tx to update, (2) no negative txs
@@ -1706,22 +2147,22 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         {
             // This should never happen: no txs
             return _Err("ExploreDisconnectInput() : TSNH no txs",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         else if (nQtyVIO < 0)
         {
             // This should never happen: negative number of txs
             return _Err("ExploreDisconnectInput() : TSNH negative txs",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // read the vio
         ExploreInOutList iolist;
-        if (!exploredb.ReadAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO, iolist))
+        if (!exploredb.ReadAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO, iolist))
         {
             return _Err("ExploreDisconnectInput() : can't read vio",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // sanity check: vio should not be empty
@@ -1729,7 +2170,7 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         {
             // This should never happen: vio is empty
             return _Err("ExploreDisconnectInput() : TSNH vio is empty",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // sanity check: last of iolist should be same as the current vio index
@@ -1737,7 +2178,7 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         {
             // This should never happen: vio is inconsistent
             return _Err("ExploreDisconnectInput() : TSNH vio inconsistent",
-                        strAddr, nQtyVIO, txid, n,
+                        addr.ToString(nColor), nQtyVIO, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // pop the most recent vio
@@ -1745,30 +2186,30 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         // last vio of the list, erase the current vio and decrement the index
         if (iolist.vinouts.empty())
         {
-            if (!exploredb.RemoveAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO))
+            if (!exploredb.RemoveAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO))
             {
                 // This should never happen: can not remove vio record
                 return _Err("ExploreDisconnectInput() : TSNH can't remove vio",
-                            strAddr, nQtyVIO, txid, n,
+                            addr.ToString(nColor), nQtyVIO, txid, n,
                             txIn.prevout.hash, txIn.prevout.n);
             }
             nQtyVIO -= 1;
-            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, strAddr, nColor, nQtyVIO))
+            if (!exploredb.WriteAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIO))
             {
                 // This should never happen: can't write qty vios
                 return _Err("ExploreDisconnectInput() : TSNH can't write qty vios",
-                            strAddr, nQtyVIO, txid, n,
+                            addr.ToString(nColor), nQtyVIO, txid, n,
                             txIn.prevout.hash, txIn.prevout.n);
             }
         }
         // vio still has in-outs, keep it around
         else
         {
-            if (!exploredb.WriteAddrList(ADDR_LIST_VIO, strAddr, nColor, nQtyVIO, iolist))
+            if (!exploredb.WriteAddrList(ADDR_LIST_VIO, addr, nColor, nQtyVIO, iolist))
             {
                 // This should never happen: can't write the vio
                 return _Err("ExploreDisconnectInput() : TSNH can't write vio",
-                            strAddr, nQtyVIO, txid, n,
+                            addr.ToString(nColor), nQtyVIO, txid, n,
                             txIn.prevout.hash, txIn.prevout.n);
             }
         }
@@ -1780,69 +2221,69 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         // lookup the OutputID
         int nOutputID = -1;
         if (!exploredb.ReadAddrLookup(ADDR_LOOKUP_OUTPUT,
-                                 strAddr, nColor, txIn.prevout.hash, txIn.prevout.n,
+                                 addr, nColor, txIn.prevout.hash, txIn.prevout.n,
                                  nOutputID))
         {
             return _Err("ExploreDisconnectInput() : can't read output ID",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (nOutputID < 1)
         {
             // This should never happen : invalid output ID
             return _Err("ExploreDisconnectInput() : invalid output ID",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // for sanity: check that the explore db and chain are synced
         ExploreOutput storedOut;
-        if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, nOutputID, storedOut))
+        if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, addr, nColor, nOutputID, storedOut))
         {
             return _Err("ExploreDisconnectInput() : can't read output",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedOut.txid != txIn.prevout.hash)
         {
             // This should never happen, stored txid doesn't match
             return _Err("ExploreDisconnectInput() : TSNH stored txid doesn't match",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedOut.vout != (int)txIn.prevout.n)
         {
             // This should never happen, stored vout doesn't match output n
             return _Err("ExploreDisconnectInput() : TSNH stored vout doesn't match",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedOut.next_txid != txid)
         {
             // This should never happen, stored next_txid doesn't match txid
             return _Err("ExploreDisconnectInput() : TSNH stored next_txid doesn't match",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedOut.next_vin != (int)n)
         {
             // This should never happen, stored next_vin doesn't match output n
             return _Err("ExploreDisconnectInput() : TSNH stored next_vin doesn't match",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         if (storedOut.IsUnspent())
         {
             // This should never happen (and is redundant), stored prev output is unspent
             return _Err("ExploreDisconnectInput() : TSNH stored prev output is unspent",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         // write the prev output as unspent
         storedOut.Unspend();
-        if (!exploredb.WriteAddrTx(ADDR_TX_OUTPUT, strAddr, nColor, nOutputID, storedOut))
+        if (!exploredb.WriteAddrTx(ADDR_TX_OUTPUT, addr, nColor, nOutputID, storedOut))
         {
             return _Err("ExploreDisconnectInput() : can't write output as spent",
-                        strAddr, nOutputID, txid, n,
+                        addr.ToString(nColor), nOutputID, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -1850,17 +2291,17 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         * 5. update the balance
         ***************************************************************/
         int64_t nBalanceOld;
-        if (!exploredb.ReadAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceOld))
+        if (!exploredb.ReadAddrValue(ADDR_BALANCE, addr, nColor, nBalanceOld))
         {
             return _Err("ExploreDisconnectTx() : can't read addr balance",
-                        strAddr, -1, txid, n,
+                        addr.ToString(nColor), -1, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         int64_t nBalanceNew = nBalanceOld + nValue;
-        if (!exploredb.WriteAddrValue(ADDR_BALANCE, strAddr, nColor, nBalanceNew))
+        if (!exploredb.WriteAddrValue(ADDR_BALANCE, addr, nColor, nBalanceNew))
         {
             return _Err("ExploreDisconnectInput() : can't write addr balance",
-                        strAddr, -1, txid, n,
+                        addr.ToString(nColor), -1, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
 
@@ -1871,83 +2312,32 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
         * 6. update the value out (removed input decreases value out)
         ***************************************************************/
         int64_t nValueOut;
-        if (!exploredb.ReadAddrValue(ADDR_VALUEOUT, strAddr, nColor, nValueOut))
+        if (!exploredb.ReadAddrValue(ADDR_VALUEOUT, addr, nColor, nValueOut))
         {
             return _Err("ExploreDisconnectInput() : can't read addr value out",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
         if (nValue > nValueOut)
         {
             // This should never happen: output value exceeds address value out
             return _Err("ExploreDisconnectInput() : TSNH prev output value exceeds value out",
-                        strAddr, -1, txid, n,
+                        addr.ToString(nColor), -1, txid, n,
                         txIn.prevout.hash, txIn.prevout.n);
         }
         nValueOut -= nValue;
         // don't remove evidence of this address here, even if no value out
-        if (!exploredb.WriteAddrValue(ADDR_VALUEOUT, strAddr, nColor, nValueOut))
+        if (!exploredb.WriteAddrValue(ADDR_VALUEOUT, addr, nColor, nValueOut))
         {
             return _Err("ExploreDisconnectInput() : can't write addr value out",
-                        strAddr, -1, txid, n);
+                        addr.ToString(nColor), -1, txid, n);
         }
       }  // ---- end economic (debit) event ----
 
        /***************************************************************
         * 7. update the balance address sets (for rich list, etc)
         ***************************************************************/
-        set<string> setAddr;
-        // no tracking of dust balances here
-        if (nBalanceOld > ExploreMaxDust(nColor))
-        {
-            if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-            {
-                // This should never happen: no old balance
-                return error("ExploreDisconnectInput() : TSNH no balance set for %s",
-                             strAddr.c_str());
-            }
-            // remove from its old set
-            setAddr.erase(strAddr);
-            if (setAddr.empty())
-            {
-                if (!exploredb.RemoveAddrSet(ADDR_SET_BAL, nColor, nBalanceOld))
-                {
-                    return error("ExploreDisconnectInput() : can't remove addr set");
-                }
-                mapAddressBalancesAddRet[nColor].erase(nBalanceOld);
-                setAddressBalancesRemoveRet[nColor].insert(nBalanceOld);
-            }
-            else
-            {
-                if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceOld, setAddr))
-                {
-                    return error("ExploreDisconnectInput() : can't write addr set");
-                }
-                mapAddressBalancesAddRet[nColor][nBalanceOld] = setAddr.size();
-                setAddressBalancesRemoveRet[nColor].erase(nBalanceOld);
-            }
-        }
-        // add to new set if non-dust
-        //    (dust balances are not tracked this way)
-        if (nBalanceNew > ExploreMaxDust(nColor))
-        {
-            if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-            {
-                return error("ExploreDisconnectInput() : can't read addr set %s",
-                             FormatMoney(nBalanceNew, nColor).c_str());
-            }
-            if (setAddr.insert(strAddr).second == false)
-            {
-                // This should never happen: address unexpectedly in set
-                return error("ExploreDisconnectInput() : TSNH address unexpectedly in set: %s",
-                             strAddr.c_str());
-            }
-            if (!exploredb.WriteAddrSet(ADDR_SET_BAL, nColor, nBalanceNew, setAddr))
-            {
-                return error("ExploreDisconnectInput() : can't write addr set");
-            }
-            mapAddressBalancesAddRet[nColor][nBalanceNew] = setAddr.size();
-            setAddressBalancesRemoveRet[nColor].erase(nBalanceNew);
-        }
+        ExploreRecordBalanceMove(addr, nColor, nBalanceOld, nBalanceNew,
+                                 mapMovesRet);
     }
         break;
     // nonstandard
@@ -1964,8 +2354,7 @@ bool ExploreDisconnectInput(CExploreDB& exploredb,
 
 bool ExploreDisconnectTx(CTxDB& txdb, CExploreDB& exploredb, const CTransaction &tx)
 {
-    MapColorBalances mapAddressBalancesAdd;
-    MapColorBalancesRemove setAddressBalancesRemove;
+    MapBalanceMoves mapMoves;
 
     map<uint256, CTxIndex> mapUnused;
     bool fInvalid;
@@ -1985,13 +2374,7 @@ bool ExploreDisconnectTx(CTxDB& txdb, CExploreDB& exploredb, const CTransaction
     bool fEconomicEvents = true;
     if (tx.IsCoinStake())
     {
-        string strIn, strOut;
-        if ((tx.vout.size() > 1) &&
-            ExploreScriptToAddress(ExploreGetOutputFor(tx.vin[0], mapInputs).scriptPubKey, ExploreGetOutputFor(tx.vin[0], mapInputs).nColor, strIn) &&
-            ExploreScriptToAddress(tx.vout[1].scriptPubKey, tx.vout[1].nColor, strOut))
-        {
-            fEconomicEvents = (strIn != strOut);
-        }
+        fEconomicEvents = !ExploreIsSelfStake(tx, mapInputs);
     }
 
     // outputs (iterate backwards)
@@ -1999,9 +2382,8 @@ bool ExploreDisconnectTx(CTxDB& txdb, CExploreDB& exploredb, const CTransaction
     {
 
         ExploreDisconnectOutput(exploredb, tx, (unsigned int)n, txid,
-                                mapAddressBalancesAdd,
-                                setAddressBalancesRemove,
-                                fEconomicEvents);
+                                fEconomicEvents,
+                                mapMoves);
     }
 
     if (!tx.IsCoinBase())
@@ -2010,17 +2392,15 @@ bool ExploreDisconnectTx(CTxDB& txdb, CExploreDB& exploredb, const CTransaction
         for (int n = tx.vin.size() - 1; n >= 0; --n)
         {
             ExploreDisconnectInput(exploredb, tx, (unsigned int)n, mapInputs, txid,
-                                   mapAddressBalancesAdd,
-                                   setAddressBalancesRemove,
-                                   fEconomicEvents);
+                                   fEconomicEvents,
+                                   mapMoves);
         }
     }
 
     exploredb.RemoveExploreTx(txid);
 
-    UpdateMapAddressBalances(mapAddressBalancesAdd,
-                             setAddressBalancesRemove,
-                             mapAddressBalances);
+    // like the inputs and outputs, not checked
+    ExploreApplyBalanceMoves(exploredb, mapMoves);
 
     return true;
 }
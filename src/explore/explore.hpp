@@ -8,39 +8,42 @@
 
 #include <map>
 #include <set>
+#include <string>
 
 #include "ExploreConstants.hpp"
+#include "ExploreAddress.hpp"
 #include "ExploreInput.hpp"
 #include "ExploreOutput.hpp"
 #include "ExploreInOutLookup.hpp"
 #include "ExploreInOutList.hpp"
+#include "ExploreRichList.hpp"
 #include "ExploreTx.hpp"
 
 class CBlock;
+class CBlockIndex;
 class CTransaction;
 class CTxDB;
 class CExploreDB;
 
 
-// Breakout Explore is color-aware. The in-memory rich-list cache and the
-// per-tx balance-change accumulators are therefore keyed by color.
-//   MapColorBalances:       color -> (balance -> number of addresses)
-//   MapColorBalancesRemove: color -> set of balances to drop from the cache
-typedef std::map<int, MapBalanceCounts> MapColorBalances;
-typedef std::map<int, std::set<int64_t> > MapColorBalancesRemove;
+// Breakout Explore is color-aware. The in-memory rich lists and the
+// balance-change accumulators are therefore keyed by color.
+//   MapBalanceMoves:        (address, color) -> (balance before, balance after)
+typedef std::map<std::pair<ExploreAddress, int>,
+                 std::pair<int64_t, int64_t> > MapBalanceMoves;
 
 
 extern bool fWithExploreAPI;
 extern bool fDebugExplore;
 extern bool fReindexExplore;
 
-// Per color, the in-memory ordered map used to serve the rich list.
-extern MapColorBalances mapAddressBalances;
+// Per color, the in-memory rich list.
+extern MapColorRichLists mapAddressBalances;
 
 
-void UpdateMapAddressBalances(const MapColorBalances& mapAddressBalancesAdd,
-                              const MapColorBalancesRemove& setAddressBalancesRemove,
-                              MapColorBalances& mapAddressBalancesRet);
+// Applies balance moves to the rich lists (dust balances are left out).
+void UpdateMapAddressBalances(const MapBalanceMoves& mapMoves,
+                              MapColorRichLists& mapAddressBalancesRet);
 
 // The explore engine reads spent prevouts through the transaction index
 // (CTxDB) and writes the address/tx index to the separate explore DB
@@ -52,6 +55,18 @@ bool ExploreConnectTx(CTxDB& txdb, CExploreDB& exploredb,
                       const int nHeight,
                       const int nVtx);
 bool ExploreConnectBlock(CTxDB& txdb, CExploreDB& exploredb, const CBlock *const block);
+// Bulk indexing defaults (-explorebatch overrides the blocks per commit).
+static const int EXPLORE_BLOCKS_PER_COMMIT = 1000;
+static const unsigned int EXPLORE_MAX_PENDING = 500000;
+
+// Connects pindexFirst and its main chain successors, committing every
+// nBlocksPerCommit blocks or nMaxPending pending keys, whichever is first.
+// With nThreads > 1 the blocks are indexed in parallel, nBlocksPerCommit at
+// a time, by workers that each own a share of the addresses.
+bool ExploreConnectBlocks(CTxDB& txdb, CExploreDB& exploredb,
+                          const CBlockIndex* pindexFirst,
+                          int nBlocksPerCommit, unsigned int nMaxPending,
+                          int nThreads, int& nCountRet);
 
 bool ExploreDisconnectTx(CTxDB& txdb, CExploreDB& exploredb, const CTransaction &tx);
 bool ExploreDisconnectBlock(CTxDB& txdb, CExploreDB& exploredb, const CBlock *const block);
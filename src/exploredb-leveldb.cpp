@@ -117,6 +117,11 @@ void CExploreDB::Close()
     activeBatch = NULL;
 }
 
+static filesystem::path GetRichListSnapshotPath()
+{
+    return GetDataDir() / "richlist.snapshot";
+}
+
 bool CExploreDB::ClearAll()
 {
     // drop any pending batch
@@ -133,8 +138,10 @@ bool CExploreDB::ClearAll()
     delete options.block_cache;
     options.block_cache = NULL;
 
-    // wipe the directory
+    // wipe the directory, and the rich list snapshot taken of it
     boost::filesystem::remove_all(GetDataDir() / "exploredb");
+    boost::system::error_code ec;
+    boost::filesystem::remove(GetRichListSnapshotPath(), ec);
 
     // reopen empty
     options = GetExploreOptions();
@@ -155,14 +162,14 @@ bool CExploreDB::ClearAll()
 bool CExploreDB::TxnBegin()
 {
     assert(!activeBatch);
-    activeBatch = new leveldb::WriteBatch();
+    activeBatch = new CLevelDBBatch();
     return true;
 }
 
 bool CExploreDB::TxnCommit()
 {
     assert(activeBatch);
-    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+    leveldb::Status status = activeBatch->Write(pdb, leveldb::WriteOptions());
     delete activeBatch;
     activeBatch = NULL;
     if (!status.ok()) {
@@ -172,46 +179,13 @@ bool CExploreDB::TxnCommit()
     return true;
 }
 
-class CExploreBatchScanner : public leveldb::WriteBatch::Handler {
-public:
-    std::string needle;
-    bool *deleted;
-    std::string *foundValue;
-    bool foundEntry;
-
-    CExploreBatchScanner() : foundEntry(false) {}
-
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        }
-    }
-
-    virtual void Delete(const leveldb::Slice& key) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = true;
-        }
-    }
-};
-
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
 // a database transaction begins reads are consistent with it.
 bool CExploreDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
     assert(activeBatch);
     *deleted = false;
-    CExploreBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status status = activeBatch->Iterate(&scanner);
-    if (!status.ok()) {
-        throw runtime_error(status.ToString());
-    }
-    return scanner.foundEntry;
+    return activeBatch->Get(key.str(), value, deleted);
 }
 
 
@@ -240,9 +214,7 @@ bool CExploreDB::WriteExploreBest(const uint256& hash, int height)
 // Generic prefix eraser retained from the Stealth implementation. With the
 // separate exploredb, a full reindex uses ClearAll() (a directory wipe)
 // instead, but this remains available for targeted record-type clearing.
-bool CExploreDB::EraseStartsWith(const string& strSentinel,
-                                 const string& strSearch,
-                                 bool fActiveBatchOK)
+bool CExploreDB::EraseStartsWith(const exploreKey_t& t, bool fActiveBatchOK)
 {
     if ((!fActiveBatchOK) && activeBatch)
     {
@@ -250,12 +222,12 @@ bool CExploreDB::EraseStartsWith(const string& strSentinel,
     }
     int count = 0;
     int xcount = 0;
+    const string strPrefix = CExploreKey(t).ToString();
     leveldb::Iterator *iter = pdb->NewIterator(leveldb::ReadOptions());
-    iter->Seek(strSentinel);
-    // don't erase the sentinel
-    iter->Next();
+    iter->Seek(strPrefix);
     if (!TxnBegin())
     {
+        delete iter;
         return error("EraseStartsWith() : first TxnBegin failed");
     }
     while (iter->Valid())
@@ -269,48 +241,25 @@ bool CExploreDB::EraseStartsWith(const string& strSentinel,
         {
             break;
         }
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.write(iter->key().data(), iter->key().size());
-        string strPrefix;
-        ssKey >> strPrefix;
-        if (strPrefix != strSearch)
+        if (!iter->key().starts_with(strPrefix))
         {
-            if (count > 0)
-            {
-                break;
-            }
-            else
-            {
-                iter->Next();
-                continue;
-            }
+            break;
         }
-        if ((xcount > 0) && ((count % 10000) == 0))
+        if ((count > 0) && ((count % 10000) == 0))
         {
             if (!TxnCommit())
             {
+                delete iter;
                 return error("EraseStartsWith() : TxnCommit failed");
             }
             if (!TxnBegin())
             {
+                delete iter;
                 return error("EraseStartsWith() : TxnBegin failed");
             }
         }
         count += 1;
-        string strKeyDel(ssKey.full_str());
-        if (activeBatch)
-        {
-            activeBatch->Delete(strKeyDel);
-        }
-        else
-        {
-            leveldb::Status status = pdb->Delete(leveldb::WriteOptions(), strKeyDel);
-            if (!status.ok())
-            {
-                return error("TSNH: Can't erase record type \"%s\".",
-                             strSearch.c_str());
-            }
-        }
+        activeBatch->Delete(iter->key().ToString());
         iter->Next();
     }
     delete iter;
@@ -323,21 +272,21 @@ bool CExploreDB::EraseStartsWith(const string& strSentinel,
 
 bool CExploreDB::WriteExploreSentinel(int value)
 {
-    return Write(EXPLORE_SENTINEL, value);
+    return Write(CExploreKey(EXPLORE_SENTINEL), value);
 }
 
 /*  AddrQty
  *  Parameters - t:type, addr:address, nColor:color, qty:quantity
  */
-bool CExploreDB::ReadAddrQty(const exploreKey_t& t, const string& addr, int nColor, int& qtyRet)
+bool CExploreDB::ReadAddrQty(const exploreKey_t& t, const ExploreAddress& addr, int nColor, int& qtyRet)
 {
     qtyRet = 0;
-    ss_key_t key = std::make_pair(t, std::make_pair(addr, nColor));
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor);
     return ReadRecord(key, qtyRet);
 }
-bool CExploreDB::WriteAddrQty(const exploreKey_t& t, const string& addr, int nColor, const int& qty)
+bool CExploreDB::WriteAddrQty(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty)
 {
-    ss_key_t key = std::make_pair(t, std::make_pair(addr, nColor));
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor);
     return Write(key, qty);
 }
 
@@ -345,32 +294,28 @@ bool CExploreDB::WriteAddrQty(const exploreKey_t& t, const string& addr, int nCo
  *  Parameters - t:type, addr:address, nColor:color, qty:quantity,
                  value:input_info|output_info|inout
  */
-bool CExploreDB::RemoveAddrTx(const exploreKey_t& t, const string& addr, int nColor, const int& qty)
+bool CExploreDB::RemoveAddrTx(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty)
 {
-    std::pair<ss_key_t, int> key =
-        std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
     return RemoveRecord(key);
 }
-bool CExploreDB::AddrTxIsViable(const exploreKey_t& t, const string& addr, int nColor, const int& qty)
+bool CExploreDB::AddrTxIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty)
 {
-    std::pair<ss_key_t, int> key =
-        std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
     return IsViable(key);
 }
 
 /*  AddrList
  *  Parameters - t:type, addr:address, nColor:color, qty:quantity, value:inout_list
  */
-bool CExploreDB::RemoveAddrList(const exploreKey_t& t, const string& addr, int nColor, const int& qty)
+bool CExploreDB::RemoveAddrList(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty)
 {
-    std::pair<ss_key_t, int> key =
-        std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
     return RemoveRecord(key);
 }
-bool CExploreDB::AddrListIsViable(const exploreKey_t& t, const string& addr, int nColor, const int& qty)
+bool CExploreDB::AddrListIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty)
 {
-    std::pair<ss_key_t, int> key =
-        std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
     return IsViable(key);
 }
 
@@ -379,35 +324,31 @@ bool CExploreDB::AddrListIsViable(const exploreKey_t& t, const string& addr, int
  *  Parameters - t:type, addr:address, nColor:color,
  *               txid:TxID, n:vout|vin, qty:quantity
  */
-bool CExploreDB::ReadAddrLookup(const exploreKey_t& t, const string& addr, int nColor,
+bool CExploreDB::ReadAddrLookup(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                                 const uint256& txid, const int& n,
                                 int& qtyRet)
 {
    qtyRet = -1;
-   lookup_key_t key = std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)),
-                                     std::make_pair(txid, n));
+   CExploreKey key = CExploreKey(t).Addr(addr, nColor).Hash(txid).Number(n);
    return ReadRecord(key, qtyRet);
 }
-bool CExploreDB::WriteAddrLookup(const exploreKey_t& t, const string& addr, int nColor,
+bool CExploreDB::WriteAddrLookup(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                                  const uint256& txid, const int& n,
                                  const int& qty)
 {
-   lookup_key_t key = std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)),
-                                     std::make_pair(txid, n));
+   CExploreKey key = CExploreKey(t).Addr(addr, nColor).Hash(txid).Number(n);
    return Write(key, qty);
 }
-bool CExploreDB::RemoveAddrLookup(const exploreKey_t& t, const string& addr, int nColor,
+bool CExploreDB::RemoveAddrLookup(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                                   const uint256& txid, const int& n)
 {
-   lookup_key_t key = std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)),
-                                     std::make_pair(txid, n));
+   CExploreKey key = CExploreKey(t).Addr(addr, nColor).Hash(txid).Number(n);
    return RemoveRecord(key);
 }
-bool CExploreDB::AddrLookupIsViable(const exploreKey_t& t, const string& addr, int nColor,
+bool CExploreDB::AddrLookupIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                                     const uint256& txid, const int& n)
 {
-   lookup_key_t key = std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)),
-                                     std::make_pair(txid, n));
+   CExploreKey key = CExploreKey(t).Addr(addr, nColor).Hash(txid).Number(n);
    return IsViable(key);
 }
 
@@ -415,44 +356,283 @@ bool CExploreDB::AddrLookupIsViable(const exploreKey_t& t, const string& addr, i
 /*  AddrValue
  *  Parameters - t:type, addr:address, nColor:color, v:value
  */
-bool CExploreDB::ReadAddrValue(const exploreKey_t& t, const string& addr, int nColor,
+bool CExploreDB::ReadAddrValue(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                                int64_t& vRet)
 {
     vRet = 0;
-    ss_key_t key = std::make_pair(t, std::make_pair(addr, nColor));
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor);
     return ReadRecord(key, vRet);
 }
-bool CExploreDB::WriteAddrValue(const exploreKey_t& t, const string& addr, int nColor,
+bool CExploreDB::WriteAddrValue(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                                 const int64_t& v)
 {
-    ss_key_t key = std::make_pair(t, std::make_pair(addr, nColor));
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor);
     return Write(key, v);
 }
-bool CExploreDB::AddrValueIsViable(const exploreKey_t& t, const std::string& addr, int nColor)
+bool CExploreDB::AddrValueIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor)
 {
-    ss_key_t key = std::make_pair(t, std::make_pair(addr, nColor));
+    CExploreKey key = CExploreKey(t).Addr(addr, nColor);
     return IsViable(key);
 }
 
 /*  AddrSet (rich list, per color)
  *  Parameters - t:type, nColor:color, b:balance, s:addresses
  */
-bool CExploreDB::ReadAddrSet(const exploreKey_t& t, int nColor, const int64_t b, set<string>& sRet)
+bool CExploreDB::ReadAddrSet(const exploreKey_t& t, int nColor, const int64_t b, set<ExploreAddress>& sRet)
 {
     sRet.clear();
-    balance_set_key_t key = std::make_pair(t, std::make_pair(nColor, b));
+    CExploreKey key = CExploreKey(t).Color(nColor).Amount(b);
     return ReadRecord(key, sRet);
 }
-bool CExploreDB::WriteAddrSet(const exploreKey_t& t, int nColor, const int64_t b, const set<string>& s)
+bool CExploreDB::WriteAddrSet(const exploreKey_t& t, int nColor, const int64_t b, const set<ExploreAddress>& s)
 {
-    balance_set_key_t key = std::make_pair(t, std::make_pair(nColor, b));
+    CExploreKey key = CExploreKey(t).Color(nColor).Amount(b);
     return Write(key, s);
 }
 bool CExploreDB::RemoveAddrSet(const exploreKey_t& t, int nColor, const int64_t b)
 {
-    balance_set_key_t key = std::make_pair(t, std::make_pair(nColor, b));
+    CExploreKey key = CExploreKey(t).Color(nColor).Amount(b);
     return RemoveRecord(key);
 }
+bool CExploreDB::ReadRichLists(const exploreKey_t& t, MapColorRichLists& mapRet)
+{
+    if (activeBatch)
+    {
+        return error("ReadRichLists(): active batch not allowed");
+    }
+    mapRet.clear();
+    // balance set keys: type, color, 8 byte balance
+    const string strPrefix = CExploreKey(t).ToString();
+    leveldb::Iterator *iter = pdb->NewIterator(leveldb::ReadOptions());
+    for (iter->Seek(strPrefix); iter->Valid(); iter->Next())
+    {
+        leveldb::Slice key = iter->key();
+        if (!key.starts_with(strPrefix))
+        {
+            break;
+        }
+        if (key.size() != 10)
+        {
+            delete iter;
+            return error("ReadRichLists(): bad key size %u",
+                         (unsigned int)key.size());
+        }
+        const unsigned char* p = (const unsigned char*)key.data();
+        int nColor = p[1];
+        int64_t nBalance = 0;
+        for (int i = 2; i < 10; i++)
+        {
+            nBalance = (int64_t)(((uint64_t)nBalance << 8) | p[i]);
+        }
+        try
+        {
+            CDataStream ssValue(iter->value().data(),
+                                iter->value().data() + iter->value().size(),
+                                SER_DISK, CLIENT_VERSION);
+            set<ExploreAddress> setAddr;
+            ssValue >> setAddr;
+            BOOST_FOREACH(const ExploreAddress& addr, setAddr)
+            {
+                mapRet[nColor].Insert(nBalance, addr);
+            }
+        }
+        catch (std::exception &e)
+        {
+            delete iter;
+            return error("ReadRichLists(): %s", e.what());
+        }
+    }
+    bool fOk = iter->status().ok();
+    delete iter;
+    return fOk;
+}
+
+/*  Rich list snapshot
+ *  A header naming the explore best block it was taken at, then per color
+ *  the entries in rich list order, then a checksum over everything before it.
+ */
+static const int RICHLIST_SNAPSHOT_VERSION = 1;
+
+bool CExploreDB::WriteRichListSnapshot(const MapColorRichLists& mapRichLists)
+{
+    if (activeBatch)
+    {
+        return error("WriteRichListSnapshot() : active batch not allowed");
+    }
+    // the snapshot is only usable against the explore index on disk
+    uint256 hashBest;
+    int nBestHeight;
+    if (!ReadExploreBest(hashBest, nBestHeight))
+    {
+        return error("WriteRichListSnapshot() : no explore best block");
+    }
+
+    int64_t nStart = GetTimeMillis();
+    filesystem::path pathSnapshot = GetRichListSnapshotPath();
+    filesystem::path pathTmp = GetDataDir() / "richlist.snapshot.new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+    {
+        return error("WriteRichListSnapshot() : open failed");
+    }
+
+    unsigned int nEntries = 0;
+    try
+    {
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(pchMessageStart) << RICHLIST_SNAPSHOT_VERSION;
+        ss << hashBest << (unsigned int)mapRichLists.size();
+        MapColorRichLists::const_iterator it;
+        for (it = mapRichLists.begin(); it != mapRichLists.end(); ++it)
+        {
+            vector<ExploreRichList::Entry> vEntries;
+            it->second.GetRange(0, it->second.size(), vEntries);
+            ss << it->first << (unsigned int)vEntries.size();
+            BOOST_FOREACH(const ExploreRichList::Entry& entry, vEntries)
+            {
+                ss << entry.balance << entry.address;
+                if (ss.size() >= (1 << 20))
+                {
+                    hasher.write(&ss[0], ss.size());
+                    fileout.write(&ss[0], ss.size());
+                    ss.clear();
+                }
+            }
+            nEntries += vEntries.size();
+        }
+        if (!ss.empty())
+        {
+            hasher.write(&ss[0], ss.size());
+            fileout.write(&ss[0], ss.size());
+        }
+        fileout << hasher.GetHash();
+    }
+    catch (std::exception &e)
+    {
+        fileout.fclose();
+        filesystem::remove(pathTmp);
+        return error("WriteRichListSnapshot() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, pathSnapshot))
+    {
+        return error("WriteRichListSnapshot() : Rename-into-place failed");
+    }
+
+    printf("Wrote rich list snapshot of %u addresses in %" PRId64 "ms\n",
+           nEntries, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CExploreDB::ReadRichListSnapshot(MapColorRichLists& mapRet)
+{
+    mapRet.clear();
+    filesystem::path pathSnapshot = GetRichListSnapshotPath();
+    if (!filesystem::exists(pathSnapshot))
+    {
+        return false;
+    }
+
+    int64_t nStart = GetTimeMillis();
+    unsigned int nEntries = 0;
+    bool fLoaded = false;
+    try
+    {
+        uint256 hashBest;
+        int nBestHeight;
+        if (activeBatch || !ReadExploreBest(hashBest, nBestHeight))
+        {
+            throw runtime_error("no explore best block");
+        }
+
+        FILE *file = fopen(pathSnapshot.string().c_str(), "rb");
+        CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+        if (!filein)
+        {
+            throw runtime_error("open failed");
+        }
+        uintmax_t nFileSize = filesystem::file_size(pathSnapshot);
+        if (nFileSize < sizeof(uint256))
+        {
+            throw runtime_error("truncated");
+        }
+        vector<char> vchData(nFileSize - sizeof(uint256));
+        uint256 hashChecksum;
+        if (!vchData.empty())
+        {
+            filein.read(&vchData[0], vchData.size());
+        }
+        filein >> hashChecksum;
+        filein.fclose();
+
+        CDataStream ss(vchData, SER_DISK, CLIENT_VERSION);
+        if (Hash(ss.begin(), ss.end()) != hashChecksum)
+        {
+            throw runtime_error("checksum mismatch");
+        }
+
+        unsigned char pchMagic[4];
+        int nSnapshotVersion;
+        uint256 hashSnapshotBest;
+        unsigned int nColors;
+        ss >> FLATDATA(pchMagic) >> nSnapshotVersion;
+        ss >> hashSnapshotBest >> nColors;
+        if (memcmp(pchMagic, pchMessageStart, sizeof(pchMagic)) != 0)
+        {
+            throw runtime_error("wrong network");
+        }
+        if (nSnapshotVersion != RICHLIST_SNAPSHOT_VERSION)
+        {
+            throw runtime_error("unknown version");
+        }
+        if (hashSnapshotBest != hashBest)
+        {
+            throw runtime_error("stale");
+        }
+
+        for (unsigned int i = 0; i < nColors; ++i)
+        {
+            int nColor;
+            unsigned int nCount;
+            ss >> nColor >> nCount;
+            vector<ExploreRichList::Entry> vEntries(nCount);
+            BOOST_FOREACH(ExploreRichList::Entry& entry, vEntries)
+            {
+                ss >> entry.balance >> entry.address;
+            }
+            if (!mapRet[nColor].Assign(vEntries))
+            {
+                throw runtime_error("entries out of order");
+            }
+            nEntries += nCount;
+        }
+        if (!ss.empty())
+        {
+            throw runtime_error("inconsistent");
+        }
+        fLoaded = true;
+    }
+    catch (std::exception &e)
+    {
+        printf("ReadRichListSnapshot() : snapshot not used: %s\n", e.what());
+        mapRet.clear();
+    }
+
+    // a snapshot describes a single shutdown; fall back to the database next time
+    boost::system::error_code ec;
+    filesystem::remove(pathSnapshot, ec);
+
+    if (fLoaded)
+    {
+        printf("Loaded %u addresses from rich list snapshot in %" PRId64 "ms\n",
+               nEntries, GetTimeMillis() - nStart);
+    }
+    return fLoaded;
+}
 
 /*  ExploreTx
  *  Parameters - txid:TxID, extx:ExploreTx
@@ -460,16 +640,16 @@ bool CExploreDB::RemoveAddrSet(const exploreKey_t& t, int nColor, const int64_t
 bool CExploreDB::ReadExploreTx(const uint256& txid, ExploreTx& extxRet)
 {
    extxRet.SetNull();
-   std::pair<exploreKey_t, uint256> key = std::make_pair(EXPLORE_TX, txid);
+   CExploreKey key = CExploreKey(EXPLORE_TX).Hash(txid);
    return ReadRecord(key, extxRet);
 }
 bool CExploreDB::WriteExploreTx(const uint256& txid, const ExploreTx& extx)
 {
-   std::pair<exploreKey_t, uint256> key = std::make_pair(EXPLORE_TX, txid);
+   CExploreKey key = CExploreKey(EXPLORE_TX).Hash(txid);
    return Write(key, extx);
 }
 bool CExploreDB::RemoveExploreTx(const uint256& txid)
 {
-    std::pair<exploreKey_t, uint256> key = std::make_pair(EXPLORE_TX, txid);
+    CExploreKey key = CExploreKey(EXPLORE_TX).Hash(txid);
     return RemoveRecord(key);
 }
@@ -17,8 +17,11 @@
 #define BREAKOUT_EXPLOREDB_LEVELDB_H
 
 #include "main.h"
+#include "batch-leveldb.h"
 
 #include "explore/ExploreConstants.hpp"
+#include "explore/ExploreAddress.hpp"
+#include "explore/ExploreRichList.hpp"
 
 #include <map>
 #include <set>
@@ -26,7 +29,6 @@
 #include <vector>
 
 #include <leveldb/db.h>
-#include <leveldb/write_batch.h>
 
 class ExploreTx;
 
@@ -37,34 +39,90 @@ extern bool fDebugExplore;
 ///////////////////////////////////////////////////////////////////////////////
 // LevelDB Keys (explore)
 ///////////////////////////////////////////////////////////////////////////////
+// Explore keys are compact binary strings: the record type byte, then
+//   address records:   the 21 byte address, a color byte and, for numbered
+//                      records, the number as 4 bytes big-endian
+//   output lookups:    the address, color, txid and vout
+//   balance sets:      a color byte and the balance, big-endian
+//   transactions:      the txid
 // Breakout is multi-color: the indexing unit is (address, color), so every
-// per-address record is scoped to a single currency.
-typedef std::pair<std::string, int> addr_color_t;
-// generalized explore keys
-typedef std::pair<exploreKey_t, addr_color_t> ss_key_t;
-// amount key (e.g. balances)
-typedef std::pair<ss_key_t, int64_t> amount_key_t;
-// in-out lookup key
-typedef std::pair<uint256, int> txidn_key_t;
-typedef std::pair<ss_key_t, txidn_key_t> lookup_key_t;
-// balance-set key: rich list is per-color, keyed by (type, (color, balance))
-typedef std::pair<exploreKey_t, std::pair<int, int64_t> > balance_set_key_t;
+// per-address record is scoped to a single currency. The big-endian fields
+// keep the records of an address in number order and the balance sets in
+// balance order.
+class CExploreKey
+{
+private:
+    std::vector<unsigned char> vch;
+
+public:
+    explicit CExploreKey(exploreKey_t t)
+    {
+        vch.reserve(64);
+        vch.push_back(t);
+    }
+
+    CExploreKey& Addr(const ExploreAddress& addr, int nColor)
+    {
+        vch.insert(vch.end(), addr.vch, addr.vch + ExploreAddress::SIZE);
+        vch.push_back((unsigned char)nColor);
+        return *this;
+    }
+
+    // four bytes, big-endian, so the keys sort like the numbers
+    CExploreKey& Number(unsigned int n)
+    {
+        for (int i = 24; i >= 0; i -= 8)
+        {
+            vch.push_back((unsigned char)(n >> i));
+        }
+        return *this;
+    }
+
+    CExploreKey& Hash(const uint256& hash)
+    {
+        vch.insert(vch.end(), hash.cbegin(), hash.cbegin() + sizeof(hash));
+        return *this;
+    }
+
+    CExploreKey& Color(int nColor)
+    {
+        vch.push_back((unsigned char)nColor);
+        return *this;
+    }
+
+    CExploreKey& Amount(int64_t n)
+    {
+        for (int i = 56; i >= 0; i -= 8)
+        {
+            vch.push_back((unsigned char)((uint64_t)n >> i));
+        }
+        return *this;
+    }
+
+    std::string ToString() const
+    {
+        return std::string(vch.begin(), vch.end());
+    }
+
+    // written raw: the key is not length prefixed
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return vch.size();
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s.write((const char*)&vch[0], vch.size());
+    }
+};
 ///////////////////////////////////////////////////////////////////////////////
 
 // Explore database schema version. Bump this to force existing exploredb
 // contents to be discarded and rebuilt on next startup (independent of the
 // txleveldb DATABASE_VERSION).
-static const int EXPLOREDB_VERSION = 1;
-
-
-template<typename K>
-std::string DBKeyToString(const K& key)
-{
-    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-    ssKey.reserve(1000);
-    ssKey << key;
-    return ssKey.str();
-}
+//   2: compact binary keys and addresses (CExploreKey, ExploreAddress)
+static const int EXPLOREDB_VERSION = 2;
 
 
 class CExploreDB
@@ -91,7 +149,7 @@ private:
 
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
-    leveldb::WriteBatch *activeBatch;
+    CLevelDBBatch *activeBatch;
     leveldb::Options options;
     bool fReadOnly;
     int nVersion;
@@ -293,6 +351,23 @@ public:
         activeBatch = NULL;
         return true;
     }
+    bool TxnActive() const
+    {
+        return activeBatch != NULL;
+    }
+    // Moves the pending changes of dbOther's batch into this one and ends
+    // dbOther's transaction. Both must have one open.
+    bool TxnMerge(CExploreDB& dbOther)
+    {
+        assert(activeBatch && dbOther.activeBatch);
+        activeBatch->Absorb(*dbOther.activeBatch);
+        return dbOther.TxnAbort();
+    }
+    // Number of distinct keys waiting in the active batch.
+    size_t TxnSize() const
+    {
+        return activeBatch ? activeBatch->size() : 0;
+    }
 
     bool ReadVersion(int& nVersionRet)
     {
@@ -311,78 +386,82 @@ public:
     bool ReadExploreBest(uint256& hashRet, int& heightRet);
     bool WriteExploreBest(const uint256& hash, int height);
 
-    bool EraseStartsWith(const std::string& strSentinel,
-                         const std::string& strSearch,
-                         bool fActiveBatchOK);
+    bool EraseStartsWith(const exploreKey_t& t, bool fActiveBatchOK);
 
     bool WriteExploreSentinel(int value=0);
-    bool ReadAddrQty(const exploreKey_t& t, const std::string& addr, int nColor, int& qtyRet);
-    bool WriteAddrQty(const exploreKey_t& t, const std::string& addr, int nColor, const int& qty);
+    bool ReadAddrQty(const exploreKey_t& t, const ExploreAddress& addr, int nColor, int& qtyRet);
+    bool WriteAddrQty(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty);
 
      // Parameters - t:type, addr:address, nColor:color, qty:quantity,
      //              value:input_info|output_info|inout_lookup|inout_list
     template<typename T>
-    bool ReadAddrTx(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool ReadAddrTx(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                     const int& qty, T& value)
     {
         value.SetNull();
-        std::pair<ss_key_t, int> key =
-            std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+        CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
         return ReadRecord(key, value);
     }
     template<typename T>
-    bool WriteAddrTx(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool WriteAddrTx(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                      const int& qty, const T& value)
     {
-        std::pair<ss_key_t, int> key =
-            std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+        CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
         return Write(key, value);
     }
 
-    bool RemoveAddrTx(const exploreKey_t& t, const std::string& addr, int nColor, const int& qty);
-    bool AddrTxIsViable(const exploreKey_t& t, const std::string& addr, int nColor, const int& qty);
+    bool RemoveAddrTx(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty);
+    bool AddrTxIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty);
 
     template<typename T>
-    bool ReadAddrList(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool ReadAddrList(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                       const int& qty, T& value)
     {
         value.SetNull();
-        std::pair<ss_key_t, int> key =
-            std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+        CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
         return ReadRecord(key, value);
     }
     template<typename T>
-    bool WriteAddrList(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool WriteAddrList(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                        const int& qty, const T& value)
     {
-        std::pair<ss_key_t, int> key =
-            std::make_pair(std::make_pair(t, std::make_pair(addr, nColor)), qty);
+        CExploreKey key = CExploreKey(t).Addr(addr, nColor).Number(qty);
         return Write(key, value);
     }
 
-    bool RemoveAddrList(const exploreKey_t& t, const std::string& addr, int nColor, const int& qty);
-    bool AddrListIsViable(const exploreKey_t& t, const std::string& addr, int nColor, const int& qty);
+    bool RemoveAddrList(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty);
+    bool AddrListIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor, const int& qty);
 
-    bool ReadAddrLookup(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool ReadAddrLookup(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                         const uint256& txid, const int& n,
                         int& qtyRet);
-    bool WriteAddrLookup(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool WriteAddrLookup(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                          const uint256& txid, const int& n,
                          const int& qty);
-    bool RemoveAddrLookup(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool RemoveAddrLookup(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                           const uint256& txid, const int& n);
-    bool AddrLookupIsViable(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool AddrLookupIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                             const uint256& txid, const int& n);
-    bool ReadAddrValue(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool ReadAddrValue(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                        int64_t& vRet);
-    bool WriteAddrValue(const exploreKey_t& t, const std::string& addr, int nColor,
+    bool WriteAddrValue(const exploreKey_t& t, const ExploreAddress& addr, int nColor,
                         const int64_t& v);
-    bool AddrValueIsViable(const exploreKey_t& t, const std::string& addr, int nColor);
+    bool AddrValueIsViable(const exploreKey_t& t, const ExploreAddress& addr, int nColor);
     bool ReadAddrSet(const exploreKey_t& t, int nColor, const int64_t b,
-                     std::set<std::string>& sRet);
+                     std::set<ExploreAddress>& sRet);
     bool WriteAddrSet(const exploreKey_t& t, int nColor, const int64_t b,
-                      const std::set<std::string>& s);
+                      const std::set<ExploreAddress>& s);
     bool RemoveAddrSet(const exploreKey_t& t, int nColor, const int64_t b);
+    // Walks every balance set of type t (no active batch allowed) and
+    // returns, per color, the rich list of their addresses.
+    bool ReadRichLists(const exploreKey_t& t, MapColorRichLists& mapRet);
+
+    // The rich lists as of the explore best block, dumped to a flat file at
+    // clean shutdown so that startup need not walk every balance set. The
+    // snapshot is only read back if it matches the explore best block, and
+    // it is removed once read.
+    bool WriteRichListSnapshot(const MapColorRichLists& mapRichLists);
+    bool ReadRichListSnapshot(MapColorRichLists& mapRet);
 
     bool ReadExploreTx(const uint256& txid, ExploreTx& extxRet);
     bool WriteExploreTx(const uint256& txid, const ExploreTx& extx);
@@ -51,6 +51,9 @@ unsigned int nNodeLifespan;
 unsigned int nDerivationMethodIndex;
 unsigned int nMinerSleep;
 bool fUseFastIndex;
+// Set once the explore index has caught up and mapAddressBalances matches it,
+// so that a shutdown during startup does not save a partial rich list.
+static bool fExploreRichListLoaded = false;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -133,6 +136,13 @@ void Shutdown(void* parg)
 //        CTxDB().Close();
         bitdb.Flush(false);
         StopNode();
+        {
+            LOCK(cs_main);
+            if (pindexBest)
+                CTxDB().WriteBlockIndexSnapshot();
+            if (fExploreRichListLoaded)
+                CExploreDB().WriteRichListSnapshot(mapAddressBalances);
+        }
         bitdb.Flush(true);
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
@@ -287,7 +297,7 @@ string HelpMessage()
         "  -pid=<file>            " + _("Specify pid file (default: breakoutd.pid)") + "\n" +
         "  -datadir=<dir>         " + _("Specify data directory") + "\n" +
         "  -wallet=<dir>          " + _("Specify wallet file (within data directory)") + "\n" +
-        "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n" +
+        "  -dbcache=<n>           " + _("Set database and transaction cache sizes in megabytes (default: 25)") + "\n" +
         "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n" +
         "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n" +
         "  -proxy=<ip:port>       " + _("Connect through socks proxy") + "\n" +
@@ -298,6 +308,7 @@ string HelpMessage()
                                                                           (int) P2P_PORT, (int) P2P_PORT_TESTNET) + "\n" +
         "  -torport=<port>        " + strprintf(_("Connect to Tor through <torport> (default: %d)"), TOR_PORT) + "\n" +
         "  -maxconnections=<n>    " + _("Maintain at most <n> connections to peers (default: 125)") + "\n" +
+        "  -headersfirst          " + _("Sync block headers first, then download blocks from several peers (default: 1)") + "\n" +
         "  -addnode=<ip>          " + _("Add a node to connect to and attempt to keep the connection open") + "\n" +
         "  -connect=<ip>          " + _("Connect only to the specified node(s)") + "\n" +
         "  -seednode=<ip>         " + _("Connect to a node to retrieve peer addresses, and disconnect") + "\n" +
@@ -310,6 +321,8 @@ string HelpMessage()
         "  -bind=<addr>           " + _("Bind to given address. Use [host]:port notation for IPv6") + "\n" +
         "  -dnsseed               " + _("Find peers using DNS lookup (default: 1)") + "\n" +
         "  -genproclimit          " + _("Max number of threads to generate with  (default: 1)") + "\n" +
+        "  -kawpowcachesize=<n>   " + strprintf(_("Megabytes of KAWPOW epoch contexts to keep in memory (default: %u)"), DEFAULT_KAWPOW_CACHE_SIZE) + "\n" +
+        "  -kawpowepochfiles      " + _("Keep KAWPOW light caches in <datadir>/epochs and map them at startup (default: 1)") + "\n" +
         "  -staking               " + _("Stake your coins to support network and gain reward (default: 1)") + "\n" +
         "  -synctime              " + _("Sync time with other nodes. Disable if time on your system is precise e.g. syncing with NTP (default: 1)") + "\n" +
         "  -cppolicy              " + _("Sync checkpoints policy (default: strict)") + "\n" +
@@ -330,6 +343,9 @@ string HelpMessage()
         "  -reservebalance=<amt>    " + _("Amount to reserve that will not stake for default stake") + "\n" +
         "  -reservebalance_<N>=<amt>    " + _("Amount to reserve that will not stake for color <N> where <N> is an int") + "\n" +
         "  -reservebalance_<ticker>=<amt>    " + _("Amount to reserve that will not stake for currency with <ticker>") + "\n" +
+        "  -stakethreads=<n>      " + strprintf(_("Set the number of stake kernel search threads (up to %d, 0 = auto, default: 1)"), MAX_STAKE_THREADS) + "\n" +
+        "  -stake_<N>=0           " + _("Do not stake color <N> where <N> is an int") + "\n" +
+        "  -stake_<ticker>=0      " + _("Do not stake currency with <ticker>") + "\n" +
         "  -paytxfee=<amt>        " + _("Fee per KB to add to transactions you send for default currency") + "\n" +
         "  -paytxfee_<N>=<amt>        " + _("Fee per KB to add to transactions you send for color currency <N>") + "\n" +
         "  -paytxfee_<ticker>=<amt>        " + _("Fee per KB to add to transactions you send for currency with <ticker>") + "\n" +
@@ -368,9 +384,13 @@ string HelpMessage()
         "  -upgradewallet         " + _("Upgrade wallet to latest format") + "\n" +
         "  -keypool=<n>           " + _("Set key pool size to <n> (default: 100)") + "\n" +
         "  -rescan=<n>            " + _("Rescan block chain for txs from block <n> (-1 = scan only what's needed, 0 = no scan, default: 0)") + "\n" +
+        "  -reconcileinterval=<n> " + _("Seconds between background checks of the wallet balances (0 = only when inconsistent, default: 3600)") + "\n" +
         "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n" +
         "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
         "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n" +
+        "  -blockindexsnapshot    " + _("Save the block index at shutdown and load it from that snapshot at startup (default: 1)") + "\n" +
+        "  -par=<n>               " + strprintf(_("Set the number of script verification threads (up to %d, 0 = auto, <0 = leave that many cores free, default: 0)"), MAX_SCRIPTCHECK_THREADS) + "\n" +
+        "  -maxscriptcachesize=<n> " + _("Remember at most <n> verified input scripts (0 = no script cache, default: 50000)") + "\n" +
         "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n" +
 
         "\n" + _("Block creation options:") + "\n" +
@@ -389,6 +409,7 @@ string HelpMessage()
         "  -exploreapi            " + _("Maintain the Breakout Explore address/tx index and RPCs (default: 0)") + "\n" +
         "  -debugexplore          " + _("Output extra Breakout Explore debugging information") + "\n" +
         "  -reindexexplore        " + _("Rebuild the Breakout Explore index from the block chain, then continue") + "\n" +
+        "  -explorebatch=<n>      " + _("Blocks per Breakout Explore index commit while rebuilding (default: 1000)") + "\n" +
 
         "  -burnkey=<key>         " + _("Random string") + "\n" +
 
@@ -535,8 +556,39 @@ bool AppInit2()
 
     nNodeLifespan = GetArg("-addrlifespan", 7);
     fUseFastIndex = GetBoolArg("-fastindex", true);
+    fHeadersFirst = GetBoolArg("-headersfirst", true);
     nMinerSleep = GetArg("-minersleep", 500);  // in milliseconds
 
+    // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
+    nScriptCheckThreads = GetArg("-par", 0);
+    if (nScriptCheckThreads <= 0)
+    {
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    }
+    if (nScriptCheckThreads <= 1)
+    {
+        nScriptCheckThreads = 0;
+    }
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+    {
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    }
+
+    // -stakethreads=1 searches on the stake miner thread alone
+    nStakeThreads = GetArg("-stakethreads", 1);
+    if (nStakeThreads <= 0)
+    {
+        nStakeThreads += boost::thread::hardware_concurrency();
+    }
+    if (nStakeThreads <= 1)
+    {
+        nStakeThreads = 0;
+    }
+    else if (nStakeThreads > MAX_STAKE_THREADS)
+    {
+        nStakeThreads = MAX_STAKE_THREADS;
+    }
+
     nDerivationMethodIndex = 0;
 
 #if TESTNET_BUILD
@@ -1314,6 +1366,22 @@ bool AppInit2()
         }
     }
 
+    // colors left out of staking, by color number or by ticker
+    for (int nColor=1; nColor < N_COLORS; ++nColor)
+    {
+        char cArg[30];
+        snprintf(cArg, sizeof(cArg), "-stake_%d", nColor);
+        if (mapArgs.count(cArg))
+        {
+            vStakeColorEnabled[nColor] = GetBoolArg(cArg, true);
+        }
+        snprintf(cArg, sizeof(cArg), "-stake_%s", COLOR_TICKER[nColor]);
+        if (mapArgs.count(cArg))
+        {
+            vStakeColorEnabled[nColor] = GetBoolArg(cArg, true);
+        }
+    }
+
     // TODO: replace this by DNSseed
     // AddOneShot(string(""));
 
@@ -1321,6 +1389,19 @@ bool AppInit2()
 
     nMaxHeight = GetArg("-maxheight", (int64_t) -1);
 
+    // the block connecting thread joins the pool as the last worker
+    if (nScriptCheckThreads)
+    {
+        printf("Using %d threads for script verification\n", nScriptCheckThreads);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        {
+            if (!NewThread(ThreadScriptCheck, NULL))
+            {
+                printf("Error: NewThread(ThreadScriptCheck) failed\n");
+            }
+        }
+    }
+
     if (!bitdb.Open(GetDataDir()))
     {
         string msg = strprintf(_("Error initializing database environment %s!"
@@ -1630,8 +1711,9 @@ bool AppInit2()
     // ***** Breakout Explore: build / reindex / auto-heal the explore index *****
     // The explore index lives in its own database (exploredb), separate from
     // the transaction index, so it can be cleared and rebuilt independently.
-    // Rebuild it whenever it is missing or out of sync with the chain tip, or
-    // when -reindexexplore is given.
+    // Rebuild it when it is missing or off the main chain, or when
+    // -reindexexplore is given. If it is only behind (e.g. an interrupted
+    // rebuild, which checkpoints as it goes) it catches up from where it is.
     if (fWithExploreAPI)
     {
         CExploreDB exploredb("cr+");   // create if missing
@@ -1645,8 +1727,17 @@ bool AppInit2()
         uint256 hashChainBest = pindexBest ? pindexBest->GetBlockHash()
                                            : uint256(0);
 
-        if (!fReindex &&
-            (!fHaveExploreBest || (hashExploreBest != hashChainBest)))
+        CBlockIndex* pindexExploreBest = NULL;
+        if (fHaveExploreBest)
+        {
+            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashExploreBest);
+            if ((mi != mapBlockIndex.end()) && mi->second->IsInMainChain())
+            {
+                pindexExploreBest = mi->second;
+            }
+        }
+
+        if (!fReindex && (pindexExploreBest == NULL))
         {
             printf("Breakout Explore index out of sync "
                    "(explore best %s, chain best %s); rebuilding.\n",
@@ -1655,45 +1746,62 @@ bool AppInit2()
             fReindex = true;
         }
 
+        CBlockIndex* pindexFirst = NULL;
         if (fReindex)
         {
             uiInterface.InitMessage(_("Clearing the Breakout Explore index."));
             printf("Clearing the Breakout Explore index.\n");
             exploredb.ClearAll();
             mapAddressBalances.clear();
+            pindexFirst = pindexGenesisBlock;
+        }
+        else
+        {
+            // the rich lists are kept in memory: take them from the snapshot
+            // of the last clean shutdown, else rebuild them from the sets
+            if (!exploredb.ReadRichListSnapshot(mapAddressBalances) &&
+                !exploredb.ReadRichLists(ADDR_SET_BAL, mapAddressBalances))
+            {
+                return InitError(_("Breakout Explore: "
+                                   "failed to load the balance sets."));
+            }
+            pindexFirst = pindexExploreBest->pnext;
+            if (pindexFirst)
+            {
+                printf("Breakout Explore index at height %d "
+                       "(chain best %s); catching up.\n",
+                       nExploreBestHeight, hashChainBest.ToString().c_str());
+            }
+        }
 
+        if (pindexFirst)
+        {
             uiInterface.InitMessage(_("Reindexing the Breakout Explore index."));
             printf("Reindexing the Breakout Explore index.\n");
 
             // suppress the per-record explore debug spam during the bulk rebuild
             fReindexExplore = true;
 
+            int nBlocksPerCommit = GetArg("-explorebatch", EXPLORE_BLOCKS_PER_COMMIT);
+            if (nBlocksPerCommit < 1)
+            {
+                nBlocksPerCommit = 1;
+            }
+
             CTxDB txdb("r");
-            CBlockIndex* pindex = pindexGenesisBlock;
             int count = 0;
-            while (pindex && !fRequestShutdown)
+            // the rebuild shares -par with script checking
+            if (!ExploreConnectBlocks(txdb, exploredb, pindexFirst,
+                                      nBlocksPerCommit, EXPLORE_MAX_PENDING,
+                                      nScriptCheckThreads, count))
             {
-                if ((count > 0) && ((count % 10000) == 0))
-                {
-                    printf("Reindexed %d blocks for Breakout Explore\n", count);
-                }
-                CBlock block;
-                if (!block.ReadFromDisk(pindex, true))
-                {
-                    return InitError(_("Breakout Explore reindex: "
-                                       "failed to read a block from disk."));
-                }
-                if (!ExploreConnectBlock(txdb, exploredb, &block))
-                {
-                    return InitError(_("Breakout Explore reindex: "
-                                       "ExploreConnectBlock failed."));
-                }
-                count += 1;
-                pindex = pindex->pnext;
+                return InitError(_("Breakout Explore reindex: "
+                                   "ExploreConnectBlocks failed."));
             }
             fReindexExplore = false;
             printf("Reindexed %d blocks for Breakout Explore.\n", count);
         }
+        fExploreRichListLoaded = true;
     }
 
     // ********************************************************* Step 10: load peers
@@ -8,6 +8,7 @@
 
 #include "kernel.h"
 #include "txdb-leveldb.h"
+#include "checkqueue.h"
 
 using namespace std;
 
@@ -270,25 +271,20 @@ uint256 ComputeStakeModifier(const CBlockIndex* pindexPrev, const uint256& kerne
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlock& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+static bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, int64_t nValueIn, int nColor, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    if (nTimeTx < nTimeTxPrev)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
-
     // Base target
     CBigNum bnTarget;
     bnTarget.SetCompact(nBits);
 
     // Weighted target
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
     CBigNum bnWeight = CBigNum(nValueIn);
     bnTarget *= bnWeight;
 
     // TODO: is ths check really necessary?
-    int nColor = txPrev.vout[prevout.n].nColor;
-
     if (!CanStake(nColor))
     {
           return false;
@@ -303,7 +299,7 @@ bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBl
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
     ss << bnStakeModifier;
-    ss << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
+    ss << nTimeTxPrev << prevout.hash << prevout.n << nTimeTx;
     hashProofOfStake = Hash(ss.begin(), ss.end());
     if (fPrintProofOfStake)
     {
@@ -313,7 +309,7 @@ bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBl
             DateTimeStrFormat(nTimeBlockFrom).c_str());
         printf("CheckStakeKernelHash() : check modifier=%s nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             bnStakeModifier.ToString().c_str(),
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString().c_str());
     }
 
@@ -333,13 +329,21 @@ bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBl
             DateTimeStrFormat(nTimeBlockFrom).c_str());
         printf("CheckStakeKernelHash() : pass modifier=%s nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             bnStakeModifier.ToString().c_str(),
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTimeTxPrev, prevout.n, nTimeTx,
             hashProofOfStake.ToString().c_str());
     }
     return true;
 
 }
 
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlock& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, bool fPrintProofOfStake)
+{
+    const CTxOut& txout = txPrev.vout[prevout.n];
+    return CheckStakeKernelHash(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev.nTime,
+                                txout.nValue, txout.nColor, prevout, nTimeTx,
+                                hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake)
 {
@@ -412,6 +416,96 @@ bool CheckKernel(int nStakeColor, CBlockIndex* pindexPrev, unsigned int nBits,
     return CheckStakeKernelHash(pindexPrev, nBits, block, txPrev, prevout, nTime, hashProofOfStake, targetProofOfStake);
 }
 
+bool ReadStakeKernelCandidate(const COutPoint& prevout, CStakeKernelCandidate& candidate)
+{
+    CTxDB txdb("r");
+    CTransaction txPrev;
+    CTxIndex txindex;
+    if (!txPrev.ReadFromDisk(txdb, prevout, txindex))
+        return false;
+
+    // Read block header
+    CBlock block;
+    if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+        return false;
+
+    candidate.posBlockFrom = txindex.pos;
+    candidate.nTimeBlockFrom = block.GetBlockTime();
+    candidate.nTimeTxPrev = txPrev.nTime;
+    candidate.nValue = txPrev.vout[prevout.n].nValue;
+    candidate.nColor = txPrev.vout[prevout.n].nColor;
+    return true;
+}
+
+bool CheckKernel(int nStakeColor, CBlockIndex* pindexPrev, unsigned int nBits,
+                 int64_t nTime, const COutPoint& prevout, const CStakeKernelCandidate& candidate)
+{
+    uint256 hashProofOfStake, targetProofOfStake;
+
+    int nStakeMinConfs = GetStakeMinConfirmations(nStakeColor);
+
+    int nDepth;
+    if (IsConfirmedInNPrevBlocks(candidate.posBlockFrom, pindexPrev, nStakeMinConfs - 1, nDepth))
+        return false;
+
+    return CheckStakeKernelHash(pindexPrev, nBits, candidate.nTimeBlockFrom, candidate.nTimeTxPrev,
+                                candidate.nValue, candidate.nColor, prevout, nTime,
+                                hashProofOfStake, targetProofOfStake, false);
+}
+
+void CStakeKernelResult::Set(int nColorIn, const COutPoint& prevoutIn, int64_t nTimeIn)
+{
+    LOCK(cs);
+    if (fFound)
+        return;
+    nColor = nColorIn;
+    prevout = prevoutIn;
+    nTime = nTimeIn;
+    fFound = true;
+}
+
+bool CStakeKernelCheck::operator()()
+{
+    BOOST_FOREACH(const CStakeKernelCoin& coin, vCoins)
+    {
+        for (int64_t n = 0; n < nSearchInterval; n++)
+        {
+            if (presult->fFound || presult->nTipGeneration != nBestChainGeneration || fShutdown)
+                return true;
+            if (CheckKernel(coin.nColor, pindexPrev, nBits, nTime - n, coin.prevout, coin.candidate))
+            {
+                presult->Set(coin.nColor, coin.prevout, nTime - n);
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+static CCheckQueue<CStakeKernelCheck> stakekernelqueue(16);
+
+void ThreadStakeKernelCheck(void* parg)
+{
+    RenameThread("breakout-stakekern");
+    stakekernelqueue.Thread();
+}
+
+bool SearchStakeKernels(std::vector<CStakeKernelCheck>& vChecks)
+{
+    if (!nStakeThreads)
+    {
+        BOOST_FOREACH(CStakeKernelCheck& check, vChecks)
+            if (!check())
+                return false;
+        return true;
+    }
+
+    // the stake miner joins the pool as the last worker
+    CCheckQueueControl<CStakeKernelCheck> control(&stakekernelqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 // Get stake modifier checksum
 unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
 {
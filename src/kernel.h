@@ -4,6 +4,8 @@
 #ifndef PPCOIN_KERNEL_H
 #define PPCOIN_KERNEL_H
 
+#include <atomic>
+
 #include "main.h"
 
 
@@ -36,4 +38,107 @@ int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd, int nColor,
 bool CheckKernel(int nStakeColor, CBlockIndex* pindexPrev, unsigned int nBits,
                  int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime = NULL);
 
+// What the kernel protocol needs to know about a staked output. Read once
+// with ReadStakeKernelCandidate(), it lets a kernel search try every
+// timestamp without going back to the tx index or the block files.
+class CStakeKernelCandidate
+{
+public:
+    CDiskTxPos posBlockFrom;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTimeTxPrev;
+    int64_t nValue;
+    int nColor;
+
+    CStakeKernelCandidate()
+    {
+        nTimeBlockFrom = 0;
+        nTimeTxPrev = 0;
+        nValue = 0;
+        nColor = 0;
+    }
+};
+
+bool ReadStakeKernelCandidate(const COutPoint& prevout, CStakeKernelCandidate& candidate);
+// Same as CheckKernel() above, for a candidate already read
+bool CheckKernel(int nStakeColor, CBlockIndex* pindexPrev, unsigned int nBits,
+                 int64_t nTime, const COutPoint& prevout, const CStakeKernelCandidate& candidate);
+
+// Where a kernel search ended up. The first kernel found wins; later
+// ones are ignored.
+class CStakeKernelResult
+{
+public:
+    std::atomic<bool> fFound;
+    int nColor;
+    COutPoint prevout;
+    int64_t nTime;
+    // nBestChainGeneration the search was started at
+    unsigned int nTipGeneration;
+
+    CStakeKernelResult() : fFound(false), nColor(0), nTime(0), nTipGeneration(0) {}
+
+    void Set(int nColorIn, const COutPoint& prevoutIn, int64_t nTimeIn);
+
+private:
+    CCriticalSection cs;
+};
+
+// A staked output a kernel search tries
+struct CStakeKernelCoin
+{
+    int nColor;
+    COutPoint prevout;
+    CStakeKernelCandidate candidate;
+
+    CStakeKernelCoin() : nColor(0) {}
+    CStakeKernelCoin(int nColorIn, const COutPoint& prevoutIn, const CStakeKernelCandidate& candidateIn) :
+        nColor(nColorIn), prevout(prevoutIn), candidate(candidateIn) { }
+};
+
+/** Closure searching a few staked outputs for a kernel, each over
+ *  nSearchInterval timestamps back from nTime. A kernel found goes to the
+ *  shared CStakeKernelResult, and the search stops early once there is one
+ *  or a new best block made it stale. None of these is a failure: the
+ *  result is true, as CCheckQueue would stop every other check on false.
+ */
+class CStakeKernelCheck
+{
+private:
+    CBlockIndex* pindexPrev;
+    unsigned int nBits;
+    int64_t nTime;
+    int64_t nSearchInterval;
+    std::vector<CStakeKernelCoin> vCoins;
+    CStakeKernelResult* presult;
+
+public:
+    CStakeKernelCheck() : pindexPrev(NULL), nBits(0), nTime(0), nSearchInterval(0), presult(NULL) {}
+    CStakeKernelCheck(CBlockIndex* pindexPrevIn, unsigned int nBitsIn, int64_t nTimeIn, int64_t nSearchIntervalIn,
+                      CStakeKernelResult* presultIn) :
+        pindexPrev(pindexPrevIn), nBits(nBitsIn), nTime(nTimeIn), nSearchInterval(nSearchIntervalIn),
+        presult(presultIn) { }
+
+    void AddCoin(const CStakeKernelCoin& coin)
+    {
+        vCoins.push_back(coin);
+    }
+
+    bool operator()();
+
+    void swap(CStakeKernelCheck &check) {
+        std::swap(pindexPrev, check.pindexPrev);
+        std::swap(nBits, check.nBits);
+        std::swap(nTime, check.nTime);
+        std::swap(nSearchInterval, check.nSearchInterval);
+        vCoins.swap(check.vCoins);
+        std::swap(presult, check.presult);
+    }
+};
+
+// Run kernel checks, on the -stakethreads pool if there is one. Returns
+// false if a check failed; whether a kernel was found is in the result.
+bool SearchStakeKernels(std::vector<CStakeKernelCheck>& vChecks);
+void ThreadStakeKernelCheck(void* parg);
+
 #endif // PPCOIN_KERNEL_H
@@ -12,6 +12,11 @@
 
 #include "key.h"
 
+// CPubKey::Verify() through the EVP_PKEY interface (1) or on the curve (0)
+#ifndef USE_EVP_ECDSA
+#define USE_EVP_ECDSA 0
+#endif
+
 
 // anonymous namespace with local implementation code (OpenSSL interaction)
 namespace {
@@ -42,16 +47,12 @@ struct Bn {
     operator BIGNUM*() { return bn; }
 };
 
-struct EcGroup {
-    EC_GROUP* group;
-    explicit EcGroup(int nid) : group(EC_GROUP_new_by_curve_name(nid)) {
-        if (!group) throw std::runtime_error("EC_GROUP_new_by_curve_name failed");
-    }
-    ~EcGroup() { EC_GROUP_free(group); }
-    EcGroup(const EcGroup&) = delete;
-    EcGroup& operator=(const EcGroup&) = delete;
-    operator EC_GROUP*() { return group; }
-};
+const EC_GROUP* GetSecp256k1Group()
+{
+    static const EC_GROUP* group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+    if (!group) throw std::runtime_error("EC_GROUP_new_by_curve_name failed");
+    return group;
+}
 
 struct EcPoint {
     EC_POINT* point;
@@ -158,7 +159,7 @@ struct EcdsaSig {
 static EvpPkey BuildPrivateKey(const unsigned char vch[32],
                                const char* point_format = nullptr)
 {
-    EcGroup group(NID_secp256k1);
+    const EC_GROUP* group = GetSecp256k1Group();
     Bn bn_priv(BN_bin2bn(vch, 32, BN_new()));
 
     // Compute the public key point
@@ -270,7 +271,7 @@ static size_t GetPubKeyBytes(EVP_PKEY* pkey, unsigned char out[65], bool fCompre
     }
 
     // Re-encode as compressed via EC_POINT
-    EcGroup group(NID_secp256k1);
+    const EC_GROUP* group = GetSecp256k1Group();
     BnCtx ctx;
     EcPoint point(group);
     if (!EC_POINT_oct2point(group, point, raw, rawlen, ctx))
@@ -294,7 +295,7 @@ static bool RecoverPublicKey(const unsigned char* msg, int msglen,
     const BIGNUM* sig_s;
     ECDSA_SIG_get0(ecsig, &sig_r, &sig_s);
 
-    EcGroup group(NID_secp256k1);
+    const EC_GROUP* group = GetSecp256k1Group();
     BnCtx ctx;
 
     BIGNUM* order  = BN_CTX_get(ctx);
@@ -342,6 +343,91 @@ static bool RecoverPublicKey(const unsigned char* msg, int msglen,
 }
 
 
+//
+// Parse a DER signature. Length fields padded with zeros past 4 bytes are
+// cut back first, as the verification the chain was validated with did.
+// Returns nullptr if the signature does not parse.
+//
+static ECDSA_SIG* ParseSignature(const valtype& vchSigParam)
+{
+    // Strip non-canonical extra length bytes
+    valtype vchSig(vchSigParam.begin(), vchSigParam.end());
+    if (vchSig.size() > 1 && vchSig[1] & 0x80)
+    {
+        unsigned char nLengthBytes = vchSig[1] & 0x7f;
+        if (static_cast<int>(vchSig.size()) < 2 + nLengthBytes)
+        {
+            return nullptr;
+        }
+        if (nLengthBytes > 4)
+        {
+            unsigned char nExtraBytes = nLengthBytes - 4;
+            for (unsigned char i = 0; i < nExtraBytes; i++)
+            {
+                if (vchSig[2 + i])
+                {
+                    return nullptr;
+                }
+            }
+            vchSig.erase(vchSig.begin() + 2,
+                         vchSig.begin() + 2 + nExtraBytes);
+            vchSig[1] = 0x80 | (nLengthBytes - nExtraBytes);
+        }
+    }
+    if (vchSig.empty())
+    {
+        return nullptr;
+    }
+
+    const unsigned char* sigptr = &vchSig[0];
+    return d2i_ECDSA_SIG(nullptr, &sigptr, vchSig.size());
+}
+
+//
+// ECDSA verification worked straight on the curve, as OpenSSL's own
+// verify does under EVP_PKEY_verify() but without building an EVP_PKEY and
+// a provider context for every signature:
+//   w = 1/s, u1 = e*w, u2 = r*w, and X = u1*G + u2*Q must have x = r mod n
+// The digest is as wide as the order, so it is used untruncated.
+//
+static bool VerifyOnCurve(const unsigned char* pub, size_t publen,
+                          const uint256& hash, const ECDSA_SIG* sig)
+{
+    const EC_GROUP* group = GetSecp256k1Group();
+    const BIGNUM* order = EC_GROUP_get0_order(group);
+
+    const BIGNUM* sig_r;
+    const BIGNUM* sig_s;
+    ECDSA_SIG_get0(sig, &sig_r, &sig_s);
+    if (BN_is_zero(sig_r) || BN_is_negative(sig_r) || BN_ucmp(sig_r, order) >= 0 ||
+        BN_is_zero(sig_s) || BN_is_negative(sig_s) || BN_ucmp(sig_s, order) >= 0)
+        return false;
+
+    BnCtx ctx;
+    EcPoint Q(group);
+    if (!EC_POINT_oct2point(group, Q, pub, publen, ctx))
+        return false;
+
+    BIGNUM* e  = BN_CTX_get(ctx);
+    BIGNUM* w  = BN_CTX_get(ctx);
+    BIGNUM* u1 = BN_CTX_get(ctx);
+    BIGNUM* u2 = BN_CTX_get(ctx);
+    BIGNUM* x  = BN_CTX_get(ctx);
+    if (!x) return false;
+
+    if (!BN_bin2bn(reinterpret_cast<const unsigned char*>(&hash), sizeof(hash), e)) return false;
+    if (!BN_mod_inverse(w, sig_s, order, ctx))                        return false;
+    if (!BN_mod_mul(u1, e, w, order, ctx))                            return false;
+    if (!BN_mod_mul(u2, sig_r, w, order, ctx))                        return false;
+
+    EcPoint X(group);
+    if (!EC_POINT_mul(group, X, u1, Q, u2, ctx))                      return false;
+    if (EC_POINT_is_at_infinity(group, X))                            return false;
+    if (!EC_POINT_get_affine_coordinates(group, X, x, nullptr, ctx))  return false;
+    if (!BN_nnmod(x, x, order, ctx))                                  return false;
+    return BN_ucmp(x, sig_r) == 0;
+}
+
 //
 // CECKey: wraps an EVP_PKEY secp256k1 key pair using the OpenSSL 3.0 EVP API.
 //
@@ -449,7 +535,7 @@ public:
             const BIGNUM* sig_s;
             ECDSA_SIG_get0(sig, &sig_r, &sig_s);
 
-            EcGroup group(NID_secp256k1);
+            const EC_GROUP* group = GetSecp256k1Group();
             BnCtx ctx;
             Bn order, halforder;
             EC_GROUP_get_order(group, order, ctx);
@@ -474,48 +560,11 @@ public:
         return true;
     }
 
-    bool Verify(const uint256& hash, const valtype& vchSigParam)
+    bool Verify(const uint256& hash, const ECDSA_SIG* sig)
     {
-        // Strip non-canonical extra length bytes
-        valtype vchSig(vchSigParam.begin(), vchSigParam.end());
-        if (vchSig.size() > 1 && vchSig[1] & 0x80)
-        {
-            unsigned char nLengthBytes = vchSig[1] & 0x7f;
-            if (static_cast<int>(vchSig.size()) < 2 + nLengthBytes)
-            {
-                return false;
-            }
-            if (nLengthBytes > 4)
-            {
-                unsigned char nExtraBytes = nLengthBytes - 4;
-                for (unsigned char i = 0; i < nExtraBytes; i++)
-                {
-                    if (vchSig[2 + i])
-                    {
-                        return false;
-                    }
-                }
-                vchSig.erase(vchSig.begin() + 2,
-                             vchSig.begin() + 2 + nExtraBytes);
-                vchSig[1] = 0x80 | (nLengthBytes - nExtraBytes);
-            }
-        }
-        if (vchSig.empty())
-        {
-            return false;
-        }
-
         // Re-serialise to canonical DER
-        const unsigned char* sigptr = &vchSig[0];
-        EcdsaSig norm_sig(EcdsaSig::from_untrusted,
-                          d2i_ECDSA_SIG(nullptr, &sigptr, vchSig.size()));
-        if (!norm_sig.sig)
-        {
-            return false;
-        }
-
         unsigned char* norm_der = nullptr;
-        int derlen = i2d_ECDSA_SIG(norm_sig, &norm_der);
+        int derlen = i2d_ECDSA_SIG(sig, &norm_der);
         if (derlen <= 0) return false;
 
         EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new(pkey, nullptr);
@@ -569,7 +618,7 @@ public:
             // Compress the recovered point for comparison
             unsigned char rec_compressed[33];
             {
-                EcGroup group(NID_secp256k1);
+                const EC_GROUP* group = GetSecp256k1Group();
                 BnCtx ctx;
                 EcPoint point(group);
                 EC_POINT_oct2point(group, point, rec_pub, rec_pub_len, ctx);
@@ -623,7 +672,7 @@ public:
     {
         try {
             BnCtx ctx;
-            EcGroup group(NID_secp256k1);
+            const EC_GROUP* group = GetSecp256k1Group();
             Bn bnOrder;
             EC_GROUP_get_order(group, bnOrder, ctx);
 
@@ -649,7 +698,7 @@ public:
     bool TweakPublic(const unsigned char vchTweak[32]) {
         try {
             BnCtx ctx;
-            EcGroup group(NID_secp256k1);
+            const EC_GROUP* group = GetSecp256k1Group();
             Bn bnOrder;
             EC_GROUP_get_order(group, bnOrder, ctx);
 
@@ -867,6 +916,15 @@ bool CKey::Load(CPrivKey& privkey, CPubKey& vchPubKey, bool fSkipCheck)
 }
 
 bool CPubKey::Verify(const uint256& hash, const valtype& vchSig) const
+{
+#if USE_EVP_ECDSA
+    return VerifyEVP(hash, vchSig);
+#else
+    return VerifyEC(hash, vchSig);
+#endif
+}
+
+bool CPubKey::VerifyEVP(const uint256& hash, const valtype& vchSig) const
 {
     if (!IsValid())
     {
@@ -877,7 +935,26 @@ bool CPubKey::Verify(const uint256& hash, const valtype& vchSig) const
     {
         return false;
     }
-    return key.Verify(hash, vchSig);
+    EcdsaSig sig(EcdsaSig::from_untrusted, ParseSignature(vchSig));
+    if (!sig.sig)
+    {
+        return false;
+    }
+    return key.Verify(hash, sig);
+}
+
+bool CPubKey::VerifyEC(const uint256& hash, const valtype& vchSig) const
+{
+    if (!IsValid())
+    {
+        return false;
+    }
+    EcdsaSig sig(EcdsaSig::from_untrusted, ParseSignature(vchSig));
+    if (!sig.sig)
+    {
+        return false;
+    }
+    return VerifyOnCurve(begin(), size(), hash, sig);
 }
 
 bool CPubKey::RecoverCompact(const uint256& hash, const valtype& vchSig) {
@@ -44,6 +44,12 @@ public:
     explicit key_error(const std::string& str) : std::runtime_error(str) {}
 };
 
+typedef struct ec_group_st EC_GROUP;
+
+// The secp256k1 group, made on first use and never freed. OpenSSL only
+// reads a group once it is built, so every caller and thread shares it.
+const EC_GROUP* GetSecp256k1Group();
+
 
 
 /** A reference to a CKey: the Hash160 of its serialized public key */
@@ -245,6 +251,13 @@ public:
     // If this public key is not fully valid, the return value will be false.
     bool Verify(const uint256 &hash, const valtype& vchSig) const;
 
+    // Verify() goes through one of these, picked at build time by
+    // USE_EVP_ECDSA: the OpenSSL EVP_PKEY interface, or the ECDSA equation
+    // worked straight on the curve (the default). Both are built so they
+    // can be checked against each other.
+    bool VerifyEVP(const uint256 &hash, const valtype& vchSig) const;
+    bool VerifyEC(const uint256 &hash, const valtype& vchSig) const;
+
     // Verify a compact signature (~65 bytes).
     // See CKey::SignCompact.
     bool VerifyCompact(const uint256 &hash, const valtype& vchSig) const;
@@ -16,10 +16,15 @@
 #include "ui_interface.h"
 #include "kernel.h"
 #include "stealth.h"
+#include "checkqueue.h"
+
+#include "ethash/ethash-internal.hpp"
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 using namespace std;
 using namespace boost;
@@ -54,8 +59,12 @@ uint256 nBestInvalidTrust = 0;
 
 uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
+std::atomic<unsigned int> nBestChainGeneration(0);
 int64_t nTimeBestReceived = 0;
 bool fImporting = false;
+int nScriptCheckThreads = 0;
+int nStakeThreads = 0;
+bool fHeadersFirst = true;
 
 // Amount of blocks that other nodes claim to have
 CMedianFilter<int> cPeerBlockCounts(5, 0);
@@ -95,6 +104,7 @@ int nNumberOfStakingCurrencies = 0;
 
 vector<int64_t> vTransactionFee(MIN_TX_FEE, MIN_TX_FEE + N_COLORS);
 vector<int64_t> vReserveBalance(N_COLORS, 0);
+vector<bool> vStakeColorEnabled(N_COLORS, true);
 vector<int64_t> vMinimumInputValue(MIN_INPUT_VALUE,
                                    MIN_INPUT_VALUE + N_COLORS);
 // Minimum amount stake can be split into, to avoid overwhelming UTXOs
@@ -182,6 +192,24 @@ void SyncWithWallets(const CTransaction& tx,
     }
 }
 
+// make sure all wallets know about the transactions of a block, with the
+// stealth outputs of the whole block scanned for in one batch
+void SyncBlockWithWallets(const CBlock& block, bool fUpdate)
+{
+    BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+    {
+        pwallet->ScanStealthBlock(block);
+    }
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        SyncWithWallets(tx, &block, fUpdate);
+    }
+    BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+    {
+        pwallet->ClearStealthScan();
+    }
+}
+
 // notify wallets about a new best chain
 void static SetBestChain(const CBlockLocator& loc)
 {
@@ -385,7 +413,7 @@ bool CTransaction::ReadFromDisk(CTxDB& txdb,
     {
         return false;
     }
-    if (!ReadFromDisk(txindexRet.pos))
+    if (!txdb.ReadTx(prevout.hash, txindexRet.pos, *this))
     {
         return false;
     }
@@ -1109,6 +1137,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
     // call CTxMemPool::accept to properly check the transaction first.
     {
         mapTx[hash] = tx;
+        mapTx[hash].CacheHash();
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
         nTransactionsUpdated++;
@@ -1667,7 +1696,7 @@ unsigned int BreakoutGravityWave(unsigned int nTime,
     // seconds in a day (86400 = 60 * 60 * 24)
     constexpr int64_t DAY = 86400;
 
-    CBigNum bnTargetLimit = GetTargetLimit(fProofOfStake, nTime);
+    const arith_uint256& bnTargetLimit = GetArithTargetLimit(fProofOfStake, nTime);
 
     // reset target if this is the first kawpow block
     if ((!fProofOfStake) && (GetFork(pindexLast->nTime) <= BRK_FORK006) &&
@@ -1695,8 +1724,8 @@ unsigned int BreakoutGravityWave(unsigned int nTime,
     int64_t LastBlockTime = 0;
     int64_t PastBlocksMin = BLOCKSPAN;
     int64_t CountBlocks = 0;
-    CBigNum PastDifficultyAverage;
-    CBigNum PastDifficultyAveragePrev;
+    arith_uint256 PastDifficultyAverage;
+    arith_uint256 PastDifficultyAveragePrev;
 
     // Grab the last BLOCKSPAN blocks of this type.
     // vpIndex will be in reverse order by height.
@@ -1739,9 +1768,9 @@ unsigned int BreakoutGravityWave(unsigned int nTime,
             else
             {
                 PastDifficultyAverage =
-                       ((PastDifficultyAveragePrev * CountBlocks) +
-                        (CBigNum().SetCompact(BlockReading->nBits))) /
-                       (CountBlocks + 1);
+                       ((PastDifficultyAveragePrev * (uint32_t)CountBlocks) +
+                        (arith_uint256().SetCompact(BlockReading->nBits))) /
+                       arith_uint256(CountBlocks + 1);
             }
             PastDifficultyAveragePrev = PastDifficultyAverage;
         }
@@ -1755,7 +1784,7 @@ unsigned int BreakoutGravityWave(unsigned int nTime,
 
     }
 
-    CBigNum bnNew(PastDifficultyAverage);
+    arith_uint256 bnNew(PastDifficultyAverage);
 
     const int64_t nTargetSpacing = GetTargetSpacing(fProofOfStake,
                                                     pindexLast->nTime);
@@ -1788,16 +1817,33 @@ unsigned int BreakoutGravityWave(unsigned int nTime,
         }
     }
 
-    // Retarget
-    bnNew *= nActualTimespan;
-    bnNew /= _nTargetTimespan;
+    bnNew = RetargetTarget(bnNew, nActualTimespan, _nTargetTimespan, bnTargetLimit);
+    return bnNew.GetCompact();
+}
 
-    if (bnNew > bnTargetLimit)
+// Retarget: bnTarget * nActualTimespan / nTargetTimespan, at most bnLimit.
+// The virtual days of BreakoutGravityWave can stretch the timespan far
+// enough for the product to pass 2^256, so it is split as q * actual +
+// r * actual / target (q, r from bnTarget / nTargetTimespan), and a result
+// that would not fit is clamped to the limit like any other oversized one.
+arith_uint256 RetargetTarget(const arith_uint256& bnTarget, int64_t nActualTimespan,
+                             int64_t nTargetTimespan, const arith_uint256& bnLimit)
+{
+    const arith_uint256 bnActualTimespan(nActualTimespan);
+    const arith_uint256 bnTargetTimespan(nTargetTimespan);
+    arith_uint256 bnQuotient = bnTarget / bnTargetTimespan;
+    arith_uint256 bnRemainder = bnTarget - bnQuotient * bnTargetTimespan;
+    arith_uint256 bnNew = bnRemainder * bnActualTimespan / bnTargetTimespan;
+    if (bnQuotient > (~arith_uint256(0) - bnNew) / bnActualTimespan)
     {
-        bnNew = bnTargetLimit;
+        return bnLimit;
     }
-
-    return bnNew.GetCompact();
+    bnNew = bnNew + bnQuotient * bnActualTimespan;
+    if (bnNew > bnLimit)
+    {
+        return bnLimit;
+    }
+    return bnNew;
 }
 
 
@@ -1812,18 +1858,19 @@ unsigned int GetNextTargetRequired(unsigned int nTime,
 
 bool CheckSHA256ProofOfWork(uint256 hash, unsigned int nBits)
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative, fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
     // ADVISORY: static is an optimization, may not be desired for forks
-    static CBigNum bnTargetLimit = GetTargetLimit(false, BRK_GENESIS_TIME);
+    static const arith_uint256 bnTargetLimit = GetArithTargetLimit(false, BRK_GENESIS_TIME);
 
     // Check range
-    if (bnTarget <= 0 || bnTarget > bnTargetLimit)
+    if (fNegative || fOverflow || bnTarget == 0 || bnTarget > bnTargetLimit)
         return error("ChecSHA256kProofOfWork() : nBits below minimum work");
 
     // Check proof of work matches claimed amount
-    if (hash > bnTarget.getuint256())
+    if (UintToArith256(hash) > bnTarget)
         return error("CheckSHA256ProofOfWork() : hash doesn't match nBits");
 
     return true;
@@ -1837,12 +1884,13 @@ bool CheckKawpowProofOfWork(const CBlock* pblock)
         return false;
     }
 
-    CBigNum bnTarget;
-    bnTarget.SetCompact(pblock->nBits);
+    bool fNegative, fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(pblock->nBits, &fNegative, &fOverflow);
 
     // Check range
-    if ((bnTarget <= 0) ||
-        (bnTarget > GetTargetLimit(false, nKAWPOWActivationTime)))
+    if (fNegative || fOverflow || (bnTarget == 0) ||
+        (bnTarget > GetArithTargetLimit(false, nKAWPOWActivationTime)))
     {
         return error("CheckKawpowProofOfWork() : nBits below minimum work");
     }
@@ -1859,7 +1907,7 @@ bool CheckKawpowProofOfWork(const CBlock* pblock)
     // KAWPOWHash_OnlyMix() incorporates mix_hash into the final hash,
     // so we only need to verify it meets the target.
     uint256 calculatedHash = KAWPOWHash_OnlyMix(*pblock);
-    if (calculatedHash > bnTarget.getuint256())
+    if (UintToArith256(calculatedHash) > bnTarget)
     {
         return error("CheckKawpowProofOfWork() : hash doesn't meet target");
     }
@@ -1938,9 +1986,273 @@ void static InvalidChainFound(CBlockIndex* pindexNew)
  */
 uint256 CBlock::GetKAWPOWHeaderHash() const
 {
-    CKAWPOWInput input{*this};
+    // the kawpow header: the block header without nonce and mix hash
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << nVersion << hashPrevBlock << hashMerkleRoot << nTime << nBits << nHeight;
+    return ss.GetHash();
+}
+
+// Shared KAWPOW epoch contexts. Validation, the miner and the mining RPCs
+// all take their contexts from here. A context is built by the first caller
+// that needs it, outside the lock; others asking for the same epoch wait for
+// that one instead of building their own. Contexts beyond -kawpowcachesize
+// are dropped furthest epoch first, and live on while a caller holds them.
+static CWaitableCriticalSection cs_kawpowContexts;
+static boost::condition_variable condKawpowContexts;
+static map<int, std::shared_ptr<ethash_epoch_context> > mapKawpowContexts;
+static set<int> setKawpowContextsBuilding;
+
+static uint64_t GetKawpowContextSize(int nEpoch)
+{
+    return ethash::get_light_cache_size(ethash::calculate_light_cache_num_items(nEpoch));
+}
+
+// Light caches are also kept on disk, one file per epoch under
+// <datadir>/epochs, so a restart or a second process maps the cache instead
+// of building it again. A file is a fixed size header (version, epoch, item
+// count and a hash of the cache) followed by the light cache itself.
+static const int KAWPOW_EPOCH_FILE_VERSION = 1;
+static const size_t KAWPOW_EPOCH_FILE_HEADER_SIZE = 64;
+/** Epoch files this far behind the one being written are removed */
+static const int KAWPOW_EPOCH_FILES_KEPT = 2;
+
+static boost::filesystem::path GetKawpowEpochFilePath(int nEpoch)
+{
+    return GetDataDir() / "epochs" / strprintf("%d.cache", nEpoch);
+}
+
+// Wrap a light cache that lives elsewhere in an epoch context. Only the
+// context and its l1 cache are allocated here; pholder keeps the light cache
+// alive for as long as the context is.
+static std::shared_ptr<ethash_epoch_context> MakeKawpowEpochContext(int nEpoch,
+                        const ethash_hash512* pLightCache, std::shared_ptr<void> pholder)
+{
+    // same layout as ethash's own contexts: the context, then the l1 cache
+    const size_t nContextAllocSize = sizeof(ethash::hash512);
+    char* const pAlloc = static_cast<char*>(std::calloc(1, nContextAllocSize + progpow::l1_cache_size));
+    if (!pAlloc)
+        return std::shared_ptr<ethash_epoch_context>();
+
+    uint32_t* const pL1Cache = reinterpret_cast<uint32_t*>(pAlloc + nContextAllocSize);
+    ethash_epoch_context* pcontext = new (pAlloc) ethash_epoch_context{nEpoch,
+                        ethash::calculate_light_cache_num_items(nEpoch), pLightCache, pL1Cache,
+                        ethash::calculate_full_dataset_num_items(nEpoch)};
+
+    ethash::hash2048* pL1Items = reinterpret_cast<ethash::hash2048*>(pL1Cache);
+    for (uint32_t i = 0; i < progpow::l1_cache_size / sizeof(ethash::hash2048); ++i)
+        pL1Items[i] = ethash::calculate_dataset_item_2048(*pcontext, i);
+
+    return std::shared_ptr<ethash_epoch_context>(pcontext, [pholder](ethash_epoch_context* p) {
+        p->~ethash_epoch_context();
+        std::free(p);
+    });
+}
+
+// Map the light cache of nEpoch from its file. Returns an empty pointer if
+// there is no file; a file that fails the checks is removed.
+static std::shared_ptr<ethash_epoch_context> LoadKawpowEpochFile(int nEpoch)
+{
+    std::shared_ptr<ethash_epoch_context> context;
+    boost::filesystem::path pathEpoch = GetKawpowEpochFilePath(nEpoch);
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(pathEpoch, ec))
+        return context;
+
+    const int nItems = ethash::calculate_light_cache_num_items(nEpoch);
+    const size_t nCacheSize = ethash::get_light_cache_size(nItems);
+    try
+    {
+        boost::interprocess::file_mapping mapping(pathEpoch.string().c_str(), boost::interprocess::read_only);
+        std::shared_ptr<boost::interprocess::mapped_region> pregion =
+                std::make_shared<boost::interprocess::mapped_region>(mapping, boost::interprocess::read_only);
+        if (pregion->get_size() != KAWPOW_EPOCH_FILE_HEADER_SIZE + nCacheSize)
+            throw runtime_error("wrong size");
+
+        const char* pBegin = static_cast<const char*>(pregion->get_address());
+        CDataStream ssHeader(pBegin, pBegin + KAWPOW_EPOCH_FILE_HEADER_SIZE, SER_DISK, CLIENT_VERSION);
+        int nFileVersion, nFileEpoch, nFileItems;
+        uint256 hashCache;
+        ssHeader >> nFileVersion >> nFileEpoch >> nFileItems >> hashCache;
+        if (nFileVersion != KAWPOW_EPOCH_FILE_VERSION || nFileEpoch != nEpoch || nFileItems != nItems)
+            throw runtime_error("header mismatch");
+
+        const char* pCache = pBegin + KAWPOW_EPOCH_FILE_HEADER_SIZE;
+        if (Hash(pCache, pCache + nCacheSize) != hashCache)
+            throw runtime_error("checksum mismatch");
+
+        context = MakeKawpowEpochContext(nEpoch, reinterpret_cast<const ethash_hash512*>(pCache), pregion);
+    }
+    catch (std::exception& e)
+    {
+        printf("LoadKawpowEpochFile() : discarding %s: %s\n", pathEpoch.string().c_str(), e.what());
+        boost::filesystem::remove(pathEpoch, ec);
+    }
+    return context;
+}
+
+static bool WriteKawpowEpochFile(const ethash_epoch_context& context)
+{
+    const int nEpoch = context.epoch_number;
+    const size_t nCacheSize = ethash::get_light_cache_size(context.light_cache_num_items);
+    const char* pCache = reinterpret_cast<const char*>(context.light_cache);
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << KAWPOW_EPOCH_FILE_VERSION << nEpoch << context.light_cache_num_items;
+    ssHeader << Hash(pCache, pCache + nCacheSize);
+    ssHeader.resize(KAWPOW_EPOCH_FILE_HEADER_SIZE);
+
+    boost::filesystem::path pathEpoch = GetKawpowEpochFilePath(nEpoch);
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(pathEpoch.parent_path(), ec);
+
+    // write to a temp file and rename it into place, so other processes
+    // never map a partial file
+    unsigned short randv = 0;
+    RAND_bytes((unsigned char *)&randv, sizeof(randv));
+    boost::filesystem::path pathTmp = pathEpoch.parent_path() / strprintf("%d.cache.%04x", nEpoch, randv);
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("WriteKawpowEpochFile() : open failed");
+    try {
+        fileout.write(&ssHeader[0], ssHeader.size());
+        fileout.write(pCache, nCacheSize);
+    }
+    catch (std::exception &e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp, ec);
+        return error("WriteKawpowEpochFile() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+    if (!RenameOver(pathTmp, pathEpoch))
+    {
+        boost::filesystem::remove(pathTmp, ec);
+        return error("WriteKawpowEpochFile() : Rename-into-place failed");
+    }
+
+    // drop the files of epochs the chain has left behind
+    for (int nOld = nEpoch - KAWPOW_EPOCH_FILES_KEPT - 1; nOld >= 0; --nOld)
+    {
+        boost::filesystem::path pathOld = GetKawpowEpochFilePath(nOld);
+        if (!boost::filesystem::exists(pathOld, ec))
+            break;
+        boost::filesystem::remove(pathOld, ec);
+    }
+    return true;
+}
+
+std::shared_ptr<ethash_epoch_context> GetKawpowEpochContext(int nEpoch)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_kawpowContexts);
+        while (true)
+        {
+            map<int, std::shared_ptr<ethash_epoch_context> >::iterator mi = mapKawpowContexts.find(nEpoch);
+            if (mi != mapKawpowContexts.end())
+                return mi->second;
+            if (!setKawpowContextsBuilding.count(nEpoch))
+                break;
+            condKawpowContexts.wait(lock);
+        }
+        setKawpowContextsBuilding.insert(nEpoch);
+    }
+
+    int64_t nStart = GetTimeMillis();
+    const bool fEpochFiles = GetBoolArg("-kawpowepochfiles", true);
+    std::shared_ptr<ethash_epoch_context> context;
+    if (fEpochFiles)
+        context = LoadKawpowEpochFile(nEpoch);
+    if (context)
+        printf("KAWPOW context for epoch %d mapped from disk in %" PRId64 "ms\n",
+               nEpoch, GetTimeMillis() - nStart);
+    else
+    {
+        context = std::shared_ptr<ethash_epoch_context>(ethash_create_epoch_context(nEpoch),
+                                                        ethash_destroy_epoch_context);
+        if (context)
+        {
+            printf("KAWPOW context for epoch %d built in %" PRId64 "ms\n",
+                   nEpoch, GetTimeMillis() - nStart);
+            if (fEpochFiles)
+                WriteKawpowEpochFile(*context);
+        }
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs_kawpowContexts);
+        setKawpowContextsBuilding.erase(nEpoch);
+        if (context)
+        {
+            mapKawpowContexts[nEpoch] = context;
+            uint64_t nMaxSize = GetArg("-kawpowcachesize", DEFAULT_KAWPOW_CACHE_SIZE) << 20;
+            uint64_t nSize = 0;
+            for (map<int, std::shared_ptr<ethash_epoch_context> >::iterator mi = mapKawpowContexts.begin();
+                 mi != mapKawpowContexts.end(); ++mi)
+                nSize += GetKawpowContextSize(mi->first);
+            while (nSize > nMaxSize && mapKawpowContexts.size() > 1)
+            {
+                // the lowest or highest epoch, whichever is further away
+                map<int, std::shared_ptr<ethash_epoch_context> >::iterator mi = mapKawpowContexts.begin();
+                if (nEpoch - mi->first < mapKawpowContexts.rbegin()->first - nEpoch)
+                    mi = --mapKawpowContexts.end();
+                nSize -= GetKawpowContextSize(mi->first);
+                mapKawpowContexts.erase(mi);
+            }
+        }
+    }
+    condKawpowContexts.notify_all();
+
+    if (!context)
+        throw runtime_error(strprintf("GetKawpowEpochContext() : out of memory for epoch %d", nEpoch));
+    return context;
+}
+
+static void ThreadPregenerateKawpowContext(void* parg)
+{
+    RenameThread("breakout-kawctx");
+    int nEpoch = *(int*)parg;
+    delete (int*)parg;
+    try
+    {
+        GetKawpowEpochContext(nEpoch);
+    }
+    catch (std::exception& e)
+    {
+        PrintException(&e, "ThreadPregenerateKawpowContext()");
+    }
+}
+
+void PregenerateKawpowEpochContext(int nHeight)
+{
+    int nEpoch = ethash::get_epoch_number(nHeight);
+    int nNextEpoch = ethash::get_epoch_number(nHeight + KAWPOW_PREGENERATE_BLOCKS);
+    if (nNextEpoch == nEpoch)
+        return;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_kawpowContexts);
+        // only nodes that use contexts at all get one built ahead
+        if (!mapKawpowContexts.count(nEpoch) ||
+            mapKawpowContexts.count(nNextEpoch) ||
+            setKawpowContextsBuilding.count(nNextEpoch))
+        {
+            return;
+        }
+    }
+    printf("Building KAWPOW context for epoch %d ahead of height %d\n",
+           nNextEpoch, nNextEpoch * ethash::epoch_length);
+    int* pnEpoch = new int(nNextEpoch);
+    if (!NewThread(ThreadPregenerateKawpowContext, pnEpoch))
+        delete pnEpoch;
+}
 
-    return SerializeHash(input);
+void GetKawpowEpochCacheInfo(vector<pair<int, uint64_t> >& vEpochs)
+{
+    boost::unique_lock<boost::mutex> lock(cs_kawpowContexts);
+    vEpochs.clear();
+    for (map<int, std::shared_ptr<ethash_epoch_context> >::iterator mi = mapKawpowContexts.begin();
+         mi != mapKawpowContexts.end(); ++mi)
+        vEpochs.push_back(make_pair(mi->first, GetKawpowContextSize(mi->first)));
 }
 
 uint256 KAWPOWHash(const CBlock& block, uint256& mix_hash)
@@ -1951,16 +2263,11 @@ uint256 KAWPOWHash(const CBlock& block, uint256& mix_hash)
     // if the mix_hash is known, then context is not necessary,
     //    using hash_no_verify() in KAWPOWHash_OnlyMix(), however
     //    nHeight is still used in the hash for the mix_hash
-    static ethash::epoch_context_ptr pcontext{nullptr, nullptr};
-
     int nHeight = block.nHeight;
 
     const int nEpoch = ethash::get_epoch_number(nHeight);
 
-    if (!pcontext || (pcontext->epoch_number != nEpoch))
-    {
-        pcontext = ethash::create_epoch_context(nEpoch);
-    }
+    std::shared_ptr<ethash_epoch_context> pcontext = GetKawpowEpochContext(nEpoch);
 
     uint256 nHeaderHash = block.GetKAWPOWHeaderHash();
     const ethash::hash256 hashHeader = to_hash256(nHeaderHash);
@@ -2007,10 +2314,15 @@ void CBlock::UpdateTime(const CBlockIndex* pindexPrev)
 }
 
 bool IsConfirmedInNPrevBlocks(const CTxIndex& txindex, const CBlockIndex* pindexFrom, int nMaxDepth, int& nActualDepth)
+{
+    return IsConfirmedInNPrevBlocks(txindex.pos, pindexFrom, nMaxDepth, nActualDepth);
+}
+
+bool IsConfirmedInNPrevBlocks(const CDiskTxPos& pos, const CBlockIndex* pindexFrom, int nMaxDepth, int& nActualDepth)
 {
     for (const CBlockIndex* pindex = pindexFrom; pindex && pindexFrom->nHeight - pindex->nHeight < nMaxDepth; pindex = pindex->pprev)
     {
-        if (pindex->nBlockPos == txindex.pos.nBlockPos && pindex->nFile == txindex.pos.nFile)
+        if (pindex->nBlockPos == pos.nBlockPos && pindex->nFile == pos.nFile)
         {
             nActualDepth = pindexFrom->nHeight - pindex->nHeight;
             return true;
@@ -2111,7 +2423,7 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
         else
         {
             // Get prev tx from disk
-            if (!txPrev.ReadFromDisk(txindex.pos))
+            if (!txdb.ReadTx(prevout.hash, txindex.pos, txPrev))
                 return error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
         }
     }
@@ -2198,7 +2510,8 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
 
 bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256,
                                  CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags)
+                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags,
+                                 vector<CScriptCheck> *pvChecks)
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -2273,6 +2586,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256,
         // The first loop above does all the inexpensive checks.
         // Only if ALL inputs pass do we perform expensive ECDSA signature checks.
         // Helps prevent CPU exhaustion attacks.
+        std::shared_ptr<const CSignatureHashContext> psighash;
         for (unsigned int i = 0; i < vin.size(); i++)
         {
             COutPoint prevout = vin[i].prevout;
@@ -2296,7 +2610,18 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256,
             if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
             {
                 // Verify signature
-                if (!VerifySignature(txPrev, *this, i, flags, 0))
+                if (!psighash)
+                {
+                    psighash = std::make_shared<const CSignatureHashContext>(*this);
+                }
+                CScriptCheck check(txPrev, *this, i, flags, 0, psighash);
+                if (pvChecks)
+                {
+                    // deferred to the script check queue (see ConnectBlock)
+                    pvChecks->push_back(CScriptCheck());
+                    check.swap(pvChecks->back());
+                }
+                else if (!check())
                 {
                     return DoS(100,error("ConnectInputs() : %s VerifySignature failed",
                                          GetHash().ToString().substr(0,10).c_str()));
@@ -2402,6 +2727,7 @@ bool CTransaction::ClientConnectInputs()
         LOCK(mempool.cs);
         // inputs can be any color
         vector<int64_t> vValueIn(N_COLORS, 0);
+        CSignatureHashContext sighash(*this);
         for (unsigned int i = 0; i < vin.size(); i++)
         {
             // Get prev tx from single transactions in memory
@@ -2414,7 +2740,7 @@ bool CTransaction::ClientConnectInputs()
                 return false;
 
             // Verify signature
-            if (!VerifySignature(txPrev, *this, i, STANDARD_SCRIPT_VERIFY_FLAGS, 0))
+            if (!VerifySignature(txPrev, *this, i, STANDARD_SCRIPT_VERIFY_FLAGS, 0, &sighash))
                 return error("ConnectInputs() : VerifySignature failed");
 
             ///// this is redundant with the mempool.mapNextTx stuff,
@@ -2507,6 +2833,24 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
     return true;
 }
 
+bool CScriptCheck::operator()() const
+{
+    if (!VerifyInputScript(scriptPubKey, *ptxTo, nIn, nFlags, nHashType, psighash.get()))
+    {
+        return error("CScriptCheck() : %s VerifySignature failed",
+                     ptxTo->GetHash().ToString().substr(0,10).c_str());
+    }
+    return true;
+}
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck(void* parg)
+{
+    RenameThread("breakout-scriptch");
+    scriptcheckqueue.Thread();
+}
+
 // connecting pindex
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 {
@@ -2563,11 +2907,15 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                        (GetFork(pindex->nTime) == BRK_FORK005));
         if (fReset)
         {
-            pindex->vTotalMint[BREAKOUT_COLOR_SIS] =
-                        pindex->pprev->vMoneySupply[BREAKOUT_COLOR_SIS];
+            pindex->vTotalMint.Set(BREAKOUT_COLOR_SIS,
+                        pindex->pprev->vMoneySupply[BREAKOUT_COLOR_SIS]);
         }
     }
 
+    // Script checks are handed to the worker pool (-par) and joined below,
+    // before anything is written to txdb.
+    CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads ? &scriptcheckqueue : NULL);
+
     unsigned int nSigOps = 0;
     BOOST_FOREACH(CTransaction& tx, vtx)
     {
@@ -2732,6 +3080,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                 vFees[nIOColor] += nFeeIO;
             }
 
+            vector<CScriptCheck> vChecks;
             if (!tx.ConnectInputs(txdb,
                                   mapInputs,
                                   mapQueuedChanges,
@@ -2739,10 +3088,12 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                                   pindex,
                                   true,
                                   false,
-                                  flags))
+                                  flags,
+                                  nScriptCheckThreads ? &vChecks : NULL))
             {
                 return false;
             }
+            control.Add(vChecks);
         }
 
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
@@ -2873,7 +3224,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                 nTotalMintRewardPrev = pindex->pprev->vTotalMint[reward.nColor];
             }
         }
-        pindex->vTotalMint[reward.nColor] = nTotalMintRewardPrev + reward.nValue;
+        pindex->vTotalMint.Set(reward.nColor, nTotalMintRewardPrev + reward.nValue);
     }
 
     if (IsProofOfStake())
@@ -2910,20 +3261,25 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         pindex->nStakeColor = nStakeColor;
         // make unclaimed mint reward available for scavenging if allowed
         int64_t nTotalMintRewardPrev = (pindex->pprev ? pindex->pprev->vTotalMint[reward.nColor] : 0);
-        pindex->vTotalMint[reward.nColor] = nTotalMintRewardPrev + reward.nValue;
+        pindex->vTotalMint.Set(reward.nColor, nTotalMintRewardPrev + reward.nValue);
     }
 
     // ppcoin: track money supply and mint amount info
     pindex->nCoinbaseColor = vtx[0].GetColor();
+    vector<int64_t> vCoinbase(N_COLORS, 0);
+    vector<int64_t> vMoneySupply(N_COLORS, 0);
     for (int i = 1; i < N_COLORS; ++i)
     {
         // confusing equation, but think of it as
         //     subtracting the noncoinbase (fees) from all (noncoinbase & coinbase)
         //     yielding just coinbase
-        pindex->vCoinbase[i] = vValueOut[i] - vValueIn[i] + vFees[i] - vScavengedFees[i];
-        pindex->vMoneySupply[i] = (pindex->pprev? pindex->pprev->vMoneySupply[i] : 0) +
+        vCoinbase[i] = vValueOut[i] - vValueIn[i] + vFees[i] - vScavengedFees[i];
+        vMoneySupply[i] = (pindex->pprev? pindex->pprev->vMoneySupply[i] : 0) +
                                                                    vValueOut[i] - vValueIn[i];
     }
+    pindex->vCoinbase.SetAll(vCoinbase);
+    pindex->vMoneySupply.SetAll(vMoneySupply,
+                                pindex->pprev ? &pindex->pprev->vMoneySupply : NULL);
 
     // check for unspendable outputs to adjust money supply and total mint
     if (pindex->pprev->nTime >= BURN_PROTOCOL_START_TIME)
@@ -2952,13 +3308,18 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                  // subtract burned coins from both money supply and total mint
                  if (whichType == TX_NULL_DATA)
                  {
-                     pindex->vTotalMint[txout.nColor] -= txout.nValue;
-                     pindex->vMoneySupply[txout.nColor] -= txout.nValue;
+                     pindex->vTotalMint.Add(txout.nColor, -txout.nValue);
+                     pindex->vMoneySupply.Add(txout.nColor, -txout.nValue);
                  }
             }
         }
     }
 
+    if (!control.Wait())
+    {
+        return DoS(100, error("ConnectBlock() : script verification failed"));
+    }
+
     if (!txdb.WriteBlockIndex(CDiskBlockIndex(pindex)))
     {
         return error("Connect() : WriteBlockIndex for pindex failed");
@@ -2978,6 +3339,16 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         }
     }
 
+    // Outputs created here are the likeliest to be spent next, so keep the
+    // spendable transactions around instead of rereading them from disk
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+    {
+        if (!tx.DoesMature())
+        {
+            txdb.CacheTx(tx);
+        }
+    }
+
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
     if (pindex->pprev)
@@ -2991,10 +3362,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     }
 
     // Watch for transactions paying to me
-    BOOST_FOREACH(CTransaction& tx, vtx)
-    {
-        SyncWithWallets(tx, this, true);
-    }
+    SyncBlockWithWallets(*this, true);
 
     // fJustCheck is a validation-only pass, so it must not write the index.
     if (fWithExploreAPI && !fJustCheck)
@@ -3472,14 +3840,11 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     // Add balance changes to pwalletMain now that chain is
     //    fully reorganized
     ///////////////////////////////////////////////////////////////////
-    {
-        LOCK(pwalletMain->cs_wallet);
-        pwalletMain->mapConfirmed.Add(mapConfirmedChanges);
-        pwalletMain->mapStake.Add(mapStakeChanges);
-        pwalletMain->mapCoinbase.Add(mapCoinbaseChanges);
-        pwalletMain->mapReceived.Add(mapReceivedChanges);
-        pwalletMain->mapSent.Add(mapSentChanges);
-    }
+    pwalletMain->AddBalanceChanges(mapConfirmedChanges,
+                                   mapStakeChanges,
+                                   mapCoinbaseChanges,
+                                   mapReceivedChanges,
+                                   mapSentChanges);
     if (fDebugMiner)
     {
         LOCK(pwalletMain->cs_wallet);
@@ -3743,14 +4108,11 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
         // Add balance changes to pwalletMain now that chain is
         //    fully reorganized
         ///////////////////////////////////////////////////////////////////
-        {
-            LOCK(pwalletMain->cs_wallet);
-            pwalletMain->mapConfirmed.Add(mapConfirmedChanges);
-            pwalletMain->mapStake.Add(mapStakeChanges);
-            pwalletMain->mapCoinbase.Add(mapCoinbaseChanges);
-            pwalletMain->mapReceived.Add(mapReceivedChanges);
-            pwalletMain->mapSent.Add(mapSentChanges);
-        }
+        pwalletMain->AddBalanceChanges(mapConfirmedChanges,
+                                       mapStakeChanges,
+                                       mapCoinbaseChanges,
+                                       mapReceivedChanges,
+                                       mapSentChanges);
         if (fDebugMiner)
         {
             LOCK(pwalletMain->cs_wallet);
@@ -3986,14 +4348,11 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
             // Add balance changes to pwalletMain now that chain is
             //    fully reorganized
             ///////////////////////////////////////////////////////////////////
-            {
-                LOCK(pwalletMain->cs_wallet);
-                pwalletMain->mapConfirmed.Add(mapConfirmedChanges);
-                pwalletMain->mapStake.Add(mapStakeChanges);
-                pwalletMain->mapCoinbase.Add(mapCoinbaseChanges);
-                pwalletMain->mapReceived.Add(mapReceivedChanges);
-                pwalletMain->mapSent.Add(mapSentChanges);
-            }
+            pwalletMain->AddBalanceChanges(mapConfirmedChanges,
+                                           mapStakeChanges,
+                                           mapCoinbaseChanges,
+                                           mapReceivedChanges,
+                                           mapSentChanges);
             if (fDebugMiner)
             {
                 LOCK(pwalletMain->cs_wallet);
@@ -4039,6 +4398,7 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     pblockindexFBBHLast = NULL;
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexNew->nChainTrust;
+    nBestChainGeneration++;
     nTimeBestReceived = GetTime();
     nTransactionsUpdated++;
 
@@ -4084,6 +4444,11 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
         }
     }
 
+    if (KawpowIsActive(pindexBest->GetBlockTime()))
+    {
+        PregenerateKawpowEpochContext(nBestHeight + 1);
+    }
+
     string strCmd = GetArg("-blocknotify", "");
 
     if (!fIsInitialDownload && !strCmd.empty())
@@ -4640,13 +5005,16 @@ bool CBlock::AcceptBlock()
 
 uint256 CBlockIndex::GetBlockTrust() const
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative, fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
-    if (bnTarget <= 0)
+    if (fNegative || fOverflow || bnTarget == 0)
         return 0;
 
-    return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
+    // 2**256 / (bnTarget+1) does not fit in 256 bits, but it equals
+    // ~bnTarget / (bnTarget+1) + 1, which does.
+    return ArithToUint256((~bnTarget / (bnTarget + 1)) + 1);
 }
 
 bool CBlockIndex::IsSuperMajority(int minVersion,
@@ -4680,6 +5048,538 @@ void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd)
     pnode->PushMessage("getblocks", CBlockLocator(pindexBegin), hashEnd);
 }
 
+
+//
+// Headers-first synchronization
+//
+// One peer at a time walks us along its chain with getheaders/headers.
+// Headers that pass the checks possible without their transactions are kept
+// in mapHeaders until their block arrives, and the chain of them with the
+// most trust is kept in vHeaderChain. The blocks on that chain are then
+// requested from every peer that has them, never more than
+// BLOCK_DOWNLOAD_WINDOW past the first one still missing, so out-of-order
+// arrivals stay within the orphan pool. All of this state is guarded by
+// cs_main.
+//
+
+// A header accepted ahead of its block. Its index entry is not in
+// mapBlockIndex, but links to the entries before it like one that is, so
+// that targets and chain trust are computed just as for blocks. Nothing
+// proves the stake of a proof-of-stake header until its block comes, so
+// nStakeAhead counts those from the last block we have up to this one.
+struct CHeaderEntry
+{
+    uint256 hashPrev;
+    unsigned int nStakeAhead;
+    CBlockIndex index;
+};
+
+// Headers whose blocks we don't have yet, or got only since the header
+// chain was last trimmed (see AdvanceHeaderDownload)
+static map<uint256, CHeaderEntry> mapHeaders;
+
+// Best header chain from height nHeaderChainHeight on, and the offset in it
+// of the first block not yet in mapBlockIndex
+static vector<uint256> vHeaderChain;
+static int nHeaderChainHeight = 0;
+static unsigned int nHeaderDownloadPos = 0;
+
+// Blocks requested off the header chain, with the peer asked and when. Each
+// entry holds a reference on its node so that it outlives a disconnect.
+static map<uint256, pair<CNode*, int64_t> > mapBlocksInFlight;
+
+// Peer we are currently fetching headers from (holds a reference)
+static CNode* pnodeHeadersSync = NULL;
+
+// Peer whose headers made the best header chain (holds a reference)
+static CNode* pnodeHeaderChainSource = NULL;
+
+// Requests for the first missing block of the header chain that timed out
+static uint256 hashFirstMissingTimedOut = 0;
+static int nFirstMissingTimeouts = 0;
+
+// Headers whose block could not be downloaded, which are not taken again
+static set<uint256> setHeadersUndeliverable;
+
+// Index entry of a header or block, NULL if we have neither
+static CBlockIndex* GetHeaderIndex(const uint256& hash)
+{
+    map<uint256, CBlockIndex*>::iterator mib = mapBlockIndex.find(hash);
+    if (mib != mapBlockIndex.end())
+        return mib->second;
+    map<uint256, CHeaderEntry>::iterator mi = mapHeaders.find(hash);
+    if (mi != mapHeaders.end())
+        return &mi->second.index;
+    return NULL;
+}
+
+// Unverified proof-of-stake headers up to and including hash
+static unsigned int GetStakeHeadersAhead(const uint256& hash)
+{
+    if (mapBlockIndex.count(hash))
+        return 0;
+    map<uint256, CHeaderEntry>::iterator mi = mapHeaders.find(hash);
+    if (mi == mapHeaders.end())
+        return 0;
+    return mi->second.nStakeAhead;
+}
+
+static int GetBestHeaderHeight()
+{
+    if (vHeaderChain.empty())
+        return nBestHeight;
+    return max(nBestHeight, nHeaderChainHeight + (int)vHeaderChain.size() - 1);
+}
+
+static uint256 GetBestHeaderTrust()
+{
+    if (vHeaderChain.empty())
+        return nBestChainTrust;
+    CBlockIndex* pindexTip = GetHeaderIndex(vHeaderChain.back());
+    if (pindexTip == NULL || pindexTip->nChainTrust < nBestChainTrust)
+        return nBestChainTrust;
+    return pindexTip->nChainTrust;
+}
+
+static uint256 GetBestHeaderHash()
+{
+    if (vHeaderChain.empty() || nBestChainTrust >= GetBestHeaderTrust())
+        return hashBestChain;
+    return vHeaderChain.back();
+}
+
+static void SetHeaderChainSource(CNode* pnode)
+{
+    LOCK(cs_vNodes);
+    if (pnodeHeaderChainSource)
+        pnodeHeaderChainSource->Release();
+    pnodeHeaderChainSource = pnode ? pnode->AddRef() : NULL;
+}
+
+static void ResetHeaderChain()
+{
+    mapHeaders.clear();
+    vHeaderChain.clear();
+    nHeaderChainHeight = 0;
+    nHeaderDownloadPos = 0;
+    hashFirstMissingTimedOut = 0;
+    nFirstMissingTimeouts = 0;
+    SetHeaderChainSource(NULL);
+}
+
+// Make the chain ending in hashTip the best header chain
+static void SetBestHeaderChain(const uint256& hashTip)
+{
+    vector<uint256> vPath;
+    uint256 hash = hashTip;
+    map<uint256, CHeaderEntry>::iterator mi;
+    while ((mi = mapHeaders.find(hash)) != mapHeaders.end())
+    {
+        int nOffset = mi->second.index.nHeight - nHeaderChainHeight;
+        if (nOffset >= 0 && nOffset < (int)vHeaderChain.size() && vHeaderChain[nOffset] == hash)
+            break;
+        vPath.push_back(hash);
+        hash = mi->second.hashPrev;
+    }
+
+    // hash is where the new chain joins the old one or the blocks we have
+    CBlockIndex* pindexFork = GetHeaderIndex(hash);
+    if (pindexFork == NULL)
+        return;
+    int nOffset = pindexFork->nHeight - nHeaderChainHeight;
+    if (nOffset >= 0 && nOffset < (int)vHeaderChain.size() && vHeaderChain[nOffset] == hash)
+        vHeaderChain.resize(nOffset + 1);
+    else
+    {
+        vHeaderChain.clear();
+        nHeaderChainHeight = pindexFork->nHeight + 1;
+    }
+    nHeaderDownloadPos = min(nHeaderDownloadPos, (unsigned int)vHeaderChain.size());
+    vHeaderChain.insert(vHeaderChain.end(), vPath.rbegin(), vPath.rend());
+}
+
+// Skip over the blocks of the header chain we already have. Their headers
+// are forgotten in batches, after which the headers that came after them
+// are linked to the block index instead.
+static void AdvanceHeaderDownload()
+{
+    while (nHeaderDownloadPos < vHeaderChain.size() &&
+           mapBlockIndex.count(vHeaderChain[nHeaderDownloadPos]))
+    {
+        nHeaderDownloadPos++;
+    }
+    if (nHeaderDownloadPos >= MAX_HEADERS_RESULTS)
+    {
+        for (unsigned int i = 0; i < nHeaderDownloadPos; i++)
+            mapHeaders.erase(vHeaderChain[i]);
+        vHeaderChain.erase(vHeaderChain.begin(), vHeaderChain.begin() + nHeaderDownloadPos);
+        nHeaderChainHeight += nHeaderDownloadPos;
+        nHeaderDownloadPos = 0;
+
+        for (map<uint256, CHeaderEntry>::iterator mi = mapHeaders.begin(); mi != mapHeaders.end(); ++mi)
+            mi->second.index.pprev = GetHeaderIndex(mi->second.hashPrev);
+    }
+}
+
+// Whether pnode sent us headers up to at least the header chain position nPos
+static bool HasAnnouncedHeader(const CNode* pnode, unsigned int nPos)
+{
+    CBlockIndex* pindex = GetHeaderIndex(pnode->hashHeadersTip);
+    if (pindex == NULL)
+        return false;
+    int nOffset = pindex->nHeight - nHeaderChainHeight;
+    return (nOffset >= (int)nPos && nOffset < (int)vHeaderChain.size() &&
+            vHeaderChain[nOffset] == pnode->hashHeadersTip);
+}
+
+// Checks of a header whose block we don't have yet, and fills in its index
+// entry. These are the parts of CheckBlock, AcceptBlock and ProcessBlock that
+// need no transactions. Without its coinstake a header does not say whether
+// it is proof-of-stake, so it is taken for proof-of-work if it is KAWPOW or
+// has a nonce (proof-of-stake blocks have neither), and otherwise for
+// whichever kind its nBits are the target of. The stake itself is left to
+// block acceptance, and blocks that turn out not to match are rejected there.
+static bool AcceptBlockHeader(const CBlock& header, const uint256& hash,
+                              CBlockIndex* pindexPrev, CBlockIndex& indexNew)
+{
+    int nHeight = pindexPrev->nHeight + 1;
+
+    if (header.IsKawpowBlock() && (int)header.nHeight != nHeight)
+        return header.DoS(100, error("AcceptBlockHeader() : wrong height %u, expected %d", header.nHeight, nHeight));
+
+    if (header.GetBlockTime() > FutureDrift(GetAdjustedTime()))
+        return error("AcceptBlockHeader() : block timestamp too far in the future");
+
+    if ((header.GetBlockTime() <= pindexPrev->GetPastTimeLimit()) ||
+        (FutureDrift(header.GetBlockTime()) < pindexPrev->GetBlockTime()))
+        return error("AcceptBlockHeader() : block's timestamp is too early");
+
+    if (header.GetBlockTime() < nLaunchTime)
+        return header.DoS(100, error("AcceptBlockHeader() : timestamp is prior to launch"));
+
+    if (!Checkpoints::CheckHardened(nHeight, hash))
+        return header.DoS(100, error("AcceptBlockHeader() : rejected by hardened checkpoint lock-in at %d", nHeight));
+
+    bool fProofOfStake = (!header.IsKawpowBlock() && header.nNonce == 0 &&
+                          header.nBits == GetNextTargetRequired(header.nTime, pindexPrev, true));
+    if (!fProofOfStake)
+    {
+        if (header.nBits != GetNextTargetRequired(header.nTime, pindexPrev, false))
+            return header.DoS(100, error("AcceptBlockHeader() : incorrect proof-of-work"));
+        if (!CheckProofOfWork(hash, header.nBits, &header))
+            return header.DoS(50, error("AcceptBlockHeader() : proof of work failed"));
+    }
+
+    // same bound as ProcessBlock on the target since the last checkpoint
+    CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint();
+    if (pcheckpoint && header.hashPrevBlock != hashBestChain)
+    {
+        int64_t deltaTime = header.GetBlockTime() - pcheckpoint->nTime;
+        CBigNum bnNewBlock;
+        bnNewBlock.SetCompact(header.nBits);
+        CBigNum bnRequired;
+        if (fProofOfStake)
+            bnRequired.SetCompact(ComputeMinStake(GetLastBlockIndex(pcheckpoint, true)->nBits, deltaTime));
+        else
+            bnRequired.SetCompact(ComputeMinWork(GetLastBlockIndex(pcheckpoint, false)->nBits, deltaTime, header.nTime));
+        if (bnNewBlock > bnRequired)
+            return header.DoS(100, error("AcceptBlockHeader() : header with too little %s",
+                                         fProofOfStake ? "proof-of-stake" : "proof-of-work"));
+    }
+
+    // the mix hash only proves the work once recomputed from the epoch,
+    // which is the expensive part and so comes last
+    if (header.IsKawpowBlock())
+    {
+        uint256 mix_hash;
+        KAWPOWHash(header, mix_hash);
+        if (mix_hash != header.mix_hash)
+            return header.DoS(100, error("AcceptBlockHeader() : KAWPOW mix hash mismatch"));
+    }
+
+    indexNew.pprev = pindexPrev;
+    indexNew.nHeight = nHeight;
+    indexNew.nVersion = header.nVersion;
+    indexNew.hashMerkleRoot = header.hashMerkleRoot;
+    indexNew.nTime = header.nTime;
+    indexNew.nBits = header.nBits;
+    indexNew.nNonce = header.nNonce;
+    indexNew.nNonce64 = header.nNonce64;
+    indexNew.mix_hash = header.mix_hash;
+    if (fProofOfStake)
+        indexNew.SetProofOfStake();
+    indexNew.nChainTrust = pindexPrev->nChainTrust + indexNew.GetBlockTrust();
+    return true;
+}
+
+static void PushGetHeaders(CNode* pnode, const uint256& hashTip)
+{
+    // Filter out duplicate requests
+    if (hashTip == pnode->hashLastGetHeaders &&
+        GetTime() - pnode->nHeadersRequestTime < 10)
+    {
+        return;
+    }
+    pnode->hashLastGetHeaders = hashTip;
+    pnode->nHeadersRequestTime = GetTime();
+
+    // Locate the tip through the headers ahead of our blocks, then through
+    // the block chain itself
+    vector<uint256> vHashes;
+    uint256 hash = hashTip;
+    int nStep = 1;
+    map<uint256, CHeaderEntry>::iterator mi;
+    while ((mi = mapHeaders.find(hash)) != mapHeaders.end())
+    {
+        vHashes.push_back(hash);
+        for (int i = 0; i < nStep && mi != mapHeaders.end(); i++)
+        {
+            hash = mi->second.hashPrev;
+            mi = mapHeaders.find(hash);
+        }
+        if (vHashes.size() > 10)
+            nStep *= 2;
+    }
+    map<uint256, CBlockIndex*>::iterator mib = mapBlockIndex.find(hash);
+    CBlockLocator locator(mib != mapBlockIndex.end() ? mib->second : pindexBest);
+    locator.Prepend(vHashes);
+
+    pnode->PushMessage("getheaders", locator, uint256(0));
+}
+
+// Accept the headers a peer sent us and make them the best header chain if
+// they have more trust, and ask for the ones after them if there may be
+// more (fMoreRet). Returns false if the peer sent something invalid.
+static bool ProcessHeaders(CNode* pfrom, const vector<CBlock>& vHeaders, bool& fMoreRet)
+{
+    fMoreRet = false;
+    bool fCapped = false;
+    uint256 hashLast = 0;
+    CBlockIndex* pindexLast = NULL;
+    BOOST_FOREACH(const CBlock& header, vHeaders)
+    {
+        if (header.IsKawpowBlock() && header.mix_hash == 0)
+        {
+            pfrom->Misbehaving(100);
+            return error("ProcessHeaders() : KAWPOW header without mix hash");
+        }
+        uint256 hash = header.GetHash();
+
+        CBlockIndex* pindexPrev = GetHeaderIndex(header.hashPrevBlock);
+        if (pindexPrev == NULL && pindexLast != NULL)
+        {
+            pfrom->Misbehaving(20);
+            return error("ProcessHeaders() : non-continuous headers sequence");
+        }
+        if (pindexPrev == NULL)
+        {
+            // The headers it builds on may have been dropped since we asked,
+            // so ask again from where we are. Only a peer that keeps sending
+            // headers we can't place is penalized.
+            printf("ProcessHeaders() : header %s does not connect\n",
+                   hash.ToString().substr(0,20).c_str());
+            if (++pfrom->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0)
+                pfrom->Misbehaving(20);
+            PushGetHeaders(pfrom, GetBestHeaderHash());
+            fMoreRet = true;
+            return true;
+        }
+        pfrom->nUnconnectingHeaders = 0;
+
+        CBlockIndex* pindex = GetHeaderIndex(hash);
+        if (pindex == NULL)
+        {
+            if (setHeadersUndeliverable.count(hash))
+            {
+                fCapped = true;
+                break;
+            }
+            CHeaderEntry entry;
+            entry.hashPrev = header.hashPrevBlock;
+            if (!AcceptBlockHeader(header, hash, pindexPrev, entry.index))
+            {
+                if (header.nDoS)
+                    pfrom->Misbehaving(header.nDoS);
+                return false;
+            }
+            // Stake headers are free to make up, so a chain of them must not
+            // outweigh our blocks by more than a download window's worth.
+            // The rest is asked for again once the blocks before it are in.
+            entry.nStakeAhead = GetStakeHeadersAhead(header.hashPrevBlock) +
+                                (entry.index.IsProofOfStake() ? 1 : 0);
+            if (entry.nStakeAhead > MAX_UNVERIFIED_STAKE_HEADERS)
+            {
+                fCapped = true;
+                break;
+            }
+            map<uint256, CHeaderEntry>::iterator mi = mapHeaders.insert(make_pair(hash, entry)).first;
+            mi->second.index.phashBlock = &mi->first;
+            pindex = &mi->second.index;
+        }
+        hashLast = hash;
+        pindexLast = pindex;
+    }
+    if (pindexLast == NULL)
+        return true;
+
+    if (pindexLast->nHeight >= pfrom->nHeadersHeight)
+    {
+        pfrom->nHeadersHeight = pindexLast->nHeight;
+        pfrom->hashHeadersTip = hashLast;
+    }
+    if (mapHeaders.count(hashLast) && pindexLast->nChainTrust > GetBestHeaderTrust())
+    {
+        SetBestHeaderChain(hashLast);
+        if (pfrom != pnodeHeaderChainSource)
+            SetHeaderChainSource(pfrom);
+        printf("ProcessHeaders() : best header now at height %d from %s\n",
+               pindexLast->nHeight, pfrom->addr.ToString().c_str());
+    }
+
+    // Forget headers of branches that lost
+    if (mapHeaders.size() > vHeaderChain.size() + 4 * MAX_HEADERS_RESULTS)
+    {
+        set<uint256> setChain(vHeaderChain.begin(), vHeaderChain.end());
+        for (map<uint256, CHeaderEntry>::iterator mi = mapHeaders.begin(); mi != mapHeaders.end(); )
+        {
+            if (setChain.count(mi->first))
+                ++mi;
+            else
+                mapHeaders.erase(mi++);
+        }
+    }
+
+    if (!fCapped && vHeaders.size() == MAX_HEADERS_RESULTS)
+    {
+        PushGetHeaders(pfrom, hashLast);
+        fMoreRet = true;
+    }
+    return true;
+}
+
+static void MarkBlockReceived(const uint256& hash)
+{
+    map<uint256, pair<CNode*, int64_t> >::iterator mi = mapBlocksInFlight.find(hash);
+    if (mi == mapBlocksInFlight.end())
+        return;
+    CNode* pnode = mi->second.first;
+    pnode->nBlocksInFlight--;
+    {
+        LOCK(cs_vNodes);
+        pnode->Release();
+    }
+    mapBlocksInFlight.erase(mi);
+}
+
+// Give up on requests to peers that went away or did not answer in time, so
+// that other peers are asked instead. A peer that sent us the headers up to
+// the first missing block and then holds that block up is disconnected to
+// make room for another; peers that only had it asked of them are not. If
+// the first missing block cannot be had at all, the header chain is dropped.
+// Its source is not penalized for that, as a slow peer is not a bad one.
+static void SweepBlocksInFlight()
+{
+    static int64_t nLastSweep = 0;
+    int64_t nNow = GetTime();
+    if (nNow - nLastSweep < 5)
+        return;
+    nLastSweep = nNow;
+
+    AdvanceHeaderDownload();
+    uint256 hashFirstMissing = 0;
+    if (nHeaderDownloadPos < vHeaderChain.size())
+        hashFirstMissing = vHeaderChain[nHeaderDownloadPos];
+    if (hashFirstMissing != hashFirstMissingTimedOut)
+    {
+        hashFirstMissingTimedOut = hashFirstMissing;
+        nFirstMissingTimeouts = 0;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (map<uint256, pair<CNode*, int64_t> >::iterator mi = mapBlocksInFlight.begin(); mi != mapBlocksInFlight.end(); )
+        {
+            CNode* pnode = mi->second.first;
+            bool fTimedOut = (nNow - mi->second.second > BLOCK_DOWNLOAD_TIMEOUT);
+            if (!pnode->fDisconnect && !fTimedOut)
+            {
+                ++mi;
+                continue;
+            }
+            if (fTimedOut && mi->first == hashFirstMissing)
+            {
+                nFirstMissingTimeouts++;
+                if (!pnode->fDisconnect && pnode != pnodeHeaderChainSource &&
+                    HasAnnouncedHeader(pnode, nHeaderDownloadPos))
+                {
+                    printf("peer %s stalled block download at %s, disconnecting\n",
+                           pnode->addr.ToString().c_str(), mi->first.ToString().substr(0,20).c_str());
+                    pnode->fDisconnect = true;
+                }
+            }
+            pnode->nBlocksInFlight--;
+            pnode->Release();
+            mapBlocksInFlight.erase(mi++);
+        }
+
+        if (pnodeHeadersSync &&
+            (pnodeHeadersSync->fDisconnect ||
+             nNow - pnodeHeadersSync->nHeadersRequestTime > HEADERS_DOWNLOAD_TIMEOUT))
+        {
+            pnodeHeadersSync->Release();
+            pnodeHeadersSync = NULL;
+        }
+    }
+
+    if (nFirstMissingTimeouts >= MAX_BLOCK_DOWNLOAD_TIMEOUTS)
+    {
+        printf("block %s of the header chain could not be downloaded, dropping headers\n",
+               hashFirstMissing.ToString().substr(0,20).c_str());
+        setHeadersUndeliverable.insert(hashFirstMissing);
+        ResetHeaderChain();
+    }
+}
+
+// Pick a peer to fetch headers from if there is none, and queue getdata
+// requests for the blocks of the header chain that pto can serve.
+static void RequestHeaderChainBlocks(CNode* pto, vector<CInv>& vGetData)
+{
+    SweepBlocksInFlight();
+
+    int nPeerHeight = max(pto->nStartingHeight, pto->nHeadersHeight);
+    if (!pnodeHeadersSync && !pto->fDisconnect &&
+        nPeerHeight > GetBestHeaderHeight() &&
+        GetTime() - pto->nHeadersRequestTime > HEADERS_DOWNLOAD_TIMEOUT)
+    {
+        {
+            LOCK(cs_vNodes);
+            pnodeHeadersSync = pto->AddRef();
+        }
+        PushGetHeaders(pto, GetBestHeaderHash());
+    }
+
+    AdvanceHeaderDownload();
+    unsigned int nEnd = min((unsigned int)vHeaderChain.size(),
+                            nHeaderDownloadPos + BLOCK_DOWNLOAD_WINDOW);
+    for (unsigned int i = nHeaderDownloadPos;
+         i < nEnd && pto->nBlocksInFlight < MAX_BLOCKS_IN_FLIGHT_PER_PEER;
+         i++)
+    {
+        if (nHeaderChainHeight + (int)i > nPeerHeight)
+            break;
+        const uint256& hash = vHeaderChain[i];
+        if (mapBlocksInFlight.count(hash) || mapBlockIndex.count(hash) || mapOrphanBlocks.count(hash))
+            continue;
+        vGetData.push_back(CInv(MSG_BLOCK, hash));
+        {
+            LOCK(cs_vNodes);
+            pto->AddRef();
+        }
+        mapBlocksInFlight[hash] = make_pair(pto, GetTime());
+        pto->nBlocksInFlight++;
+    }
+}
+
 #if 0
 // bool static ReserealizeBlockSignature(CBlock* pblock)
 // {
@@ -4849,8 +5749,12 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool& fOrphan, bool fIsBootstrap
                 setStakeSeenOrphan.insert(pblock->GetProofOfStake());
             }
 
-            // Ask this guy to fill in what we're missing
-            PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(hash));
+            // Ask this guy to fill in what we're missing, unless the block
+            // was fetched off the header chain and its parents are coming
+            if (!fHeadersFirst)
+                PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(hash));
+            else if (!mapHeaders.count(hash))
+                PushGetHeaders(pfrom, GetBestHeaderHash());
             // ppcoin: getblocks may not obtain the ancestor block rejected
             // earlier by duplicate-stake check so we ask for it again directly
             if (!IsInitialBlockDownload())
@@ -4936,11 +5840,11 @@ bool CBlock::SignBlock(CWallet& wallet, int64_t nFees[])
 
     if (nSearchTime > nLastCoinStakeSearchTime)
     {
-        // randomly pick a color from all staking currencies with weight
+        // search all enabled staking currencies with weight at once
         vector<int> vColors;
         for (int i = 1; i < N_COLORS; ++i)
         {
-            if (!CanStake(i))
+            if (!CanStake(i) || !vStakeColorEnabled[i])
             {
                 continue;
             }
@@ -4960,19 +5864,25 @@ bool CBlock::SignBlock(CWallet& wallet, int64_t nFees[])
         {
             return false;
         }
-        int idx = rand() % vColors.size();
-        int nColor = vColors[idx];
 
         // TODO: get rid of nSearchInterval
         int64_t nSearchInterval = 1;
-        if (wallet.CreateCoinStake(nColor,
+        CStakeKernelResult kernel;
+        if (wallet.FindStakeKernel(vColors,
+                                   pindexBest,
+                                   nBits,
+                                   txCoinStake.nTime,
+                                   nSearchInterval,
+                                   kernel) &&
+            wallet.CreateCoinStake(kernel.nColor,
                                    wallet,
                                    nBits,
                                    nSearchInterval,
                                    nFees,
                                    vtx[0],
                                    txCoinStake,
-                                   key))
+                                   key,
+                                   &kernel.prevout))
         {
             if (txCoinStake.nTime >= pindexBest->GetPastTimeLimit() + 1)
             {
@@ -5770,9 +6680,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             }
         }
 
-        // Ask the first connected node for block updates
+        // Ask the first connected node for block updates. Headers-first sync
+        // picks its peers in SendMessages instead.
         static int nAskedForBlocks = 0;
-        if (!pfrom->fClient && !pfrom->fOneShot &&
+        if (!fHeadersFirst && !pfrom->fClient && !pfrom->fOneShot &&
             (pfrom->nStartingHeight > (nBestHeight - 144)) &&
             (pfrom->nVersion < NOBLKS_VERSION_START ||
              pfrom->nVersion >= NOBLKS_VERSION_END) &&
@@ -5917,8 +6828,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             if (!fAlreadyHave)
                 pfrom->AskFor(inv);
             else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
-                pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(inv.hash));
-            } else if (nInv == nLastBlock) {
+                if (!fHeadersFirst)
+                    pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(inv.hash));
+                else if (!mapHeaders.count(inv.hash))
+                    PushGetHeaders(pfrom, GetBestHeaderHash());
+            } else if (nInv == nLastBlock && !fHeadersFirst) {
                 // In case we are on a very long side-chain, it is possible that we already have
                 // the last block in an inv bundle sent in response to getblocks. Try to detect
                 // this situation and push another getblocks to continue.
@@ -6092,6 +7006,29 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         pfrom->PushMessage("headers", vHeaders);
     }
 
+    else if (strCommand == "headers")
+    {
+        vector<CBlock> vHeaders;
+        vRecv >> vHeaders;
+        if (vHeaders.size() > MAX_HEADERS_RESULTS)
+        {
+            pfrom->Misbehaving(20);
+            return error("message headers size() = %" PRIszu "", vHeaders.size());
+        }
+
+        bool fMore = false;
+        bool fValid = ProcessHeaders(pfrom, vHeaders, fMore);
+        if (!fMore && pfrom == pnodeHeadersSync)
+        {
+            // this peer has nothing more for us, let another one take over
+            LOCK(cs_vNodes);
+            pnodeHeadersSync->Release();
+            pnodeHeadersSync = NULL;
+        }
+        if (!fValid)
+            return false;
+    }
+
     else if (strCommand == "tx")
     {
         vector<uint256> vWorkQueue;
@@ -6116,8 +7053,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 ColorsMap mapReceived;
                 ColorsMap mapSent;
                 wtx.GetAmounts(false, mapReceived, mapSent);
-                pwalletMain->mapReceived.Add(mapReceived);
-                pwalletMain->mapSent.Add(mapSent);
+                pwalletMain->AddBalanceChanges(ColorsMap(), ColorsMap(),
+                                               ColorsMap(), mapReceived,
+                                               mapSent);
             }
 
             RelayTransaction(tx, inv.hash);
@@ -6183,12 +7121,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
         CInv inv(MSG_BLOCK, hashBlock);
         pfrom->AddInventoryKnown(inv);
+        MarkBlockReceived(hashBlock);
         bool fOrphan;
         if (ProcessBlock(pfrom, &block, fOrphan))
         {
             mapAlreadyAskedFor.erase(inv);
             // orphaned blocks will trigger their own getblocks request
-            if (!fOrphan &&
+            if (!fOrphan && !fHeadersFirst &&
                 (nBestHeight < pfrom->nStartingHeight) &&
                 (nBestHeight >= (pfrom->pindexLastGetBlocksBegin->nHeight +
                                  GETBLOCKS_LIMIT)))
@@ -6196,6 +7135,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 PushGetBlocks(pfrom, pindexBest, uint256(0));
             }
         }
+        else if (block.nDoS && mapHeaders.count(hashBlock))
+        {
+            // the header chain leads through an invalid block
+            printf("received invalid block %s of the header chain, dropping headers\n",
+                   hashBlock.ToString().substr(0,20).c_str());
+            ResetHeaderChain();
+        }
         if (block.nDoS) pfrom->Misbehaving(block.nDoS);
     }
 
@@ -6628,6 +7574,13 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
             pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
+        if (fHeadersFirst && pto->fSuccessfullyConnected &&
+            !pto->fClient && !pto->fOneShot &&
+            (pto->nVersion < NOBLKS_VERSION_START ||
+             pto->nVersion >= NOBLKS_VERSION_END))
+        {
+            RequestHeaderChainBlocks(pto, vGetData);
+        }
         if (!vGetData.empty())
             pto->PushMessage("getdata", vGetData);
 
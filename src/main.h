@@ -14,11 +14,11 @@
 #include "base58.h"
 #include "alert.h"
 
+#include <atomic>
 #include <list>
 
 class CWallet;
 class CBlock;
-class CKAWPOWInput;
 class CBlockIndex;
 class CKeyItem;
 class CReserveKey;
@@ -59,6 +59,32 @@ static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 750;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
+/** Maximum number of script-checking threads allowed */
+static const int MAX_SCRIPTCHECK_THREADS = 16;
+/** Maximum number of stake kernel search threads */
+static const int MAX_STAKE_THREADS = 16;
+/** Kernel hashes one stake kernel search check is given at least */
+static const int STAKE_KERNEL_CHECK_HASHES = 64;
+/** Number of headers sent in one 'headers' message */
+static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** 'headers' replies in a row that do not connect before the peer is penalized */
+static const int MAX_UNCONNECTING_HEADERS = 10;
+/** How far past the first missing block headers-first sync downloads */
+static const unsigned int BLOCK_DOWNLOAD_WINDOW = 512;
+/** Proof-of-stake headers a header chain may hold past the blocks we have */
+static const unsigned int MAX_UNVERIFIED_STAKE_HEADERS = BLOCK_DOWNLOAD_WINDOW;
+/** Number of blocks requested from a single peer at a time */
+static const int MAX_BLOCKS_IN_FLIGHT_PER_PEER = 16;
+/** Seconds before a block request is given to another peer */
+static const int64_t BLOCK_DOWNLOAD_TIMEOUT = 60;
+/** Timed out requests for the first missing block before its headers are dropped */
+static const int MAX_BLOCK_DOWNLOAD_TIMEOUTS = 3;
+/** Seconds to wait for a 'headers' reply before syncing from another peer */
+static const int64_t HEADERS_DOWNLOAD_TIMEOUT = 120;
+/** Default for -kawpowcachesize, megabytes of KAWPOW epoch contexts kept */
+static const unsigned int DEFAULT_KAWPOW_CACHE_SIZE = 128;
+/** Blocks before an epoch boundary at which its context is built ahead */
+static const int KAWPOW_PREGENERATE_BLOCKS = 250;
 
 inline bool MoneyRange(int64_t nValue, int nColor) { return (nValue >= 0 && nValue <= MAX_MONEY[nColor]); }
 
@@ -102,6 +128,8 @@ extern uint256 nBestChainTrust;
 extern uint256 nBestInvalidTrust;
 extern uint256 hashBestChain;
 extern CBlockIndex* pindexBest;
+// bumped with every new best block, for threads that may not take cs_main
+extern std::atomic<unsigned int> nBestChainGeneration;
 extern unsigned int nTransactionsUpdated;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
@@ -126,6 +154,10 @@ extern int nDefaultStake;
 extern int nNumberOfStakingCurrencies;
 extern bool fUseFastIndex;
 extern unsigned int nDerivationMethodIndex;
+extern int nScriptCheckThreads;
+extern int nStakeThreads;
+extern std::vector<bool> vStakeColorEnabled;
+extern bool fHeadersFirst;
 
 extern bool fEnforceCanonical;
 
@@ -136,10 +168,13 @@ static const uint64_t nMinDiskSpace = 52428800;
 class CReserveKey;
 class CTxDB;
 class CTxIndex;
+class CDiskTxPos;
+class CScriptCheck;
 
 void RegisterWallet(CWallet* pwalletIn);
 void UnregisterWallet(CWallet* pwalletIn);
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL, bool fUpdate = false, bool fConnect = true);
+void SyncBlockWithWallets(const CBlock& block, bool fUpdate);
 bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool& fOrphan, bool fIsBootstrap=false);
 bool CheckDiskSpace(uint64_t nAdditionalBytes=0);
 FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode="rb");
@@ -150,6 +185,7 @@ CBlockIndex* FindBlockByHeight(int nHeight);
 bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 bool LoadExternalBlockFile(FILE* fileIn);
+void ThreadScriptCheck(void* parg);
 
 bool CheckSHA256ProofOfWork(uint256 hash, unsigned int nBits);
 bool CheckKawpowProofOfWork(const CBlock* pblock);
@@ -162,6 +198,8 @@ double GetDifficulty(const CBlockIndex* blockindex);
 unsigned int GetNextTargetRequired(unsigned int nTime,
                                    const CBlockIndex* pindexLast,
                                    bool fProofOfStake);
+arith_uint256 RetargetTarget(const arith_uint256& bnTarget, int64_t nActualTimespan,
+                             int64_t nTargetTimespan, const arith_uint256& bnLimit);
 struct AMOUNT GetPoWSubsidy(CBlockIndex* pindexPrev);
 struct AMOUNT GetProofOfWorkReward(CBlockIndex* pindexPrev);
 struct AMOUNT GetProofOfStakeReward(CBlockIndex* pindexPrev, int nStakeColor);
@@ -171,6 +209,7 @@ int GetNumBlocksOfPeers();
 bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor, int nAlertType=(int)ALERT_CLASSIC);
 bool IsConfirmedInNPrevBlocks(const CTxIndex& txindex, const CBlockIndex* pindexFrom, int nMaxDepth, int&     nActualDepth);
+bool IsConfirmedInNPrevBlocks(const CDiskTxPos& pos, const CBlockIndex* pindexFrom, int nMaxDepth, int& nActualDepth);
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock);
 uint256 WantedByOrphan(const COrphanBlock* pblockOrphan);
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
@@ -184,6 +223,13 @@ bool DecodeHexBlk(CBlock&, const std::string& strHexBlk);
 uint256 KAWPOWHash(const CBlock& blockHeader, uint256& mix_hash);
 uint256 KAWPOWHash_OnlyMix(const CBlock& blockHeader);
 
+/** Process-wide KAWPOW epoch context, built on first use and shared */
+std::shared_ptr<ethash_epoch_context> GetKawpowEpochContext(int nEpoch);
+/** Start building the next epoch's context if the chain is close to it */
+void PregenerateKawpowEpochContext(int nHeight);
+/** Epochs held by the shared context cache and their light cache sizes */
+void GetKawpowEpochCacheInfo(std::vector<std::pair<int, uint64_t> >& vEpochs);
+
 bool KawpowIsActive(const int64_t nTime);
 bool KawpowIsActive();
 
@@ -559,6 +605,65 @@ enum GetMinFee_mode
 typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
 
 
+/** Memoized hash of an object that may still be changed while it is
+ * being built. Nothing is kept until Enable() says the object is final;
+ * a copy starts out disabled again, so copying a final object and then
+ * changing the copy is safe. Filling it from several threads is safe.
+ */
+class CHashMemo
+{
+private:
+    enum
+    {
+        MEMO_OFF,
+        MEMO_EMPTY,
+        MEMO_FILLING,
+        MEMO_SET
+    };
+    mutable std::atomic<int> nState;
+    mutable uint256 hash;
+
+public:
+    CHashMemo() : nState(MEMO_OFF) {}
+    CHashMemo(const CHashMemo&) : nState(MEMO_OFF) {}
+    CHashMemo& operator=(const CHashMemo&)
+    {
+        Disable();
+        return *this;
+    }
+
+    void Enable()
+    {
+        int nOff = MEMO_OFF;
+        nState.compare_exchange_strong(nOff, MEMO_EMPTY);
+    }
+
+    void Disable()
+    {
+        nState.store(MEMO_OFF);
+    }
+
+    bool Get(uint256& hashRet) const
+    {
+        if (nState.load(std::memory_order_acquire) != MEMO_SET)
+            return false;
+        hashRet = hash;
+        return true;
+    }
+
+    void Set(const uint256& hashIn) const
+    {
+        // the first thread to get here fills it, others just move on
+        int nEmpty = MEMO_EMPTY;
+        if (nState.compare_exchange_strong(nEmpty, MEMO_FILLING))
+        {
+            hash = hashIn;
+            nState.store(MEMO_SET, std::memory_order_release);
+        }
+    }
+};
+
+
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
  */
@@ -580,6 +685,9 @@ public:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+    // memory only: txid, kept once the transaction is final (see CacheHash)
+    CHashMemo hashMemo;
+
     CTransaction()
     {
         SetNull();
@@ -587,6 +695,10 @@ public:
 
     IMPLEMENT_SERIALIZE
     (
+        if (fRead)
+        {
+            const_cast<CTransaction*>(this)->hashMemo.Disable();
+        }
         READWRITE(this->nVersion);
         nSerVersion = this->nVersion;
         READWRITE(nTime);
@@ -595,6 +707,11 @@ public:
         READWRITE(nLockTime);
         READWRITE(strTxComment);
         READWRITE(nServiceTypeID);
+        // read from the network or disk: nothing changes it from here on
+        if (fRead)
+        {
+            const_cast<CTransaction*>(this)->hashMemo.Enable();
+        }
     )
 
     void SetNull()
@@ -607,6 +724,7 @@ public:
         nDoS = 0;  // Denial-of-service prevention
         strTxComment.clear();
         nServiceTypeID = SERVICE_NONE;
+        hashMemo.Disable();
     }
 
 
@@ -620,6 +738,18 @@ public:
     // making the txid immutable without invalidating sigs
     // once in block chain, SerializeHash of block uses IMPLEMENT_SERIALIZE
     uint256 GetHash() const
+    {
+        uint256 hash;
+        if (hashMemo.Get(hash))
+        {
+            return hash;
+        }
+        hash = ComputeHash();
+        hashMemo.Set(hash);
+        return hash;
+    }
+
+    uint256 ComputeHash() const
     {
         // miners expect filled coinbase script sigs
         int nFork = GetFork(this->nTime);
@@ -629,16 +759,29 @@ public:
         }
         else
         {
-            CTransaction txTmp(*this);
-            // Blank the sigs
-            for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+            // Blank the sigs: serialized as above, with empty scriptSigs
+            CHashWriter ss(SER_GETHASH, this->nVersion);
+            ss << this->nVersion << nTime;
+            WriteCompactSize(ss, vin.size());
+            BOOST_FOREACH(const CTxIn& txin, vin)
             {
-                   txTmp.vin[i].scriptSig = CScript();
+                ss << txin.prevout;
+                WriteCompactSize(ss, 0);
+                ss << txin.nSequence;
             }
-            return SerializeHash(txTmp);
+            ss << vout << nLockTime << strTxComment << nServiceTypeID;
+            return ss.GetHash();
         }
     }
 
+    // Keep the txid from now on. Only for a transaction nothing will
+    // change any more, such as one held under its hash by the memory
+    // pool or a wallet; reading it from a stream does this already.
+    void CacheHash()
+    {
+        hashMemo.Enable();
+    }
+
     bool IsFinal(int nBlockHeight=0, int64_t nBlockTime=0) const
     {
         AssertLockHeld(cs_main);
@@ -988,11 +1131,13 @@ public:
         @param[in] pindexBlock
         @param[in] fBlock	true if called from ConnectBlock
         @param[in] fMiner	true if called from CreateNewBlock
+        @param[out] pvChecks	if not NULL, script checks are appended here instead of being run
         @return Returns true if all checks succeed
      */
     bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags,
+                       std::vector<CScriptCheck> *pvChecks = NULL);
     bool ClientConnectInputs();
     bool CheckTransaction() const;
     bool AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs=true, bool* pfMissingInputs=NULL);
@@ -1006,6 +1151,41 @@ protected:
 };
 
 
+/** Closure representing one script verification.
+ *  Note that this stores a reference to the spending transaction, so it
+ *  must outlive the check (the block's vtx does, in ConnectBlock).
+ */
+class CScriptCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction *ptxTo;
+    unsigned int nIn;
+    unsigned int nFlags;
+    int nHashType;
+    // shared by the checks of all inputs of ptxTo
+    std::shared_ptr<const CSignatureHashContext> psighash;
+
+public:
+    CScriptCheck() : ptxTo(NULL), nIn(0), nFlags(0), nHashType(0) {}
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, int nHashTypeIn,
+                 const std::shared_ptr<const CSignatureHashContext>& psighashIn = std::shared_ptr<const CSignatureHashContext>()) :
+        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn), psighash(psighashIn) { }
+
+    bool operator()() const;
+
+    void swap(CScriptCheck &check) {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nFlags, check.nFlags);
+        std::swap(nHashType, check.nHashType);
+        psighash.swap(check.psighash);
+    }
+};
+
+
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx : public CTransaction
 {
@@ -1175,6 +1355,55 @@ public:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+private:
+    // memory only: the header as it was when GetHash() last ran, and the
+    // result; scrypt and kawpow only run again once a field has changed
+    struct CHeaderMemo
+    {
+        bool fSet;
+        int nVersion;
+        uint256 hashPrevBlock;
+        uint256 hashMerkleRoot;
+        unsigned int nTime;
+        unsigned int nBits;
+        unsigned int nNonce;
+        uint32_t nHeight;
+        uint64_t nNonce64;
+        uint256 mix_hash;
+        uint256 hash;
+    };
+    mutable CHeaderMemo headerMemo;
+
+    bool IsHeaderMemo() const
+    {
+        return headerMemo.fSet &&
+               headerMemo.nVersion == nVersion &&
+               headerMemo.hashPrevBlock == hashPrevBlock &&
+               headerMemo.hashMerkleRoot == hashMerkleRoot &&
+               headerMemo.nTime == nTime &&
+               headerMemo.nBits == nBits &&
+               headerMemo.nNonce == nNonce &&
+               headerMemo.nHeight == nHeight &&
+               headerMemo.nNonce64 == nNonce64 &&
+               headerMemo.mix_hash == mix_hash;
+    }
+
+    void SetHeaderMemo(const uint256& hash) const
+    {
+        headerMemo.nVersion = nVersion;
+        headerMemo.hashPrevBlock = hashPrevBlock;
+        headerMemo.hashMerkleRoot = hashMerkleRoot;
+        headerMemo.nTime = nTime;
+        headerMemo.nBits = nBits;
+        headerMemo.nNonce = nNonce;
+        headerMemo.nHeight = nHeight;
+        headerMemo.nNonce64 = nNonce64;
+        headerMemo.mix_hash = mix_hash;
+        headerMemo.hash = hash;
+        headerMemo.fSet = true;
+    }
+
+public:
     CBlock(int nVersionIn = 0)
     {
         SetNull(nVersionIn);
@@ -1241,6 +1470,7 @@ public:
         nNonce64 = 0;
         nHeight = 0;
         mix_hash = 0;
+        headerMemo.fSet = false;
     }
 
     bool IsNull() const
@@ -1250,14 +1480,19 @@ public:
 
     uint256 GetHash() const
     {
+        if (IsHeaderMemo())
+        {
+            return headerMemo.hash;
+        }
+        uint256 hash;
         int nFork = GetFork(nTime);
         if (nFork < BRK_FORK003)
         {
-            return SerializeHash(*this);
+            hash = SerializeHash(*this);
         }
         else if (!IsKawpowBlock())
         {
-            return scrypt_blockhash(BEGIN(nVersion));
+            hash = scrypt_blockhash(BEGIN(nVersion));
         }
         else
         {
@@ -1268,8 +1503,10 @@ public:
                 throw std::runtime_error(
                              "CBlock::GetHash(): TSNH mix_hash is null");
             }
-            return KAWPOWHash_OnlyMix(*this);
+            hash = KAWPOWHash_OnlyMix(*this);
         }
+        SetHeaderMemo(hash);
+        return hash;
     }
 
     bool IsKawpowBlock() const
@@ -1519,28 +1756,6 @@ private:
  * Custom serializer for CBlockHeader that omits the nNonce and mixHash, for use
  * as input to ProgPow.
  */
-class CKAWPOWInput : private CBlock
-{
-public:
-    CKAWPOWInput(const CBlock &block)
-    {
-        CBlock::SetNull();
-        *((CBlock*)this) = block;
-    }
-
-    IMPLEMENT_SERIALIZE
-    (
-        READWRITE(this->nVersion);
-        nSerVersion = this->nVersion;
-        READWRITE(hashPrevBlock);
-        READWRITE(hashMerkleRoot);
-        READWRITE(nTime);
-        READWRITE(nBits);
-        READWRITE(nHeight);
-    )
-};
-
-
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block.  pprev and pnext link a path through the
@@ -1559,14 +1774,14 @@ public:
     uint256 nChainTrust; // ppcoin: trust score of block chain
     int nHeight;
 
-    std::vector<int64_t> vCoinbase;
+    ColorsArray vCoinbase;
     int64_t nCoinbaseColor;
     int64_t nStakeColor;
     // Money supply has colors
-    std::vector<int64_t> vMoneySupply;
+    ColorsArray vMoneySupply;
 
     // Total mints for all currencies are tracked for fee scavenging PoW
-    std::vector<int64_t> vTotalMint;
+    ColorsArray vTotalMint;
 
     unsigned int nFlags;  // ppcoin: block index flags
     enum
@@ -1604,7 +1819,6 @@ public:
         nFile = 0;
         nBlockPos = 0;
         nHeight = 0;
-        vCoinbase.assign(N_COLORS, 0);
         nChainTrust = 0;
         nCoinbaseColor = (int) BREAKOUT_COLOR_NONE;
         nFlags = 0;
@@ -1625,8 +1839,6 @@ public:
         mix_hash       = 0;
 
         nStakeColor    = BREAKOUT_COLOR_NONE;
-        vMoneySupply.assign(N_COLORS, 0);
-        vTotalMint.assign(N_COLORS, 0);
     }
 
     CBlockIndex(unsigned int nFileIn, unsigned int nBlockPosIn, CBlock& block)
@@ -1638,9 +1850,6 @@ public:
         nBlockPos = nBlockPosIn;
         nHeight = 0;
         nChainTrust = 0;
-	vCoinbase.assign(N_COLORS, 0);
-	vMoneySupply.assign(N_COLORS, 0);
-        vTotalMint.assign(N_COLORS, 0);
         nCoinbaseColor = block.GetCoinbaseColor();
         nFlags = 0;
         bnStakeModifier = 0;
@@ -1988,6 +2197,12 @@ public:
         vHave = vHaveIn;
     }
 
+    // Put hashes newer than the ones located so far, newest first, in front
+    void Prepend(const std::vector<uint256>& vHashes)
+    {
+        vHave.insert(vHave.begin(), vHashes.begin(), vHashes.end());
+    }
+
     IMPLEMENT_SERIALIZE
     (
         if (!(nType & SER_GETHASH))
@@ -27,10 +27,6 @@ std::mutex kawpowTemplateMutex;
 
 //  static bool fSHA256dMiningActive = false;
 
-// Epoch context cache for mining
-static std::map<int, std::shared_ptr<ethash_epoch_context>> mining_epoch_cache;
-static CCriticalSection cs_mining_epoch_cache;
-
 using namespace std;
 using namespace ethash;
 
@@ -1438,50 +1434,8 @@ void MineWithKawpow(CWallet* pwallet)
 
             // Get epoch context
             const int epoch_number = get_epoch_number(nHeight);
-            shared_ptr<ethash_epoch_context> context;
-
-            {
-                LOCK(cs_mining_epoch_cache);
-                auto it = mining_epoch_cache.find(epoch_number);
-                if (it != mining_epoch_cache.end())
-                {
-                    context = it->second;
-                }
-                else
-                {
-                    printf("KAWPoW miner: Creating DAG for epoch %d "
-                              "(height %d)...\n",
-                              epoch_number,
-                              nHeight);
-
-                    auto start_dag = GetTimeMicros();
-                    // Wrap the unique_ptr's released pointer in a shared_ptr,
-                    // preserving the custom deleter.
-                    auto unique_ctx = create_epoch_context(epoch_number);
-                    context = shared_ptr<ethash_epoch_context>(
-                        unique_ctx.release(),
-                        ethash_destroy_epoch_context
-                    );
-                    auto end_dag = GetTimeMicros();
-
-                    printf("KAWPoW miner: DAG creation took %.2f seconds\n",
-                              (end_dag - start_dag) / 1000000.0);
-
-                    // Cache the epoch (keep 2 latest epochs)
-                    mining_epoch_cache[epoch_number] = context;
-                    if (mining_epoch_cache.size() > 2)
-                    {
-                        mining_epoch_cache.erase(mining_epoch_cache.begin());
-                    }
-
-                    if (fDebugMiner)
-                    {
-                        printf(
-                            "getkawpowhash(): Created and cached epoch %d\n",
-                            epoch_number);
-                    }
-                }
-            }
+            shared_ptr<ethash_epoch_context> context =
+                GetKawpowEpochContext(epoch_number);
 
             // Get KAWPoW header hash
             uint256 headerHash = pblock->GetKAWPOWHeaderHash();
@@ -1753,12 +1707,6 @@ int StartKawpowMining(bool fGenerate, int nThreads, CWallet* pwallet)
         kawpowMinerThreads->join_all();
         delete kawpowMinerThreads;
         kawpowMinerThreads = nullptr;
-
-        // Clear epoch cache
-        {
-            LOCK(cs_mining_epoch_cache);
-            mining_epoch_cache.clear();
-        }
     }
 
     if (nThreads == 0 || !fGenerate)
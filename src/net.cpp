@@ -6,6 +6,7 @@
 #include "irc.h"
 #include "db.h"
 #include "net.h"
+#include "kernel.h"
 #include "init.h"
 #include "addrman.h"
 #include "ui_interface.h"
@@ -1901,6 +1902,19 @@ void StartNode(void* parg)
         {
             printf("Error: NewThread(ThreadStakeMiner) failed\n");
         }
+
+        // the stake miner joins the kernel search pool as the last worker
+        if (nStakeThreads)
+        {
+            printf("Using %d threads for stake kernel search\n", nStakeThreads);
+            for (int i = 0; i < nStakeThreads - 1; i++)
+            {
+                if (!NewThread(ThreadStakeKernelCheck, NULL))
+                {
+                    printf("Error: NewThread(ThreadStakeKernelCheck) failed\n");
+                }
+            }
+        }
     }
 }
 
@@ -201,6 +201,14 @@ public:
     uint256 hashLastGetBlocksEnd;
     int nStartingHeight;
 
+    // headers-first sync
+    int nHeadersHeight;
+    uint256 hashHeadersTip;
+    uint256 hashLastGetHeaders;
+    int64_t nHeadersRequestTime;
+    int nUnconnectingHeaders;
+    int nBlocksInFlight;
+
     // flood relay
     std::vector<CAddress> vAddrToSend;
     std::set<CAddress> setAddrKnown;
@@ -239,6 +247,12 @@ public:
         pindexLastGetBlocksBegin = 0;
         hashLastGetBlocksEnd = 0;
         nStartingHeight = -1;
+        nHeadersHeight = -1;
+        hashHeadersTip = 0;
+        hashLastGetHeaders = 0;
+        nHeadersRequestTime = 0;
+        nUnconnectingHeaders = 0;
+        nBlocksInFlight = 0;
         fGetAddr = false;
         nMisbehavior = 0;
         hashCheckpointKnown = 0;
@@ -181,6 +181,86 @@ Value getdifficulty(const Array& params, bool fHelp)
 }
 
 
+Value getsigcacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "Returns hit/miss counters and sizes of the signature and script verification caches.");
+
+    CVerifyCacheStats stats;
+    GetVerifyCacheStats(stats);
+
+    Object objSig;
+    objSig.push_back(Pair("hits",              (boost::uint64_t)stats.nSigHits));
+    objSig.push_back(Pair("misses",            (boost::uint64_t)stats.nSigMisses));
+    objSig.push_back(Pair("entries",           (boost::uint64_t)stats.nSigEntries));
+    objSig.push_back(Pair("maxentries",        GetArg("-maxsigcachesize", 50000)));
+
+    Object objScript;
+    objScript.push_back(Pair("hits",           (boost::uint64_t)stats.nScriptHits));
+    objScript.push_back(Pair("misses",         (boost::uint64_t)stats.nScriptMisses));
+    objScript.push_back(Pair("entries",        (boost::uint64_t)stats.nScriptEntries));
+    objScript.push_back(Pair("maxentries",     GetArg("-maxscriptcachesize", 50000)));
+
+    Object obj;
+    obj.push_back(Pair("signatures",           objSig));
+    obj.push_back(Pair("scripts",              objScript));
+    return obj;
+}
+
+
+Value testverify(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "testverify [signatures]\n"
+            "Signs [signatures] random hashes (default 1000) and times their\n"
+            "verification through both ECDSA backends, the curve (\"ec\") and\n"
+            "the OpenSSL EVP interface (\"evp\"), in verifications per second.");
+
+    int nSigs = 1000;
+    if (params.size() > 0)
+        nSigs = params[0].get_int();
+    if (nSigs < 1 || nSigs > 100000)
+        throw JSONRPCError(RPC_INVALID_PARAMS, "Signatures must be from 1 to 100,000");
+
+    vector<CPubKey> vPubKeys;
+    vector<uint256> vHashes;
+    vector<valtype> vSigs;
+    for (int i = 0; i < nSigs; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        uint256 hash = GetRandHash();
+        valtype vchSig;
+        if (!key.Sign(hash, vchSig))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Signing failed");
+        vPubKeys.push_back(key.GetPubKey());
+        vHashes.push_back(hash);
+        vSigs.push_back(vchSig);
+    }
+
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nSigs; i++)
+        if (!vPubKeys[i].VerifyEC(vHashes[i], vSigs[i]))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "VerifyEC rejected a good signature");
+    int64_t nECTime = GetTimeMicros() - nStart + 1;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nSigs; i++)
+        if (!vPubKeys[i].VerifyEVP(vHashes[i], vSigs[i]))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "VerifyEVP rejected a good signature");
+    int64_t nEVPTime = GetTimeMicros() - nStart + 1;
+
+    Object obj;
+    obj.push_back(Pair("signatures",           nSigs));
+    obj.push_back(Pair("ec",                   (boost::int64_t)nSigs * 1000000 / nECTime));
+    obj.push_back(Pair("evp",                  (boost::int64_t)nSigs * 1000000 / nEVPTime));
+    return obj;
+}
+
+
 Value settxfee(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
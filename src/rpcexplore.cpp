@@ -29,7 +29,7 @@ using namespace json_spirit;
 using namespace std;
 
 
-extern MapColorBalances mapAddressBalances;
+extern MapColorRichLists mapAddressBalances;
 
 static const unsigned int SEC_PER_DAY = 86400;
 
@@ -58,17 +58,16 @@ string CheckExploreAPI(bool& fHelp)
 // Address decoding
 //
 // Breakout addresses encode their color, so decoding a user-supplied address
-// yields both the canonical (color-scoped) address string used as the explore
-// key and the color needed to look up per-color records. Throws if invalid.
-int ExploreAddrColor(string& strAddress)
+// yields both the compact address used in explore keys and the color needed
+// to look up per-color records. Throws if invalid.
+int ExploreAddrColor(const string& strAddress, ExploreAddress& addrRet)
 {
-    CBitcoinAddress addr(strAddress);
-    if (!addr.IsValid())
+    int nColor;
+    if (!addrRet.SetString(strAddress, nColor))
     {
         throw runtime_error("Invalid address.");
     }
-    strAddress = addr.ToString();
-    return addr.nColor;
+    return nColor;
 }
 
 
@@ -81,12 +80,12 @@ int GetInOutID(const int nData)
 }
 
 void GetInputInfo(CExploreDB& exploredb,
-                   const string& strAddress, int nColor,
+                   const ExploreAddress& addr, int nColor,
                    const int id,
                    vector<AddrTxInfo>& vRet)
 {
     ExploreInput input;
-    if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, strAddress, nColor, id, input))
+    if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, addr, nColor, id, input))
     {
         throw runtime_error("TSNH: Problem reading input.");
     }
@@ -108,7 +107,7 @@ void GetInputInfo(CExploreDB& exploredb,
         }
         InOutInfo inout(extx.height, extx.vtx, input);
         AddrTxInfo addrtx;
-        addrtx.address = strAddress;
+        addrtx.address = addr.ToString(nColor);
         addrtx.extx = extx;
         addrtx.inouts.insert(inout);
         vRet.push_back(addrtx);
@@ -122,7 +121,7 @@ void GetInputInfo(CExploreDB& exploredb,
 }
 
 void GetAddrInputs(CExploreDB& exploredb,
-                   const string& strAddress, int nColor,
+                   const ExploreAddress& addr, int nColor,
                    const int nStart,
                    const int nMax,
                    const int nQtyInputs,
@@ -131,17 +130,17 @@ void GetAddrInputs(CExploreDB& exploredb,
     int nStop = min(nStart + nMax - 1, nQtyInputs);
     for (int id = nStart; id <= nStop; ++id)
     {
-        GetInputInfo(exploredb, strAddress, nColor, id, vRet);
+        GetInputInfo(exploredb, addr, nColor, id, vRet);
     }
 }
 
 void GetOutputInfo(CExploreDB& exploredb,
-                   const string& strAddress, int nColor,
+                   const ExploreAddress& addr, int nColor,
                    const int id,
                    vector<AddrTxInfo>& vRet)
 {
     ExploreOutput output;
-    if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, strAddress, nColor, id, output))
+    if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, addr, nColor, id, output))
     {
         throw runtime_error("TSNH: Problem reading output.");
     }
@@ -154,7 +153,7 @@ void GetOutputInfo(CExploreDB& exploredb,
         }
         InOutInfo inout(extx.height, extx.vtx, output);
         AddrTxInfo addrtx;
-        addrtx.address = strAddress;
+        addrtx.address = addr.ToString(nColor);
         addrtx.extx = extx;
         addrtx.inouts.insert(inout);
         vRet.push_back(addrtx);
@@ -168,7 +167,7 @@ void GetOutputInfo(CExploreDB& exploredb,
 }
 
 void GetAddrOutputs(CExploreDB& exploredb,
-                    const string& strAddress, int nColor,
+                    const ExploreAddress& addr, int nColor,
                     const int nStart,
                     const int nMax,
                     const int nQtyOutputs,
@@ -177,32 +176,32 @@ void GetAddrOutputs(CExploreDB& exploredb,
     int nStop = min(nStart + nMax - 1, nQtyOutputs);
     for (int i = nStart; i <= nStop; ++i)
     {
-        GetOutputInfo(exploredb, strAddress, nColor, i, vRet);
+        GetOutputInfo(exploredb, addr, nColor, i, vRet);
     }
 }
 
 void GetInOut(CExploreDB& exploredb,
-              const string& strAddress, int nColor,
+              const ExploreAddress& addr, int nColor,
               const int id,
               vector<AddrTxInfo>& vAddrTxRet)
 {
     ExploreInOutLookup inout;
-    if (!exploredb.ReadAddrTx(ADDR_TX_INOUT, strAddress, nColor, id, inout))
+    if (!exploredb.ReadAddrTx(ADDR_TX_INOUT, addr, nColor, id, inout))
     {
         throw runtime_error("TSNH: Problem reading inout.");
     }
     if (inout.IsInput())
     {
-        GetInputInfo(exploredb, strAddress, nColor, inout.GetID(), vAddrTxRet);
+        GetInputInfo(exploredb, addr, nColor, inout.GetID(), vAddrTxRet);
     }
     else
     {
-        GetOutputInfo(exploredb, strAddress, nColor, inout.GetID(), vAddrTxRet);
+        GetOutputInfo(exploredb, addr, nColor, inout.GetID(), vAddrTxRet);
     }
 }
 
 void GetInOuts(CExploreDB& exploredb,
-               const string& strAddress, int nColor,
+               const ExploreAddress& addr, int nColor,
                const int nStart,
                const int nMax,
                const int nQtyInOuts,
@@ -211,7 +210,7 @@ void GetInOuts(CExploreDB& exploredb,
     int nStop = min(nStart + nMax - 1, nQtyInOuts);
     for (int i = nStart; i <= nStop; ++i)
     {
-        GetInOut(exploredb, strAddress, nColor, i, vAddrTxRet);
+        GetInOut(exploredb, addr, nColor, i, vAddrTxRet);
     }
 }
 
@@ -219,47 +218,47 @@ void GetInOuts(CExploreDB& exploredb,
 //
 // Addresses
 //
-void GetAddrInfo(const string& strAddress, int nColor, Object& objRet)
+void GetAddrInfo(const ExploreAddress& addr, int nColor, Object& objRet)
 {
     CExploreDB exploredb;
 
-    if (!exploredb.AddrValueIsViable(ADDR_BALANCE, strAddress, nColor))
+    if (!exploredb.AddrValueIsViable(ADDR_BALANCE, addr, nColor))
     {
         throw runtime_error("Address does not exist.");
     }
 
     int64_t nBalance;
-    if (!exploredb.ReadAddrValue(ADDR_BALANCE, strAddress, nColor, nBalance))
+    if (!exploredb.ReadAddrValue(ADDR_BALANCE, addr, nColor, nBalance))
     {
          throw runtime_error("TSNH: Can't read balance.");
     }
 
     int nQtyVIO;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, strAddress, nColor, nQtyVIO))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyVIO))
     {
          throw runtime_error("TSNH: Can't read number of transactions.");
     }
 
     int nQtyOutputs;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, strAddress, nColor, nQtyOutputs))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutputs))
     {
          throw runtime_error("TSNH: Can't read number of outputs.");
     }
 
     int64_t nValueIn;
-    if (!exploredb.ReadAddrValue(ADDR_VALUEIN, strAddress, nColor, nValueIn))
+    if (!exploredb.ReadAddrValue(ADDR_VALUEIN, addr, nColor, nValueIn))
     {
          throw runtime_error("TSNH: Can't read total value in.");
     }
 
     int nQtyInputs;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, strAddress, nColor, nQtyInputs))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, addr, nColor, nQtyInputs))
     {
          throw runtime_error("TSNH: Can't read number of inputs.");
     }
 
     int64_t nValueOut;
-    if (!exploredb.ReadAddrValue(ADDR_VALUEOUT, strAddress, nColor, nValueOut))
+    if (!exploredb.ReadAddrValue(ADDR_VALUEOUT, addr, nColor, nValueOut))
     {
          throw runtime_error("TSNH: Can't read total value out.");
     }
@@ -267,30 +266,13 @@ void GetAddrInfo(const string& strAddress, int nColor, Object& objRet)
     int nRank = 0;
     if (nBalance > CENT[nColor])
     {
-        const MapBalanceCounts& mapForColor = mapAddressBalances[nColor];
-        MapBalanceCounts::const_iterator it;
-        for (it = mapForColor.begin(); it != mapForColor.end(); ++it)
-        {
-            if ((*it).first < nBalance)
-            {
-                break;
-            }
-            else if ((*it).first == nBalance)
-            {
-                // all in a tie have the same rank
-                nRank += 1;
-                break;
-            }
-            else
-            {
-                nRank += (*it).second;
-            }
-        }
+        // all in a tie have the same rank
+        nRank = mapAddressBalances[nColor].CountAbove(nBalance) + 1;
     }
 
     int nQtyUnspent = nQtyOutputs - nQtyInputs;
 
-    objRet.push_back(Pair("address", strAddress));
+    objRet.push_back(Pair("address", addr.ToString(nColor)));
     objRet.push_back(Pair("color", (boost::int64_t)nColor));
     objRet.push_back(Pair("balance", ValueFromAmount(nBalance, nColor)));
     objRet.push_back(Pair("rank", (boost::int64_t)nRank));
@@ -305,12 +287,12 @@ void GetAddrInfo(const string& strAddress, int nColor, Object& objRet)
 }
 
 void GetAddrTx(CExploreDB& exploredb,
-               const string& strAddress, int nColor,
+               const ExploreAddress& addr, int nColor,
                const int i,
                AddrTxInfo& addrtxRet)
 {
     ExploreInOutList vIO;
-    if (!exploredb.ReadAddrList(ADDR_LIST_VIO, strAddress, nColor, i, vIO))
+    if (!exploredb.ReadAddrList(ADDR_LIST_VIO, addr, nColor, i, vIO))
     {
         throw runtime_error("TSNH: Can't read transaction in-outs");
     }
@@ -325,7 +307,7 @@ void GetAddrTx(CExploreDB& exploredb,
         InOutInfo inoutinfo(j);
         if (inoutinfo.IsInput())
         {
-            if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, strAddress, nColor, GetInOutID(j),
+            if (!exploredb.ReadAddrTx(ADDR_TX_INPUT, addr, nColor, GetInOutID(j),
                                  inoutinfo.inout.input))
             {
                 throw runtime_error("TSNH: Problem reading input.");
@@ -333,7 +315,7 @@ void GetAddrTx(CExploreDB& exploredb,
         }
         else
         {
-            if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, strAddress, nColor, GetInOutID(j),
+            if (!exploredb.ReadAddrTx(ADDR_TX_OUTPUT, addr, nColor, GetInOutID(j),
                                  inoutinfo.inout.output))
             {
                 throw runtime_error("TSNH: Problem reading input.");
@@ -351,7 +333,7 @@ void GetAddrTx(CExploreDB& exploredb,
         {
            throw runtime_error("TSNH: In-outs not from the same tx.");
         }
-        addrtxRet.address = strAddress;
+        addrtxRet.address = addr.ToString(nColor);
         inoutinfo.height = addrtxRet.extx.height;
         inoutinfo.vtx = addrtxRet.extx.vtx;
         addrtxRet.inouts.insert(inoutinfo);
@@ -359,7 +341,7 @@ void GetAddrTx(CExploreDB& exploredb,
 }
 
 void GetAddrTxs(CExploreDB& exploredb,
-                const string& strAddress, int nColor,
+                const ExploreAddress& addr, int nColor,
                 const int nStart,
                 const int nMax,
                 const int nQtyTxs,
@@ -369,7 +351,7 @@ void GetAddrTxs(CExploreDB& exploredb,
     for (int i = nStart; i <= nStop; ++i)
     {
         AddrTxInfo addrtx;
-        GetAddrTx(exploredb, strAddress, nColor, i, addrtx);
+        GetAddrTx(exploredb, addr, nColor, i, addrtx);
         vAddrTxRet.push_back(addrtx);
     }
 }
@@ -423,18 +405,18 @@ Value getaddressbalance(const Array &params, bool fHelp)
             "Returns the balance of <address>.");
     }
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
-    if (!exploredb.AddrValueIsViable(ADDR_BALANCE, strAddress, nColor))
+    if (!exploredb.AddrValueIsViable(ADDR_BALANCE, addr, nColor))
     {
         throw runtime_error("Address does not exist.");
     }
 
     int64_t nBalance;
-    if (!exploredb.ReadAddrValue(ADDR_BALANCE, strAddress, nColor, nBalance))
+    if (!exploredb.ReadAddrValue(ADDR_BALANCE, addr, nColor, nBalance))
     {
          throw runtime_error("TSNH: Can't read balance.");
     }
@@ -453,11 +435,11 @@ Value getaddressinfo(const Array &params, bool fHelp)
             "Returns info about <address>.");
     }
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     Object obj;
-    GetAddrInfo(strAddress, nColor, obj);
+    GetAddrInfo(addr, nColor, obj);
     return obj;
 }
 
@@ -477,13 +459,13 @@ Value getaddressinputs(const Array &params, bool fHelp)
             "    [max] is the max inputs to return (default: 100)");
     }
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
     int nQtyInputs;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, strAddress, nColor, nQtyInputs))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_INPUT, addr, nColor, nQtyInputs))
     {
          throw runtime_error("TSNH: Can't read number of inputs.");
     }
@@ -522,7 +504,7 @@ Value getaddressinputs(const Array &params, bool fHelp)
 
     int nBestHeightStart = nBestHeight;
     vector<AddrTxInfo> vAddrTx;
-    GetAddrInputs(exploredb, strAddress, nColor, nStart, nMax, nQtyInputs, vAddrTx);
+    GetAddrInputs(exploredb, addr, nColor, nStart, nMax, nQtyInputs, vAddrTx);
     BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
     {
         unsigned int i = 0;
@@ -557,13 +539,13 @@ Value getaddressoutputs(const Array &params, bool fHelp)
             "    [max] is the max outputs to return (default: 100)");
     }
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
     int nQtyOutputs;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, strAddress, nColor, nQtyOutputs))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutputs))
     {
          throw runtime_error("TSNH: Can't read number of outputs.");
     }
@@ -602,7 +584,7 @@ Value getaddressoutputs(const Array &params, bool fHelp)
 
     int nBestHeightStart = nBestHeight;
     vector<AddrTxInfo> vAddrTx;
-    GetAddrOutputs(exploredb, strAddress, nColor, nStart, nMax, nQtyOutputs, vAddrTx);
+    GetAddrOutputs(exploredb, addr, nColor, nStart, nMax, nQtyOutputs, vAddrTx);
     BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
     {
         unsigned int i = 0;
@@ -646,12 +628,12 @@ static void EraseKey(Object& obj, const string& key)
 // Collect an address's unspent outputs as ready-to-return JSON objects
 // (in output order, "isspent" stripped).
 void GetAddrUtxos(CExploreDB& exploredb,
-                  const string& strAddress, int nColor,
+                  const ExploreAddress& addr, int nColor,
                   int nQtyOutputs, int nBestHeightStart,
                   vector<Object>& vUtxosRet)
 {
     vector<AddrTxInfo> vAddrTx;
-    GetAddrOutputs(exploredb, strAddress, nColor, 1, nQtyOutputs, nQtyOutputs, vAddrTx);
+    GetAddrOutputs(exploredb, addr, nColor, 1, nQtyOutputs, nQtyOutputs, vAddrTx);
     BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
     {
         unsigned int i = 0;
@@ -684,13 +666,13 @@ Value getaddressutxos(const Array &params, bool fHelp)
             "    [max] is the max UTXOs to return (default: 100)");
     }
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
     int nQtyOutputs;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, strAddress, nColor, nQtyOutputs))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutputs))
     {
          throw runtime_error("TSNH: Can't read number of outputs.");
     }
@@ -703,7 +685,7 @@ Value getaddressutxos(const Array &params, bool fHelp)
 
     int nBestHeightStart = nBestHeight;
     vector<Object> vUtxos;
-    GetAddrUtxos(exploredb, strAddress, nColor, nQtyOutputs, nBestHeightStart, vUtxos);
+    GetAddrUtxos(exploredb, addr, nColor, nQtyOutputs, nBestHeightStart, vUtxos);
 
     int nQty = (int)vUtxos.size();
     if (nQty == 0)
@@ -761,13 +743,13 @@ Value getaddressutxospg(const Array &params, bool fHelp)
     // leading params = 1 (1st param is <address>, 2nd is <page>)
     static const unsigned int LEADING_PARAMS = 1;
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
     int nQtyOutputs;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, strAddress, nColor, nQtyOutputs))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_OUTPUT, addr, nColor, nQtyOutputs))
     {
          throw runtime_error("TSNH: Can't read number of outputs.");
     }
@@ -779,7 +761,7 @@ Value getaddressutxospg(const Array &params, bool fHelp)
 
     int nBestHeightStart = nBestHeight;
     vector<Object> vUtxos;
-    GetAddrUtxos(exploredb, strAddress, nColor, nQtyOutputs, nBestHeightStart, vUtxos);
+    GetAddrUtxos(exploredb, addr, nColor, nQtyOutputs, nBestHeightStart, vUtxos);
 
     int nTotal = (int)vUtxos.size();
     if (nTotal == 0)
@@ -829,13 +811,13 @@ Value getaddresstxspg(const Array &params, bool fHelp)
     // leading params = 1 (1st param is <address>, 2nd is <page>)
     static const unsigned int LEADING_PARAMS = 1;
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
     int nQtyTxs;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, strAddress, nColor, nQtyTxs))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_VIO, addr, nColor, nQtyTxs))
     {
          throw runtime_error("TSNH: Can't read number of transactions.");
     }
@@ -849,7 +831,7 @@ Value getaddresstxspg(const Array &params, bool fHelp)
     GetPagination(params, LEADING_PARAMS, nQtyTxs, pg);
 
     vector<AddrTxInfo> vAddrTx;
-    GetAddrTxs(exploredb, strAddress, nColor, pg.start, pg.max, nQtyTxs, vAddrTx);
+    GetAddrTxs(exploredb, addr, nColor, pg.start, pg.max, nQtyTxs, vAddrTx);
 
     if (!pg.forward)
     {
@@ -890,13 +872,13 @@ Value getaddressinouts(const Array &params, bool fHelp)
             "    [max] is the max in-outs to return (default: 100)");
     }
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
     int nQtyInOuts;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, strAddress, nColor, nQtyInOuts))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
     {
          throw runtime_error("TSNH: Can't read number of in-outs.");
     }
@@ -935,7 +917,7 @@ Value getaddressinouts(const Array &params, bool fHelp)
 
     int nBestHeightStart = nBestHeight;
     vector<AddrTxInfo> vAddrTx;
-    GetInOuts(exploredb, strAddress, nColor, nStart, nMax, nQtyInOuts, vAddrTx);
+    GetInOuts(exploredb, addr, nColor, nStart, nMax, nQtyInOuts, vAddrTx);
 
     BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
     {
@@ -970,13 +952,13 @@ Value getaddressinoutspg(const Array &params, bool fHelp)
     // leading params = 1 (1st param is <address>, 2nd is <page>)
     static const unsigned int LEADING_PARAMS = 1;
 
-    string strAddress = params[0].get_str();
-    int nColor = ExploreAddrColor(strAddress);
+    ExploreAddress addr;
+    int nColor = ExploreAddrColor(params[0].get_str(), addr);
 
     CExploreDB exploredb;
 
     int nQtyInOuts;
-    if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, strAddress, nColor, nQtyInOuts))
+    if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, addr, nColor, nQtyInOuts))
     {
          throw runtime_error("TSNH: Can't read number of in-outs.");
     }
@@ -990,7 +972,7 @@ Value getaddressinoutspg(const Array &params, bool fHelp)
     GetPagination(params, LEADING_PARAMS, nQtyInOuts, pg);
 
     vector<AddrTxInfo> vAddrTx;
-    GetInOuts(exploredb, strAddress, nColor, pg.start, pg.max, nQtyInOuts, vAddrTx);
+    GetInOuts(exploredb, addr, nColor, pg.start, pg.max, nQtyInOuts, vAddrTx);
 
     int nBestHeightStart = nBestHeight;
     Array data;
@@ -1059,9 +1041,9 @@ typedef std::pair<int, int> txkey_t;
 class AddrInOutList : public ExploreInOutList
 {
 public:
-    std::string address;
+    ExploreAddress address;
     int color;
-    AddrInOutList(const std::string& addressIn,
+    AddrInOutList(const ExploreAddress& addressIn,
                   int colorIn,
                   const ExploreInOutList& inoutlistIn)
         : ExploreInOutList(inoutlistIn)
@@ -1074,7 +1056,7 @@ public:
 // A used (address, color) belonging to the HD account.
 struct HDAddr
 {
-    std::string address;
+    ExploreAddress address;
     int color;
     CPubKey pubkey;
     uint32_t child;
@@ -1155,14 +1137,14 @@ void GetHDAccountAddrs(CExploreDB& exploredb,
         for (uint32_t nChild = 0; nChild < nMaxHDChildren; ++nChild)
         {
             CPubKey pubKey = GetHDChildPubKey(hdParent, nChild);
+            ExploreAddress addr(pubKey.GetID());
             bool fUsed = false;
             BOOST_FOREACH(int c, vColors)
             {
-                string strAddress = GetColorAddress(pubKey, c);
-                if (exploredb.AddrValueIsViable(ADDR_BALANCE, strAddress, c))
+                if (exploredb.AddrValueIsViable(ADDR_BALANCE, addr, c))
                 {
                     HDAddr hd;
-                    hd.address = strAddress;
+                    hd.address = addr;
                     hd.color = c;
                     hd.pubkey = pubKey;
                     hd.child = nChild;
@@ -1321,7 +1303,7 @@ void GetHDTxList(CExploreDB& exploredb,
             BOOST_FOREACH(const int& n, jt->vinouts)
             {
                 AddrInOutInfo addrinout(n);
-                addrinout.address = jt->address;
+                addrinout.address = jt->address.ToString(jt->color);
                 if (addrinout.IsInput())
                 {
                     if (!exploredb.ReadAddrTx(ADDR_TX_INPUT,
@@ -1463,24 +1445,24 @@ Value gethdaddresses(const Array &params, bool fHelp)
         for (uint32_t nChild = 0; nChild < nMaxHDChildren; ++nChild)
         {
             CPubKey pubKey = GetHDChildPubKey(hdParent, nChild);
+            ExploreAddress addr(pubKey.GetID());
 
             Array aryAddrs;
             bool fUsed = false;
             BOOST_FOREACH(int c, vColors)
             {
-                string strAddress = GetColorAddress(pubKey, c);
-                if (!exploredb.AddrValueIsViable(ADDR_BALANCE, strAddress, c))
+                if (!exploredb.AddrValueIsViable(ADDR_BALANCE, addr, c))
                 {
                     continue;
                 }
                 int nQtyInOuts = 0;
-                if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, strAddress, c, nQtyInOuts))
+                if (!exploredb.ReadAddrQty(ADDR_QTY_INOUT, addr, c, nQtyInOuts))
                 {
                     throw runtime_error("TSNH: Can't read number of in-outs.");
                 }
                 Object objAddr;
                 objAddr.push_back(Pair("color", (boost::int64_t)c));
-                objAddr.push_back(Pair("address", strAddress));
+                objAddr.push_back(Pair("address", addr.ToString(c)));
                 objAddr.push_back(Pair("inouts", (boost::int64_t)nQtyInOuts));
                 aryAddrs.push_back(objAddr);
                 fUsed = true;
@@ -2112,17 +2094,7 @@ int ExploreCheckColor(const Value& v)
 
 boost::int64_t GetRichListSize(int nColor, int64_t nMinBalance)
 {
-    unsigned int nCount = 0;
-    const MapBalanceCounts& mapForColor = mapAddressBalances[nColor];
-    MapBalanceCounts::const_iterator it;
-    for (it = mapForColor.begin(); it != mapForColor.end(); ++it)
-    {
-        if ((*it).first < nMinBalance)
-        {
-            break;
-        }
-        nCount += (*it).second;
-    }
+    unsigned int nCount = mapAddressBalances[nColor].CountAtLeast(nMinBalance);
     return static_cast<boost::int64_t>(nCount);
 }
 
@@ -2151,49 +2123,16 @@ Value getrichlistsize(const Array &params, bool fHelp)
 
 
 
+// Ties are ordered by address, so consecutive pages neither repeat nor
+// skip addresses.
 void GetRichList(int nColor, int nStart, int nMax, Object& objRet)
 {
-    CExploreDB exploredb;
-    int nLimit = nStart + nMax - 1;
-    int nCount = 0;
-
-    const MapBalanceCounts& mapForColor = mapAddressBalances[nColor];
-    MapBalanceCounts::const_iterator it;
-    for (it = mapForColor.begin(); it != mapForColor.end(); ++it)
+    vector<ExploreRichList::Entry> vEntries;
+    mapAddressBalances[nColor].GetRange(nStart - 1, nMax, vEntries);
+    BOOST_FOREACH(const ExploreRichList::Entry& entry, vEntries)
     {
-        int nSize = static_cast<int>((*it).second);
-        if ((nSize + nCount) >= nStart)
-        {
-            int64_t nBalance = (*it).first;
-            set<string> setBalances;
-            if (!exploredb.ReadAddrSet(ADDR_SET_BAL, nColor, nBalance, setBalances))
-            {
-                throw runtime_error(
-                        strprintf("TSNH: unable to read balance set %s",
-                                  FormatMoney(nBalance, nColor).c_str()));
-            }
-            // sanity check
-            if (nSize != static_cast<int>(setBalances.size()))
-            {
-                throw runtime_error(
-                        strprintf("TSNH: balance set %s size mismatch",
-                                  FormatMoney(nBalance, nColor).c_str()));
-            }
-            BOOST_FOREACH(const string& addr, setBalances)
-            {
-                objRet.push_back(Pair(addr, ValueFromAmount(nBalance, nColor)));
-                nCount += 1;
-            }
-            // return all that tied for last spot
-            if (nCount >= nLimit)
-            {
-                break;
-            }
-        }
-        else
-        {
-            nCount += nSize;
-        }
+        objRet.push_back(Pair(entry.address.ToString(nColor),
+                              ValueFromAmount(entry.balance, nColor)));
     }
 }
 
@@ -18,10 +18,6 @@
 using namespace json_spirit;
 using namespace std;
 
-// Epoch context cache for mining
-static map<int, shared_ptr<ethash_epoch_context>> mining_epoch_cache;
-static CCriticalSection cs_mining_epoch_cache;
-
 static const unsigned int DEFAULT_GENERATE_THREADS = 1;
 
 
@@ -49,13 +45,16 @@ void GetKawpowMiningInfo(Object& obj)
 
     // Add epoch cache information
     {
-        LOCK(cs_mining_epoch_cache);
+        vector<pair<int, uint64_t> > vEpochs;
+        GetKawpowEpochCacheInfo(vEpochs);
         Array epochArray;
-        for (const auto& pair : mining_epoch_cache)
+        for (const auto& pair : vEpochs)
         {
             Object epochObj;
             epochObj.push_back(Pair("epoch", pair.first));
-            epochObj.push_back(Pair("dag_size", (int64_t)ethash::get_full_dataset_size(pair.first)));
+            epochObj.push_back(Pair("light_cache_size", (boost::int64_t)pair.second));
+            epochObj.push_back(Pair("dag_size", (boost::int64_t)ethash::get_full_dataset_size(
+                                    ethash::calculate_full_dataset_num_items(pair.first))));
             epochArray.push_back(epochObj);
         }
         obj.push_back(Pair("cached_epochs", epochArray));
@@ -170,7 +169,7 @@ Value generateblocks(shared_ptr<CReserveKey> coinbaseScript,
 
             // Get epoch context
             const int epoch_number = ethash::get_epoch_number(pblock->nHeight);
-            auto context = ethash::create_epoch_context(epoch_number);
+            auto context = GetKawpowEpochContext(epoch_number);
 
             // Get header hash
             uint256 headerHash = pblock->GetKAWPOWHeaderHash();
@@ -684,8 +683,12 @@ Value getworkex(const Array& params, bool fHelp)
         }
         else
         {
+            // read into a copy: pblock is reused, and a transaction
+            // read in place would keep its txid (see CTransaction::CacheHash)
+            CTransaction txCoinbase;
             CDataStream(coinbase, SER_NETWORK, PROTOCOL_VERSION) >>
-                pblock->vtx[0];  // FIXME - AGS!
+                txCoinbase;  // FIXME - AGS!
+            pblock->vtx[0] = txCoinbase;
         }
 
         pblock->hashMerkleRoot = pblock->BuildMerkleTree();
@@ -1383,52 +1386,8 @@ Value getkawpowhash(const Array& params, bool fHelp)
                   nHeight);
     }
 
-    // Create epoch context (this may take time for first use of an epoch)
-    static map<int, shared_ptr<ethash_epoch_context>> epoch_cache;
-    static CCriticalSection cs_epoch_cache;
-
-    shared_ptr<ethash_epoch_context> context;
-    {
-        LOCK(cs_epoch_cache);
-        auto it = epoch_cache.find(epoch_number);
-        if (it != epoch_cache.end())
-        {
-            context = it->second;
-        }
-        else
-        {
-            printf("getkawpowhash(): Creating DAG for epoch %d "
-                      "(height %d)...\n",
-                      epoch_number,
-                      nHeight);
-
-            auto start_dag = GetTimeMicros();
-            // Wrap the unique_ptr's released pointer in a shared_ptr,
-            // preserving the custom deleter.
-            auto unique_ctx = ethash::create_epoch_context(epoch_number);
-            context = shared_ptr<ethash_epoch_context>(
-                unique_ctx.release(),
-                ethash_destroy_epoch_context
-            );
-            auto end_dag = GetTimeMicros();
-
-            printf("getkawpowhash(): DAG creation took %.2f seconds\n",
-                      (end_dag - start_dag) / 1000000.0);
-
-            // Cache the epoch (keep 2 latest epochs)
-            epoch_cache[epoch_number] = context;
-            if (epoch_cache.size() > 2)
-            {
-                epoch_cache.erase(epoch_cache.begin());
-            }
-
-            if (fDebugMiner)
-            {
-                printf("getkawpowhash(): Created and cached epoch %d\n",
-                          epoch_number);
-            }
-        }
-    }
+    // Shared with the miner and validation; built on first use of an epoch
+    std::shared_ptr<ethash_epoch_context> context = GetKawpowEpochContext(epoch_number);
 
     // Calculate ProgPoW hash
     auto start_time = GetTimeMicros();
@@ -1747,7 +1706,7 @@ Value testkawpow(const Array& params, bool fHelp)
 
     // Get epoch context
     const int epoch_number = ethash::get_epoch_number(nHeight);
-    auto context = ethash::create_epoch_context(epoch_number);
+    auto context = GetKawpowEpochContext(epoch_number);
 
     // Run test
     auto start_time = GetTimeMillis();
@@ -644,6 +644,78 @@ Value decodescript(const Array& params, bool fHelp)
     return r;
 }
 
+Value testscripttemplate(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "testscripttemplate [iterations]\n"
+            "\nTime MatchScriptTemplate against Solver on the standard scripts.\n"
+
+            "\nArguments:\n"
+            "1. iterations  (number, optional, default=10000) Passes over the scripts\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"scripts\" : n,          (number) Scripts classified by each\n"
+            "  \"template_ms\" : n,      (number) Time taken by MatchScriptTemplate\n"
+            "  \"solver_ms\" : n,        (number) Time taken by Solver\n"
+            "  \"speedup\" : n.nnn       (number) Solver time over template time\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("testscripttemplate", "100000")
+        );
+
+    int nIterations = 10000;
+    if (params.size() > 0)
+        nIterations = params[0].get_int();
+    if (nIterations < 1 || nIterations > 1000000)
+        throw JSONRPCError(RPC_INVALID_PARAMS, "Iterations must be from 1 to 1,000,000");
+
+    CKey key[3];
+    for (int i = 0; i < 3; i++)
+        key[i].MakeNewKey(i != 1);
+    CKeyID keyID = key[0].GetPubKey().GetID();
+    valtype vchHash(keyID.begin(), keyID.end());
+
+    vector<CScript> vScripts;
+    vScripts.push_back(CScript() << key[0].GetPubKey() << OP_CHECKSIG);
+    vScripts.push_back(CScript() << key[1].GetPubKey() << OP_CHECKSIG);
+    vScripts.push_back(CScript() << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG);
+    vScripts.push_back(CScript() << OP_HASH160 << vchHash << OP_EQUAL);
+    vScripts.push_back(CScript() << OP_2 << key[0].GetPubKey() << key[1].GetPubKey()
+                                 << key[2].GetPubKey() << OP_3 << OP_CHECKMULTISIG);
+    vScripts.push_back(CScript() << OP_RETURN << valtype(33, 6));
+
+    CScriptTemplate tmpl;
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    int64_t nMatched = 0;
+
+    int64_t nStart = GetTimeMillis();
+    for (int n = 0; n < nIterations; n++)
+        BOOST_FOREACH(const CScript& script, vScripts)
+            nMatched += MatchScriptTemplate(script, tmpl);
+    int64_t nTemplateTime = GetTimeMillis() - nStart;
+
+    nStart = GetTimeMillis();
+    for (int n = 0; n < nIterations; n++)
+        BOOST_FOREACH(const CScript& script, vScripts)
+            nMatched += Solver(script, whichType, vSolutions);
+    int64_t nSolverTime = GetTimeMillis() - nStart;
+
+    int64_t nScripts = (int64_t)nIterations * vScripts.size();
+    if (nMatched != 2 * nScripts)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "MatchScriptTemplate and Solver disagree");
+
+    Object result;
+    result.push_back(Pair("scripts", nScripts));
+    result.push_back(Pair("template_ms", nTemplateTime));
+    result.push_back(Pair("solver_ms", nSolverTime));
+    result.push_back(Pair("speedup", (double)nSolverTime / max(nTemplateTime, (int64_t)1)));
+    return result;
+}
+
 Value signrawtransaction(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 4)
@@ -800,6 +872,7 @@ Value signrawtransaction(const Array& params, bool fHelp)
     Object result;
 
     // Sign what we can:
+    CSignatureHashContext sighash(mergedTx);
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++)
     {
         CTxIn& txin = mergedTx.vin[i];
@@ -814,7 +887,7 @@ Value signrawtransaction(const Array& params, bool fHelp)
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mergedTx.vout.size()))
         {
-            uint8_t iSSResult = SignSignature(keystore, prevPubKey, mergedTx, i, nHashType);
+            uint8_t iSSResult = SignSignature(keystore, prevPubKey, mergedTx, i, nHashType, &sighash);
             if (fDebug && (iSSResult > 0))
             {
                 printf("signrawtransaction: Problem signing with SignSignature: %d\n", (int) iSSResult);
@@ -827,7 +900,7 @@ Value signrawtransaction(const Array& params, bool fHelp)
             // txin.scriptSig starts empty (cleared above)
             txin.scriptSig = CombineSignatures(prevPubKey, mergedTx, i, txin.scriptSig, txv.vin[i].scriptSig);
         }
-        if (!VerifyScript(txin.scriptSig, prevPubKey, mergedTx, i, STANDARD_SCRIPT_VERIFY_FLAGS, 0))
+        if (!VerifyScript(txin.scriptSig, prevPubKey, mergedTx, i, STANDARD_SCRIPT_VERIFY_FLAGS, 0, &sighash))
         {
             fComplete = false;
         }
@@ -897,8 +970,8 @@ Value sendrawtransaction(const Array& params, bool fHelp)
             ColorsMap mapReceived;
             ColorsMap mapSent;
             wtx.GetAmounts(false, mapReceived, mapSent);
-            pwalletMain->mapReceived.Add(mapReceived);
-            pwalletMain->mapSent.Add(mapSent);
+            pwalletMain->AddBalanceChanges(ColorsMap(), ColorsMap(),
+                                           ColorsMap(), mapReceived, mapSent);
         }
     }
     RelayTransaction(tx, hashTx);
@@ -3574,6 +3574,7 @@ Value scanforstealthtxns(const Array& params, bool fHelp)
         CBlock block;
         block.ReadFromDisk(pindex, true);
 
+        pwalletMain->ScanStealthBlock(block);
         BOOST_FOREACH(CTransaction& tx, block.vtx)
         {
             if (!tx.IsStandard())
@@ -3582,6 +3583,7 @@ Value scanforstealthtxns(const Array& params, bool fHelp)
 
             pwalletMain->AddToWalletIfInvolvingMe(tx, &block, fUpdate);
         };
+        pwalletMain->ClearStealthScan();
 
         pindex = pindex->pnext;
     };
@@ -7,6 +7,8 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
 
+#include <atomic>
+
 using namespace std;
 using namespace boost;
 
@@ -18,7 +20,8 @@ using namespace boost;
 #include "sync.h"
 #include "util.h"
 
-bool CheckSig(valtype vchSig, const valtype &vchPubKey, const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, int flags);
+bool CheckSig(valtype vchSig, const valtype &vchPubKey, const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, int flags,
+              const CSignatureHashContext* psighash = NULL);
 
 static const valtype vchFalse(0);
 static const valtype vchZero(0);
@@ -396,7 +399,8 @@ static bool CheckLockTime(const CTransaction& txTo, unsigned int nIn, const CBig
     return true;
 }
 
-bool EvalScript(vector<valtype >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType)
+bool EvalScript(vector<valtype >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType,
+                const CSignatureHashContext* psighash)
 {
     CAutoBN_CTX pctx;
     CScript::const_iterator pc = script.begin();
@@ -1159,7 +1163,8 @@ bool EvalScript(vector<valtype >& stack, const CScript& script, const CTransacti
                                              txTo,
                                              nIn,
                                              nHashType,
-                                             flags);
+                                             flags,
+                                             psighash);
 
                     popstack(stack);
                     popstack(stack);
@@ -1227,7 +1232,7 @@ bool EvalScript(vector<valtype >& stack, const CScript& script, const CTransacti
 
                         // Check signature
                         bool fOk = CheckSignatureEncoding(vchSig, flags) && CheckPubKeyEncoding(vchPubKey) &&
-                            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags);
+                            CheckSig(vchSig, vchPubKey, scriptCode, txTo, nIn, nHashType, flags, psighash);
 
                         if (fOk)
                         {
@@ -1368,6 +1373,210 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int
 }
 
 
+// Feeds serialized objects straight into a digest context
+class CSigHashWriter
+{
+private:
+    EVP_MD_CTX* ctx;
+
+public:
+    explicit CSigHashWriter(EVP_MD_CTX* ctxIn) : ctx(ctxIn) {}
+
+    CSigHashWriter& write(const char* pch, size_t size)
+    {
+        ctx_update_range(ctx, reinterpret_cast<const unsigned char*>(pch), size);
+        return *this;
+    }
+
+    CSigHashWriter& write(const std::vector<unsigned char>& vch, size_t nPos, size_t nSize)
+    {
+        ctx_update_range(ctx, vch.data() + nPos, nSize);
+        return *this;
+    }
+
+    template<typename T>
+    CSigHashWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, SER_GETHASH, 0);
+        return *this;
+    }
+};
+
+CSignatureHashContext::CSignatureHashContext(const CTransaction& txToIn) :
+    txTo(txToIn), hashTx(txToIn.GetHash())
+{
+    CDataStream ss(SER_GETHASH, 0);
+    if ((GetFork(txTo.nTime) < BRK_FORK007) || !txTo.IsCoinBase())
+    {
+        ss << hashTx;
+    }
+    ss << txTo.nVersion << txTo.nTime;
+    vchPrefix.assign(ss.begin(), ss.end());
+
+    ss.clear();
+    BOOST_FOREACH(const CTxIn& txin, txTo.vin)
+    {
+        ss << txin.prevout << CScript() << txin.nSequence;
+    }
+    vchInputs.assign(ss.begin(), ss.end());
+    assert(vchInputs.size() == txTo.vin.size() * BLANK_TXIN_SIZE);
+
+    ss.clear();
+    vOutputPos.reserve(txTo.vout.size() + 1);
+    BOOST_FOREACH(const CTxOut& txout, txTo.vout)
+    {
+        vOutputPos.push_back(ss.size());
+        ss << txout;
+    }
+    vOutputPos.push_back(ss.size());
+    vchOutputs.assign(ss.begin(), ss.end());
+
+    ss.clear();
+    CTxOut txoutNull;
+    txoutNull.SetNull();
+    ss << txoutNull;
+    vchNullOutput.assign(ss.begin(), ss.end());
+
+    ss.clear();
+    ss << txTo.nLockTime << txTo.strTxComment << txTo.nServiceTypeID;
+    vchSuffix.assign(ss.begin(), ss.end());
+
+    // one pass over the blanked inputs, saving the state at each interval
+    EvpMdCtx mdctx;
+    if (!EVP_DigestInit_ex(mdctx.ctx, EVP_sha256(), nullptr))
+        throw std::runtime_error("CSignatureHashContext: EVP_DigestInit_ex failed");
+    CSigHashWriter hw(mdctx.ctx);
+    hw.write(vchPrefix, 0, vchPrefix.size());
+    WriteCompactSize(hw, txTo.vin.size());
+    for (unsigned int i = 0; i < txTo.vin.size(); i += SIGHASH_MIDSTATE_INTERVAL)
+    {
+        if (i > 0)
+            hw.write(vchInputs, (i - SIGHASH_MIDSTATE_INTERVAL) * BLANK_TXIN_SIZE,
+                     SIGHASH_MIDSTATE_INTERVAL * BLANK_TXIN_SIZE);
+        vMidstate.push_back(std::unique_ptr<EvpMdCtx>(new EvpMdCtx()));
+        if (!EVP_MD_CTX_copy_ex(vMidstate.back()->ctx, mdctx.ctx))
+            throw std::runtime_error("CSignatureHashContext: EVP_MD_CTX_copy_ex failed");
+    }
+}
+
+uint256 CSignatureHashContext::GetHash(const CScript& scriptCodeIn, unsigned int nIn, int nHashType) const
+{
+    if (nIn >= txTo.vin.size())
+    {
+        printf("ERROR: SignatureHash() : nIn=%d out of range\n", nIn);
+        return 1;
+    }
+
+    bool fAll = false;
+    bool fSingle = false;
+    switch (nHashType & 0x1f)
+    {
+    case SIGHASH_NONE:
+        break;
+    case SIGHASH_SINGLE:
+        if (nIn >= txTo.vout.size())
+        {
+            printf("ERROR: SignatureHash() : nOut=%d out of range\n", nIn);
+            return 1;
+        }
+        fSingle = true;
+        break;
+    default:
+        fAll = true;
+    }
+    bool fAnyoneCanPay = (nHashType & SIGHASH_ANYONECANPAY);
+
+    CScript scriptCode(scriptCodeIn);
+    scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
+
+    EvpMdCtx mdctx;
+    CSigHashWriter hw(mdctx.ctx);
+    unsigned int nNext = 0;
+    if (fAll && !fAnyoneCanPay)
+    {
+        // resume from the last midstate before this input
+        unsigned int k = nIn / SIGHASH_MIDSTATE_INTERVAL;
+        if (!EVP_MD_CTX_copy_ex(mdctx.ctx, vMidstate[k]->ctx))
+            throw std::runtime_error("CSignatureHashContext: EVP_MD_CTX_copy_ex failed");
+        nNext = k * SIGHASH_MIDSTATE_INTERVAL;
+    }
+    else
+    {
+        if (!EVP_DigestInit_ex(mdctx.ctx, EVP_sha256(), nullptr))
+            throw std::runtime_error("CSignatureHashContext: EVP_DigestInit_ex failed");
+        hw.write(vchPrefix, 0, vchPrefix.size());
+        WriteCompactSize(hw, fAnyoneCanPay ? 1 : txTo.vin.size());
+    }
+
+    // the other inputs, with nSequence zeroed unless SIGHASH_ALL
+    static const char pchZeroSequence[4] = {};
+    const unsigned int nBlankScriptEnd = BLANK_TXIN_SIZE - 4;
+    if (!fAnyoneCanPay)
+    {
+        if (fAll)
+        {
+            hw.write(vchInputs, nNext * BLANK_TXIN_SIZE, (nIn - nNext) * BLANK_TXIN_SIZE);
+        }
+        else
+        {
+            for (unsigned int i = 0; i < nIn; i++)
+            {
+                hw.write(vchInputs, i * BLANK_TXIN_SIZE, nBlankScriptEnd);
+                hw.write(pchZeroSequence, sizeof(pchZeroSequence));
+            }
+        }
+    }
+
+    const CTxIn& txin = txTo.vin[nIn];
+    hw << txin.prevout << scriptCode << txin.nSequence;
+
+    if (!fAnyoneCanPay)
+    {
+        if (fAll)
+        {
+            unsigned int nPos = (nIn + 1) * BLANK_TXIN_SIZE;
+            hw.write(vchInputs, nPos, vchInputs.size() - nPos);
+        }
+        else
+        {
+            for (unsigned int i = nIn + 1; i < txTo.vin.size(); i++)
+            {
+                hw.write(vchInputs, i * BLANK_TXIN_SIZE, nBlankScriptEnd);
+                hw.write(pchZeroSequence, sizeof(pchZeroSequence));
+            }
+        }
+    }
+
+    if (fAll)
+    {
+        WriteCompactSize(hw, txTo.vout.size());
+        hw.write(vchOutputs, 0, vchOutputs.size());
+    }
+    else if (fSingle)
+    {
+        WriteCompactSize(hw, nIn + 1);
+        for (unsigned int i = 0; i < nIn; i++)
+            hw.write(vchNullOutput, 0, vchNullOutput.size());
+        hw.write(vchOutputs, vOutputPos[nIn], vOutputPos[nIn + 1] - vOutputPos[nIn]);
+    }
+    else
+    {
+        WriteCompactSize(hw, 0);
+    }
+
+    hw.write(vchSuffix, 0, vchSuffix.size());
+    hw << nHashType;
+
+    uint256 hash1, hash2;
+    unsigned int outlen = 32;
+    if (!EVP_DigestFinal_ex(mdctx.ctx, reinterpret_cast<unsigned char*>(&hash1), &outlen))
+        throw std::runtime_error("CSignatureHashContext: EVP_DigestFinal_ex failed");
+    SHA256_Once(reinterpret_cast<const unsigned char*>(&hash1), sizeof(hash1),
+                reinterpret_cast<unsigned char*>(&hash2));
+    return hash2;
+}
+
+
 // Valid signature cache, to avoid doing expensive ECDSA signature checking
 // twice for every transaction (once when accepted into memory pool, and
 // again when accepted into the block chain)
@@ -1381,6 +1590,11 @@ private:
     boost::shared_mutex cs_sigcache;
 
 public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CSignatureCache() : nHits(0), nMisses(0) {}
+
     bool
     Get(const uint256 &hash, const valtype& vchSig, const CPubKey& pubKey)
     {
@@ -1389,7 +1603,11 @@ public:
         sigdata_type k(hash, vchSig, pubKey);
         set<sigdata_type>::iterator mi = setValid.find(k);
         if (mi != setValid.end())
+        {
+            ++nHits;
             return true;
+        }
+        ++nMisses;
         return false;
     }
 
@@ -1422,13 +1640,107 @@ public:
         sigdata_type k(hash, vchSig, pubKey);
         setValid.insert(k);
     }
+
+    uint64_t Size()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.size();
+    }
 };
 
-bool CheckSig(valtype vchSig, const valtype &vchPubKey, const CScript &scriptCode,
-              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags)
+static CSignatureCache signatureCache;
+
+
+// Valid script cache, one level above the signature cache. Keyed by
+// (txid, input, flags, scriptPubKey), so a transaction that passed
+// CTxMemPool::accept skips SignatureHash and script evaluation entirely
+// when its block is connected. Entries are dropped once a block uses them.
+
+class CScriptCache
+{
+private:
+    set<uint256> setValid;
+    boost::shared_mutex cs_scriptcache;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CScriptCache() : nHits(0), nMisses(0) {}
+
+    static uint256 GetEntry(const CScript& scriptPubKey, const uint256& hashTx,
+                            const CTransaction& txTo, unsigned int nIn, unsigned int flags)
+    {
+        // SCRIPT_VERIFY_NOCACHE only says whether to add, not what was checked
+        unsigned int nCheckFlags = flags & ~SCRIPT_VERIFY_NOCACHE;
+        CHashWriter ss(SER_GETHASH, 0);
+        // the txid leaves out the scriptSigs, so the one checked goes in too
+        ss << hashTx << nIn << nCheckFlags << scriptPubKey << txTo.vin[nIn].scriptSig;
+        return ss.GetHash();
+    }
+
+    bool Get(const uint256& entry, bool fErase)
+    {
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_scriptcache);
+            if (setValid.count(entry) == 0)
+            {
+                ++nMisses;
+                return false;
+            }
+        }
+        ++nHits;
+        if (fErase)
+        {
+            boost::unique_lock<boost::shared_mutex> lock(cs_scriptcache);
+            setValid.erase(entry);
+        }
+        return true;
+    }
+
+    void Set(const uint256& entry)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxscriptcachesize", 50000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_scriptcache);
+
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        {
+            // random eviction, same reasoning as CSignatureCache
+            set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(entry);
+    }
+
+    uint64_t Size()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_scriptcache);
+        return setValid.size();
+    }
+};
+
+static CScriptCache scriptCache;
+
+
+void GetVerifyCacheStats(CVerifyCacheStats& stats)
 {
-    static CSignatureCache signatureCache;
+    stats.nSigHits = signatureCache.nHits;
+    stats.nSigMisses = signatureCache.nMisses;
+    stats.nSigEntries = signatureCache.Size();
+    stats.nScriptHits = scriptCache.nHits;
+    stats.nScriptMisses = scriptCache.nMisses;
+    stats.nScriptEntries = scriptCache.Size();
+}
 
+bool CheckSig(valtype vchSig, const valtype &vchPubKey, const CScript &scriptCode,
+              const CTransaction& txTo, unsigned int nIn, int nHashType, int flags,
+              const CSignatureHashContext* psighash)
+{
     CPubKey pubkey(vchPubKey);
     if (!pubkey.IsValid())
     {
@@ -1450,7 +1762,8 @@ bool CheckSig(valtype vchSig, const valtype &vchPubKey, const CScript &scriptCod
     }
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+    uint256 sighash = psighash ? psighash->GetHash(scriptCode, nIn, nHashType) :
+                                 SignatureHash(scriptCode, txTo, nIn, nHashType);
 
     if (signatureCache.Get(sighash, vchSig, pubkey))
     {
@@ -1474,130 +1787,232 @@ bool CheckSig(valtype vchSig, const valtype &vchPubKey, const CScript &scriptCod
 //
 // Return public keys or hashes from scriptPubKey, for 'standard' transaction types.
 //
-bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<valtype >& vSolutionsRet)
+// CScript::GetOp2() without the copy: the pushed data is left in the script
+static inline bool GetScriptOp(const CScript& script,
+                               CScript::const_iterator& pc,
+                               opcodetype& opcodeRet,
+                               CScriptTemplate::CSolution& dataRet)
 {
-    // Templates
-    static multimap<txnouttype, CScript> mTemplates;
-    if (mTemplates.empty())
+    opcodeRet = OP_INVALIDOPCODE;
+    dataRet.pbegin = dataRet.pend = NULL;
+    if (pc >= script.end())
+        return false;
+
+    unsigned int opcode = *pc++;
+
+    // Immediate operand
+    if (opcode <= OP_PUSHDATA4)
     {
-        // Standard tx, sender provides pubkey, receiver adds signature
-        mTemplates.insert(make_pair(TX_PUBKEY, CScript() << OP_PUBKEY << OP_CHECKSIG));
+        unsigned int nSize;
+        if (opcode < OP_PUSHDATA1)
+        {
+            nSize = opcode;
+        }
+        else if (opcode == OP_PUSHDATA1)
+        {
+            if (script.end() - pc < 1)
+                return false;
+            nSize = *pc++;
+        }
+        else if (opcode == OP_PUSHDATA2)
+        {
+            if (script.end() - pc < 2)
+                return false;
+            nSize = 0;
+            memcpy(&nSize, &pc[0], 2);
+            pc += 2;
+        }
+        else
+        {
+            if (script.end() - pc < 4)
+                return false;
+            memcpy(&nSize, &pc[0], 4);
+            pc += 4;
+        }
+        if ((unsigned int)(script.end() - pc) < nSize)
+            return false;
+        dataRet.pbegin = &script[0] + (pc - script.begin());
+        dataRet.pend = dataRet.pbegin + nSize;
+        pc += nSize;
+    }
 
-        // Bitcoin address tx, sender provides hash of pubkey, receiver provides signature and pubkey
-        mTemplates.insert(make_pair(TX_PUBKEYHASH, CScript() << OP_DUP << OP_HASH160 << OP_PUBKEYHASH << OP_EQUALVERIFY << OP_CHECKSIG));
+    opcodeRet = (opcodetype)opcode;
+    return true;
+}
 
-        // Sender provides N pubkeys, receivers provides M signatures
-        mTemplates.insert(make_pair(TX_MULTISIG, CScript() << OP_SMALLINTEGER << OP_PUBKEYS << OP_SMALLINTEGER << OP_CHECKMULTISIG));
+static inline bool IsSmallInteger(opcodetype opcode)
+{
+    return opcode == OP_0 || (opcode >= OP_1 && opcode <= OP_16);
+}
 
-        // Empty, provably prunable, data-carrying output
-        mTemplates.insert(make_pair(TX_NULL_DATA, CScript() << OP_RETURN));
-        mTemplates.insert(make_pair(TX_NULL_DATA, CScript() << OP_RETURN << OP_SMALLDATA));
-        mTemplates.insert(make_pair(TX_NULL_DATA, CScript() << OP_RETURN << OP_SMALLDATA << OP_RETURN << OP_SMALLDATA));
-    }
+// Matches the standard templates without allocating:
+//   TX_PUBKEY       <pubkey> OP_CHECKSIG
+//   TX_PUBKEYHASH   OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+//   TX_SCRIPTHASH   OP_HASH160 <20 bytes> OP_EQUAL
+//   TX_MULTISIG     OP_m <pubkey>... OP_n OP_CHECKMULTISIG
+//   TX_NULL_DATA    OP_RETURN [<small data> [OP_RETURN <small data>]]
+// The common encodings are recognized by length and bytes alone. Anything
+// else is decoded op by op, and since no two templates start with the same
+// op the first one decides which template to try. This gives the same
+// answer the op-by-op walk over every template gave, down to which
+// push encodings are accepted.
+bool MatchScriptTemplate(const CScript& scriptPubKey, CScriptTemplate& templateRet)
+{
+    templateRet.type = TX_NONSTANDARD;
+    templateRet.nRequired = 0;
+    templateRet.nSolutions = 0;
 
-    vSolutionsRet.clear();
+    const unsigned int nSize = scriptPubKey.size();
+    if (nSize == 0)
+        return false;
+    const unsigned char* p = &scriptPubKey[0];
+    CScriptTemplate::CSolution* vSolution = templateRet.vSolution;
 
     // Shortcut for pay-to-script-hash, which are more constrained than the other types:
     // it is always OP_HASH160 20 [20 byte hash] OP_EQUAL
     if (scriptPubKey.IsPayToScriptHash())
     {
-        typeRet = TX_SCRIPTHASH;
-        valtype hashBytes(scriptPubKey.begin()+2, scriptPubKey.begin()+22);
-        vSolutionsRet.push_back(hashBytes);
+        templateRet.type = TX_SCRIPTHASH;
+        vSolution[0].pbegin = p + 2;
+        vSolution[0].pend = p + 22;
+        templateRet.nSolutions = 1;
+        return true;
+    }
+    if (nSize == 25 && p[0] == OP_DUP && p[1] == OP_HASH160 && p[2] == 20 &&
+        p[23] == OP_EQUALVERIFY && p[24] == OP_CHECKSIG)
+    {
+        templateRet.type = TX_PUBKEYHASH;
+        vSolution[0].pbegin = p + 3;
+        vSolution[0].pend = p + 23;
+        templateRet.nSolutions = 1;
+        return true;
+    }
+    if (((nSize == 35 && p[0] == 33) || (nSize == 67 && p[0] == 65)) &&
+        p[nSize - 1] == OP_CHECKSIG)
+    {
+        templateRet.type = TX_PUBKEY;
+        vSolution[0].pbegin = p + 1;
+        vSolution[0].pend = p + nSize - 1;
+        templateRet.nSolutions = 1;
         return true;
     }
 
-    // Scan templates
-    const CScript& script1 = scriptPubKey;
-    BOOST_FOREACH(const PAIRTYPE(txnouttype, CScript)& tplate, mTemplates)
+    CScript::const_iterator pc = scriptPubKey.begin();
+    opcodetype opcode;
+    CScriptTemplate::CSolution data;
+    if (!GetScriptOp(scriptPubKey, pc, opcode, data))
+        return false;
+
+    if (opcode == OP_DUP)
     {
-        const CScript& script2 = tplate.second;
-        vSolutionsRet.clear();
+        CScriptTemplate::CSolution hash;
+        if (!GetScriptOp(scriptPubKey, pc, opcode, data) || opcode != OP_HASH160 ||
+            !GetScriptOp(scriptPubKey, pc, opcode, hash) || hash.size() != sizeof(uint160) ||
+            !GetScriptOp(scriptPubKey, pc, opcode, data) || opcode != OP_EQUALVERIFY ||
+            !GetScriptOp(scriptPubKey, pc, opcode, data) || opcode != OP_CHECKSIG ||
+            pc != scriptPubKey.end())
+        {
+            return false;
+        }
+        templateRet.type = TX_PUBKEYHASH;
+        vSolution[0] = hash;
+        templateRet.nSolutions = 1;
+        return true;
+    }
 
-        opcodetype opcode1, opcode2;
-        valtype vch1, vch2;
+    if (data.size() >= 33 && data.size() <= 120)
+    {
+        CScriptTemplate::CSolution pubkey = data;
+        if (!GetScriptOp(scriptPubKey, pc, opcode, data) || opcode != OP_CHECKSIG ||
+            pc != scriptPubKey.end())
+        {
+            return false;
+        }
+        templateRet.type = TX_PUBKEY;
+        vSolution[0] = pubkey;
+        templateRet.nSolutions = 1;
+        return true;
+    }
 
-        // Compare
-        CScript::const_iterator pc1 = script1.begin();
-        CScript::const_iterator pc2 = script2.begin();
-        while (true)
+    if (IsSmallInteger(opcode))
+    {
+        int m = CScript::DecodeOP_N(opcode);
+        if (!GetScriptOp(scriptPubKey, pc, opcode, data))
+            return false;
+        unsigned int nKeys = 0;
+        while (data.size() >= 33 && data.size() <= 120)
         {
-            if (pc1 == script1.end() && pc2 == script2.end())
-            {
-                // Found a match
-                typeRet = tplate.first;
-                if (typeRet == TX_MULTISIG)
-                {
-                    // Additional checks for TX_MULTISIG:
-                    unsigned char m = vSolutionsRet.front()[0];
-                    unsigned char n = vSolutionsRet.back()[0];
-                    if (m < 1 || n < 1 || m > n || vSolutionsRet.size()-2 != n)
-                        return false;
-                }
-                return true;
-            }
-            if (!script1.GetOp(pc1, opcode1, vch1))
+            if (nKeys < MAX_SCRIPT_TEMPLATE_KEYS)
+                vSolution[nKeys] = data;
+            nKeys++;
+            if (!GetScriptOp(scriptPubKey, pc, opcode, data))
                 break;
-            if (!script2.GetOp(pc2, opcode2, vch2))
-                break;
-
-            // Template matching opcodes:
-            if (opcode2 == OP_PUBKEYS)
-            {
-                while (vch1.size() >= 33 && vch1.size() <= 120)
-                {
-                    vSolutionsRet.push_back(vch1);
-                    if (!script1.GetOp(pc1, opcode1, vch1))
-                        break;
-                }
-                if (!script2.GetOp(pc2, opcode2, vch2))
-                    break;
-                // Normal situation is to fall through
-                // to other if/else statements
-            }
+        }
+        if (!IsSmallInteger(opcode))
+            return false;
+        int n = CScript::DecodeOP_N(opcode);
+        if (!GetScriptOp(scriptPubKey, pc, opcode, data) || opcode != OP_CHECKMULTISIG ||
+            pc != scriptPubKey.end())
+        {
+            return false;
+        }
+        // Additional checks for TX_MULTISIG:
+        templateRet.type = TX_MULTISIG;
+        if (m < 1 || n < 1 || m > n || nKeys != (unsigned int)n)
+            return false;
+        templateRet.nRequired = m;
+        templateRet.nSolutions = nKeys;
+        return true;
+    }
 
-            if (opcode2 == OP_PUBKEY)
-            {
-                if (vch1.size() < 33 || vch1.size() > 120)
-                    break;
-                vSolutionsRet.push_back(vch1);
-            }
-            else if (opcode2 == OP_PUBKEYHASH)
-            {
-                if (vch1.size() != sizeof(uint160))
-                    break;
-                vSolutionsRet.push_back(vch1);
-            }
-            else if (opcode2 == OP_SMALLINTEGER)
-            {   // Single-byte small integer pushed onto vSolutions
-                if (opcode1 == OP_0 ||
-                    (opcode1 >= OP_1 && opcode1 <= OP_16))
-                {
-                    char n = (char)CScript::DecodeOP_N(opcode1);
-                    vSolutionsRet.push_back(valtype(1, n));
-                }
-                else
-                    break;
-            }
-            else if (opcode2 == OP_SMALLDATA)
-            {
-                // small pushdata,  <= MAX_OP_RETURN_RELAY bytes
-                if (vch1.size() > MAX_OP_RETURN_RELAY)
-                    break;
-            }
-            else if (opcode1 != opcode2 || vch1 != vch2)
+    if (opcode == OP_RETURN)
+    {
+        // Empty, provably prunable, data-carrying output
+        if (pc == scriptPubKey.end())
+        {
+            templateRet.type = TX_NULL_DATA;
+            return true;
+        }
+        if (!GetScriptOp(scriptPubKey, pc, opcode, data) ||
+            data.size() > MAX_OP_RETURN_RELAY)
+        {
+            return false;
+        }
+        if (pc != scriptPubKey.end())
+        {
+            if (!GetScriptOp(scriptPubKey, pc, opcode, data) || opcode != OP_RETURN ||
+                !GetScriptOp(scriptPubKey, pc, opcode, data) ||
+                data.size() > MAX_OP_RETURN_RELAY || pc != scriptPubKey.end())
             {
-                // Others must match exactly
-                break;
+                return false;
             }
         }
+        templateRet.type = TX_NULL_DATA;
+        return true;
     }
 
-    vSolutionsRet.clear();
-    typeRet = TX_NONSTANDARD;
     return false;
 }
 
+bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<valtype >& vSolutionsRet)
+{
+    vSolutionsRet.clear();
+
+    CScriptTemplate tmpl;
+    bool fMatch = MatchScriptTemplate(scriptPubKey, tmpl);
+    typeRet = tmpl.type;
+    if (!fMatch)
+        return false;
+
+    if (typeRet == TX_MULTISIG)
+        vSolutionsRet.push_back(valtype(1, (char)tmpl.nRequired));
+    for (unsigned int i = 0; i < tmpl.nSolutions; i++)
+        vSolutionsRet.push_back(valtype(tmpl.vSolution[i].pbegin, tmpl.vSolution[i].pend));
+    if (typeRet == TX_MULTISIG)
+        vSolutionsRet.push_back(valtype(1, (char)tmpl.nSolutions));
+    return true;
+}
+
 
 bool Sign1(const CKeyID& address, const CKeyStore& keystore, uint256 hash, int nHashType, CScript& scriptSigRet)
 {
@@ -1696,14 +2111,16 @@ int ScriptSigArgsExpected(txnouttype t, const vector<valtype >& vSolutions)
 
 bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType)
 {
-    vector<valtype> vSolutions;
-    if (!Solver(scriptPubKey, whichType, vSolutions))
+    CScriptTemplate tmpl;
+    bool fMatch = MatchScriptTemplate(scriptPubKey, tmpl);
+    whichType = tmpl.type;
+    if (!fMatch)
         return false;
 
     if (whichType == TX_MULTISIG)
     {
-        unsigned char m = vSolutions.front()[0];
-        unsigned char n = vSolutions.back()[0];
+        unsigned int m = tmpl.nRequired;
+        unsigned int n = tmpl.nSolutions;
         // Support up to x-of-3 multisig txns as standard
         if (n < 1 || n > 3)
             return false;
@@ -1714,24 +2131,23 @@ bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType)
     return whichType != TX_NONSTANDARD;
 }
 
-unsigned int HaveKeys(const vector<valtype>& pubkeys, const CKeyStore& keystore)
+// number of the multisig template's keys held by keystore
+static unsigned int HaveKeys(const CScriptTemplate& tmpl, const CKeyStore& keystore)
 {
     unsigned int nResult = 0;
-    BOOST_FOREACH(const valtype& pubkey, pubkeys)
+    for (unsigned int i = 0; i < tmpl.nSolutions; i++)
     {
-        CKeyID keyID = CPubKey(pubkey).GetID();
-        if (keystore.HaveKey(keyID))
+        if (keystore.HaveKey(tmpl.GetPubKey(i).GetID()))
             ++nResult;
     }
     return nResult;
 }
 
-bool HaveAnyKey(const vector<valtype>& pubkeys, const CKeyStore& keystore)
+static bool HaveAnyKey(const CScriptTemplate& tmpl, const CKeyStore& keystore)
 {
-    BOOST_FOREACH(const valtype& pubkey, pubkeys)
+    for (unsigned int i = 0; i < tmpl.nSolutions; i++)
     {
-        CKeyID keyID = CPubKey(pubkey).GetID();
-        if (keystore.HaveKey(keyID))
+        if (keystore.HaveKey(tmpl.GetPubKey(i).GetID()))
         {
             return true;
         }
@@ -1788,9 +2204,8 @@ isminetype IsMine(const CKeyStore& keystore,
 {
     isInvalid = false;
 
-    vector<valtype> vSolutions;
-    txnouttype whichType;
-    if (!Solver(scriptPubKey, whichType, vSolutions))
+    CScriptTemplate tmpl;
+    if (!MatchScriptTemplate(scriptPubKey, tmpl))
     {
         if (keystore.HaveWatchOnly(scriptPubKey))
         {
@@ -1800,20 +2215,20 @@ isminetype IsMine(const CKeyStore& keystore,
     }
 
     CKeyID keyID;
-    switch (whichType)
+    switch (tmpl.type)
     {
         case TX_NONSTANDARD:
         case TX_NULL_DATA:
             break;
         case TX_PUBKEY:
-            keyID = CPubKey(vSolutions[0]).GetID();
+            keyID = tmpl.GetPubKey(0).GetID();
             if (keystore.HaveKey(keyID))
             {
                 return ISMINE_SPENDABLE;
             }
             break;
         case TX_PUBKEYHASH:
-            keyID = CKeyID(uint160(vSolutions[0]), BREAKOUT_COLOR_NONE);
+            keyID = CKeyID(tmpl.GetHash160(), BREAKOUT_COLOR_NONE);
             if (keystore.HaveKey(keyID))
             {
                 return ISMINE_SPENDABLE;
@@ -1821,7 +2236,7 @@ isminetype IsMine(const CKeyStore& keystore,
             break;
         case TX_SCRIPTHASH:
         {
-            CScriptID scriptID = CScriptID(uint160(vSolutions[0]));
+            CScriptID scriptID = CScriptID(tmpl.GetHash160());
             CScript subscript;
             if (keystore.GetCScript(scriptID, subscript))
             {
@@ -1842,16 +2257,14 @@ isminetype IsMine(const CKeyStore& keystore,
             // partially owned (somebody else has a key that can spend
             // them) enable spend-out-from-under-you attacks, especially
             // in shared-wallet situations.
-            vector<valtype> keys(vSolutions.begin()+1,
-                                 vSolutions.begin()+vSolutions.size()-1);
             if (fMultiSig)
             {
-                if (HaveAnyKey(keys, keystore))
+                if (HaveAnyKey(tmpl, keystore))
                 {
                     return ISMINE_MULTISIG;
                 }
             }
-            else if (HaveKeys(keys, keystore) == keys.size())
+            else if (HaveKeys(tmpl, keystore) == tmpl.nSolutions)
             {
                 return ISMINE_SPENDABLE;
             }
@@ -1875,28 +2288,31 @@ isminetype IsMine(const CKeyStore& keystore,
 
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
 {
-    vector<valtype> vSolutions;
-    txnouttype whichType;
-    if (!Solver(scriptPubKey, whichType, vSolutions))
+    CScriptTemplate tmpl;
+    if (!MatchScriptTemplate(scriptPubKey, tmpl))
         return false;
+    return ExtractDestination(tmpl, addressRet);
+}
 
-    if (whichType == TX_PUBKEY)
+bool ExtractDestination(const CScriptTemplate& tmpl, CTxDestination& addressRet)
+{
+    if (tmpl.type == TX_PUBKEY)
     {
-        CPubKey pubKey(vSolutions[0]);
+        CPubKey pubKey = tmpl.GetPubKey(0);
         if (!pubKey.IsValid())
             return false;
 
         addressRet = pubKey.GetID();
         return true;
     }
-    else if (whichType == TX_PUBKEYHASH)
+    else if (tmpl.type == TX_PUBKEYHASH)
     {
-        addressRet = CKeyID(uint160(vSolutions[0]), BREAKOUT_COLOR_NONE);
+        addressRet = CKeyID(tmpl.GetHash160(), BREAKOUT_COLOR_NONE);
         return true;
     }
-    else if (whichType == TX_SCRIPTHASH)
+    else if (tmpl.type == TX_SCRIPTHASH)
     {
-        addressRet = CScriptID(uint160(vSolutions[0]));
+        addressRet = CScriptID(tmpl.GetHash160());
         return true;
     }
     // Multisig txns have more than one address...
@@ -1970,9 +2386,10 @@ bool ExtractDestinations(const CScript& scriptPubKey,
                          int& nRequiredRet)
 {
     addressRet.clear();
-    typeRet = TX_NONSTANDARD;
-    vector<valtype> vSolutions;
-    if (!Solver(scriptPubKey, typeRet, vSolutions))
+    CScriptTemplate tmpl;
+    bool fMatch = MatchScriptTemplate(scriptPubKey, tmpl);
+    typeRet = tmpl.type;
+    if (!fMatch)
     {
         return false;
     }
@@ -1984,10 +2401,10 @@ bool ExtractDestinations(const CScript& scriptPubKey,
 
     if (typeRet == TX_MULTISIG)
     {
-        nRequiredRet = vSolutions.front()[0];
-        for (unsigned int i = 1; i < vSolutions.size() - 1; i++)
+        nRequiredRet = tmpl.nRequired;
+        for (unsigned int i = 0; i < tmpl.nSolutions; i++)
         {
-            CPubKey pubKey(vSolutions[i]);
+            CPubKey pubKey = tmpl.GetPubKey(i);
             if (!pubKey.IsValid())
             {
                 continue;
@@ -2006,7 +2423,7 @@ bool ExtractDestinations(const CScript& scriptPubKey,
     {
         nRequiredRet = 1;
         CTxDestination address;
-        if (!ExtractDestination(scriptPubKey, address))
+        if (!ExtractDestination(tmpl, address))
         {
             return false;
         }
@@ -2017,17 +2434,17 @@ bool ExtractDestinations(const CScript& scriptPubKey,
 }
 
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
-                  unsigned int flags, int nHashType)
+                  unsigned int flags, int nHashType, const CSignatureHashContext* psighash)
 {
     vector<valtype> stack, stackCopy;
-    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType))
+    if (!EvalScript(stack, scriptSig, txTo, nIn, flags, nHashType, psighash))
     {
         return false;
     }
 
     stackCopy = stack;
 
-    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType))
+    if (!EvalScript(stack, scriptPubKey, txTo, nIn, flags, nHashType, psighash))
     {
         return false;
     }
@@ -2053,7 +2470,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
         popstack(stackCopy);
 
-        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType))
+        if (!EvalScript(stackCopy, pubKey2, txTo, nIn, flags, nHashType, psighash))
         {
             return false;
         }
@@ -2069,14 +2486,16 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
 
 
 // TODO: change to an enumerated return type
-uint8_t SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType)
+uint8_t SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType,
+                      const CSignatureHashContext* psighash)
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
 
     // Leave out the signature from the hash, since a signature can't sign itself.
     // The checksig op will also drop the signatures from its hash.
-    uint256 hash = SignatureHash(fromPubKey, txTo, nIn, nHashType);
+    uint256 hash = psighash ? psighash->GetHash(fromPubKey, nIn, nHashType) :
+                              SignatureHash(fromPubKey, txTo, nIn, nHashType);
 
     txnouttype whichType;
     if (!Solver(keystore, fromPubKey, hash, nHashType, txin.scriptSig, whichType))
@@ -2092,7 +2511,8 @@ uint8_t SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTra
         CScript subscript = txin.scriptSig;
 
         // Recompute txn hash using subscript in place of scriptPubKey:
-        uint256 hash2 = SignatureHash(subscript, txTo, nIn, nHashType);
+        uint256 hash2 = psighash ? psighash->GetHash(subscript, nIn, nHashType) :
+                                   SignatureHash(subscript, txTo, nIn, nHashType);
 
         txnouttype subType;
         bool fSolved =
@@ -2106,7 +2526,7 @@ uint8_t SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTra
     }
 
     // Test solution
-    if (VerifyScript(txin.scriptSig, fromPubKey, txTo, nIn, STANDARD_SCRIPT_VERIFY_FLAGS, 0))
+    if (VerifyScript(txin.scriptSig, fromPubKey, txTo, nIn, STANDARD_SCRIPT_VERIFY_FLAGS, 0, psighash))
     {
         return 0;
     }
@@ -2116,7 +2536,8 @@ uint8_t SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTra
     }
 }
 
-uint8_t SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType)
+uint8_t SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType,
+                      const CSignatureHashContext* psighash)
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
@@ -2124,10 +2545,11 @@ uint8_t SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTr
     assert(txin.prevout.hash == txFrom.GetHash());
     const CTxOut& txout = txFrom.vout[txin.prevout.n];
 
-    return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType);
+    return SignSignature(keystore, txout.scriptPubKey, txTo, nIn, nHashType, psighash);
 }
 
-bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType)
+bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType,
+                     const CSignatureHashContext* psighash)
 {
     assert(nIn < txTo.vin.size());
     const CTxIn& txin = txTo.vin[nIn];
@@ -2138,7 +2560,38 @@ bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsig
     if (txin.prevout.hash != txFrom.GetHash())
         return false;
 
-    return VerifyScript(txin.scriptSig, txout.scriptPubKey, txTo, nIn, flags, nHashType);
+    return VerifyInputScript(txout.scriptPubKey, txTo, nIn, flags, nHashType, psighash);
+}
+
+bool VerifyInputScript(const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                       unsigned int flags, int nHashType, const CSignatureHashContext* psighash)
+{
+    assert(nIn < txTo.vin.size());
+
+    // a forced nHashType is not part of the cache key
+    if (nHashType != 0)
+    {
+        return VerifyScript(txTo.vin[nIn].scriptSig, scriptPubKey, txTo, nIn, flags, nHashType, psighash);
+    }
+
+    uint256 hashTx = psighash ? psighash->GetTxHash() : txTo.GetHash();
+    uint256 entry = CScriptCache::GetEntry(scriptPubKey, hashTx, txTo, nIn, flags);
+    if (scriptCache.Get(entry, (flags & SCRIPT_VERIFY_NOCACHE)))
+    {
+        return true;
+    }
+
+    if (!VerifyScript(txTo.vin[nIn].scriptSig, scriptPubKey, txTo, nIn, flags, 0, psighash))
+    {
+        return false;
+    }
+
+    if (!(flags & SCRIPT_VERIFY_NOCACHE))
+    {
+        scriptCache.Set(entry);
+    }
+
+    return true;
 }
 
 static CScript PushAll(const vector<valtype>& values)
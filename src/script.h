@@ -6,6 +6,7 @@
 #ifndef H_BITCOIN_SCRIPT
 #define H_BITCOIN_SCRIPT
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -787,9 +788,104 @@ public:
 };
 
 
+/** Inputs between saved hash midstates in a CSignatureHashContext */
+static const unsigned int SIGHASH_MIDSTATE_INTERVAL = 16;
+
+/** Signature hashes for every input of one transaction.
+ * SignatureHash() copies and reserializes the whole transaction for each
+ * input, which is quadratic in the number of inputs. This serializes the
+ * parts that do not depend on the input once, and keeps the hash state
+ * after every SIGHASH_MIDSTATE_INTERVAL blanked inputs so SIGHASH_ALL
+ * only hashes from the nearest one on. GetHash() gives the same result
+ * as SignatureHash() for any input and hash type.
+ * Scriptsigs are not part of the context, so it stays valid while the
+ * transaction is signed, but not if anything else in it changes.
+ * The transaction must outlive the context.
+ */
+class CSignatureHashContext
+{
+private:
+    const CTransaction& txTo;
+    uint256 hashTx;
+    // [txid] nVersion nTime
+    std::vector<unsigned char> vchPrefix;
+    // every input with an empty scriptSig, BLANK_TXIN_SIZE bytes each
+    std::vector<unsigned char> vchInputs;
+    // the outputs back to back, vOutputPos[i] is where output i starts
+    std::vector<unsigned char> vchOutputs;
+    std::vector<unsigned int> vOutputPos;
+    // what SIGHASH_SINGLE puts in place of the earlier outputs
+    std::vector<unsigned char> vchNullOutput;
+    // nLockTime strTxComment nServiceTypeID
+    std::vector<unsigned char> vchSuffix;
+    // vMidstate[k]: vchPrefix, input count, k * SIGHASH_MIDSTATE_INTERVAL inputs
+    std::vector<std::unique_ptr<EvpMdCtx> > vMidstate;
+
+    CSignatureHashContext(const CSignatureHashContext&) = delete;
+    CSignatureHashContext& operator=(const CSignatureHashContext&) = delete;
+
+public:
+    // prevout, empty scriptSig, nSequence
+    static const unsigned int BLANK_TXIN_SIZE = 36 + 1 + 4;
+
+    explicit CSignatureHashContext(const CTransaction& txToIn);
+
+    uint256 GetHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const;
+    const CTransaction& GetTransaction() const { return txTo; }
+    const uint256& GetTxHash() const { return hashTx; }
+};
+
+uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
 bool IsDERSignature(const valtype &vchSig, bool haveHashType = true);
 bool IsCompressedOrUncompressedPubKey(const valtype &vchPubKey);
-bool EvalScript(std::vector<valtype >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType);
+bool EvalScript(std::vector<valtype >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType,
+                const CSignatureHashContext* psighash = NULL);
+
+/** Most keys a multisig template can carry: n is pushed as OP_1..OP_16 */
+static const unsigned int MAX_SCRIPT_TEMPLATE_KEYS = 16;
+
+/** A scriptPubKey matched against the standard templates by
+ * MatchScriptTemplate(). The solutions are left where they are in the
+ * script instead of being copied out, so they are only valid while that
+ * script is.
+ *   TX_PUBKEY      vSolution[0] is the public key
+ *   TX_PUBKEYHASH  vSolution[0] is the key hash
+ *   TX_SCRIPTHASH  vSolution[0] is the script hash
+ *   TX_MULTISIG    vSolution[0..nSolutions) are the public keys,
+ *                  nRequired of them needed to spend
+ */
+class CScriptTemplate
+{
+public:
+    struct CSolution
+    {
+        const unsigned char* pbegin;
+        const unsigned char* pend;
+
+        unsigned int size() const { return pend - pbegin; }
+    };
+
+    txnouttype type;
+    int nRequired;
+    unsigned int nSolutions;
+    CSolution vSolution[MAX_SCRIPT_TEMPLATE_KEYS];
+
+    CScriptTemplate() : type(TX_NONSTANDARD), nRequired(0), nSolutions(0) {}
+
+    CPubKey GetPubKey(unsigned int i) const
+    {
+        return CPubKey(vSolution[i].pbegin, vSolution[i].pend);
+    }
+
+    uint160 GetHash160() const
+    {
+        uint160 hash;
+        memcpy(hash.begin(), vSolution[0].pbegin, sizeof(hash));
+        return hash;
+    }
+};
+
+bool MatchScriptTemplate(const CScript& scriptPubKey, CScriptTemplate& templateRet);
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<valtype >& vSolutionsRet);
 int ScriptSigArgsExpected(txnouttype t, const std::vector<valtype >& vSolutions);
 bool IsStandard(const CScript& scriptPubKey, txnouttype& whichType);
@@ -800,6 +896,7 @@ isminetype IsMine(const CKeyStore &keystore, const CTxDestination& dest, bool& i
 isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey, bool& isInvalid, bool fMultiSig);
 void ExtractAffectedKeys(const CKeyStore &keystore, const CScript& scriptPubKey, std::vector<CKeyID> &vKeys);
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet);
+bool ExtractDestination(const CScriptTemplate& scriptTemplate, CTxDestination& addressRet);
 
 bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<CTxDestination>& addressRet, int& nRequiredRet);
 
@@ -819,11 +916,30 @@ CScript GetScriptForMultisig(int nRequired, const std::vector<CPubKey>& keys);
 /** Check whether a CTxDestination is a CNoDestination. */
 bool IsValidDestination(const CTxDestination& dest);
 
-uint8_t SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
-uint8_t SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
+// psighash, when given, must have been made from txTo
+uint8_t SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL,
+                      const CSignatureHashContext* psighash = NULL);
+uint8_t SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL,
+                      const CSignatureHashContext* psighash = NULL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
-                   unsigned int flags, int nHashType);
-bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType);
+                   unsigned int flags, int nHashType, const CSignatureHashContext* psighash = NULL);
+bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType,
+                     const CSignatureHashContext* psighash = NULL);
+// Verify txTo.vin[nIn].scriptSig against scriptPubKey, consulting the script cache
+bool VerifyInputScript(const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                       unsigned int flags, int nHashType, const CSignatureHashContext* psighash = NULL);
+
+/** Counters for the signature and script verification caches (see getsigcacheinfo) */
+struct CVerifyCacheStats
+{
+    uint64_t nSigHits;
+    uint64_t nSigMisses;
+    uint64_t nSigEntries;
+    uint64_t nScriptHits;
+    uint64_t nScriptMisses;
+    uint64_t nScriptEntries;
+};
+void GetVerifyCacheStats(CVerifyCacheStats& stats);
 
 // Given two sets of signatures for scriptPubKey, possibly with OP_0 placeholders,
 // combine them intelligently and return the result.
@@ -5,11 +5,11 @@
 #define SEC_MESSAGE_H
 
 #include <leveldb/db.h>
-#include <leveldb/write_batch.h>
 
 #include "net.h"
 #include "db.h"
 #include "wallet.h"
+#include "batch-leveldb.h"
 #include "lz4/lz4.h"
 
 
@@ -313,7 +313,7 @@ public:
     bool EraseSmesg(unsigned char* chKey);
     
     leveldb::DB *pdb;       // points to the global instance
-    leveldb::WriteBatch *activeBatch;
+    CLevelDBBatch *activeBatch;
     
 };
 
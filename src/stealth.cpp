@@ -24,6 +24,7 @@
 
 #include "stealth.h"
 #include "base58.h"
+#include "key.h"
 
 #include <openssl/rand.h>
 #include <openssl/ec.h>
@@ -242,12 +243,7 @@ int SecretToPublicKey(const ec_secret& secret, ec_point& out)
     // public key = private * G
     int rv = 0;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    if (!ecgrp)
-    {
-        printf("SecretToPublicKey(): EC_GROUP_new_by_curve_name failed.\n");
-        return 1;
-    };
+    const EC_GROUP* ecgrp = GetSecp256k1Group();
 
     BN_CTX* bnCtx = BN_CTX_new();
     BIGNUM*  bnIn = BN_new();
@@ -294,7 +290,6 @@ int SecretToPublicKey(const ec_secret& secret, ec_point& out)
     if (pub)   EC_POINT_free(pub);
     if (bnIn)  BN_free(bnIn);
     if (bnCtx) BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
@@ -338,12 +333,7 @@ int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend,
     EC_POINT* R       = NULL;
     EC_POINT* Rout    = NULL;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    if (!ecgrp)
-    {
-        printf("StealthSecret(): EC_GROUP_new_by_curve_name failed.\n");
-        return 1;
-    };
+    const EC_GROUP* ecgrp = GetSecp256k1Group();
 
     if (!(bnCtx = BN_CTX_new()))
     {
@@ -453,7 +443,6 @@ int StealthSecret(ec_secret& secret, ec_point& pubkey, const ec_point& pkSpend,
     if (Q)       EC_POINT_free(Q);
     if (bnEphem) BN_free(bnEphem);
     if (bnCtx)   BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
@@ -478,12 +467,7 @@ int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey,
     BIGNUM*   bnOrder      = NULL;
     BIGNUM*   bnSpend      = NULL;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    if (!ecgrp)
-    {
-        printf("StealthSecretSpend(): EC_GROUP_new_by_curve_name failed.\n");
-        return 1;
-    };
+    const EC_GROUP* ecgrp = GetSecp256k1Group();
 
     if (!(bnCtx = BN_CTX_new()))
     {
@@ -583,7 +567,6 @@ int StealthSecretSpend(ec_secret& scanSecret, ec_point& ephemPubkey,
     if (P)            EC_POINT_free(P);
     if (bnScanSecret) BN_free(bnScanSecret);
     if (bnCtx)        BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
@@ -598,12 +581,7 @@ int StealthSharedToSecretSpend(ec_secret& sharedS, ec_secret& spendSecret, ec_se
     BIGNUM*  bnOrder = NULL;
     BIGNUM*  bnSpend = NULL;
 
-    EC_GROUP* ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
-    if (!ecgrp)
-    {
-        printf("StealthSharedToSecretSpend(): EC_GROUP_new_by_curve_name failed.\n");
-        return 1;
-    };
+    const EC_GROUP* ecgrp = GetSecp256k1Group();
 
     if (!(bnCtx = BN_CTX_new()))
     {
@@ -662,12 +640,128 @@ int StealthSharedToSecretSpend(ec_secret& sharedS, ec_secret& spendSecret, ec_se
     if (bnOrder)  BN_free(bnOrder);
     if (bnc)      BN_free(bnc);
     if (bnCtx)    BN_CTX_free(bnCtx);
-    EC_GROUP_free(ecgrp);
 
     return rv;
 };
 
 
+void CStealthScanner::Clear()
+{
+    for (unsigned int i = 0; i < vEntries.size(); ++i)
+    {
+        BN_clear_free(vEntries[i].bnScanSecret);
+        EC_POINT_free(vEntries[i].R);
+    };
+    vEntries.clear();
+};
+
+bool CStealthScanner::Add(const CStealthAddress& sxAddr)
+{
+    if (sxAddr.scan_secret.size() != ec_secret_size
+        || sxAddr.spend_pubkey.size() != ec_compressed_size)
+        return false; // Stealth Address is not owned
+
+    const EC_GROUP* ecgrp = GetSecp256k1Group();
+
+    CEntry entry;
+    entry.scan_pubkey = sxAddr.scan_pubkey;
+    entry.bnScanSecret = BN_bin2bn(&sxAddr.scan_secret[0], ec_secret_size, NULL);
+    entry.R = bytes_to_point(ecgrp, &sxAddr.spend_pubkey[0], ec_compressed_size, NULL);
+    if (!entry.bnScanSecret || !entry.R)
+    {
+        printf("CStealthScanner::Add(): bad scan secret or spend pubkey.\n");
+        if (entry.R)            EC_POINT_free(entry.R);
+        if (entry.bnScanSecret) BN_clear_free(entry.bnScanSecret);
+        return false;
+    };
+
+    vEntries.push_back(entry);
+    return true;
+};
+
+bool CStealthScanner::Scan(const std::vector<ec_point>& vEphemPK,
+                           std::vector<CStealthScanResult>& vResultRet) const
+{
+    /*
+    Same as StealthSecret() on the receiving side, for every pair of
+    ephemeral key P and address (d, R):
+        c  = H(dP)
+        R' = cG + R
+    One BN_CTX and one set of temporaries serve the whole batch.
+    */
+
+    vResultRet.assign(vEphemPK.size() * vEntries.size(), CStealthScanResult());
+    if (vResultRet.empty())
+        return true;
+
+    bool rv = true;
+    uint8_t vchOutP[ec_compressed_size];
+
+    BN_CTX*   bnCtx = NULL;
+    BIGNUM*   bnc   = NULL;
+    EC_POINT* P     = NULL;
+    EC_POINT* dP    = NULL;
+    EC_POINT* Rout  = NULL;
+
+    const EC_GROUP* ecgrp = GetSecp256k1Group();
+
+    if (!(bnCtx = BN_CTX_new())
+        || !(bnc = BN_new())
+        || !(P = EC_POINT_new(ecgrp))
+        || !(dP = EC_POINT_new(ecgrp))
+        || !(Rout = EC_POINT_new(ecgrp)))
+    {
+        printf("CStealthScanner::Scan(): allocation failed.\n");
+        rv = false;
+        goto End;
+    };
+
+    for (unsigned int i = 0; i < vEphemPK.size(); ++i)
+    {
+        const ec_point& pkEphem = vEphemPK[i];
+        if (pkEphem.empty()
+            || !EC_POINT_oct2point(ecgrp, P, &pkEphem[0], pkEphem.size(), bnCtx))
+            continue; // not a point, no address can match it
+
+        for (unsigned int j = 0; j < vEntries.size(); ++j)
+        {
+            const CEntry& entry = vEntries[j];
+            CStealthScanResult& result = vResultRet[i * vEntries.size() + j];
+
+            // dP
+            if (!EC_POINT_mul(ecgrp, dP, NULL, P, entry.bnScanSecret, bnCtx)
+                || !point_to_bytes(ecgrp, dP, vchOutP, ec_compressed_size, bnCtx))
+                continue;
+
+            // c = SHA256(dP)
+            SHA256(vchOutP, ec_compressed_size, &result.sShared.e[0]);
+
+            // R' = cG + 1R
+            if (!BN_bin2bn(&result.sShared.e[0], ec_secret_size, bnc)
+                || !EC_POINT_mul(ecgrp, Rout, bnc, entry.R, BN_value_one(), bnCtx))
+                continue;
+
+            result.pkExtracted.resize(ec_compressed_size);
+            if (!point_to_bytes(ecgrp, Rout, &result.pkExtracted[0], ec_compressed_size, bnCtx))
+            {
+                result.pkExtracted.clear();
+                continue;
+            };
+
+            result.fValid = true;
+        };
+    };
+
+    End:
+    if (Rout)  EC_POINT_free(Rout);
+    if (dP)    EC_POINT_free(dP);
+    if (P)     EC_POINT_free(P);
+    if (bnc)   BN_clear_free(bnc);
+    if (bnCtx) BN_CTX_free(bnCtx);
+
+    return rv;
+};
+
 // stealth addresses have the ticker suffix
 bool IsStealthAddress(const std::string& qualAddress)
 {
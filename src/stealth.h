@@ -13,6 +13,8 @@
 #include <vector>
 #include <inttypes.h>
 
+#include <openssl/ec.h>
+
 
 typedef std::vector<uint8_t> data_chunk;
 
@@ -113,6 +115,54 @@ int StealthSharedToSecretSpend(ec_secret& sharedS, ec_secret& spendSecret, ec_se
 
 bool IsStealthAddress(const std::string& encodedAddress);
 
+/** What one owned stealth address makes of one ephemeral key:
+ * the shared secret c = H(dP) and the payment key R' = R + cG */
+struct CStealthScanResult
+{
+    bool fValid;
+    ec_secret sShared;
+    ec_point pkExtracted;
+
+    CStealthScanResult() : fValid(false) {}
+};
+
+/** Scan material of the owned stealth addresses: the scan secrets as
+ * BIGNUMs and the spend keys as decoded points, made once instead of for
+ * every ephemeral key tried. Scan() only reads the table, so one scanner
+ * can serve several threads. Entries keep the order they were added in. */
+class CStealthScanner
+{
+private:
+    struct CEntry
+    {
+        ec_point scan_pubkey;
+        BIGNUM* bnScanSecret;
+        EC_POINT* R;
+    };
+
+    std::vector<CEntry> vEntries;
+
+    CStealthScanner(const CStealthScanner&);
+    CStealthScanner& operator=(const CStealthScanner&);
+
+public:
+    CStealthScanner() {}
+    ~CStealthScanner() { Clear(); }
+
+    void Clear();
+
+    // adds sxAddr if it is owned, returns false if it is not or is bad
+    bool Add(const CStealthAddress& sxAddr);
+
+    unsigned int size() const { return vEntries.size(); }
+    bool empty() const { return vEntries.empty(); }
+    const ec_point& GetScanPubKey(unsigned int i) const { return vEntries[i].scan_pubkey; }
+
+    // vResultRet[i * size() + j] is what entry j makes of vEphemPK[i]
+    bool Scan(const std::vector<ec_point>& vEphemPK,
+              std::vector<CStealthScanResult>& vResultRet) const;
+};
+
 
 #endif  // BITCOIN_STEALTHADDRESS_H
 
@@ -0,0 +1,120 @@
+#include <boost/test/unit_test.hpp>
+
+#include "arith_uint256.h"
+#include "bignum.h"
+#include "main.h"
+
+// arith_uint256 replaced CBigNum in retargeting, proof-of-work checks and
+// chain trust. These tests run both over the same inputs and require the
+// same answers, since any difference would be a consensus split.
+
+BOOST_AUTO_TEST_SUITE(arith_uint256_tests)
+
+// deterministic, so a failure can be reproduced
+static uint32_t nTestRand = 0x5eed1234;
+static uint32_t TestRand32()
+{
+    nTestRand = nTestRand * 1103515245 + 12345;
+    return (nTestRand >> 16) | ((nTestRand * 1103515245 + 12345) & 0xffff0000);
+}
+
+static uint256 TestRand256(int nBits)
+{
+    uint256 n;
+    for (int i = 0; i < 8; i++)
+        n = (n << 32) | uint256(TestRand32());
+    return nBits < 256 ? (n >> (256 - nBits)) : n;
+}
+
+BOOST_AUTO_TEST_CASE(arith_uint256_compact)
+{
+    for (int i = 0; i < 100000; i++)
+    {
+        uint32_t nCompact = TestRand32();
+        if (i % 2)
+            nCompact = (nCompact & 0x00ffffff) | ((TestRand32() % 36) << 24);
+
+        bool fNegative, fOverflow;
+        arith_uint256 bnArith;
+        bnArith.SetCompact(nCompact, &fNegative, &fOverflow);
+        CBigNum bn;
+        bn.SetCompact(nCompact);
+
+        if (fNegative || fOverflow)
+        {
+            // the callers reject these exactly where CBigNum gave <= 0 or
+            // more than any target limit
+            BOOST_CHECK(bn < 0 || bn > CBigNum(~uint256(0)));
+            continue;
+        }
+        BOOST_CHECK(bn >= 0);
+        BOOST_CHECK(ArithToUint256(bnArith) == bn.getuint256());
+        BOOST_CHECK_EQUAL(bnArith.GetCompact(), bn.GetCompact());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(arith_uint256_trust)
+{
+    for (int i = 0; i < 20000; i++)
+    {
+        uint32_t nBits = ((3 + TestRand32() % 30) << 24) | (TestRand32() & 0x007fffff);
+
+        arith_uint256 bnTarget;
+        bnTarget.SetCompact(nBits);
+        if (bnTarget == 0)
+            continue;
+        arith_uint256 bnTrust = (~bnTarget / (bnTarget + 1)) + 1;
+
+        CBigNum bn;
+        bn.SetCompact(nBits);
+        BOOST_CHECK(ArithToUint256(bnTrust) == ((CBigNum(1) << 256) / (bn + 1)).getuint256());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(arith_uint256_muldiv)
+{
+    for (int i = 0; i < 20000; i++)
+    {
+        uint256 a = TestRand256(1 + TestRand32() % 256);
+        uint256 b = TestRand256(1 + TestRand32() % 128);
+        if (b == 0)
+            continue;
+        uint32_t n = TestRand32();
+
+        CBigNum bnMod = CBigNum(1) << 256;
+        BOOST_CHECK(ArithToUint256(UintToArith256(a) / UintToArith256(b)) ==
+                    (CBigNum(a) / CBigNum(b)).getuint256());
+        BOOST_CHECK(ArithToUint256(UintToArith256(a) * UintToArith256(b)) ==
+                    ((CBigNum(a) * CBigNum(b)) % bnMod).getuint256());
+        BOOST_CHECK(ArithToUint256(UintToArith256(a) * n) ==
+                    ((CBigNum(a) * CBigNum(uint256(n))) % bnMod).getuint256());
+    }
+}
+
+// the retarget step of BreakoutGravityWave, including timespans stretched
+// by the virtual days far enough that the product no longer fits
+BOOST_AUTO_TEST_CASE(arith_uint256_retarget)
+{
+    const arith_uint256 bnLimit = ~arith_uint256(0) >> 8;
+    for (int i = 0; i < 20000; i++)
+    {
+        arith_uint256 bnNew = UintToArith256(TestRand256(200 + TestRand32() % 49));
+        if (bnNew > bnLimit)
+            bnNew = bnLimit;
+        int64_t nTargetTimespan = 24 * (60 + TestRand32() % 600);
+        int64_t nActualTimespan = nTargetTimespan / 3 + TestRand32() % (nTargetTimespan * 3);
+        if (i % 3 == 0)
+            nActualTimespan += ((int64_t)TestRand32() << (TestRand32() % 31));
+
+        CBigNum bn(ArithToUint256(bnNew));
+        bn *= nActualTimespan;
+        bn /= nTargetTimespan;
+        if (bn > CBigNum(ArithToUint256(bnLimit)))
+            bn = CBigNum(ArithToUint256(bnLimit));
+
+        BOOST_CHECK_EQUAL(RetargetTarget(bnNew, nActualTimespan, nTargetTimespan, bnLimit).GetCompact(),
+                          bn.GetCompact());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
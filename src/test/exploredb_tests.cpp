@@ -0,0 +1,77 @@
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include "base58.h"
+#include "exploredb-leveldb.h"
+#include "key.h"
+#include "util.h"
+
+using namespace std;
+
+static string NumberKey(unsigned int n)
+{
+    ExploreAddress addr;
+    return CExploreKey(ADDR_TX_OUTPUT).Addr(addr, BREAKOUT_COLOR_BRK).Number(n).ToString();
+}
+
+BOOST_AUTO_TEST_SUITE(exploredb_tests)
+
+BOOST_AUTO_TEST_CASE(explorekey_number_order)
+{
+    // around each length boundary of a 7 bits per byte varint, and the ends
+    const unsigned int vBoundaries[] = {0, 127, 255, 16511, 65535, 2113663, 16777215};
+    for (unsigned int i = 0; i < sizeof(vBoundaries) / sizeof(vBoundaries[0]); i++)
+    {
+        unsigned int n = vBoundaries[i];
+        BOOST_CHECK(NumberKey(n) < NumberKey(n + 1));
+        BOOST_CHECK(NumberKey(n) < NumberKey(n + 256));
+    }
+    BOOST_CHECK(NumberKey(256) < NumberKey(16512));
+    BOOST_CHECK(NumberKey(0xfffffffe) < NumberKey(0xffffffff));
+
+    for (int i = 0; i < 10000; i++)
+    {
+        unsigned int a = insecure_rand() >> GetRandInt(32);
+        unsigned int b = insecure_rand() >> GetRandInt(32);
+        BOOST_CHECK_EQUAL(NumberKey(a) < NumberKey(b), a < b);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(explorekey_amount_order)
+{
+    const int64_t vAmounts[] = {0, 1, 255, 256, 65535, 65536, 10000000000LL, 0x7fffffffffffffffLL};
+    for (unsigned int i = 1; i < sizeof(vAmounts) / sizeof(vAmounts[0]); i++)
+    {
+        BOOST_CHECK(CExploreKey(ADDR_BALANCE).Color(1).Amount(vAmounts[i - 1]).ToString() <
+                    CExploreKey(ADDR_BALANCE).Color(1).Amount(vAmounts[i]).ToString());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(exploreaddress_roundtrip)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID(key.GetPubKey().GetID(), BREAKOUT_COLOR_BRK);
+
+    ExploreAddress addr;
+    BOOST_CHECK(addr.IsNull());
+    BOOST_CHECK(addr.Set(CTxDestination(keyID)));
+    BOOST_CHECK(!addr.IsNull());
+
+    string strAddress = CBitcoinAddress(keyID, BREAKOUT_COLOR_BRK).ToString();
+    BOOST_CHECK_EQUAL(addr.ToString(BREAKOUT_COLOR_BRK), strAddress);
+
+    ExploreAddress addrParsed;
+    int nColor = BREAKOUT_COLOR_NONE;
+    BOOST_CHECK(addrParsed.SetString(strAddress, nColor));
+    BOOST_CHECK_EQUAL(nColor, (int)BREAKOUT_COLOR_BRK);
+    BOOST_CHECK(addrParsed == addr);
+
+    // nothing but a key or script id
+    BOOST_CHECK(!addrParsed.Set(CTxDestination(CNoDestination())));
+    BOOST_CHECK(addrParsed.IsNull());
+    BOOST_CHECK(!addrParsed.SetString("not an address", nColor));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <vector>
+
+#include "base58.h"
+#include "explore/ExploreRichList.hpp"
+#include "util.h"
+
+using namespace std;
+
+typedef ExploreRichList::Entry Entry;
+
+static ExploreAddress MakeAddress(int n)
+{
+    ExploreAddress addr;
+    addr.vch[0] = PUBKEY_ADDRESS;
+    addr.vch[1] = n & 0xff;
+    addr.vch[2] = (n >> 8) & 0xff;
+    return addr;
+}
+
+// Checks the counts and pages of the rich list against a plain std::set.
+static void CheckAgainst(const ExploreRichList& richlist, const set<Entry>& setRef)
+{
+    BOOST_CHECK_EQUAL(richlist.size(), setRef.size());
+
+    vector<Entry> vRef(setRef.begin(), setRef.end());
+    for (int64_t b = 0; b < 12; b++)
+    {
+        unsigned int nAbove = 0, nAtLeast = 0;
+        BOOST_FOREACH(const Entry& entry, vRef)
+        {
+            nAbove += (entry.balance > b) ? 1 : 0;
+            nAtLeast += (entry.balance >= b) ? 1 : 0;
+        }
+        BOOST_CHECK_EQUAL(richlist.CountAbove(b), nAbove);
+        BOOST_CHECK_EQUAL(richlist.CountAtLeast(b), nAtLeast);
+    }
+
+    for (unsigned int nStart = 0; nStart <= vRef.size() + 1; nStart += 7)
+    {
+        vector<Entry> vPage;
+        richlist.GetRange(nStart, 10, vPage);
+        unsigned int nExpected = (nStart < vRef.size()) ?
+                                 min((unsigned int)vRef.size() - nStart, 10u) : 0;
+        BOOST_CHECK_EQUAL(vPage.size(), nExpected);
+        for (unsigned int i = 0; i < vPage.size(); i++)
+        {
+            BOOST_CHECK_EQUAL(vPage[i].balance, vRef[nStart + i].balance);
+            BOOST_CHECK(vPage[i].address == vRef[nStart + i].address);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(explorerichlist_tests)
+
+BOOST_AUTO_TEST_CASE(explorerichlist_order)
+{
+    ExploreRichList richlist;
+    BOOST_CHECK(richlist.empty());
+    BOOST_CHECK(richlist.Insert(5, MakeAddress(2)));
+    BOOST_CHECK(richlist.Insert(9, MakeAddress(3)));
+    BOOST_CHECK(richlist.Insert(5, MakeAddress(1)));
+    BOOST_CHECK(!richlist.Insert(5, MakeAddress(1)));
+
+    // richest first, ties in address order
+    vector<Entry> vAll;
+    richlist.GetRange(0, 10, vAll);
+    BOOST_CHECK_EQUAL(vAll.size(), 3U);
+    BOOST_CHECK(vAll[0].address == MakeAddress(3));
+    BOOST_CHECK(vAll[1].address == MakeAddress(1));
+    BOOST_CHECK(vAll[2].address == MakeAddress(2));
+
+    // tied addresses share a rank
+    BOOST_CHECK_EQUAL(richlist.CountAbove(9) + 1, 1U);
+    BOOST_CHECK_EQUAL(richlist.CountAbove(5) + 1, 2U);
+    BOOST_CHECK_EQUAL(richlist.CountAtLeast(5), 3U);
+
+    BOOST_CHECK(!richlist.Erase(9, MakeAddress(1)));
+    BOOST_CHECK(richlist.Erase(5, MakeAddress(1)));
+    BOOST_CHECK_EQUAL(richlist.size(), 2U);
+    BOOST_CHECK(!richlist.Contains(5, MakeAddress(1)));
+}
+
+BOOST_AUTO_TEST_CASE(explorerichlist_like_set)
+{
+    ExploreRichList richlist;
+    set<Entry> setRef;
+    for (int i = 0; i < 3000; i++)
+    {
+        Entry entry(GetRandInt(12), MakeAddress(GetRandInt(200)));
+        if (GetRandInt(3) < 2)
+        {
+            bool fNew = setRef.insert(entry).second;
+            BOOST_CHECK_EQUAL(richlist.Insert(entry.balance, entry.address), fNew);
+        }
+        else
+        {
+            bool fFound = setRef.erase(entry) > 0;
+            BOOST_CHECK_EQUAL(richlist.Erase(entry.balance, entry.address), fFound);
+        }
+        if (i % 100 == 0)
+        {
+            CheckAgainst(richlist, setRef);
+        }
+    }
+    CheckAgainst(richlist, setRef);
+}
+
+BOOST_AUTO_TEST_CASE(explorerichlist_assign)
+{
+    set<Entry> setRef;
+    for (int i = 0; i < 500; i++)
+    {
+        setRef.insert(Entry(GetRandInt(12), MakeAddress(i)));
+    }
+    vector<Entry> vEntries(setRef.begin(), setRef.end());
+
+    ExploreRichList richlist;
+    BOOST_CHECK(richlist.Assign(vEntries));
+    CheckAgainst(richlist, setRef);
+
+    // still a working tree afterwards
+    Entry entry(100, MakeAddress(1000));
+    BOOST_CHECK(richlist.Insert(entry.balance, entry.address));
+    setRef.insert(entry);
+    CheckAgainst(richlist, setRef);
+
+    // out of order or duplicated entries are refused
+    swap(vEntries[0], vEntries[1]);
+    BOOST_CHECK(!richlist.Assign(vEntries));
+    BOOST_CHECK(richlist.empty());
+    swap(vEntries[0], vEntries[1]);
+    vEntries[1] = vEntries[0];
+    BOOST_CHECK(!richlist.Assign(vEntries));
+    BOOST_CHECK(richlist.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -144,4 +144,43 @@ BOOST_AUTO_TEST_CASE(key_test1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(key_verify_backends)
+{
+    // CPubKey::VerifyEC() must accept exactly what the EVP_PKEY path does
+    for (int i = 0; i < 32; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        CPubKey pubkey = key.GetPubKey();
+        uint256 hash = GetRandHash();
+        valtype vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        BOOST_CHECK(pubkey.VerifyEC(hash, vchSig));
+        BOOST_CHECK(pubkey.VerifyEVP(hash, vchSig));
+        BOOST_CHECK(!pubkey.VerifyEC(GetRandHash(), vchSig));
+        BOOST_CHECK(!pubkey.VerifyEVP(GetRandHash(), vchSig));
+
+        // every single-bit change of the signature
+        for (unsigned int j = 0; j < vchSig.size() * 8; j++)
+        {
+            valtype vchBad(vchSig);
+            vchBad[j / 8] ^= 1 << (j % 8);
+            BOOST_CHECK_EQUAL(pubkey.VerifyEC(hash, vchBad), pubkey.VerifyEVP(hash, vchBad));
+        }
+
+        // the outer length stretched over zero padding, then cut short
+        valtype vchLong(vchSig);
+        vchLong[1] = 0x86;
+        vchLong.insert(vchLong.begin() + 2, 5, 0);
+        vchLong.insert(vchLong.begin() + 7, vchSig[1]);
+        BOOST_CHECK_EQUAL(pubkey.VerifyEC(hash, vchLong), pubkey.VerifyEVP(hash, vchLong));
+        vchLong.resize(4);
+        BOOST_CHECK(!pubkey.VerifyEC(hash, vchLong));
+        BOOST_CHECK(!pubkey.VerifyEVP(hash, vchLong));
+
+        BOOST_CHECK(!pubkey.VerifyEC(hash, valtype()));
+        BOOST_CHECK(!pubkey.VerifyEVP(hash, valtype()));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -442,4 +442,164 @@ BOOST_AUTO_TEST_CASE(script_combineSigs)
     BOOST_CHECK(combined == partial3c);
 }
 
+BOOST_AUTO_TEST_CASE(script_template)
+{
+    CKey key[3];
+    for (int i = 0; i < 3; i++)
+        key[i].MakeNewKey(i != 1);
+    CKeyID keyID = key[0].GetPubKey().GetID();
+    valtype vchHash(keyID.begin(), keyID.end());
+
+    vector<CScript> vScripts;
+    vScripts.push_back(CScript() << key[0].GetPubKey() << OP_CHECKSIG);
+    vScripts.push_back(CScript() << key[1].GetPubKey() << OP_CHECKSIG);
+    vScripts.push_back(CScript() << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG);
+    vScripts.push_back(CScript() << OP_HASH160 << vchHash << OP_EQUAL);
+    vScripts.push_back(CScript() << OP_2 << key[0].GetPubKey() << key[1].GetPubKey()
+                                 << key[2].GetPubKey() << OP_3 << OP_CHECKMULTISIG);
+    vScripts.push_back(CScript() << OP_RETURN);
+    vScripts.push_back(CScript() << OP_RETURN << valtype(33, 6));
+    vScripts.push_back(CScript() << OP_RETURN << valtype(33, 6) << OP_RETURN << valtype(40, 7));
+
+    // Same templates with the data pushed by OP_PUSHDATA1, which only the
+    // op-by-op walk sees through
+    CScript p2pkh;
+    p2pkh << OP_DUP << OP_HASH160 << OP_PUSHDATA1 << (opcodetype)20;
+    p2pkh.insert(p2pkh.end(), vchHash.begin(), vchHash.end());
+    p2pkh << OP_EQUALVERIFY << OP_CHECKSIG;
+    vScripts.push_back(p2pkh);
+    valtype vchPubKey = key[0].GetPubKey().Raw();
+    CScript p2pk;
+    p2pk << OP_PUSHDATA1 << (opcodetype)vchPubKey.size();
+    p2pk.insert(p2pk.end(), vchPubKey.begin(), vchPubKey.end());
+    p2pk << OP_CHECKSIG;
+    vScripts.push_back(p2pk);
+
+    txnouttype expected[] = { TX_PUBKEY, TX_PUBKEY, TX_PUBKEYHASH, TX_SCRIPTHASH, TX_MULTISIG,
+                              TX_NULL_DATA, TX_NULL_DATA, TX_NULL_DATA, TX_PUBKEYHASH, TX_PUBKEY };
+    for (unsigned int i = 0; i < vScripts.size(); i++)
+    {
+        CScriptTemplate tmpl;
+        BOOST_CHECK(MatchScriptTemplate(vScripts[i], tmpl));
+        BOOST_CHECK_EQUAL(tmpl.type, expected[i]);
+    }
+
+    CScriptTemplate tmpl;
+    BOOST_CHECK(MatchScriptTemplate(vScripts[2], tmpl));
+    BOOST_CHECK(tmpl.GetHash160() == uint160(vchHash));
+    BOOST_CHECK(MatchScriptTemplate(vScripts[8], tmpl));
+    BOOST_CHECK(tmpl.GetHash160() == uint160(vchHash));
+    BOOST_CHECK(MatchScriptTemplate(vScripts[1], tmpl));
+    BOOST_CHECK(tmpl.GetPubKey(0) == key[1].GetPubKey());
+
+    // Solver() keeps its layout for multisig: m, keys..., n
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    BOOST_CHECK(Solver(vScripts[4], whichType, vSolutions));
+    BOOST_CHECK_EQUAL(whichType, TX_MULTISIG);
+    BOOST_CHECK_EQUAL(vSolutions.size(), 5U);
+    BOOST_CHECK_EQUAL(vSolutions.front()[0], 2);
+    BOOST_CHECK_EQUAL(vSolutions.back()[0], 3);
+    BOOST_CHECK(CPubKey(vSolutions[2]) == key[1].GetPubKey());
+
+    // Near misses
+    vector<CScript> vBad;
+    vBad.push_back(CScript() << OP_DUP << OP_HASH160 << valtype(19, 1) << OP_EQUALVERIFY << OP_CHECKSIG);
+    vBad.push_back(CScript() << key[0].GetPubKey() << OP_CHECKSIG << OP_NOP);
+    vBad.push_back(CScript() << OP_3 << key[0].GetPubKey() << key[1].GetPubKey() << OP_2 << OP_CHECKMULTISIG);
+    vBad.push_back(CScript() << OP_1 << key[0].GetPubKey() << OP_2 << OP_CHECKMULTISIG);
+    vBad.push_back(CScript() << OP_RETURN << valtype(MAX_OP_RETURN_RELAY + 1, 6));
+    vBad.push_back(CScript() << OP_RETURN << valtype(1, 6) << OP_NOP << valtype(1, 6));
+    vBad.push_back(CScript() << OP_PUSHDATA1);
+    vBad.push_back(CScript());
+    BOOST_FOREACH(const CScript& script, vBad)
+    {
+        BOOST_CHECK(!MatchScriptTemplate(script, tmpl));
+        BOOST_CHECK(!Solver(script, whichType, vSolutions));
+    }
+
+    // the matcher and Solver() agree on every standard script
+    BOOST_FOREACH(const CScript& script, vScripts)
+    {
+        BOOST_CHECK(MatchScriptTemplate(script, tmpl));
+        BOOST_CHECK(Solver(script, whichType, vSolutions));
+        BOOST_CHECK_EQUAL(tmpl.type, whichType);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(script_sighash_context)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    CScript scriptCodeSep = (CScript() << OP_CODESEPARATOR << OP_1 << OP_CODESEPARATOR << OP_DROP) + scriptPubKey;
+
+    const int nHashTypes[] = { SIGHASH_ALL, SIGHASH_NONE, SIGHASH_SINGLE, 0, 4,
+                               SIGHASH_ALL | SIGHASH_ANYONECANPAY,
+                               SIGHASH_NONE | SIGHASH_ANYONECANPAY,
+                               SIGHASH_SINGLE | SIGHASH_ANYONECANPAY };
+
+    // Input counts on both sides of the midstate interval, outputs fewer
+    // than inputs so SIGHASH_SINGLE runs out of outputs
+    for (unsigned int nInputs = 1; nInputs <= 2 * SIGHASH_MIDSTATE_INTERVAL + 3; nInputs += 5)
+    {
+        CTransaction txTo;
+        for (unsigned int i = 0; i < nInputs; i++)
+        {
+            CTxIn txin(GetRandHash(), i % 3);
+            txin.nSequence = insecure_rand();
+            txin.scriptSig = CScript() << valtype(i % 4 * 40, 1);
+            txTo.vin.push_back(txin);
+        }
+        for (unsigned int i = 0; i < nInputs / 2 + 1; i++)
+            txTo.vout.push_back(CTxOut(i * COIN[BREAKOUT_COLOR_BRK], (int) BREAKOUT_COLOR_BRK, scriptPubKey));
+        txTo.nLockTime = nInputs;
+        txTo.strTxComment = "sighash";
+
+        CSignatureHashContext sighash(txTo);
+        for (unsigned int nIn = 0; nIn <= nInputs; nIn++)
+            BOOST_FOREACH(int nHashType, nHashTypes)
+            {
+                BOOST_CHECK(sighash.GetHash(scriptPubKey, nIn, nHashType) ==
+                            SignatureHash(scriptPubKey, txTo, nIn, nHashType));
+                BOOST_CHECK(sighash.GetHash(scriptCodeSep, nIn, nHashType) ==
+                            SignatureHash(scriptCodeSep, txTo, nIn, nHashType));
+            }
+
+        // changing scriptSigs, as signing does, leaves the context valid
+        txTo.vin[0].scriptSig = CScript() << OP_0;
+        BOOST_CHECK(sighash.GetHash(scriptPubKey, nInputs - 1, SIGHASH_ALL) ==
+                    SignatureHash(scriptPubKey, txTo, nInputs - 1, SIGHASH_ALL));
+    }
+
+    // Signing and verifying through the context
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CTransaction txFrom;
+    txFrom.vout.push_back(CTxOut(COIN[BREAKOUT_COLOR_BRK], (int) BREAKOUT_COLOR_BRK, scriptPubKey));
+    CTransaction txTo;
+    for (unsigned int i = 0; i < 3; i++)
+        txTo.vin.push_back(CTxIn(txFrom.GetHash(), 0));
+    txTo.vout.push_back(CTxOut(COIN[BREAKOUT_COLOR_BRK], (int) BREAKOUT_COLOR_BRK, scriptPubKey));
+    CSignatureHashContext sighash(txTo);
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
+        BOOST_CHECK_EQUAL(SignSignature(keystore, txFrom, txTo, i, SIGHASH_ALL, &sighash), 0);
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
+    {
+        BOOST_CHECK(VerifySignature(txFrom, txTo, i, SCRIPT_VERIFY_NOCACHE, 0));
+        BOOST_CHECK(VerifySignature(txFrom, txTo, i, SCRIPT_VERIFY_NOCACHE, 0, &sighash));
+    }
+
+    // Every input of a consolidation sized transaction
+    CTransaction txBig;
+    for (unsigned int i = 0; i < 500; i++)
+        txBig.vin.push_back(CTxIn(GetRandHash(), i));
+    txBig.vout.push_back(CTxOut(COIN[BREAKOUT_COLOR_BRK], (int) BREAKOUT_COLOR_BRK, scriptPubKey));
+    CSignatureHashContext sighashBig(txBig);
+    for (unsigned int i = 0; i < txBig.vin.size(); i++)
+        BOOST_CHECK(sighashBig.GetHash(scriptPubKey, i, SIGHASH_ALL) ==
+                    SignatureHash(scriptPubKey, txBig, i, SIGHASH_ALL));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "stealth.h"
+#include "util.h"
+
+using namespace std;
+
+static CStealthAddress MakeStealthAddress(ec_secret& scanSecret, ec_secret& spendSecret)
+{
+    CStealthAddress sxAddr;
+    BOOST_CHECK_EQUAL(GenerateRandomSecret(scanSecret), 0);
+    BOOST_CHECK_EQUAL(GenerateRandomSecret(spendSecret), 0);
+    BOOST_CHECK_EQUAL(SecretToPublicKey(scanSecret, sxAddr.scan_pubkey), 0);
+    BOOST_CHECK_EQUAL(SecretToPublicKey(spendSecret, sxAddr.spend_pubkey), 0);
+    sxAddr.scan_secret.assign(&scanSecret.e[0], &scanSecret.e[0] + ec_secret_size);
+    sxAddr.spend_secret.assign(&spendSecret.e[0], &spendSecret.e[0] + ec_secret_size);
+    return sxAddr;
+}
+
+BOOST_AUTO_TEST_SUITE(stealth_tests)
+
+// The batched scanner against the one address, one key at a time path
+BOOST_AUTO_TEST_CASE(stealth_scanner_matches_secret)
+{
+    const unsigned int nAddresses = 4;
+    const unsigned int nEphem = 6;
+
+    CStealthScanner scanner;
+    vector<CStealthAddress> vAddr;
+    vector<ec_secret> vScanSecret(nAddresses), vSpendSecret(nAddresses);
+    for (unsigned int j = 0; j < nAddresses; j++)
+    {
+        vAddr.push_back(MakeStealthAddress(vScanSecret[j], vSpendSecret[j]));
+        BOOST_CHECK(scanner.Add(vAddr[j]));
+    }
+    BOOST_CHECK_EQUAL(scanner.size(), nAddresses);
+
+    // addresses we only watch have no scan secret
+    CStealthAddress sxWatched = vAddr[0];
+    sxWatched.scan_secret.clear();
+    BOOST_CHECK(!scanner.Add(sxWatched));
+    BOOST_CHECK_EQUAL(scanner.size(), nAddresses);
+
+    vector<ec_secret> vEphemSecret(nEphem);
+    vector<ec_point> vEphemPK(nEphem);
+    for (unsigned int i = 0; i < nEphem; i++)
+    {
+        BOOST_CHECK_EQUAL(GenerateRandomSecret(vEphemSecret[i]), 0);
+        BOOST_CHECK_EQUAL(SecretToPublicKey(vEphemSecret[i], vEphemPK[i]), 0);
+    }
+    // one that is not a point
+    vEphemPK.push_back(ec_point(ec_compressed_size, 0xff));
+
+    vector<CStealthScanResult> vResult;
+    BOOST_CHECK(scanner.Scan(vEphemPK, vResult));
+    BOOST_CHECK_EQUAL(vResult.size(), vEphemPK.size() * nAddresses);
+
+    for (unsigned int i = 0; i < nEphem; i++)
+    {
+        for (unsigned int j = 0; j < nAddresses; j++)
+        {
+            const CStealthScanResult& result = vResult[i * nAddresses + j];
+            BOOST_CHECK(result.fValid);
+
+            // what the sender made of the address
+            ec_secret sShared;
+            ec_point pkSent;
+            BOOST_CHECK_EQUAL(StealthSecret(vEphemSecret[i], vAddr[j].scan_pubkey,
+                                            vAddr[j].spend_pubkey, sShared, pkSent), 0);
+            BOOST_CHECK(memcmp(&result.sShared.e[0], &sShared.e[0], ec_secret_size) == 0);
+            BOOST_CHECK(result.pkExtracted == pkSent);
+
+            // and the key the receiver spends it with
+            ec_secret sSpend, sSpendShared;
+            ec_point pkSpend;
+            BOOST_CHECK_EQUAL(StealthSecretSpend(vScanSecret[j], vEphemPK[i], vSpendSecret[j], sSpend), 0);
+            BOOST_CHECK_EQUAL(SecretToPublicKey(sSpend, pkSpend), 0);
+            BOOST_CHECK(pkSpend == result.pkExtracted);
+            BOOST_CHECK_EQUAL(StealthSharedToSecretSpend(sShared, vSpendSecret[j], sSpendShared), 0);
+            BOOST_CHECK(memcmp(&sSpendShared.e[0], &sSpend.e[0], ec_secret_size) == 0);
+        }
+    }
+    for (unsigned int j = 0; j < nAddresses; j++)
+        BOOST_CHECK(!vResult[nEphem * nAddresses + j].fValid);
+
+    vector<ec_point> vNone;
+    BOOST_CHECK(scanner.Scan(vNone, vResult));
+    BOOST_CHECK(vResult.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
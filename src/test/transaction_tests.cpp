@@ -261,4 +261,93 @@ BOOST_AUTO_TEST_CASE(test_GetThrow)
     BOOST_CHECK_THROW(t1.GetValueIn(missingInputs), runtime_error);
 }
 
+// txid as GetHash() computed it before: a copy with the sigs blanked
+static uint256 LegacyTxHash(const CTransaction& tx)
+{
+    if (tx.IsCoinBase() && (GetFork(tx.nTime) >= BRK_FORK003))
+        return SerializeHash(tx);
+    CTransaction txTmp(tx);
+    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+        txTmp.vin[i].scriptSig = CScript();
+    return SerializeHash(txTmp);
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_memo)
+{
+    CTransaction t1;
+    t1.vin.resize(3);
+    for (unsigned int i = 0; i < t1.vin.size(); i++)
+    {
+        t1.vin[i].prevout.hash = GetRandHash();
+        t1.vin[i].prevout.n = i;
+        t1.vin[i].scriptSig << OP_1 << valtype(i * 100, 1);
+    }
+    t1.vout.resize(2);
+    t1.vout[0].nValue = 90*CENT[BREAKOUT_COLOR_BRK];
+    t1.vout[0].scriptPubKey << OP_1;
+    t1.strTxComment = "memo";
+
+    // not cached while it is being built
+    uint256 hash1 = t1.GetHash();
+    BOOST_CHECK(hash1 == LegacyTxHash(t1));
+    t1.vout[1].nValue = 1;
+    BOOST_CHECK(t1.GetHash() != hash1);
+    BOOST_CHECK(t1.GetHash() == LegacyTxHash(t1));
+
+    // read from a stream: cached
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << t1;
+    CTransaction t2;
+    ss >> t2;
+    BOOST_CHECK(t2.GetHash() == t1.GetHash());
+    BOOST_CHECK(t2.GetHash() == t1.GetHash());
+
+    // a copy of a cached transaction can be changed
+    CTransaction t3(t2);
+    t3.vout[0].nValue = 2;
+    BOOST_CHECK(t3.GetHash() == LegacyTxHash(t3));
+    BOOST_CHECK(t3.GetHash() != t2.GetHash());
+    t3 = t2;
+    t3.nLockTime = 5;
+    BOOST_CHECK(t3.GetHash() == LegacyTxHash(t3));
+
+    // reading into a used transaction forgets its old txid
+    ss << t3;
+    ss >> t2;
+    BOOST_CHECK(t2.GetHash() == t3.GetHash());
+
+    // scriptSigs are not part of the txid
+    t3.vin[0].scriptSig = CScript();
+    BOOST_CHECK(t3.GetHash() == t2.GetHash());
+
+    // coinbases after fork 3 hash with their scriptSig
+    CTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig << OP_2 << OP_3;
+    txCoinBase.vout.resize(1);
+    BOOST_CHECK(txCoinBase.IsCoinBase());
+    BOOST_CHECK(txCoinBase.GetHash() == LegacyTxHash(txCoinBase));
+    txCoinBase.nTime = 0;
+    BOOST_CHECK(txCoinBase.GetHash() == LegacyTxHash(txCoinBase));
+
+    // the block header hash follows changes to the header
+    CBlock block(CBlock::GENESIS_VERSION);
+    block.nTime = 0;
+    block.nBits = 1;
+    block.vtx.push_back(t1);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    uint256 hashBlock = block.GetHash();
+    BOOST_CHECK(hashBlock == SerializeHash(block));
+    BOOST_CHECK(block.GetHash() == hashBlock);
+    block.nNonce++;
+    BOOST_CHECK(block.GetHash() != hashBlock);
+    BOOST_CHECK(block.GetHash() == SerializeHash(block));
+    CBlock blockCopy(block);
+    BOOST_CHECK(blockCopy.GetHash() == block.GetHash());
+    blockCopy.hashPrevBlock = hashBlock;
+    BOOST_CHECK(blockCopy.GetHash() == SerializeHash(blockCopy));
+    BOOST_CHECK(blockCopy.GetHash() != block.GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,8 @@
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include <leveldb/env.h>
 #include <leveldb/cache.h>
@@ -19,12 +21,162 @@
 #include "txdb-leveldb.h"
 #include "util.h"
 #include "main.h"
+#include "ui_interface.h"
 
 using namespace std;
 using namespace boost;
 
 leveldb::DB *txdb; // global pointer for LevelDB object instance
 
+// In-memory cache in front of the "tx" records of the LevelDB and of the
+// transactions they point to in the blk*.dat files. It is shared by all
+// CTxDB instances and bounded by -dbcache. Transaction index entries mirror
+// committed database state only: writes inside a batch are published when
+// the batch commits. nSequence is bumped on every publish so that a reader
+// racing a commit does not put back a value it read before the commit.
+class CTxDBCache
+{
+private:
+    CCriticalSection cs_txcache;
+    map<uint256, CTxIndex> mapTxIndex;
+    map<uint256, CTransaction> mapTx;
+    uint64_t nBytes;
+    uint64_t nSequence;
+
+    static uint64_t EntrySize(const CTxIndex& txindex)
+    {
+        return sizeof(uint256) + sizeof(CTxIndex) + txindex.vSpent.size() * sizeof(CDiskTxPos);
+    }
+
+    static uint64_t EntrySize(const CTransaction& tx)
+    {
+        return sizeof(uint256) + sizeof(CTransaction) +
+                    ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    }
+
+    void EraseTxIndexUnlocked(map<uint256, CTxIndex>::iterator it)
+    {
+        nBytes -= EntrySize(it->second);
+        mapTxIndex.erase(it);
+    }
+
+    void EraseTxUnlocked(map<uint256, CTransaction>::iterator it)
+    {
+        nBytes -= EntrySize(it->second);
+        mapTx.erase(it);
+    }
+
+    // Evict random entries (see CSignatureCache) until under the limit
+    void Trim()
+    {
+        uint64_t nMaxBytes = (uint64_t) GetArg("-dbcache", 25) << 20;
+        while (nBytes > nMaxBytes && !(mapTx.empty() && mapTxIndex.empty()))
+        {
+            uint256 hashRandom = GetRandHash();
+            // transaction bodies are larger and cheaper to lose
+            if (!mapTx.empty() && (mapTxIndex.empty() || (hashRandom.Get64() & 1)))
+            {
+                map<uint256, CTransaction>::iterator it = mapTx.lower_bound(hashRandom);
+                if (it == mapTx.end())
+                    it = mapTx.begin();
+                EraseTxUnlocked(it);
+            }
+            else
+            {
+                map<uint256, CTxIndex>::iterator it = mapTxIndex.lower_bound(hashRandom);
+                if (it == mapTxIndex.end())
+                    it = mapTxIndex.begin();
+                EraseTxIndexUnlocked(it);
+            }
+        }
+    }
+
+    void SetTxIndexUnlocked(const uint256& hash, const CTxIndex& txindex)
+    {
+        map<uint256, CTxIndex>::iterator it = mapTxIndex.find(hash);
+        if (it != mapTxIndex.end())
+            EraseTxIndexUnlocked(it);
+        mapTxIndex.insert(make_pair(hash, txindex));
+        nBytes += EntrySize(txindex);
+    }
+
+public:
+    CTxDBCache() : nBytes(0), nSequence(0) {}
+
+    bool GetTxIndex(const uint256& hash, CTxIndex& txindex, uint64_t& nSequenceRet)
+    {
+        LOCK(cs_txcache);
+        nSequenceRet = nSequence;
+        map<uint256, CTxIndex>::const_iterator it = mapTxIndex.find(hash);
+        if (it == mapTxIndex.end())
+            return false;
+        txindex = it->second;
+        return true;
+    }
+
+    // Cache a value read from the database, unless a commit happened since
+    void AddTxIndex(const uint256& hash, const CTxIndex& txindex, uint64_t nSequenceRead)
+    {
+        LOCK(cs_txcache);
+        if (nSequenceRead != nSequence)
+            return;
+        SetTxIndexUnlocked(hash, txindex);
+        Trim();
+    }
+
+    // Publish committed changes; a null CTxIndex erases the entry
+    void Commit(const map<uint256, CTxIndex>& mapChanges)
+    {
+        LOCK(cs_txcache);
+        ++nSequence;
+        for (map<uint256, CTxIndex>::const_iterator mi = mapChanges.begin(); mi != mapChanges.end(); ++mi)
+        {
+            if (mi->second.pos.IsNull())
+            {
+                map<uint256, CTxIndex>::iterator it = mapTxIndex.find(mi->first);
+                if (it != mapTxIndex.end())
+                    EraseTxIndexUnlocked(it);
+            }
+            else
+            {
+                SetTxIndexUnlocked(mi->first, mi->second);
+            }
+        }
+        Trim();
+    }
+
+    bool GetTx(const uint256& hash, CTransaction& tx)
+    {
+        LOCK(cs_txcache);
+        map<uint256, CTransaction>::const_iterator it = mapTx.find(hash);
+        if (it == mapTx.end())
+            return false;
+        tx = it->second;
+        return true;
+    }
+
+    void AddTx(const uint256& hash, const CTransaction& tx)
+    {
+        LOCK(cs_txcache);
+        if (mapTx.count(hash))
+            return;
+        mapTx.insert(make_pair(hash, tx));
+        nBytes += EntrySize(tx);
+        Trim();
+    }
+
+    void Clear()
+    {
+        LOCK(cs_txcache);
+        ++nSequence;
+        mapTxIndex.clear();
+        mapTx.clear();
+        nBytes = 0;
+    }
+};
+
+static CTxDBCache txcache;
+
 static leveldb::Options GetOptions() {
     leveldb::Options options;
     int nCacheSizeMB = GetArg("-dbcache", 25);
@@ -95,6 +247,7 @@ CTxDB::CTxDB(const char* pszMode)
             printf("Required index version is %d, removing old database\n", DATABASE_VERSION);
 
             // Leveldb instance destruction
+            txcache.Clear();
             delete txdb;
             txdb = pdb = NULL;
             delete activeBatch;
@@ -122,6 +275,7 @@ CTxDB::CTxDB(const char* pszMode)
 
 void CTxDB::Close()
 {
+    txcache.Clear();
     delete txdb;
     txdb = pdb = NULL;
     delete options.filter_policy;
@@ -135,78 +289,79 @@ void CTxDB::Close()
 bool CTxDB::TxnBegin()
 {
     assert(!activeBatch);
-    activeBatch = new leveldb::WriteBatch();
+    activeBatch = new CLevelDBBatch();
     return true;
 }
 
 bool CTxDB::TxnCommit()
 {
     assert(activeBatch);
-    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+    leveldb::Status status = activeBatch->Write(pdb, leveldb::WriteOptions());
     delete activeBatch;
     activeBatch = NULL;
     if (!status.ok()) {
         printf("LevelDB batch commit failure: %s\n", status.ToString().c_str());
+        mapPendingTxIndex.clear();
         return false;
     }
+    txcache.Commit(mapPendingTxIndex);
+    mapPendingTxIndex.clear();
     return true;
 }
 
-class CBatchScanner : public leveldb::WriteBatch::Handler {
-public:
-    std::string needle;
-    bool *deleted;
-    std::string *foundValue;
-    bool foundEntry;
-
-    CBatchScanner() : foundEntry(false) {}
-
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        }
-    }
-
-    virtual void Delete(const leveldb::Slice& key) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = true;
-        }
-    }
-};
-
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
+// a database transaction begins reads are consistent with it.
 bool CTxDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
     assert(activeBatch);
     *deleted = false;
-    CBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status status = activeBatch->Iterate(&scanner);
-    if (!status.ok()) {
-        throw runtime_error(status.ToString());
-    }
-    return scanner.foundEntry;
+    return activeBatch->Get(key.str(), value, deleted);
 }
 
 bool CTxDB::ReadTxIndex(uint256 hash, CTxIndex& txindex)
 {
     assert(!fClient);
     txindex.SetNull();
-    return Read(make_pair(string("tx"), hash), txindex);
+    if (activeBatch)
+    {
+        map<uint256, CTxIndex>::const_iterator mi = mapPendingTxIndex.find(hash);
+        if (mi != mapPendingTxIndex.end())
+        {
+            txindex = mi->second;
+            return !txindex.pos.IsNull();
+        }
+    }
+    uint64_t nSequence;
+    if (txcache.GetTxIndex(hash, txindex, nSequence))
+    {
+        return true;
+    }
+    if (!Read(make_pair(string("tx"), hash), txindex))
+    {
+        return false;
+    }
+    txcache.AddTxIndex(hash, txindex, nSequence);
+    return true;
 }
 
 bool CTxDB::UpdateTxIndex(uint256 hash, const CTxIndex& txindex)
 {
     assert(!fClient);
-    return Write(make_pair(string("tx"), hash), txindex);
+    if (!Write(make_pair(string("tx"), hash), txindex))
+    {
+        return false;
+    }
+    if (activeBatch)
+    {
+        mapPendingTxIndex[hash] = txindex;
+    }
+    else
+    {
+        map<uint256, CTxIndex> mapChanges;
+        mapChanges[hash] = txindex;
+        txcache.Commit(mapChanges);
+    }
+    return true;
 }
 
 bool CTxDB::AddTxIndex(const CTransaction& tx, const CDiskTxPos& pos, int nHeight)
@@ -216,7 +371,7 @@ bool CTxDB::AddTxIndex(const CTransaction& tx, const CDiskTxPos& pos, int nHeigh
     // Add to tx index
     uint256 hash = tx.GetHash();
     CTxIndex txindex(pos, tx.vout.size());
-    return Write(make_pair(string("tx"), hash), txindex);
+    return UpdateTxIndex(hash, txindex);
 }
 
 bool CTxDB::EraseTxIndex(const CTransaction& tx)
@@ -224,7 +379,21 @@ bool CTxDB::EraseTxIndex(const CTransaction& tx)
     assert(!fClient);
     uint256 hash = tx.GetHash();
 
-    return Erase(make_pair(string("tx"), hash));
+    if (!Erase(make_pair(string("tx"), hash)))
+    {
+        return false;
+    }
+    if (activeBatch)
+    {
+        mapPendingTxIndex[hash] = CTxIndex();
+    }
+    else
+    {
+        map<uint256, CTxIndex> mapChanges;
+        mapChanges[hash] = CTxIndex();
+        txcache.Commit(mapChanges);
+    }
+    return true;
 }
 
 bool CTxDB::ContainsTx(uint256 hash)
@@ -233,13 +402,32 @@ bool CTxDB::ContainsTx(uint256 hash)
     return Exists(make_pair(string("tx"), hash));
 }
 
+bool CTxDB::ReadTx(uint256 hash, const CDiskTxPos& pos, CTransaction& tx)
+{
+    if (txcache.GetTx(hash, tx))
+    {
+        return true;
+    }
+    if (!tx.ReadFromDisk(pos))
+    {
+        return false;
+    }
+    txcache.AddTx(hash, tx);
+    return true;
+}
+
+void CTxDB::CacheTx(const CTransaction& tx)
+{
+    txcache.AddTx(tx.GetHash(), tx);
+}
+
 bool CTxDB::ReadDiskTx(uint256 hash, CTransaction& tx, CTxIndex& txindex)
 {
     assert(!fClient);
     tx.SetNull();
     if (!ReadTxIndex(hash, txindex))
         return false;
-    return (tx.ReadFromDisk(txindex.pos));
+    return ReadTx(hash, txindex.pos, tx);
 }
 
 bool CTxDB::ReadDiskTx(uint256 hash, CTransaction& tx)
@@ -304,13 +492,39 @@ static CBlockIndex *InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
-bool CTxDB::LoadBlockIndex()
+// Copy the fields of a database record into the in-memory entry for hash,
+// creating it and its neighbours as needed.
+static CBlockIndex *InsertDiskBlockIndex(const uint256& hash, const CDiskBlockIndex& diskindex)
+{
+    CBlockIndex* pindexNew       = InsertBlockIndex(hash);
+    pindexNew->pprev             = InsertBlockIndex(diskindex.hashPrev);
+    pindexNew->pnext             = InsertBlockIndex(diskindex.hashNext);
+    pindexNew->nFile             = diskindex.nFile;
+    pindexNew->nBlockPos         = diskindex.nBlockPos;
+    pindexNew->nHeight           = diskindex.nHeight;
+    pindexNew->vCoinbase         = diskindex.vCoinbase;
+    pindexNew->nCoinbaseColor    = diskindex.nCoinbaseColor;
+    pindexNew->nStakeColor       = diskindex.nStakeColor;
+    pindexNew->vMoneySupply      = diskindex.vMoneySupply;
+    pindexNew->vTotalMint        = diskindex.vTotalMint;
+    pindexNew->nFlags            = diskindex.nFlags;
+    pindexNew->bnStakeModifier   = diskindex.bnStakeModifier;
+    pindexNew->prevoutStake      = diskindex.prevoutStake;
+    pindexNew->nStakeTime        = diskindex.nStakeTime;
+    pindexNew->hashProof         = diskindex.hashProof;
+    pindexNew->nVersion          = diskindex.nVersion;
+    pindexNew->hashMerkleRoot    = diskindex.hashMerkleRoot;
+    pindexNew->nTime             = diskindex.nTime;
+    pindexNew->nBits             = diskindex.nBits;
+    pindexNew->nNonce            = diskindex.nNonce;
+    pindexNew->nNonce64          = diskindex.nNonce64;
+    pindexNew->mix_hash          = diskindex.mix_hash;
+
+    return pindexNew;
+}
+
+bool CTxDB::LoadBlockIndexGuts()
 {
-    if (mapBlockIndex.size() > 0) {
-        // Already loaded once in this session. It can happen during migration
-        // from BDB.
-        return true;
-    }
     // The block index is an in-memory structure that maps hashes to on-disk
     // locations where the contents of the block can be found. Here, we scan it
     // out of the DB and into mapBlockIndex.
@@ -350,29 +564,7 @@ bool CTxDB::LoadBlockIndex()
         }
 
         // Construct block index object
-        CBlockIndex* pindexNew       = InsertBlockIndex(blockHash);
-        pindexNew->pprev             = InsertBlockIndex(diskindex.hashPrev);
-        pindexNew->pnext             = InsertBlockIndex(diskindex.hashNext);
-        pindexNew->nFile             = diskindex.nFile;
-        pindexNew->nBlockPos         = diskindex.nBlockPos;
-        pindexNew->nHeight           = diskindex.nHeight;
-        pindexNew->vCoinbase         = diskindex.vCoinbase;
-        pindexNew->nCoinbaseColor    = diskindex.nCoinbaseColor;
-        pindexNew->nStakeColor       = diskindex.nStakeColor;
-        pindexNew->vMoneySupply      = diskindex.vMoneySupply;
-        pindexNew->vTotalMint        = diskindex.vTotalMint;
-        pindexNew->nFlags            = diskindex.nFlags;
-        pindexNew->bnStakeModifier   = diskindex.bnStakeModifier;
-        pindexNew->prevoutStake      = diskindex.prevoutStake;
-        pindexNew->nStakeTime        = diskindex.nStakeTime;
-        pindexNew->hashProof         = diskindex.hashProof;
-        pindexNew->nVersion          = diskindex.nVersion;
-        pindexNew->hashMerkleRoot    = diskindex.hashMerkleRoot;
-        pindexNew->nTime             = diskindex.nTime;
-        pindexNew->nBits             = diskindex.nBits;
-        pindexNew->nNonce            = diskindex.nNonce;
-        pindexNew->nNonce64          = diskindex.nNonce64;
-        pindexNew->mix_hash          = diskindex.mix_hash;
+        CBlockIndex* pindexNew = InsertDiskBlockIndex(blockHash, diskindex);
 
         // Watch for genesis block
         if (pindexGenesisBlock == NULL && blockHash == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet))
@@ -421,6 +613,7 @@ bool CTxDB::LoadBlockIndex()
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
     printf("Assigning chain trusts.\n");
     int progress = 1;
+    uint64_t nSupplyUsage = 0;
     BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
     {
         if (progress % 100000 == 0)
@@ -432,6 +625,15 @@ bool CTxDB::LoadBlockIndex()
         }
         CBlockIndex* pindex = item.second;
         pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + pindex->GetBlockTrust();
+        // share supply arrays with the parent now that heights are ordered
+        if (pindex->pprev)
+        {
+            pindex->vMoneySupply.Rebase(pindex->pprev->vMoneySupply);
+            pindex->vTotalMint.Rebase(pindex->pprev->vTotalMint);
+        }
+        nSupplyUsage += pindex->vCoinbase.DynamicUsage() +
+                        pindex->vMoneySupply.DynamicUsage() +
+                        pindex->vTotalMint.DynamicUsage();
         // NovaCoin: calculate stake modifier checksum
         pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
         progress += 1;
@@ -444,6 +646,398 @@ bool CTxDB::LoadBlockIndex()
         }
     }
     printf("Chain trusts done.\n");
+    printf("Block index supply arrays use %" PRIu64 " kB\n", nSupplyUsage / 1024);
+
+    return true;
+}
+
+// The block index snapshot is a flat copy of mapBlockIndex written at clean
+// shutdown: a header naming the best chain it was taken at, one record per
+// block in height order, and a checksum over everything before it. Loading it
+// skips the database walk, the sort and the stake modifier checksums. It is
+// only trusted if the checksum holds and the database still has the same
+// best chain, and it is removed once read so that it never outlives the run
+// that follows the shutdown which wrote it.
+static const int BLOCKINDEX_SNAPSHOT_VERSION = 1;
+
+// Set once mapBlockIndex holds the complete index, so that a shutdown during
+// startup does not save a partial one.
+static bool fBlockIndexLoaded = false;
+
+static filesystem::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blkindex.snapshot";
+}
+
+// Read-only stream over a mapped snapshot, deserializing in place
+class CSnapshotStream
+{
+private:
+    const char* pcur;
+    const char* pend;
+
+public:
+    int nType;
+    int nVersion;
+
+    CSnapshotStream(const char* pbegin, const char* pendIn, int nTypeIn, int nVersionIn) :
+        pcur(pbegin), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    bool empty() const
+    {
+        return pcur == pend;
+    }
+
+    CSnapshotStream& read(char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pcur))
+            throw std::ios_base::failure("CSnapshotStream::read() : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return *this;
+    }
+
+    template<typename T>
+    CSnapshotStream& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return *this;
+    }
+};
+
+// Drop whatever a failed snapshot load left in the global index.
+static void ClearBlockIndex()
+{
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        delete item.second;
+    mapBlockIndex.clear();
+    setStakeSeen.clear();
+    pindexGenesisBlock = NULL;
+}
+
+bool CTxDB::WriteBlockIndexSnapshot()
+{
+    if (!fBlockIndexLoaded || !GetBoolArg("-blockindexsnapshot", true))
+        return false;
+
+    // the snapshot is only usable against the chain state on disk
+    uint256 hashBestChainDB;
+    if (!ReadHashBestChain(hashBestChainDB) || hashBestChainDB != hashBestChain)
+        return error("WriteBlockIndexSnapshot() : best chain not committed");
+
+    int64_t nStart = GetTimeMillis();
+    vector<pair<int, CBlockIndex*> > vSortedByHeight;
+    vSortedByHeight.reserve(mapBlockIndex.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vSortedByHeight.push_back(make_pair(item.second->nHeight, item.second));
+    sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    filesystem::path pathSnapshot = GetBlockIndexSnapshotPath();
+    filesystem::path pathTmp = GetDataDir() / "blkindex.snapshot.new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("WriteBlockIndexSnapshot() : open failed");
+
+    try {
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(pchMessageStart) << BLOCKINDEX_SNAPSHOT_VERSION << CLIENT_VERSION;
+        ss << hashBestChain << (unsigned int)vSortedByHeight.size();
+        BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
+        {
+            CBlockIndex* pindex = item.second;
+            ss << *pindex->phashBlock << CDiskBlockIndex(pindex);
+            ss << pindex->nChainTrust << pindex->nStakeModifierChecksum;
+            if (ss.size() >= (1 << 20))
+            {
+                hasher.write(&ss[0], ss.size());
+                fileout.write(&ss[0], ss.size());
+                ss.clear();
+            }
+        }
+        if (!ss.empty())
+        {
+            hasher.write(&ss[0], ss.size());
+            fileout.write(&ss[0], ss.size());
+        }
+        fileout << hasher.GetHash();
+    }
+    catch (std::exception &e) {
+        fileout.fclose();
+        filesystem::remove(pathTmp);
+        return error("WriteBlockIndexSnapshot() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, pathSnapshot))
+        return error("WriteBlockIndexSnapshot() : Rename-into-place failed");
+
+    printf("Wrote block index snapshot of %" PRIszu " blocks in %" PRId64 "ms\n",
+           vSortedByHeight.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CTxDB::LoadBlockIndexSnapshot()
+{
+    filesystem::path pathSnapshot = GetBlockIndexSnapshotPath();
+    if (!filesystem::exists(pathSnapshot))
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    bool fLoaded = false;
+    try {
+        uint256 hashBestChainDB;
+        if (!ReadHashBestChain(hashBestChainDB))
+            throw runtime_error("no best chain in database");
+
+        interprocess::file_mapping mapping(pathSnapshot.string().c_str(), interprocess::read_only);
+        interprocess::mapped_region region(mapping, interprocess::read_only);
+        const char* pbegin = (const char*)region.get_address();
+        size_t nSize = region.get_size();
+        if (nSize < sizeof(uint256))
+            throw runtime_error("truncated");
+        const char* pend = pbegin + nSize - sizeof(uint256);
+        uint256 hashChecksum;
+        memcpy(&hashChecksum, pend, sizeof(hashChecksum));
+        if (Hash(pbegin, pend) != hashChecksum)
+            throw runtime_error("checksum mismatch");
+
+        CSnapshotStream s(pbegin, pend, SER_DISK, CLIENT_VERSION);
+        unsigned char pchMagic[4];
+        int nSnapshotVersion, nSnapshotClientVersion;
+        uint256 hashSnapshotBest;
+        unsigned int nCount;
+        s >> FLATDATA(pchMagic) >> nSnapshotVersion >> nSnapshotClientVersion;
+        s >> hashSnapshotBest >> nCount;
+        if (memcmp(pchMagic, pchMessageStart, sizeof(pchMagic)) != 0)
+            throw runtime_error("wrong network");
+        if (nSnapshotVersion != BLOCKINDEX_SNAPSHOT_VERSION)
+            throw runtime_error("unknown version");
+        if (hashSnapshotBest != hashBestChainDB)
+            throw runtime_error("stale");
+        // records use the serialization of the client that wrote them
+        s.nVersion = nSnapshotClientVersion;
+
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            uint256 hash;
+            CDiskBlockIndex diskindex;
+            s >> hash >> diskindex;
+            CBlockIndex* pindexNew = InsertDiskBlockIndex(hash, diskindex);
+            s >> pindexNew->nChainTrust >> pindexNew->nStakeModifierChecksum;
+
+            // parents come first, so supply arrays can share with them now
+            if (pindexNew->pprev)
+            {
+                pindexNew->vMoneySupply.Rebase(pindexNew->pprev->vMoneySupply);
+                pindexNew->vTotalMint.Rebase(pindexNew->pprev->vTotalMint);
+            }
+            if (pindexGenesisBlock == NULL && hash == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet))
+                pindexGenesisBlock = pindexNew;
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+            if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+                throw runtime_error(strprintf("failed stake modifier checkpoint at %d", pindexNew->nHeight));
+        }
+        // every pprev/pnext must have been resolved by a record of its own
+        if (!s.empty() || mapBlockIndex.size() != nCount)
+            throw runtime_error("inconsistent");
+        fLoaded = true;
+    }
+    catch (std::exception &e) {
+        printf("LoadBlockIndexSnapshot() : snapshot not used: %s\n", e.what());
+        ClearBlockIndex();
+    }
+
+    // a snapshot describes a single shutdown; fall back to the database next time
+    boost::system::error_code ec;
+    filesystem::remove(pathSnapshot, ec);
+
+    if (fLoaded)
+        printf("Loaded %" PRIszu " blocks from block index snapshot in %" PRId64 "ms\n",
+               mapBlockIndex.size(), GetTimeMillis() - nStart);
+    return fLoaded;
+}
+
+// Outcome of verifying one block at startup
+struct CBlockCheckResult
+{
+    enum { UNCHECKED, GOOD, BAD, UNREADABLE };
+
+    int nStatus;
+    vector<string> vProblems;
+
+    CBlockCheckResult() : nStatus(UNCHECKED) {}
+
+    void Bad(const string& strProblem)
+    {
+        nStatus = BAD;
+        vProblems.push_back(strProblem);
+    }
+};
+
+// Work shared by the startup block verification threads. Each worker takes
+// the next unchecked block and fills in its slot of vResult.
+struct CBlockCheckJob
+{
+    const vector<CBlockIndex*>& vCheck;
+    const map<pair<unsigned int, unsigned int>, int>& mapBlockPos;
+    int nCheckLevel;
+    vector<CBlockCheckResult>& vResult;
+    std::atomic<int> nNext;
+    std::atomic<int> nDone;
+    std::atomic<int> nRunning;
+
+    CBlockCheckJob(const vector<CBlockIndex*>& vCheckIn,
+                   const map<pair<unsigned int, unsigned int>, int>& mapBlockPosIn,
+                   int nCheckLevelIn, vector<CBlockCheckResult>& vResultIn) :
+        vCheck(vCheckIn), mapBlockPos(mapBlockPosIn), nCheckLevel(nCheckLevelIn),
+        vResult(vResultIn), nNext(0), nDone(0), nRunning(0) {}
+};
+
+// Verify one block of the -checkblocks window at the given -checklevel.
+// mapBlockPos holds the disk position and height of every block in the window.
+static void CheckBlockAtLevel(CTxDB& txdb, CBlockIndex* pindex, int nCheckLevel,
+                              const map<pair<unsigned int, unsigned int>, int>& mapBlockPos,
+                              CBlockCheckResult& result)
+{
+    result.nStatus = CBlockCheckResult::GOOD;
+    CBlock block;
+    if (!block.ReadFromDisk(pindex))
+    {
+        result.nStatus = CBlockCheckResult::UNREADABLE;
+        return;
+    }
+    // check level 1: verify block validity
+    // check level 7: verify block signature too
+    if (nCheckLevel>0 && !block.CheckBlock(true, true, (nCheckLevel>6)))
+    {
+        result.Bad(strprintf("LoadBlockIndex() : *** found bad block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString().c_str()));
+    }
+    // check level 2: verify transaction index validity
+    if (nCheckLevel>1)
+    {
+        BOOST_FOREACH(const CTransaction &tx, block.vtx)
+        {
+            uint256 hashTx = tx.GetHash();
+            CTxIndex txindex;
+            if (txdb.ReadTxIndex(hashTx, txindex))
+            {
+                // check level 3: checker transaction hashes
+                if (nCheckLevel>2 || pindex->nFile != txindex.pos.nFile || pindex->nBlockPos != txindex.pos.nBlockPos)
+                {
+                    // either an error or a duplicate transaction
+                    CTransaction txFound;
+                    if (!txFound.ReadFromDisk(txindex.pos))
+                    {
+                        result.Bad(strprintf("LoadBlockIndex() : *** cannot read mislocated transaction %s", hashTx.ToString().c_str()));
+                    }
+                    else
+                        if (txFound.GetHash() != hashTx) // not a duplicate tx
+                        {
+                            result.Bad(strprintf("LoadBlockIndex(): *** invalid tx position for %s", hashTx.ToString().c_str()));
+                        }
+                }
+                // check level 4: check whether spent txouts were spent within the main chain
+                unsigned int nOutput = 0;
+                if (nCheckLevel>3)
+                {
+                    BOOST_FOREACH(const CDiskTxPos &txpos, txindex.vSpent)
+                    {
+                        if (!txpos.IsNull())
+                        {
+                            // the spend must be in this block or a later one of the window
+                            pair<unsigned int, unsigned int> posFind = make_pair(txpos.nFile, txpos.nBlockPos);
+                            map<pair<unsigned int, unsigned int>, int>::const_iterator mi = mapBlockPos.find(posFind);
+                            if (mi == mapBlockPos.end() || mi->second < pindex->nHeight)
+                            {
+                                result.Bad(strprintf("LoadBlockIndex(): *** found bad spend at %d, hashBlock=%s, hashTx=%s", pindex->nHeight, pindex->GetBlockHash().ToString().c_str(), hashTx.ToString().c_str()));
+                            }
+                            // check level 6: check whether spent txouts were spent by a valid transaction that consume them
+                            if (nCheckLevel>5)
+                            {
+                                CTransaction txSpend;
+                                if (!txSpend.ReadFromDisk(txpos))
+                                {
+                                    result.Bad(strprintf("LoadBlockIndex(): *** cannot read spending transaction of %s:%i from disk", hashTx.ToString().c_str(), nOutput));
+                                }
+                                else if (!txSpend.CheckTransaction())
+                                {
+                                    result.Bad(strprintf("LoadBlockIndex(): *** spending transaction of %s:%i is invalid", hashTx.ToString().c_str(), nOutput));
+                                }
+                                else
+                                {
+                                    bool fFound = false;
+                                    BOOST_FOREACH(const CTxIn &txin, txSpend.vin)
+                                        if (txin.prevout.hash == hashTx && txin.prevout.n == nOutput)
+                                            fFound = true;
+                                    if (!fFound)
+                                    {
+                                        result.Bad(strprintf("LoadBlockIndex(): *** spending transaction of %s:%i does not spend it", hashTx.ToString().c_str(), nOutput));
+                                    }
+                                }
+                            }
+                        }
+                        nOutput++;
+                    }
+                }
+            }
+            // check level 5: check whether all prevouts are marked spent
+            if (nCheckLevel>4)
+            {
+                 BOOST_FOREACH(const CTxIn &txin, tx.vin)
+                 {
+                      CTxIndex txindex;
+                      if (txdb.ReadTxIndex(txin.prevout.hash, txindex))
+                          if (txindex.vSpent.size()-1 < txin.prevout.n || txindex.vSpent[txin.prevout.n].IsNull())
+                          {
+                              result.Bad(strprintf("LoadBlockIndex(): *** found unspent prevout %s:%i in %s", txin.prevout.hash.ToString().c_str(), txin.prevout.n, hashTx.ToString().c_str()));
+                          }
+                 }
+            }
+        }
+    }
+}
+
+static void ThreadCheckBlocks(CBlockCheckJob* pjob)
+{
+    RenameThread("breakout-checkblk");
+    CTxDB txdb("r");
+    while (!fRequestShutdown)
+    {
+        int i = pjob->nNext++;
+        if (i >= (int)pjob->vCheck.size())
+            break;
+        try {
+            CheckBlockAtLevel(txdb, pjob->vCheck[i], pjob->nCheckLevel,
+                              pjob->mapBlockPos, pjob->vResult[i]);
+        }
+        catch (std::exception &e) {
+            pjob->vResult[i].Bad(strprintf("LoadBlockIndex(): *** exception checking block at %d: %s",
+                                           pjob->vCheck[i]->nHeight, e.what()));
+        }
+        pjob->nDone++;
+    }
+    pjob->nRunning--;
+}
+
+bool CTxDB::LoadBlockIndex()
+{
+    if (mapBlockIndex.size() > 0) {
+        // Already loaded once in this session. It can happen during migration
+        // from BDB.
+        return true;
+    }
+
+    if (!GetBoolArg("-blockindexsnapshot", true) || !LoadBlockIndexSnapshot())
+    {
+        if (!LoadBlockIndexGuts())
+            return false;
+        if (fRequestShutdown)
+            return true;
+    }
 
     // Load hashBestChain pointer to end of best chain
     if (!ReadHashBestChain(hashBestChain))
@@ -493,117 +1087,64 @@ bool CTxDB::LoadBlockIndex()
         printf("Skipping block verification (-checkblocks < 0)\n");
     }
         
-    CBlockIndex* pindexFork = NULL;
-    map<pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
+    // Blocks are checked newest first, by as many workers as -par allows,
+    // but problems are reported in that order once all of them are done.
+    vector<CBlockIndex*> vCheck;
     for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
     {
-        if (fRequestShutdown || (pindex->nHeight < nBestHeight-nCheckDepth))
+        if (pindex->nHeight < nBestHeight-nCheckDepth)
             break;
-        CBlock block;
-        if (!block.ReadFromDisk(pindex))
-            return error("LoadBlockIndex() : block.ReadFromDisk failed");
-        // check level 1: verify block validity
-        // check level 7: verify block signature too
-        if (nCheckLevel>0 && !block.CheckBlock(true, true, (nCheckLevel>6)))
-        {
-            printf("LoadBlockIndex() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString().c_str());
-            pindexFork = pindex->pprev;
-        }
-        // check level 2: verify transaction index validity
-        if (nCheckLevel>1)
+        vCheck.push_back(pindex);
+    }
+    map<pair<unsigned int, unsigned int>, int> mapBlockPos;
+    if (nCheckLevel>3)
+    {
+        BOOST_FOREACH(CBlockIndex* pindex, vCheck)
+            mapBlockPos[make_pair(pindex->nFile, pindex->nBlockPos)] = pindex->nHeight;
+    }
+
+    vector<CBlockCheckResult> vResult(vCheck.size());
+    if (!vCheck.empty())
+    {
+        CBlockCheckJob job(vCheck, mapBlockPos, nCheckLevel, vResult);
+        int nThreads = min((int)vCheck.size(), max(nScriptCheckThreads, 1));
+        boost::thread_group threadGroup;
+        job.nRunning = nThreads;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&ThreadCheckBlocks, &job));
+        int nLastPercent = -1;
+        while (job.nDone < (int)vCheck.size() && job.nRunning > 0)
         {
-            pair<unsigned int, unsigned int> pos = make_pair(pindex->nFile, pindex->nBlockPos);
-            mapBlockPos[pos] = pindex;
-            BOOST_FOREACH(const CTransaction &tx, block.vtx)
+            int nPercent = (int)(100 * (int64_t)job.nDone / vCheck.size());
+            if (nPercent != nLastPercent)
             {
-                uint256 hashTx = tx.GetHash();
-                CTxIndex txindex;
-                if (ReadTxIndex(hashTx, txindex))
-                {
-                    // check level 3: checker transaction hashes
-                    if (nCheckLevel>2 || pindex->nFile != txindex.pos.nFile || pindex->nBlockPos != txindex.pos.nBlockPos)
-                    {
-                        // either an error or a duplicate transaction
-                        CTransaction txFound;
-                        if (!txFound.ReadFromDisk(txindex.pos))
-                        {
-                            printf("LoadBlockIndex() : *** cannot read mislocated transaction %s\n", hashTx.ToString().c_str());
-                            pindexFork = pindex->pprev;
-                        }
-                        else
-                            if (txFound.GetHash() != hashTx) // not a duplicate tx
-                            {
-                                printf("LoadBlockIndex(): *** invalid tx position for %s\n", hashTx.ToString().c_str());
-                                pindexFork = pindex->pprev;
-                            }
-                    }
-                    // check level 4: check whether spent txouts were spent within the main chain
-                    unsigned int nOutput = 0;
-                    if (nCheckLevel>3)
-                    {
-                        BOOST_FOREACH(const CDiskTxPos &txpos, txindex.vSpent)
-                        {
-                            if (!txpos.IsNull())
-                            {
-                                pair<unsigned int, unsigned int> posFind = make_pair(txpos.nFile, txpos.nBlockPos);
-                                if (!mapBlockPos.count(posFind))
-                                {
-                                    printf("LoadBlockIndex(): *** found bad spend at %d, hashBlock=%s, hashTx=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString().c_str(), hashTx.ToString().c_str());
-                                    pindexFork = pindex->pprev;
-                                }
-                                // check level 6: check whether spent txouts were spent by a valid transaction that consume them
-                                if (nCheckLevel>5)
-                                {
-                                    CTransaction txSpend;
-                                    if (!txSpend.ReadFromDisk(txpos))
-                                    {
-                                        printf("LoadBlockIndex(): *** cannot read spending transaction of %s:%i from disk\n", hashTx.ToString().c_str(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else if (!txSpend.CheckTransaction())
-                                    {
-                                        printf("LoadBlockIndex(): *** spending transaction of %s:%i is invalid\n", hashTx.ToString().c_str(), nOutput);
-                                        pindexFork = pindex->pprev;
-                                    }
-                                    else
-                                    {
-                                        bool fFound = false;
-                                        BOOST_FOREACH(const CTxIn &txin, txSpend.vin)
-                                            if (txin.prevout.hash == hashTx && txin.prevout.n == nOutput)
-                                                fFound = true;
-                                        if (!fFound)
-                                        {
-                                            printf("LoadBlockIndex(): *** spending transaction of %s:%i does not spend it\n", hashTx.ToString().c_str(), nOutput);
-                                            pindexFork = pindex->pprev;
-                                        }
-                                    }
-                                }
-                            }
-                            nOutput++;
-                        }
-                    }
-                }
-                // check level 5: check whether all prevouts are marked spent
-                if (nCheckLevel>4)
-                {
-                     BOOST_FOREACH(const CTxIn &txin, tx.vin)
-                     {
-                          CTxIndex txindex;
-                          if (ReadTxIndex(txin.prevout.hash, txindex))
-                              if (txindex.vSpent.size()-1 < txin.prevout.n || txindex.vSpent[txin.prevout.n].IsNull())
-                              {
-                                  printf("LoadBlockIndex(): *** found unspent prevout %s:%i in %s\n", txin.prevout.hash.ToString().c_str(), txin.prevout.n, hashTx.ToString().c_str());
-                                  pindexFork = pindex->pprev;
-                              }
-                     }
-                }
+                uiInterface.InitMessage(strprintf(_("Verifying blocks... %d%%"), nPercent));
+                nLastPercent = nPercent;
             }
+            MilliSleep(250);
         }
+        threadGroup.join_all();
+        uiInterface.InitMessage(_("Loading block index..."));
+    }
+
+    CBlockIndex* pindexFork = NULL;
+    for (unsigned int i = 0; i < vCheck.size(); i++)
+    {
+        const CBlockCheckResult& result = vResult[i];
+        // a shutdown request stops the workers before they reach every block
+        if (result.nStatus == CBlockCheckResult::UNCHECKED)
+            break;
+        BOOST_FOREACH(const string& strProblem, result.vProblems)
+            printf("%s\n", strProblem.c_str());
+        if (result.nStatus == CBlockCheckResult::UNREADABLE)
+            return error("LoadBlockIndex() : block.ReadFromDisk failed");
+        if (result.nStatus == CBlockCheckResult::BAD)
+            pindexFork = vCheck[i]->pprev;
     }
 
     printf("LoadBlockIndex(): building block index lookup\n");
     CBlockIndex* pindexLookup = pindexBest;
-    progress = 1;
+    int progress = 1;
     for (int i = pindexBest->nHeight; i >= 0; --i)
     {
         if (!pindexLookup)
@@ -631,5 +1172,6 @@ bool CTxDB::LoadBlockIndex()
         block.SetBestChain(txdb, pindexFork);
     }
 
+    fBlockIndexLoaded = true;
     return true;
 }
@@ -7,13 +7,13 @@
 #define BITCOIN_LEVELDB_H
 
 #include "main.h"
+#include "batch-leveldb.h"
 
 #include <map>
 #include <string>
 #include <vector>
 
 #include <leveldb/db.h>
-#include <leveldb/write_batch.h>
 
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
@@ -45,11 +45,16 @@ private:
 
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
-    leveldb::WriteBatch *activeBatch;
+    CLevelDBBatch *activeBatch;
     leveldb::Options options;
     bool fReadOnly;
     int nVersion;
 
+    // Transaction index entries written while activeBatch is open. They are
+    // published to the shared txindex cache only once the batch commits.
+    // A null CTxIndex marks an erased entry.
+    std::map<uint256, CTxIndex> mapPendingTxIndex;
+
 protected:
     // Returns true and sets (value,false) if activeBatch contains the given key
     // or leaves value alone and sets deleted = true if activeBatch contains a
@@ -169,6 +174,7 @@ public:
     {
         delete activeBatch;
         activeBatch = NULL;
+        mapPendingTxIndex.clear();
         return true;
     }
 
@@ -192,14 +198,23 @@ public:
     bool ReadDiskTx(uint256 hash, CTransaction& tx);
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx, CTxIndex& txindex);
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx);
+    // Read the transaction with the given hash stored at pos, using the
+    // in-memory transaction cache before going to the block file.
+    bool ReadTx(uint256 hash, const CDiskTxPos& pos, CTransaction& tx);
+    // Remember a transaction that is likely to be spent soon.
+    void CacheTx(const CTransaction& tx);
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
     bool ReadHashBestChain(uint256& hashBestChain);
     bool WriteHashBestChain(uint256 hashBestChain);
     bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
     bool WriteBestInvalidTrust(CBigNum bnBestInvalidTrust);
     bool LoadBlockIndex();
+    // Dump the in-memory block index to a flat file that the next
+    // LoadBlockIndex() can map instead of walking the database.
+    bool WriteBlockIndexSnapshot();
 private:
     bool LoadBlockIndexGuts();
+    bool LoadBlockIndexSnapshot();
 };
 
 
@@ -571,6 +571,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
                            wtx.GetHash().ToString().c_str());
                     wtx.MarkSpent(nIn);
                     wtx.WriteToDisk();
+                    IndexCoins(wtx);
                     NotifyTransactionChanged(this, txin.prevout.hash, CT_UPDATED);
                 }
             }
@@ -588,6 +589,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
                 {
                     wtx.MarkUnspent(&txout - &tx.vout[0]);
                     wtx.WriteToDisk();
+                    IndexCoins(wtx);
                     NotifyTransactionChanged(this, hash, CT_UPDATED);
                 }
             }
@@ -596,6 +598,46 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
     }
 }
 
+void CWallet::IndexCoins(const CWalletTx& wtx)
+{
+    // multisig outputs are indexed too; readers filter by their own fMultiSig
+    static const bool fMultiSig = true;
+
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        const CTxOut& txout = wtx.vout[i];
+        if (txout.nColor < 0 || txout.nColor >= N_COLORS)
+            continue;
+        if (!wtx.IsSpent(i) && (IsMine(txout, fMultiSig) & ISMINE_ALL))
+            vCoinIndex[txout.nColor][COutPoint(hash, i)] = &wtx;
+        else
+            vCoinIndex[txout.nColor].erase(COutPoint(hash, i));
+    }
+}
+
+void CWallet::UnindexCoins(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        const CTxOut& txout = wtx.vout[i];
+        if (txout.nColor >= 0 && txout.nColor < N_COLORS)
+            vCoinIndex[txout.nColor].erase(COutPoint(hash, i));
+    }
+}
+
+void CWallet::RebuildCoinIndex()
+{
+    LOCK(cs_wallet);
+    vCoinIndex.assign(N_COLORS, std::map<COutPoint, const CWalletTx*>());
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
+         it != mapWallet.end(); ++it)
+        IndexCoins((*it).second);
+}
+
 void CWallet::MarkDirty()
 {
     {
@@ -614,6 +656,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
         pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
+        wtx.CacheHash();
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
@@ -700,6 +743,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
             }
             fUpdated |= wtx.UpdateSpent(wtxIn.vfSpent);
         }
+        IndexCoins(wtx);
 
         //// debug print
         printf("AddToWallet %s  %s%s\n",
@@ -817,6 +861,7 @@ bool CWallet::EraseFromWallet(uint256 hash)
             ColorsMap mapRcvd;
             ColorsMap mapSnt;
             wtx.GetAmounts(false, mapRcvd, mapSnt);
+            UnindexCoins(wtx);
             if (mapWallet.erase(hash))
             {
                 CWalletDB(strWalletFile).EraseTx(hash);
@@ -853,6 +898,8 @@ bool CWallet::EraseFromWallet(uint256 hash)
                         mapConfirmed.Add(mapSnt);
                     }
                 }
+                ++nBalanceUpdates;
+                CheckBalances();
             }
         }
     }
@@ -1232,9 +1279,215 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+// One block of a rescan: read ahead by the reader thread, then pre-filtered
+// by a worker. vMatch flags the transactions AddToWalletIfInvolvingMe()
+// must see whatever their inputs are.
+struct CRescanBlock
+{
+    enum { EMPTY, READ, FILTERING, FILTERED };
+
+    int nState;
+    CBlock block;
+    vector<char> vMatch;
+    // stealth-looking outputs of the transactions not matched
+    unsigned int nStealthSkipped;
+
+    CRescanBlock() : nState(EMPTY), nStealthSkipped(0) {}
+};
+
+// Work shared by the rescan reader, the filter workers and the thread
+// applying the matches. Block i of vScan lives in vSlot[i % vSlot.size()]
+// until it has been applied, so at most vSlot.size() blocks are in flight.
+struct CRescanJob
+{
+    const CWallet* pwallet;
+    const vector<CBlockIndex*>& vScan;
+    const set<uint256>& setWalletTxs;
+    const CStealthScanner& scanner;
+    vector<CRescanBlock> vSlot;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    unsigned int nRead;
+    unsigned int nFilter;
+    unsigned int nApplied;
+    bool fQuit;
+
+    CRescanJob(const CWallet* pwalletIn, const vector<CBlockIndex*>& vScanIn,
+               const set<uint256>& setWalletTxsIn,
+               const CStealthScanner& scannerIn, unsigned int nSlots) :
+        pwallet(pwalletIn), vScan(vScanIn), setWalletTxs(setWalletTxsIn),
+        scanner(scannerIn), vSlot(nSlots), nRead(0), nFilter(0),
+        nApplied(0), fQuit(false) {}
+};
+
+// The ephemeral key of a stealth output: OP_RETURN <33 bytes>
+static bool GetStealthEphemPK(const CTxOut& txout, ec_point& vchEphemPKRet)
+{
+    opcodetype opCode;
+    CScript::const_iterator itTxA = txout.scriptPubKey.begin();
+    return txout.scriptPubKey.GetOp(itTxA, opCode, vchEphemPKRet) &&
+           (opCode == OP_RETURN) &&
+           txout.scriptPubKey.GetOp(itTxA, opCode, vchEphemPKRet) &&
+           (vchEphemPKRet.size() == 33);
+}
+
+// Whether an output pays one of the owned stealth addresses, tried against
+// every other output of the transaction as FindStealthTransactions() does
+static bool IsOwnedStealthTx(const CTransaction& tx,
+                             const CStealthScanner& scanner,
+                             unsigned int& nStealthRet)
+{
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+    {
+        ec_point vchEphemPK;
+        if (!GetStealthEphemPK(txout, vchEphemPK))
+        {
+            continue;
+        }
+        nStealthRet++;
+        vector<CKeyID> vKeyIDs;
+        BOOST_FOREACH(const CTxOut& txoutB, tx.vout)
+        {
+            CTxDestination address;
+            if ((&txoutB == &txout) ||
+                !ExtractDestination(txoutB.scriptPubKey, address) ||
+                (address.type() != typeid(CKeyID)))
+            {
+                continue;
+            }
+            vKeyIDs.push_back(boost::get<CKeyID>(address));
+        }
+        vector<CStealthScanResult> vResult;
+        if (vKeyIDs.empty() ||
+            !scanner.Scan(vector<ec_point>(1, vchEphemPK), vResult))
+        {
+            continue;
+        }
+        BOOST_FOREACH(const CStealthScanResult& result, vResult)
+        {
+            if (!result.fValid)
+            {
+                continue;
+            }
+            CPubKey cpkE(result.pkExtracted);
+            if (cpkE.IsValid() &&
+                (find(vKeyIDs.begin(), vKeyIDs.end(), cpkE.GetID()) != vKeyIDs.end()))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Flags the transactions of a block that are already in the wallet, pay the
+// wallet or pay one of its stealth addresses. Spends of wallet coins are
+// left to the applying thread, which sees the matches of earlier blocks.
+static void FilterRescanBlock(const CRescanJob& job, CRescanBlock& slot)
+{
+    // no reason why multisig txs can't be added to the wallet
+    static const bool fMultiSig = true;
+
+    slot.vMatch.assign(slot.block.vtx.size(), false);
+    slot.nStealthSkipped = 0;
+    for (unsigned int i = 0; i < slot.block.vtx.size(); i++)
+    {
+        const CTransaction& tx = slot.block.vtx[i];
+        if (job.setWalletTxs.count(tx.GetHash()) ||
+            (job.pwallet->IsMine(tx, fMultiSig) & ISMINE_ALL))
+        {
+            slot.vMatch[i] = true;
+            continue;
+        }
+        unsigned int nStealth = 0;
+        if (IsOwnedStealthTx(tx, job.scanner, nStealth))
+        {
+            slot.vMatch[i] = true;
+            continue;
+        }
+        slot.nStealthSkipped += nStealth;
+    }
+}
+
+static void ThreadRescanRead(CRescanJob* pjob)
+{
+    RenameThread("breakout-rescanrd");
+    const unsigned int nSlots = pjob->vSlot.size();
+    for (unsigned int i = 0; i < pjob->vScan.size(); i++)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(pjob->mutex);
+            while (!pjob->fQuit && (i >= pjob->nApplied + nSlots))
+            {
+                pjob->cond.wait(lock);
+            }
+            if (pjob->fQuit)
+            {
+                return;
+            }
+        }
+        // the slot is EMPTY and no other thread touches it until READ
+        CRescanBlock& slot = pjob->vSlot[i % nSlots];
+        slot.block.SetNull();
+        slot.block.ReadFromDisk(pjob->vScan[i], true);
+        {
+            boost::unique_lock<boost::mutex> lock(pjob->mutex);
+            slot.nState = CRescanBlock::READ;
+            pjob->nRead = i + 1;
+        }
+        pjob->cond.notify_all();
+    }
+}
+
+static void ThreadRescanFilter(CRescanJob* pjob)
+{
+    RenameThread("breakout-rescan");
+    const unsigned int nSlots = pjob->vSlot.size();
+    while (true)
+    {
+        unsigned int i;
+        {
+            boost::unique_lock<boost::mutex> lock(pjob->mutex);
+            while (!pjob->fQuit && (pjob->nFilter < pjob->vScan.size()) &&
+                   (pjob->nFilter >= pjob->nRead))
+            {
+                pjob->cond.wait(lock);
+            }
+            if (pjob->fQuit || (pjob->nFilter >= pjob->vScan.size()))
+            {
+                return;
+            }
+            i = pjob->nFilter++;
+            pjob->vSlot[i % nSlots].nState = CRescanBlock::FILTERING;
+        }
+        CRescanBlock& slot = pjob->vSlot[i % nSlots];
+        try
+        {
+            FilterRescanBlock(*pjob, slot);
+        }
+        catch (std::exception& e)
+        {
+            // leave the whole block to AddToWalletIfInvolvingMe()
+            PrintExceptionContinue(&e, "ThreadRescanFilter()");
+            slot.vMatch.assign(slot.block.vtx.size(), true);
+            slot.nStealthSkipped = 0;
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(pjob->mutex);
+            slot.nState = CRescanBlock::FILTERED;
+        }
+        pjob->cond.notify_all();
+    }
+}
+
 // Scan the block chain (starting in pindexStart) for transactions
 // from or to us. If fUpdate is true, found transactions that already
 // exist in the wallet will be updated.
+//
+// Blocks are read ahead by one thread and pre-filtered by as many workers as
+// -par allows; the matches are then added to the wallet in chain order, so
+// the result is that of handing every transaction to
+// AddToWalletIfInvolvingMe() in turn.
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart,
                                        bool fUpdate,
                                        const CProgressHelper* pprogress)
@@ -1248,33 +1501,110 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart,
         return 0;
     }
 
+    // blocks in flight per filter worker
+    static const unsigned int RESCAN_BLOCKS_PER_THREAD = 16;
+
     int ret = 0;
 
-    CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
-        while (pindex)
+
+        // no need to read and scan block, if block was created before
+        // our wallet birthday (as adjusted for block time variability)
+        vector<CBlockIndex*> vScan;
+        for (CBlockIndex* pindex = pindexStart; pindex; pindex = pindex->pnext)
         {
-            pprogress->update(pindex->nHeight, nBestHeight);
-            // no need to read and scan block, if block was created before
-            // our wallet birthday (as adjusted for block time variability)
             if (nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200)))
             {
-                pindex = pindex->pnext;
                 continue;
             }
+            vScan.push_back(pindex);
+        }
+        if (vScan.empty())
+        {
+            return 0;
+        }
 
-            CBlock block;
-            block.ReadFromDisk(pindex, true);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        set<uint256> setWalletTxs;
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
+             it != mapWallet.end(); ++it)
+        {
+            setWalletTxs.insert((*it).first);
+        }
+        // the workers' own scanner, so nothing they read changes under them
+        CStealthScanner scanner;
+        BOOST_FOREACH(const CStealthAddress& sxAddr, stealthAddresses)
+        {
+            scanner.Add(sxAddr);
+        }
+        // keys found through stealth payments during the scan are not in
+        // what the workers matched against, so after the first one every
+        // transaction is checked here again
+        const uint32_t nFoundStealthStart = nFoundStealth;
+
+        int nThreads = max(nScriptCheckThreads, 1);
+        CRescanJob job(this, vScan, setWalletTxs, scanner,
+                       nThreads * RESCAN_BLOCKS_PER_THREAD);
+        boost::thread_group threadGroup;
+        threadGroup.create_thread(boost::bind(&ThreadRescanRead, &job));
+        for (int i = 0; i < nThreads; i++)
+        {
+            threadGroup.create_thread(boost::bind(&ThreadRescanFilter, &job));
+        }
+
+        try
+        {
+            const unsigned int nSlots = job.vSlot.size();
+            for (unsigned int i = 0; i < vScan.size(); i++)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                CRescanBlock& slot = job.vSlot[i % nSlots];
+                {
+                    boost::unique_lock<boost::mutex> lock(job.mutex);
+                    while (slot.nState != CRescanBlock::FILTERED)
+                    {
+                        job.cond.wait(lock);
+                    }
+                }
+                pprogress->update(vScan[i]->nHeight, nBestHeight);
+
+                bool fRecheck = (nFoundStealth != nFoundStealthStart);
+                if (!fRecheck)
                 {
-                    ret++;
+                    nStealth += slot.nStealthSkipped;
                 }
+                for (unsigned int j = 0; j < slot.block.vtx.size(); j++)
+                {
+                    const CTransaction& tx = slot.block.vtx[j];
+                    bool fInvolved = slot.vMatch[j] || fRecheck;
+                    for (unsigned int k = 0; !fInvolved && k < tx.vin.size(); k++)
+                    {
+                        fInvolved = mapWallet.count(tx.vin[k].prevout.hash);
+                    }
+                    if (fInvolved && AddToWalletIfInvolvingMe(tx, &slot.block, fUpdate))
+                    {
+                        ret++;
+                    }
+                }
+
+                {
+                    boost::unique_lock<boost::mutex> lock(job.mutex);
+                    slot.nState = CRescanBlock::EMPTY;
+                    job.nApplied = i + 1;
+                }
+                job.cond.notify_all();
             }
-            pindex = pindex->pnext;
         }
+        catch (...)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(job.mutex);
+                job.fQuit = true;
+            }
+            job.cond.notify_all();
+            threadGroup.join_all();
+            throw;
+        }
+        threadGroup.join_all();
     }
     return ret;
 }
@@ -1347,6 +1677,7 @@ void CWallet::ReacceptWalletTransactions(const CProgressHelper* pprogress)
                                          wtx.GetHash().ToString().c_str());
                     wtx.MarkDirty();
                     wtx.WriteToDisk();
+                    IndexCoins(wtx);
                 }
             }
             else
@@ -1472,6 +1803,7 @@ int CWallet::ClearWalletTransactions(string& strError,
 
                 if (mapWallet.count(hash))
                 {
+                    UnindexCoins(mapWallet[hash]);
                     mapWallet.erase(hash);
                     NotifyTransactionChanged(this, hash, CT_DELETED);
                     nErasedTx += 1;
@@ -1603,123 +1935,247 @@ void CWallet::FillSnapshot(const CProgressHelper* pprogress)
                     mapReceivedNew,
                     mapSentNew,
                     pprogress);
+        mapConfirmed = mapConfirmedNew;
+        mapStake = mapStakeNew;
+        mapCoinbase = mapCoinbaseNew;
+        mapReceived = mapReceivedNew;
+        mapSent = mapSentNew;
+        ++nBalanceUpdates;
+        fReconcileRequested = false;
     }
-    mapConfirmed = mapConfirmedNew;
-    mapStake = mapStakeNew;
-    mapCoinbase = mapCoinbaseNew;
-    mapReceived = mapReceivedNew;
-    mapSent = mapSentNew;
 }
 
-// Not only periodically reconciles the real-time wallet balances (snapshot)
-// but also checks to see if the snapshot did not stay reconciled.
-void CWallet::Reconciler()
+// Applies the real-time balance changes of a block connection, a
+// reorganization or a new unconfirmed transaction.
+void CWallet::AddBalanceChanges(const ColorsMap& mapConfirmedChanges,
+                                const ColorsMap& mapStakeChanges,
+                                const ColorsMap& mapCoinbaseChanges,
+                                const ColorsMap& mapReceivedChanges,
+                                const ColorsMap& mapSentChanges)
 {
-    // 1 hr (3600 s)
-    constexpr int64_t CYCLE_INTERVAL = 1 * 3600 * 1000;
-    // check for fShutdown every second (1000 ms)
-    constexpr int64_t CYCLE_STEP = 1000;
-    string strProgressLabel("Progress of reconciling balances");
+    LOCK(cs_wallet);
+    mapConfirmed.Add(mapConfirmedChanges);
+    mapStake.Add(mapStakeChanges);
+    mapCoinbase.Add(mapCoinbaseChanges);
+    mapReceived.Add(mapReceivedChanges);
+    mapSent.Add(mapSentChanges);
+    ++nBalanceUpdates;
+    CheckBalances();
+}
+
+// Cheap test of the real-time balances, run with every update: no map may
+// go negative and immature coins are part of confirmed. A failure asks the
+// Reconciler() for a full pass rather than waiting out its cycle.
+bool CWallet::CheckBalances()
+{
+    AssertLockHeld(cs_wallet);
+    const ColorsMap* pmaps[] = { &mapConfirmed, &mapStake, &mapCoinbase,
+                                 &mapReceived, &mapSent };
+    set<int> setColors;
+    for (unsigned int i = 0; i < sizeof(pmaps) / sizeof(pmaps[0]); i++)
+    {
+        for (ColorsMapConstIter it = pmaps[i]->Begin();
+             it != pmaps[i]->End(); ++it)
+        {
+            setColors.insert(it->first);
+        }
+    }
+    BOOST_FOREACH(int nColor, setColors)
+    {
+        int64_t nConfirmed = mapConfirmed.Get(nColor);
+        int64_t nStake = mapStake.Get(nColor);
+        int64_t nCoinbase = mapCoinbase.Get(nColor);
+        if (nConfirmed < 0 || nStake < 0 || nCoinbase < 0 ||
+            mapReceived.Get(nColor) < 0 || mapSent.Get(nColor) < 0 ||
+            nStake + nCoinbase > nConfirmed)
+        {
+            printf("CheckBalances(): TSNH - inconsistent %s balances at "
+                   "block %d, requesting reconcile\n",
+                   COLOR_TICKER[nColor], nBestHeight);
+            fReconcileRequested = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Recomputes the balances from mapWallet a chunk of transactions at a time,
+// releasing the locks between chunks so that RPC calls and block processing
+// are not stalled behind a large wallet. If the balances change or the best
+// block moves during the pass, it starts over with chunks twice as large, so
+// that on a busy node it ends at the latest with the whole wallet done under
+// one lock. Returns false only on shutdown.
+bool CWallet::ReconcileBalances(const CProgressHelper* pprogress)
+{
+    static const unsigned int RECONCILE_CHUNK = 500;
+
+    ColorsMap confirmed, stake, coinbase, received, sent;
+    unsigned int nChunk = RECONCILE_CHUNK;
+    unsigned int nUpdatesStart;
+    const CBlockIndex* pindexStart;
+    unsigned int nTotal;
+    {
+        LOCK2(cs_main, cs_wallet);
+        nUpdatesStart = nBalanceUpdates;
+        pindexStart = pindexBest;
+        nTotal = mapWallet.size();
+    }
+
     const string strLine(78, '=');
     const char* pline = strLine.c_str();
-    const CProgressHelper progressReconcile(&logProgress,
-                                            &strProgressLabel,
-                                            100);
-    ColorsMap confirmed, stake, coinbase, received, sent;
-    const CBlockIndex* pindexLastBest = pindexBest;
+    unsigned int nDone = 0;
+    uint256 hashLast = 0;
     while (!fShutdown)
     {
-        GranularMilliSleep(CYCLE_INTERVAL, CYCLE_STEP);
-        printf("Reconciler(): Calculating balances.\n");
-        NotifyReconcileStarted();
-#ifdef QT_GUI
-        // Allow the GUI thread to process the reconcileStarted event
-        // before FillSnapshot() locks cs_wallet
-        MilliSleep(200);
-#endif
         {
-            // store the real-time calculated state
-            LOCK(cs_wallet);
-            confirmed = mapConfirmed;
-            stake = mapStake;
-            coinbase = mapCoinbase;
-            received = mapReceived;
-            sent = mapSent;
-        }
-        // reconcile the state
-        FillSnapshot(&progressReconcile);
-        NotifyReconcileEnded();
-        int fMapsChanged = (int)BalanceMapType::NONE;
-        {
-            // compare the real time calculated state to reconciliation
-            LOCK(cs_wallet);
-            if (confirmed != mapConfirmed)
-            {
-                fMapsChanged |= (int)BalanceMapType::CONFIRMED;
-            }
-            if (stake != mapStake)
-            {
-                fMapsChanged |= (int)BalanceMapType::STAKE;
-            }
-            if (coinbase != mapCoinbase)
+            LOCK2(cs_main, cs_wallet);
+            if ((nBalanceUpdates != nUpdatesStart) ||
+                (pindexBest != pindexStart))
             {
-                fMapsChanged |= (int)BalanceMapType::COINBASE;
+                confirmed.Clear();
+                stake.Clear();
+                coinbase.Clear();
+                received.Clear();
+                sent.Clear();
+                nChunk = (nChunk > nTotal) ? nChunk : 2 * nChunk;
+                nUpdatesStart = nBalanceUpdates;
+                pindexStart = pindexBest;
+                nTotal = mapWallet.size();
+                nDone = 0;
             }
-            if (received != mapReceived)
+            map<uint256, CWalletTx>::const_iterator it =
+                                   (nDone == 0) ? mapWallet.begin()
+                                                : mapWallet.upper_bound(hashLast);
+            for (unsigned int n = 0;
+                 (n < nChunk) && (it != mapWallet.end()); ++n, ++it)
             {
-                fMapsChanged |= (int)BalanceMapType::RECEIVED;
+                AddToSnapshot((*it).second, 1,
+                              confirmed, stake, coinbase, received, sent);
+                hashLast = (*it).first;
+                ++nDone;
             }
-            if (sent != mapSent)
+
+            if (it == mapWallet.end())
             {
-                fMapsChanged |= (int)BalanceMapType::SENT;
+                int fMapsChanged = (int)BalanceMapType::NONE;
+                if (confirmed != mapConfirmed)
+                {
+                    fMapsChanged |= (int)BalanceMapType::CONFIRMED;
+                }
+                if (stake != mapStake)
+                {
+                    fMapsChanged |= (int)BalanceMapType::STAKE;
+                }
+                if (coinbase != mapCoinbase)
+                {
+                    fMapsChanged |= (int)BalanceMapType::COINBASE;
+                }
+                if (received != mapReceived)
+                {
+                    fMapsChanged |= (int)BalanceMapType::RECEIVED;
+                }
+                if (sent != mapSent)
+                {
+                    fMapsChanged |= (int)BalanceMapType::SENT;
+                }
+                if (fMapsChanged != (int)BalanceMapType::NONE)
+                {
+                    // this should never happen, balances did not stay reconciled
+                    printf("%s\n", pline);
+                    printf("TSNH: Balances did not stay reconciled\n");
+                    printf("%s\n", pline);
+                    printf(" Time: %s\n",
+                           DateTimeStrFormat(GetAdjustedTime()).c_str());
+                    printf(" Best Block (%d)\n   %s\n",
+                           pindexBest->nHeight,
+                           pindexBest->phashBlock->ToString().c_str());
+                    printf("%s\n", pline);
+                    if (fMapsChanged & (int)BalanceMapType::CONFIRMED)
+                    {
+                        printf("Confirmed changed\n Was: %s\n Now: %s\n",
+                               mapConfirmed.ToString().c_str(),
+                               confirmed.ToString().c_str());
+                    }
+                    printf("%s\n", pline);
+                    if (fMapsChanged & (int)BalanceMapType::STAKE)
+                    {
+                        printf("Stake changed\n Was: %s\n Now: %s\n",
+                               mapStake.ToString().c_str(),
+                               stake.ToString().c_str());
+                    }
+                    printf("%s\n", pline);
+                    if (fMapsChanged & (int)BalanceMapType::COINBASE)
+                    {
+                        printf("Coinbase changed\n Was: %s\n Now: %s\n",
+                               mapCoinbase.ToString().c_str(),
+                               coinbase.ToString().c_str());
+                    }
+                    printf("%s\n", pline);
+                    if (fMapsChanged & (int)BalanceMapType::RECEIVED)
+                    {
+                        printf("Received changed\n Was: %s\n Now: %s\n",
+                               mapReceived.ToString().c_str(),
+                               received.ToString().c_str());
+                    }
+                    printf("%s\n", pline);
+                    if (fMapsChanged & (int)BalanceMapType::SENT)
+                    {
+                        printf("Sent changed\n Was: %s\n Now: %s\n",
+                               mapSent.ToString().c_str(),
+                               sent.ToString().c_str());
+                    }
+                    printf("%s\n Balances reconciled.\n%s\n", pline, pline);
+                    mapConfirmed = confirmed;
+                    mapStake = stake;
+                    mapCoinbase = coinbase;
+                    mapReceived = received;
+                    mapSent = sent;
+                    ++nBalanceUpdates;
+                }
+                fReconcileRequested = false;
+                return true;
             }
         }
-        if (fMapsChanged != (int)BalanceMapType::NONE)
-        {
-             LOCK(cs_wallet);
-             // this should never happen, balances did not stay reconciled
-             printf("%s\n", pline);
-             printf("TSNH: Balances did not stay reconciled\n");
-             printf("%s\n", pline);
-             printf(" Time: %s\n",
-                    DateTimeStrFormat(GetAdjustedTime()).c_str());
-             printf(" Last Block (%d)\n   %s\n",
-                    pindexLastBest->nHeight,
-                    pindexLastBest->phashBlock->ToString().c_str());
-             printf(" Best Block (%d)\n   %s\n",
-                    pindexBest->nHeight,
-                    pindexBest->phashBlock->ToString().c_str());
-             printf("%s\n", pline);
-             if (fMapsChanged & (int)BalanceMapType::CONFIRMED)
-             {
-                 printf("Confirmed changed\n Was: %s\n Now: %s\n",
-                        confirmed.ToString().c_str(),
-                        mapConfirmed.ToString().c_str());
-             }
-             printf("%s\n", pline);
-             if (fMapsChanged & (int)BalanceMapType::STAKE)
-             {
-                 printf("Stake changed\n Was: %s\n Now: %s\n",
-                        stake.ToString().c_str(),
-                        mapStake.ToString().c_str());
-             }
-             printf("%s\n", pline);
-             if (fMapsChanged & (int)BalanceMapType::COINBASE)
-             {
-                 printf("Coinbase changed\n Was: %s\n Now: %s\n",
-                        coinbase.ToString().c_str(),
-                        mapCoinbase.ToString().c_str());
-             }
-             printf("%s\n", pline);
-             if (fMapsChanged & (int)BalanceMapType::RECEIVED)
-             {
-                 printf("Received changed\n Was: %s\n Now: %s\n",
-                        received.ToString().c_str(),
-                        mapReceived.ToString().c_str());
-             }
-             printf("%s\n Balances reconciled.\n%s\n", pline, pline);
-        }
-        pindexLastBest = pindexBest;
+        pprogress->update(nDone, max(nTotal, nDone));
+        MilliSleep(1);
+    }
+    return false;
+}
+
+// Runs ReconcileBalances() in the background every -reconcileinterval
+// seconds, and sooner when CheckBalances() asks for it.
+void CWallet::Reconciler()
+{
+    // check for fShutdown every second (1000 ms)
+    constexpr int64_t CYCLE_STEP = 1000;
+    // requested passes run at most once a minute
+    constexpr int64_t REQUEST_INTERVAL = 60 * 1000;
+    const int64_t nInterval = GetArg("-reconcileinterval", 3600) * 1000;
+    string strProgressLabel("Progress of reconciling balances");
+    const CProgressHelper progressReconcile(&logProgress,
+                                            &strProgressLabel,
+                                            100);
+
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+
+    int64_t nLastPass = GetTimeMillis();
+    int64_t nNextPass = (nInterval > 0) ? (nLastPass + nInterval) : 0;
+    while (!fShutdown)
+    {
+        MilliSleep(CYCLE_STEP);
+        int64_t nNow = GetTimeMillis();
+        bool fRequested = fReconcileRequested &&
+                          (nNow - nLastPass >= REQUEST_INTERVAL);
+        if (!fRequested && ((nNextPass == 0) || (nNow < nNextPass)))
+        {
+            continue;
+        }
+        printf("Reconciler(): Calculating balances.\n");
+        NotifyReconcileStarted();
+        ReconcileBalances(&progressReconcile);
+        NotifyReconcileEnded();
+        nLastPass = GetTimeMillis();
+        nNextPass = (nInterval > 0) ? (nLastPass + nInterval) : 0;
     }
 }
 
@@ -1766,9 +2222,6 @@ void CWallet::GetSnapshot(int nMinDepth,
                           ColorsMap& mapSentRet,
                           const CProgressHelper* pprogress) const
 {
-    // concept of a balance does not apply to multisigs
-    static const bool fMultiSig = false;
-
     // has minimum confirmations
     mapConfirmedRet.Clear();
     mapStakeRet.Clear();
@@ -1785,64 +2238,82 @@ void CWallet::GetSnapshot(int nMinDepth,
         {
             pprogress->update(nDone, nTotal);
         }
+        AddToSnapshot((*it).second,
+                      nMinDepth,
+                      mapConfirmedRet,
+                      mapStakeRet,
+                      mapCoinbaseRet,
+                      mapReceivedRet,
+                      mapSentRet);
+        ++nDone;
+    }
+}
 
-        const CWalletTx& wtx = (*it).second;
+// Adds one wallet transaction's contribution to snapshot balances
+void CWallet::AddToSnapshot(const CWalletTx& wtx,
+                            int nMinDepth,
+                            ColorsMap& mapConfirmedRet,
+                            ColorsMap& mapStakeRet,
+                            ColorsMap& mapCoinbaseRet,
+                            ColorsMap& mapReceivedRet,
+                            ColorsMap& mapSentRet) const
+{
+    // concept of a balance does not apply to multisigs
+    static const bool fMultiSig = false;
 
-        int nDepth = wtx.GetDepthInMainChain();
+    int nDepth = wtx.GetDepthInMainChain();
 
-        // Skip transactions disconnected from the main chain (depth < 0).
-        // Orphaned coinstake/coinbase txs remain in mapWallet via DisableTransaction
-        // but must not contribute to any balance map.
-        if (nDepth < 0)
-        {
-            ++nDone;
-            continue;
-        }
+    // Skip transactions disconnected from the main chain (depth < 0).
+    // Orphaned coinstake/coinbase txs remain in mapWallet via DisableTransaction
+    // but must not contribute to any balance map.
+    if (nDepth < 0)
+    {
+        return;
+    }
 
-        bool fIsMinDepth = nDepth >= nMinDepth;
+    bool fIsMinDepth = nDepth >= nMinDepth;
 
-        bool fImmature = wtx.DoesMature() && (wtx.GetBlocksToMaturity() > 0);
+    bool fImmature = wtx.DoesMature() && (wtx.GetBlocksToMaturity() > 0);
 
-        // Don't add unconfimed transactions not in mempool to snapshot:
-        //    so test depth == 0 and not depth <= 0
-        bool fUnconfirmed = (nDepth == 0);
+    // Don't add unconfimed transactions not in mempool to snapshot:
+    //    so test depth == 0 and not depth <= 0
+    bool fUnconfirmed = (nDepth == 0);
 
-        ColorsMap mapRcvd;
-        ColorsMap mapSnt;
+    ColorsMap mapRcvd;
+    ColorsMap mapSnt;
 
-        wtx.GetAmounts(fMultiSig, mapRcvd, mapSnt);
+    wtx.GetAmounts(fMultiSig, mapRcvd, mapSnt);
 
-        if (fIsMinDepth)
-        {
-            mapConfirmedRet.Add(mapRcvd);
-        }
-        if (fImmature)
+    if (fIsMinDepth)
+    {
+        mapConfirmedRet.Add(mapRcvd);
+    }
+    if (fImmature)
+    {
+        if (wtx.IsCoinStake())
         {
-            if (wtx.IsCoinStake())
-            {
-                mapStakeRet.Add(mapRcvd);
-            }
-            else if (wtx.IsCoinBase())
-            {
-                mapCoinbaseRet.Add(mapRcvd);
-            }
-            else
-            {
-                throw runtime_error(
-                          "GetSnapshot(): TSNH - "
-                          "matures but not coinstake or coinbase");
-            }
+            mapStakeRet.Add(mapRcvd);
         }
-        if (fUnconfirmed)
+        else if (wtx.IsCoinBase())
         {
-            mapReceivedRet.Add(mapRcvd);
-            mapSentRet.Add(mapSnt);
+            mapCoinbaseRet.Add(mapRcvd);
         }
         else
         {
-            mapConfirmedRet.Subtract(mapSnt);
+            throw runtime_error(
+                      "GetSnapshot(): TSNH - "
+                      "matures but not coinstake or coinbase");
         }
     }
+    if (fUnconfirmed)
+    {
+        mapReceivedRet.Add(mapRcvd);
+        mapSentRet.Add(mapSnt);
+    }
+    else
+    {
+        mapConfirmedRet.Subtract(mapSnt);
+    }
 }
 
 // TODO: very nested, need to do some factoring
@@ -2060,53 +2531,61 @@ void CWallet::AvailableCoins(int nColor,
 {
     vCoins.clear();
 
+    if (nColor < 0 || nColor >= N_COLORS)
+    {
+        return;
+    }
+
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-             it != mapWallet.end();
+        // outputs of one tx are adjacent in the index, so the tx
+        // checks run once per tx as they did over mapWallet
+        const CWalletTx* pcoinLast = NULL;
+        int nDepth = -1;
+        for (map<COutPoint, const CWalletTx*>::const_iterator it =
+                                               vCoinIndex[nColor].begin();
+             it != vCoinIndex[nColor].end();
              ++it)
         {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (!pcoin->IsFinal())
-            {
-                continue;
-            }
-
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-            {
-                continue;
-            }
-
-            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
-            {
-                continue;
-            }
+            const CWalletTx* pcoin = (*it).second;
+            unsigned int i = (*it).first.n;
 
-            if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0)
+            if (pcoin != pcoinLast)
             {
-                continue;
+                pcoinLast = pcoin;
+                nDepth = -1;
+                if (!pcoin->IsFinal())
+                {
+                    continue;
+                }
+                if (fOnlyConfirmed && !pcoin->IsTrusted())
+                {
+                    continue;
+                }
+                if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+                {
+                    continue;
+                }
+                if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0)
+                {
+                    continue;
+                }
+                nDepth = pcoin->GetDepthInMainChain();
             }
 
-            int nDepth = pcoin->GetDepthInMainChain();
             if (nDepth < 0)
             {
                 continue;
             }
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
+            if (!(pcoin->IsSpent(i)) &&
+                // spendable only
+                (IsMine(pcoin->vout[i], fMultiSig) & ISMINE_SPENDABLE) &&
+                pcoin->vout[i].nValue >= vMinimumInputValue[nColor] &&
+                (!coinControl || !coinControl->HasSelected() ||
+                 coinControl->IsSelected((*it).first.hash, i)))
             {
-                if ((pcoin->vout[i].nColor == nColor) &&
-                    !(pcoin->IsSpent(i)) &&
-                    // spendable only
-                    (IsMine(pcoin->vout[i], fMultiSig) & ISMINE_SPENDABLE) &&
-                    pcoin->vout[i].nValue >=
-                        vMinimumInputValue[pcoin->vout[i].nColor] &&
-                    (!coinControl || !coinControl->HasSelected() ||
-                     coinControl->IsSelected((*it).first, i)))
-                {
-                    vCoins.push_back(COutput(pcoin, i, nDepth));
-                }
+                vCoins.push_back(COutput(pcoin, i, nDepth));
             }
         }
     }
@@ -2120,36 +2599,47 @@ void CWallet::AvailableCoinsMinConf(int nColor,
 {
     vCoins.clear();
 
+    if (nColor < 0 || nColor >= N_COLORS)
+    {
+        return;
+    }
+
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-             it != mapWallet.end();
+        const CWalletTx* pcoinLast = NULL;
+        int nDepth = -1;
+        bool fSkip = true;
+        for (map<COutPoint, const CWalletTx*>::const_iterator it =
+                                               vCoinIndex[nColor].begin();
+             it != vCoinIndex[nColor].end();
              ++it)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = (*it).second;
+            unsigned int i = (*it).first.n;
 
-            if (!pcoin->IsFinal())
+            if (pcoin != pcoinLast)
             {
-                continue;
+                pcoinLast = pcoin;
+                fSkip = true;
+                if (!pcoin->IsFinal())
+                {
+                    continue;
+                }
+                nDepth = pcoin->GetDepthInMainChain();
+                fSkip = (nDepth < nConf);
             }
 
-            if (pcoin->GetDepthInMainChain() < nConf)
+            if (fSkip)
             {
                 continue;
             }
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
+            if (!(pcoin->IsSpent(i)) &&
+                // spendable only
+                (IsMine(pcoin->vout[i], fMultiSig) & ISMINE_SPENDABLE) &&
+                pcoin->vout[i].nValue >= vMinimumInputValue[nColor])
             {
-                if ((pcoin->vout[i].nColor == nColor) &&
-                    !(pcoin->IsSpent(i)) &&
-                    // spendable only
-                    (IsMine(pcoin->vout[i], fMultiSig) & ISMINE_SPENDABLE) &&
-                    pcoin->vout[i].nValue >=
-                        vMinimumInputValue[pcoin->vout[i].nColor])
-                {
-                    vCoins.push_back(
-                        COutput(pcoin, i, pcoin->GetDepthInMainChain()));
-                }
+                vCoins.push_back(COutput(pcoin, i, nDepth));
             }
         }
     }
@@ -2162,43 +2652,52 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins,
 {
     LOCK2(cs_main, cs_wallet);
     vCoins.clear();
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end();
-         ++it)
+    for (int nColor = 0; nColor < N_COLORS; nColor++)
     {
-        const CWalletTx* pcoin = &(*it).second;
-        if (!pcoin->IsFinal())
-        {
-            continue;
-        }
-        if (!pcoin->IsTrusted())
-        {
-            continue;
-        }
-        if (pcoin->IsCoinBase() && (pcoin->GetBlocksToMaturity() > 0))
-        {
-            continue;
-        }
-        if (pcoin->IsCoinStake() && (pcoin->GetBlocksToMaturity() > 0))
+        if (!(setColors.empty() || setColors.count(nColor)))
         {
             continue;
         }
-        int nDepth = pcoin->GetDepthInMainChain();
-        if (nDepth < 0)
-        {
-            continue;
-        }
-        for (unsigned int i = 0; i < pcoin->vout.size(); i++)
+        const CWalletTx* pcoinLast = NULL;
+        int nDepth = -1;
+        for (map<COutPoint, const CWalletTx*>::const_iterator it =
+                                               vCoinIndex[nColor].begin();
+             it != vCoinIndex[nColor].end();
+             ++it)
         {
-            if (pcoin->IsSpent(i))
+            const CWalletTx* pcoin = (*it).second;
+            unsigned int i = (*it).first.n;
+            if (pcoin != pcoinLast)
+            {
+                pcoinLast = pcoin;
+                nDepth = -1;
+                if (!pcoin->IsFinal())
+                {
+                    continue;
+                }
+                if (!pcoin->IsTrusted())
+                {
+                    continue;
+                }
+                if (pcoin->IsCoinBase() && (pcoin->GetBlocksToMaturity() > 0))
+                {
+                    continue;
+                }
+                if (pcoin->IsCoinStake() && (pcoin->GetBlocksToMaturity() > 0))
+                {
+                    continue;
+                }
+                nDepth = pcoin->GetDepthInMainChain();
+            }
+            if (nDepth < 0)
             {
                 continue;
             }
-            const CTxOut& txout = pcoin->vout[i];
-            if (!(setColors.empty() || setColors.count(txout.nColor)))
+            if (pcoin->IsSpent(i))
             {
                 continue;
             }
+            const CTxOut& txout = pcoin->vout[i];
             if (txout.nValue < vMinimumInputValue[txout.nColor])
             {
                 continue;
@@ -2759,10 +3258,11 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, int64_t> >& vecSend,
                 }
 
                 // Sign
+                CSignatureHashContext sighash(wtxNew);
                 int nIn = 0;
                 BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setCoins)
                 {
-                    int code = SignSignature(*this, *coin.first, wtxNew, nIn++);
+                    int code = SignSignature(*this, *coin.first, wtxNew, nIn++, SIGHASH_ALL, &sighash);
                     if (code != 0)
                     {
                         return false;
@@ -2774,7 +3274,7 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, int64_t> >& vecSend,
                 {
                     BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setFeeCoins)
                     {
-                        int code = SignSignature(*this, *coin.first, wtxNew, nIn++);
+                        int code = SignSignature(*this, *coin.first, wtxNew, nIn++, SIGHASH_ALL, &sighash);
                         if (code != 0)
                         {
                             return false;
@@ -2939,6 +3439,7 @@ bool CWallet::AddStealthAddress(CStealthAddress& sxAddr)
 
     // must add before changing spend_secret
     stealthAddresses.insert(sxAddr);
+    fStealthScannerStale = true;
 
     bool fOwned = sxAddr.scan_secret.size() == ec_secret_size;
 
@@ -2981,6 +3482,8 @@ bool CWallet::AddStealthAddress(CStealthAddress& sxAddr)
 
 bool CWallet::UnlockStealthAddresses(const CKeyingMaterial& vMasterKeyIn)
 {
+    fStealthScannerStale = true;
+
     // -- decrypt spend_secret of stealth addresses
     set<CStealthAddress>::iterator it;
     for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
@@ -3440,11 +3943,8 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
     LOCK(cs_wallet);
     ec_secret sSpendR;
     ec_secret sSpend;
-    ec_secret sScan;
     ec_secret sShared;
 
-    ec_point pkExtracted;
-
     vector<uint8_t> vchEphemPK;
     vector<uint8_t> vchDataB;
     vector<uint8_t> vchENarr;
@@ -3494,6 +3994,11 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
 
         int32_t nOutputId = -1;
         nStealth++;
+        // what each owned address makes of vchEphemPK, worked out once
+        // the first output that could be the payment turns up
+        bool fScanned = false;
+        vector<CStealthScanResult> vScan;
+        vector<CKeyID> vScanIDs;
         BOOST_FOREACH(const CTxOut& txoutB, tx.vout)
         {
             nOutputId++;
@@ -3529,40 +4034,43 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
 
             CKeyID ckidMatch = boost::get<CKeyID>(address);
 
-            // The vchEphemPK needs to be extracted to scan for encrypted narrations
-            // even if the key has already been added.
-            set<CStealthAddress>::iterator it;
-            for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
+            if (!fScanned)
             {
-                if (it->scan_secret.size() != ec_secret_size)
+                ScanStealthEphemeral(vchEphemPK, vScan);
+                vScanIDs.resize(vScan.size());
+                for (unsigned int j = 0; j < vScan.size(); ++j)
                 {
-                    continue; // Stealth Address is not owned
+                    CPubKey cpkE(vScan[j].pkExtracted);
+                    vScan[j].fValid = vScan[j].fValid && cpkE.IsValid();
+                    if (vScan[j].fValid)
+                    {
+                        vScanIDs[j] = cpkE.GetID();
+                    }
                 }
+                fScanned = true;
+            }
 
-                //printf("it->Encodeded() %s\n",  it->Encoded().c_str());
-                memcpy(&sScan.e[0], &it->scan_secret[0], ec_secret_size);
-
-                if (StealthSecret(sScan, vchEphemPK, it->spend_pubkey, sShared, pkExtracted) != 0)
-                {
-                    printf("CWallet::FindStealthTransactions: StealthSecret failed.\n");
-                    continue;
-                };
-                //printf("pkExtracted %" PRIszu ": %s\n", pkExtracted.size(), HexStr(pkExtracted).c_str());
-
-                CPubKey cpkE(pkExtracted);
-
-                if (!cpkE.IsValid())
+            // The vchEphemPK needs to be extracted to scan for encrypted narrations
+            // even if the key has already been added.
+            const CStealthScanner& scanner = GetStealthScanner();
+            for (unsigned int j = 0; j < vScan.size(); ++j)
+            {
+                if (!vScan[j].fValid || (ckidMatch != vScanIDs[j]))
                 {
                     continue;
                 }
 
-                CKeyID ckidE = cpkE.GetID();
-
-                if (ckidMatch != ckidE)
+                CStealthAddress sxFind;
+                sxFind.scan_pubkey = scanner.GetScanPubKey(j);
+                set<CStealthAddress>::iterator it = stealthAddresses.find(sxFind);
+                if (it == stealthAddresses.end())
                 {
                     continue;
                 }
 
+                sShared = vScan[j].sShared;
+                CPubKey cpkE(vScan[j].pkExtracted);
+
                 if (fDebug)
                 {
                     printf("Found stealth txn to address %s\n", it->Encoded().c_str());
@@ -3702,6 +4210,91 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
     return true;
 }
 
+// The scanner is only remade when the stealth address set changed size or
+// was marked stale by adding or unlocking addresses; labels do not matter.
+const CStealthScanner& CWallet::GetStealthScanner()
+{
+    AssertLockHeld(cs_wallet);
+    if (fStealthScannerStale ||
+        (nStealthScannerAddresses != stealthAddresses.size()))
+    {
+        stealthScanner.Clear();
+        BOOST_FOREACH(const CStealthAddress& sxAddr, stealthAddresses)
+        {
+            stealthScanner.Add(sxAddr);
+        }
+        nStealthScannerAddresses = stealthAddresses.size();
+        fStealthScannerStale = false;
+        // made by the old scanner
+        mapStealthScan.clear();
+    }
+    return stealthScanner;
+}
+
+void CWallet::ScanStealthEphemeral(const ec_point& vchEphemPK,
+                                   vector<CStealthScanResult>& vResultRet)
+{
+    const CStealthScanner& scanner = GetStealthScanner();
+    map<ec_point, vector<CStealthScanResult> >::const_iterator mi =
+                                            mapStealthScan.find(vchEphemPK);
+    if (mi != mapStealthScan.end())
+    {
+        vResultRet = mi->second;
+        return;
+    }
+    if (!scanner.Scan(vector<ec_point>(1, vchEphemPK), vResultRet))
+    {
+        printf("CWallet::ScanStealthEphemeral: Scan failed.\n");
+    }
+}
+
+void CWallet::ScanStealthBlock(const CBlock& block)
+{
+    LOCK(cs_wallet);
+    mapStealthScan.clear();
+    const CStealthScanner& scanner = GetStealthScanner();
+    if (scanner.empty())
+    {
+        return;
+    }
+
+    vector<ec_point> vEphemPK;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        {
+            ec_point vchEphemPK;
+            if (GetStealthEphemPK(txout, vchEphemPK))
+            {
+                vEphemPK.push_back(vchEphemPK);
+            }
+        }
+    }
+    if (vEphemPK.empty())
+    {
+        return;
+    }
+
+    vector<CStealthScanResult> vResult;
+    if (!scanner.Scan(vEphemPK, vResult))
+    {
+        printf("CWallet::ScanStealthBlock: Scan failed.\n");
+        return;
+    }
+    const unsigned int nAddresses = scanner.size();
+    for (unsigned int i = 0; i < vEphemPK.size(); i++)
+    {
+        vector<CStealthScanResult>::const_iterator itBegin = vResult.begin() + i * nAddresses;
+        mapStealthScan[vEphemPK[i]].assign(itBegin, itBegin + nAddresses);
+    }
+}
+
+void CWallet::ClearStealthScan()
+{
+    LOCK(cs_wallet);
+    mapStealthScan.clear();
+}
+
 // NovaCoin: get current stake weight for currency of nColor
 bool CWallet::GetStakeWeightByColor(int nColor, const CKeyStore& keystore, uint64_t& nWeight)
 {
@@ -3775,13 +4368,131 @@ bool CWallet::GetStakeWeight(const CKeyStore& keystore, uint64_t& nWeight)
 
 // coin stake is CBlock::vtx[1] and has vout[0] empty
 // mint for staking block is put into vtx[0] that has vout[0] (and vout[1]?) empty
-bool CWallet::CreateCoinStake(int nStakeColor, const CKeyStore& keystore,
-                                unsigned int nBits, int64_t nSearchInterval,
-                                  int64_t nFees[], CTransaction& txMint, CTransaction& txStake, CKey& key)
+bool CWallet::GetStakeKernelCandidate(const CWalletTx* pcoin, unsigned int nOut,
+                                      CStakeKernelCandidate& candidate)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    COutPoint prevout(pcoin->GetHash(), nOut);
+    std::map<COutPoint, std::pair<uint256, CStakeKernelCandidate> >::iterator mi =
+                                              mapStakeKernelCandidates.find(prevout);
+    if (mi != mapStakeKernelCandidates.end())
+    {
+        map<uint256, CBlockIndex*>::iterator miBlock = mapBlockIndex.find(mi->second.first);
+        if (mi->second.first == pcoin->hashBlock &&
+            miBlock != mapBlockIndex.end() && miBlock->second->IsInMainChain())
+        {
+            candidate = mi->second.second;
+            return true;
+        }
+        mapStakeKernelCandidates.erase(mi);
+    }
+
+    if (!ReadStakeKernelCandidate(prevout, candidate))
+        return false;
+    mapStakeKernelCandidates[prevout] = make_pair(pcoin->hashBlock, candidate);
+    return true;
+}
+
+bool CWallet::SelectStakeCoins(int nStakeColor, unsigned int nSpendTime,
+                               set<pair<const CWalletTx*,unsigned int> >& setCoins)
 {
     // would not make sense to stake partail-ownership multisig
     static const bool fMultiSig = false;
 
+    int64_t nBalance = GetSpendable(nStakeColor);
+    int64_t nResBal = vReserveBalance[nStakeColor];
+
+    if (nBalance <= nResBal)
+    {
+        return false;
+    }
+
+    // unused, placeholder
+    int64_t nValueIn = 0;
+
+    int nStakeMinConfs = GetStakeMinConfirmations(nStakeColor);
+
+    // Select coins with suitable depth and correct color
+    if (!SelectCoinsSimple(nBalance - nResBal, nStakeColor, nSpendTime,
+                              nStakeMinConfs, setCoins, nValueIn, fMultiSig)) {
+        return false;
+    }
+
+    if (setCoins.empty()) {
+        return false;
+    }
+
+    // forget the candidates of coins of this color no longer selected
+    {
+        set<COutPoint> setStakeOutpoints;
+        BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
+            setStakeOutpoints.insert(COutPoint(pcoin.first->GetHash(), pcoin.second));
+
+        LOCK(cs_wallet);
+        std::map<COutPoint, std::pair<uint256, CStakeKernelCandidate> >::iterator mi = mapStakeKernelCandidates.begin();
+        while (mi != mapStakeKernelCandidates.end())
+        {
+            if (mi->second.second.nColor == nStakeColor && !setStakeOutpoints.count(mi->first))
+                mapStakeKernelCandidates.erase(mi++);
+            else
+                ++mi;
+        }
+    }
+
+    return true;
+}
+
+bool CWallet::FindStakeKernel(const vector<int>& vColors, CBlockIndex* pindexPrev,
+                              unsigned int nBits, int64_t nTime, int64_t nSearchInterval,
+                              CStakeKernelResult& kernel)
+{
+    // the workers stop once the generation moves on from this one
+    kernel.nTipGeneration = nBestChainGeneration;
+    if (pindexPrev != pindexBest)
+        return false;
+
+    vector<CStakeKernelCoin> vCoins;
+    BOOST_FOREACH(int nStakeColor, vColors)
+    {
+        set<pair<const CWalletTx*,unsigned int> > setCoins;
+        if (!SelectStakeCoins(nStakeColor, nTime, setCoins))
+            continue;
+
+        BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
+        {
+            CStakeKernelCandidate candidate;
+            if (!GetStakeKernelCandidate(pcoin.first, pcoin.second, candidate))
+                continue;
+            vCoins.push_back(CStakeKernelCoin(nStakeColor, COutPoint(pcoin.first->GetHash(), pcoin.second),
+                                              candidate));
+        }
+    }
+
+    // no color or output gets to go first every time
+    for (int i = (int)vCoins.size() - 1; i > 0; i--)
+        swap(vCoins[i], vCoins[GetRandInt(i + 1)]);
+
+    // enough outputs to a check that the hashing outweighs the queueing
+    unsigned int nCoinsPerCheck = max((int64_t)1, STAKE_KERNEL_CHECK_HASHES / max(nSearchInterval, (int64_t)1));
+    vector<CStakeKernelCheck> vChecks;
+    for (unsigned int i = 0; i < vCoins.size(); i++)
+    {
+        if (i % nCoinsPerCheck == 0)
+            vChecks.push_back(CStakeKernelCheck(pindexPrev, nBits, nTime, nSearchInterval, &kernel));
+        vChecks.back().AddCoin(vCoins[i]);
+    }
+
+    if (!SearchStakeKernels(vChecks))
+        return false;
+    return kernel.fFound;
+}
+
+bool CWallet::CreateCoinStake(int nStakeColor, const CKeyStore& keystore,
+                                unsigned int nBits, int64_t nSearchInterval,
+                                  int64_t nFees[], CTransaction& txMint, CTransaction& txStake, CKey& key,
+                                  const COutPoint* pprevoutKernel)
+{
     if (!CanStake(nStakeColor))
     {
            return false;
@@ -3824,41 +4535,21 @@ bool CWallet::CreateCoinStake(int nStakeColor, const CKeyStore& keystore,
     vector<const CWalletTx*> vwtxPrev;
 
     set<pair<const CWalletTx*,unsigned int> > setCoins;
-
-    // unused, placeholder
-    int64_t nValueIn = 0;
-
-    int nStakeMinConfs = GetStakeMinConfirmations(nStakeColor);
-
-    // Select coins with suitable depth and correct color
-    if (!SelectCoinsSimple(nBalance - nResBal, nStakeColor, txStake.nTime,
-                              nStakeMinConfs, setCoins, nValueIn, fMultiSig)) {
-        return false;
-    }
-
-    if (setCoins.empty()) {
+    if (!SelectStakeCoins(nStakeColor, txStake.nTime, setCoins))
+    {
         return false;
     }
 
     int64_t nStakeCredit = 0;
     CScript scriptPubKeyKernel;
-    CTxDB txdb("r");
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
-        CTxIndex txindex;
-        {
-            LOCK2(cs_main, cs_wallet);
-            if (!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex))
-                continue;
-        }
+        if (pprevoutKernel && *pprevoutKernel != COutPoint(pcoin.first->GetHash(), pcoin.second))
+            continue;
 
-        // Read block header
-        CBlock block;
-        {
-            LOCK2(cs_main, cs_wallet);
-            if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
-                continue;
-        }
+        CStakeKernelCandidate candidate;
+        if (!GetStakeKernelCandidate(pcoin.first, pcoin.second, candidate))
+            continue;
 
 
         static int nMaxStakeSearchInterval = 60;
@@ -3874,9 +4565,8 @@ bool CWallet::CreateCoinStake(int nStakeColor, const CKeyStore& keystore,
             // Search backward in time from the given txStake timestamp
             // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
             COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
             if (CheckKernel(nStakeColor, pindexPrev, nBits,
-                            txStake.nTime - n, prevoutStake, &nBlockTime))
+                            txStake.nTime - n, prevoutStake, candidate))
             {
                 // Found a kernel
                 if (fDebug && GetBoolArg("-printcoinstake"))
@@ -4071,10 +4761,11 @@ bool CWallet::CreateCoinStake(int nStakeColor, const CKeyStore& keystore,
     }
 
     // Sign
+    CSignatureHashContext sighash(txStake);
     int nIn = 0;
     BOOST_FOREACH(const CWalletTx* pcoin, vwtxPrev)
     {
-        if (SignSignature(*this, *pcoin, txStake, nIn++) != 0)
+        if (SignSignature(*this, *pcoin, txStake, nIn++, SIGHASH_ALL, &sighash) != 0)
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
@@ -4134,6 +4825,7 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew,
                 coin.BindWallet(this);
                 coin.MarkSpent(txin.prevout.n);
                 coin.WriteToDisk();
+                IndexCoins(coin);
                 NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
             }
 
@@ -4193,6 +4885,8 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew,
                 mapConfirmed.Subtract(mapSnt);
             }
         }
+        ++nBalanceUpdates;
+        CheckBalances();
         wtxNew.RelayWalletTransaction();
     }
     return true;
@@ -4466,6 +5160,7 @@ void CWallet::Consolidate(const map<CTxDestination, string>& mapSources,
                 ///////////////////////////////////////////////////////////////
                 // sign the payment inputs
                 ///////////////////////////////////////////////////////////////
+                CSignatureHashContext sighash(wtxNew);
                 int nIn = 0;
                 for (COutput output : vSelected)
                 {
@@ -4473,7 +5168,9 @@ void CWallet::Consolidate(const map<CTxDestination, string>& mapSources,
                                       *this,
                                       output.tx->vout[output.i].scriptPubKey,
                                       wtxNew,
-                                      nIn);
+                                      nIn,
+                                      SIGHASH_ALL,
+                                      &sighash);
                     if (code != 0)
                     {
                         printf("Consolidate(): "
@@ -4496,7 +5193,9 @@ void CWallet::Consolidate(const map<CTxDestination, string>& mapSources,
                                         *this,
                                         output.tx->vout[output.i].scriptPubKey,
                                         wtxNew,
-                                        nIn);
+                                        nIn,
+                                        SIGHASH_ALL,
+                                        &sighash);
                         if (code != 0)
                         {
                             printf("Consolidate(): could not "
@@ -4736,6 +5435,8 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    RebuildCoinIndex();
+
     NewThread(ThreadFlushWalletDB, &strWalletFile);
     return DB_LOAD_OK;
 }
@@ -5197,6 +5898,7 @@ void CWallet::FixSpentCoins(vector<int>& vMismatchFound,
                 {
                     pcoin->MarkUnspent(n);
                     pcoin->WriteToDisk();
+                    IndexCoins(*pcoin);
                 }
             }
             else if ((IsMine(pcoin->vout[n], fMultiSig) & ISMINE_ALL) &&
@@ -5214,6 +5916,7 @@ void CWallet::FixSpentCoins(vector<int>& vMismatchFound,
                 {
                     pcoin->MarkSpent(n);
                     pcoin->WriteToDisk();
+                    IndexCoins(*pcoin);
                 }
             }
         }
@@ -5245,6 +5948,7 @@ void CWallet::DisableTransaction(const CTransaction &tx)
             {
                 prev.MarkUnspent(txin.prevout.n);
                 prev.WriteToDisk();
+                IndexCoins(prev);
             }
         }
     }
@@ -22,6 +22,7 @@
 #include "stealth.h"
 #include "smessage.h"
 #include "crypter.h"
+#include "kernel.h"
 
 
 extern bool fWalletUnlockStakingOnly;
@@ -194,6 +195,41 @@ private:
 
     CWalletDB *pwalletdbEncryption;
 
+    // Stake kernel candidates by outpoint, with the block the wallet had
+    // the output's transaction in when the candidate was read (cs_wallet).
+    // An entry is reread once that block leaves the main chain or the
+    // wallet moves the transaction, and dropped once its coin stops being
+    // selected for staking.
+    std::map<COutPoint, std::pair<uint256, CStakeKernelCandidate> > mapStakeKernelCandidates;
+    bool GetStakeKernelCandidate(const CWalletTx* pcoin, unsigned int nOut,
+                                 CStakeKernelCandidate& candidate);
+    // Owned, unspent outputs of mapWallet by color (cs_wallet), so coin
+    // selection and staking need not walk every wallet transaction. Kept
+    // current wherever a transaction is added or erased or has outputs
+    // marked spent or unspent. Readers still apply their own depth,
+    // maturity and ownership tests to what they find here.
+    std::vector<std::map<COutPoint, const CWalletTx*> > vCoinIndex;
+    void IndexCoins(const CWalletTx& wtx);
+    void UnindexCoins(const CWalletTx& wtx);
+    void RebuildCoinIndex();
+
+    // Scan material of the owned stealth addresses (cs_wallet). It is made
+    // again by GetStealthScanner() when the stealth addresses were added to,
+    // removed or unlocked. mapStealthScan holds what the current scanner
+    // made of the ephemeral keys of the block being synced, so
+    // FindStealthTransactions() need not redo them one by one.
+    CStealthScanner stealthScanner;
+    unsigned int nStealthScannerAddresses;
+    bool fStealthScannerStale;
+    std::map<ec_point, std::vector<CStealthScanResult> > mapStealthScan;
+    const CStealthScanner& GetStealthScanner();
+    void ScanStealthEphemeral(const ec_point& vchEphemPK,
+                              std::vector<CStealthScanResult>& vResultRet);
+
+    // coins of nStakeColor to search for a kernel, past the reserve balance
+    bool SelectStakeCoins(int nStakeColor, unsigned int nSpendTime,
+                          std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins);
+
     // the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
 
@@ -245,6 +281,11 @@ public:
     ColorsMap mapReceived;
     // unconfirmed sent coins
     ColorsMap mapSent;
+    // bumped with every change to the maps above (cs_wallet), so a
+    // reconcile that released the lock can tell that it raced a change
+    unsigned int nBalanceUpdates;
+    // set when CheckBalances() finds the maps inconsistent
+    bool fReconcileRequested;
     //////////////////////////////////////////////////////////////////////////
     
 
@@ -263,7 +304,12 @@ public:
         mapCoinbase.Clear();
         mapReceived.Clear();
         mapSent.Clear();
+        nBalanceUpdates = 0;
+        fReconcileRequested = false;
         mapStakeTo.clear();
+        vCoinIndex.resize(N_COLORS);
+        nStealthScannerAddresses = 0;
+        fStealthScannerStale = true;
     }
     CWallet(std::string strWalletFileIn)
     {
@@ -279,7 +325,12 @@ public:
         mapCoinbase.Clear();
         mapReceived.Clear();
         mapSent.Clear();
+        nBalanceUpdates = 0;
+        fReconcileRequested = false;
         mapStakeTo.clear();
+        vCoinIndex.resize(N_COLORS);
+        nStealthScannerAddresses = 0;
+        fStealthScannerStale = true;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -377,7 +428,14 @@ public:
     int ClearWalletTransactions(std::string& strError,
                                 const CProgressHelper* pprogress = &progressQuiet);
     void FillSnapshot(const CProgressHelper* pprogress = &progressQuiet);
+    bool ReconcileBalances(const CProgressHelper* pprogress = &progressQuiet);
     void Reconciler();
+    void AddBalanceChanges(const ColorsMap& mapConfirmedChanges,
+                           const ColorsMap& mapStakeChanges,
+                           const ColorsMap& mapCoinbaseChanges,
+                           const ColorsMap& mapReceivedChanges,
+                           const ColorsMap& mapSentChanges);
+    bool CheckBalances();
 
     // gets confirmed for coin of nColor
     int64_t GetConfirmed(int nColor) const;
@@ -404,6 +462,13 @@ public:
                      ColorsMap& mapReceived,
                      ColorsMap& mapSent,
                      const CProgressHelper* progress = &progressQuiet) const;
+    void AddToSnapshot(const CWalletTx& wtx,
+                       int nMinDepth,
+                       ColorsMap& mapConfirmedRet,
+                       ColorsMap& mapStakeRet,
+                       ColorsMap& mapCoinbaseRet,
+                       ColorsMap& mapReceivedRet,
+                       ColorsMap& mapSentRet) const;
     void GetPrivateKeys(std::set<int> setColors, bool fMultiSig,
                         mapSecretByAddressByColor_t &mapAddrs) const;
     void GetHand(int nMinDepth,
@@ -444,6 +509,15 @@ public:
     // get the weighted sum of stake weights for all staking currencies
     bool GetStakeWeight(const CKeyStore& keystore, uint64_t& nWeight);
 
+    // search the coins of all of vColors at once for a kernel
+    bool FindStakeKernel(const std::vector<int>& vColors,
+                         CBlockIndex* pindexPrev,
+                         unsigned int nBits,
+                         int64_t nTime,
+                         int64_t nSearchInterval,
+                         CStakeKernelResult& kernel);
+
+    // pprevoutKernel: only try this output as the kernel
     bool CreateCoinStake(int nColor,
                          const CKeyStore& keystore,
                          unsigned int nBits,
@@ -451,7 +525,8 @@ public:
                          int64_t nFees[],
                          CTransaction& txMint,
                          CTransaction& txStake,
-                         CKey& key);
+                         CKey& key,
+                         const COutPoint* pprevoutKernel = NULL);
 
     // potentially long lasting loop: use in a thread (i.e. ThreadConsolidate)
     void Consolidate(const std::map<CTxDestination, std::string>& mapSources,
@@ -487,6 +562,10 @@ public:
                                        std::string& sNarr, CWalletTx& wtxNew,
                                        std::string& sError, bool fAskFee=false);
     bool FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNarr);
+    // scans the ephemeral keys of a whole block at once, ahead of syncing
+    // its transactions, until ClearStealthScan()
+    void ScanStealthBlock(const CBlock& block);
+    void ClearStealthScan();
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int nSize = 0);